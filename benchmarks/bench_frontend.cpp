@@ -0,0 +1,123 @@
+// Front end throughput (lex + parse + sema) over the test corpus,
+// the stages are dominated by small map lookups (keywords, operators, string interning)
+#include "lexer/buffer.h"
+#include "libtest.h"
+#include "parser/parser.h"
+#include "revision_data.h"
+#include "sema/importlib.h"
+#include "sema/sema.h"
+#include "utilities/stopwatch.h"
+
+#include <filesystem>
+#include <iostream>
+
+using namespace lython;
+
+using Time = StopWatch<double, std::chrono::microseconds>;
+
+template <typename Fun>
+void bench(String const& name, Fun fun, int repeat = 20) {
+    fun();
+
+    Time time;
+    for (int i = 0; i < repeat; i++) {
+        fun();
+    }
+    double total = time.stop();
+    std::cout << fmt::format("{:>30} | {:10.3f} | {:10.3f} \n", name, total / repeat, total);
+}
+
+Array<String> load_corpus() {
+    Array<String> sources;
+    String        folder = String(_SOURCE_DIRECTORY) + "/tests/cases/cases";
+
+    for (auto const& entry: std::filesystem::directory_iterator(folder.c_str())) {
+        String name = String(entry.path().stem().string().c_str());
+
+        for (auto const& testcase: get_test_cases("cases", name)) {
+            sources.push_back(testcase.code);
+        }
+    }
+    return sources;
+}
+
+int lex(String const& source) {
+    StringBuffer reader(source);
+    Lexer        lexer(reader);
+    int          count = 0;
+
+    while (lexer.next_token().type() != tok_eof) {
+        count += 1;
+    }
+    return count;
+}
+
+Module* parse(String const& source) {
+    StringBuffer reader(source);
+    Lexer        lex(reader);
+    Parser       parser(lex);
+    return parser.parse_module();
+}
+
+void analyse(String const& source) {
+    Module*          mod = parse(source);
+    SemanticAnalyser sema;
+    sema.exec(mod, 0);
+    delete mod;
+}
+
+// Lookups of interned names, the most common key type of the front end
+template <typename Map>
+void name_lookups(Array<StringRef> const& names) {
+    Map map;
+    for (int i = 0; i < int(names.size()); i++) {
+        map[names[i]] = i;
+    }
+
+    int volatile found = 0;
+    for (int r = 0; r < 100; r++) {
+        for (auto const& name: names) {
+            found = found + int(map.count(name));
+        }
+    }
+}
+
+int main() {
+    Array<String> corpus = load_corpus();
+    ImportLib::instance()->add_to_path(String(_SOURCE_DIRECTORY) + "/code");
+
+    // Only measure the front end, not its debug output
+    outlog().disable(LogLevel::Debug);
+    outlog().disable(LogLevel::Trace);
+    outlog().disable(LogLevel::Info);
+
+    std::cout << fmt::format("{} sources\n", corpus.size());
+    std::cout << fmt::format("{:>30} | {:>10} | {:>10} \n", "bench", "mean (us)", "total (us)");
+
+    bench("lex", [&]() {
+        for (auto const& source: corpus) {
+            lex(source);
+        }
+    });
+
+    bench("lex+parse", [&]() {
+        for (auto const& source: corpus) {
+            delete parse(source);
+        }
+    });
+
+    bench("lex+parse+sema", [&]() {
+        for (auto const& source: corpus) {
+            analyse(source);
+        }
+    });
+
+    Array<StringRef> names;
+    for (int i = 0; i < 4096; i++) {
+        names.push_back(StringRef(fmt::format("name_{}", i).c_str()));
+    }
+
+    bench("Dict[StringRef, int]", [&]() { name_lookups<Dict<StringRef, int>>(names); });
+    bench("StableDict[StringRef, int]", [&]() { name_lookups<StableDict<StringRef, int>>(names); });
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Allocation throughput of the garbage collector against the system allocator
+#include "dtypes.h"
+#include "logging/logging.h"
+#include "stdlib/garbage.h"
+#include "utilities/stopwatch.h"
+
+#include <iostream>
+
+using namespace lython;
+
+// Small object, the size of a list cell
+struct Node {
+    int   value;
+    Node* next;
+};
+
+constexpr int count = 1000000;
+
+using Time = StopWatch<double, std::chrono::microseconds>;
+
+// `fun` returns the time spent allocating, freeing is not measured.
+// The first run is a warmup so the memory is not touched for the first time
+template <typename Fun>
+void bench(String const& name, Fun fun, int repeat = 10) {
+    fun();
+
+    double total = 0;
+    for (int i = 0; i < repeat; i++) {
+        total += fun();
+    }
+    std::cout << fmt::format("{:>30} | {:10.3f} | {:10.3f} | {:10.3f}\n",
+                             name,
+                             total / repeat,
+                             total,
+                             (total / repeat) * 1000.0 / count);
+}
+
+double gc_alloc(BoehmGarbageCollector& gc) {
+    Time  time;
+    Node* prev = nullptr;
+    for (int i = 0; i < count; i++) {
+        Node* node  = gc.malloc<Node>();
+        node->value = i;
+        node->next  = prev;
+        prev        = node;
+    }
+    double elapsed = time.stop();
+
+    for (GCObjectHeader* hdr: gc.allocations(GCGen::Temporary)) {
+        gc.free(hdr->data());
+    }
+    return elapsed;
+}
+
+// What the collector used to do for every allocation
+double malloc_tracked() {
+    Array<void*> allocations;
+
+    Time  time;
+    Node* prev = nullptr;
+    for (int i = 0; i < count; i++) {
+        Node* node  = (Node*)std::malloc(sizeof(Node) + sizeof(GCObjectHeader));
+        node->value = i;
+        node->next  = prev;
+        prev        = node;
+        allocations.push_back(node);
+    }
+    double elapsed = time.stop();
+
+    for (void* ptr: allocations) {
+        std::free(ptr);
+    }
+    return elapsed;
+}
+
+double malloc_only() {
+    Time  time;
+    Node* prev = nullptr;
+    for (int i = 0; i < count; i++) {
+        Node* node  = (Node*)std::malloc(sizeof(Node));
+        node->value = i;
+        node->next  = prev;
+        prev        = node;
+    }
+    double elapsed = time.stop();
+
+    while (prev != nullptr) {
+        Node* next = prev->next;
+        std::free(prev);
+        prev = next;
+    }
+    return elapsed;
+}
+
+int main() {
+    // Only measure the allocators, not their debug output
+    outlog().disable(LogLevel::Debug);
+    outlog().disable(LogLevel::Trace);
+
+    BoehmGarbageCollector buffered;
+    buffered.auto_collect = false;
+
+    BoehmGarbageCollector shared;
+    shared.auto_collect         = false;
+    shared.thread_local_buffers = false;
+
+    std::cout << fmt::format(
+        "{:>30} | {:>10} | {:>10} | {:>10}\n", "bench", "mean (us)", "total (us)", "alloc (ns)");
+    bench("gc thread local buffers", [&]() { return gc_alloc(buffered); });
+    bench("gc shared pages", [&]() { return gc_alloc(shared); });
+    bench("malloc + allocation array", malloc_tracked);
+    bench("malloc", malloc_only);
+    return 0;
+}
@@ -1,5 +1,7 @@
 
 #include "bench.h"
+#include "stdlib/hashtable.h"
+#include "utilities/names.h"
 
 #include <iostream>
 #include <random>
@@ -32,6 +34,8 @@ std::size_t new_hash(String const& k) noexcept {
 std::size_t xx_hash_32(String const& k) noexcept { return XXH32(k.data(), k.length(), 0); }
 std::size_t xx_hash_64(String const& k) noexcept { return XXH64(k.data(), k.length(), 0); }
 std::size_t xx_hash_3(String const& k) noexcept { return XXH3_64bits(k.data(), k.length()); }
+std::size_t sip_hash(String const& k) noexcept { return SipHash<String>::hash(k); }
+std::size_t wy_hash(String const& k) noexcept { return wy::hash(k.data(), k.length()); }
 
 // check https://github.com/google/benchmark
 
@@ -53,6 +57,9 @@ lython::String make_string(size_t size = 64) {
 int main() {
     lython::String string = "owjfopwejfpwejfopwejfpwoejfpwef";
 
+    // interned strings mix their id, the characters are not read
+    static StringRef interned(string);
+
     // but we need to check for collision too
 
     make_string(64);
@@ -78,6 +85,24 @@ int main() {
         lython::Benchmark<int>("XX HASH 3", [](int size) {
             //
             lython::fakeuse(xx_hash_3(make_string(size)));
+        }),
+        lython::Benchmark<int>("WY HASH", [](int size) {
+            //
+            lython::fakeuse(wy_hash(make_string(size)));
+        }),
+        lython::Benchmark<int>("SIP HASH", [](int size) {
+            //
+            lython::fakeuse(sip_hash(make_string(size)));
+        }),
+        lython::Benchmark<int>("INTERNED (precomputed)", [](int size) {
+            // same string generation cost as the others
+            lython::fakeuse(make_string(size));
+            lython::fakeuse(Hash<StringRef>::hash(interned));
+        }),
+        lython::Benchmark<int>("INT MIXER", [](int size) {
+            //
+            lython::fakeuse(make_string(size));
+            lython::fakeuse(Hash<int64>::hash(int64(size)));
         })
     }, 100, 10000);
     // clang-format on
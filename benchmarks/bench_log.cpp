@@ -0,0 +1,69 @@
+// Cost of the log points left in the interpreter hot paths
+#include "dtypes.h"
+#include "logging/logging.h"
+#include "utilities/stopwatch.h"
+
+#include <iostream>
+
+using namespace lython;
+
+static int formatted = 0;
+
+// Stands for `str(value)` in the evaluator log points
+std::string expensive(int64_t value) {
+    formatted += 1;
+    return fmt::format("{}", value);
+}
+
+template <typename Fun>
+double bench(String const& name, Fun fun, int repeat = 10) {
+    StopWatch<double, std::chrono::microseconds> time;
+    for (int i = 0; i < repeat; i++) {
+        fun();
+    }
+    double total = time.stop();
+    std::cout << fmt::format("{:>30} | {:10.3f} | {:10.3f} \n", name, total / repeat, total);
+    return total / repeat;
+}
+
+int main() {
+    int const         n    = 10000000;
+    volatile int64_t  sink = 0;
+    Logger&           log  = outlog();
+
+    log.disable(LogLevel::Debug);
+    log.disable(LogLevel::Trace);
+
+    std::cout << fmt::format("WITH_LOG: {} WITH_LOG_DEBUG: {}\n", WITH_LOG, WITH_LOG_DEBUG);
+    std::cout << fmt::format("{:>30} | {:>10} | {:>10} \n", "bench", "mean (us)", "total (us)");
+
+    double base = bench("no log point", [&]() {
+        int64_t acc = 0;
+        for (int i = 0; i < n; i++) {
+            acc = acc * 31 + i;
+        }
+        sink = acc;
+    });
+
+    double disabled = bench("kwdebug (disabled)", [&]() {
+        int64_t acc = 0;
+        for (int i = 0; i < n; i++) {
+            acc = acc * 31 + i;
+            kwdebug(log, "{} {}", i, expensive(acc));
+        }
+        sink = acc;
+    });
+
+    double traced = bench("kwtrace (disabled)", [&]() {
+        int64_t acc = 0;
+        for (int i = 0; i < n; i++) {
+            acc = acc * 31 + i;
+            kwtrace(log, 1, "{}", expensive(acc));
+        }
+        sink = acc;
+    });
+
+    std::cout << fmt::format("overhead: debug {:.2f}x trace {:.2f}x\n", disabled / base, traced / base);
+    std::cout << fmt::format("arguments evaluated: {}\n", formatted);
+    return formatted != 0;
+}
@@ -0,0 +1,89 @@
+// Search kernels of ArrayNative (__contains__, count) for every instruction set
+// against the boxed array, the key is missing so the whole array is scanned
+#include "ast/values/value.h"
+#include "dtypes.h"
+#include "logging/logging.h"
+#include "stdlib/array.h"
+#include "utilities/names.h"
+#include "utilities/stopwatch.h"
+
+#include <iostream>
+
+using namespace lython;
+using namespace kiwi;
+
+using Time = StopWatch<double, std::chrono::nanoseconds>;
+
+// Scan about the same number of elements for every length
+constexpr std::size_t work = std::size_t(1) << 25;
+
+template <typename Fun>
+double bench(std::size_t n, Fun fun) {
+    int repeat = int(std::max(work / n, std::size_t(3)));
+
+    int volatile found = fun();
+
+    Time time;
+    for (int i = 0; i < repeat; i++) {
+        found = found + fun();
+    }
+    return time.stop() / repeat;
+}
+
+void row(String const& name, std::size_t n, double contains, double count) {
+    std::cout << fmt::format("{:>20} | {:>10} | {:12.1f} | {:12.1f} | {:8.3f}\n",
+                             name,
+                             n,
+                             contains,
+                             count,
+                             contains / double(n));
+}
+
+template <typename V, typename Make>
+void search(String const& name, std::size_t n, V missing, Make make) {
+    ArrayNative<V> array;
+    array.values.reserve(n);
+    for (std::size_t i = 0; i < n; i++) {
+        array.append(make(i));
+    }
+
+    double contains = bench(n, [&]() { return int(array.__contains__(missing)); });
+    double count    = bench(n, [&]() { return array.count(missing); });
+    row(name, n, contains, count);
+}
+
+int main() {
+    Array<StringRef> names;
+    for (int i = 0; i < 1024; i++) {
+        names.push_back(StringRef(fmt::format("name_{}", i).c_str()));
+    }
+    StringRef missing("missing");
+
+    std::cout << fmt::format("{:>20} | {:>10} | {:>12} | {:>12} | {:>8}\n",
+                             "bench",
+                             "length",
+                             "contains(ns)",
+                             "count(ns)",
+                             "ns/elt");
+
+    for (std::size_t n: {8, 64, 512, 4096, 32768, 262144, 2097152, 10000000}) {
+        search<Value>("boxed i64", n, Value(int64(-1)), [](std::size_t i) {
+            return Value(int64(i));
+        });
+
+        for (auto isa: {kernels::Isa::Portable, kernels::Isa::SSE2, kernels::Isa::AVX2}) {
+            if (!kernels::force_isa(isa)) {
+                continue;
+            }
+
+            String suffix = kernels::isa_name(isa);
+            search<int64_t>("i64 " + suffix, n, -1, [](std::size_t i) { return int64_t(i); });
+            search<double>("f64 " + suffix, n, -1.0, [](std::size_t i) { return double(i); });
+            search<StringRef>("str " + suffix, n, missing, [&](std::size_t i) {
+                return names[i % names.size()];
+            });
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+// bench.h cannot be included, its `Compare` clashes with the AST node
+#include "lexer/buffer.h"
+#include "parser/parser.h"
+#include "sema/sema.h"
+#include "utilities/stopwatch.h"
+#include "vm/tree.h"
+#include "vm/vm.h"
+
+#include <iostream>
+
+using namespace lython;
+
+// Loop and arithmetic heavy workload, executed by the tree evaluator and the bytecode VM
+String code = "def loop(n: i32) -> i32:\n"
+              "    s = 0\n"
+              "    i = 0\n"
+              "    while i < n:\n"
+              "        if (i % 3) == 0:\n"
+              "            s += i\n"
+              "        else:\n"
+              "            s -= 1\n"
+              "        i += 1\n"
+              "    return s\n"
+              "\n"
+              "def fib(n: i32) -> i32:\n"
+              "    if n < 2:\n"
+              "        return n\n"
+              "    return fib(n - 1) + fib(n - 2)\n";
+
+template <typename Fun>
+void bench(String const& name, Fun fun, int repeat = 10) {
+    StopWatch<double, std::chrono::microseconds> time;
+    for (int i = 0; i < repeat; i++) {
+        fun();
+    }
+    double total = time.stop();
+    std::cout << fmt::format("{:>30} | {:10.3f} | {:10.3f} \n", name, total / repeat, total);
+}
+
+Module* parse(String const& source) {
+    StringBuffer reader(source);
+    Lexer        lex(reader);
+    Parser       parser(lex);
+    return parser.parse_module();
+}
+
+int main() {
+    SemanticAnalyser sema;
+    Module*          mod = parse(code);
+    sema.exec(mod, 0);
+
+    Module* loop_call = parse("loop(10000)");
+    Module* fib_call  = parse("fib(15)");
+    sema.exec(loop_call->body[0], 0);
+    sema.exec(fib_call->body[0], 0);
+
+    if (sema.has_errors()) {
+        sema.show_diagnostic(std::cout);
+        return 1;
+    }
+
+    TreeEvaluator tree;
+    tree.module(mod, 0);
+
+    Program program;
+    if (!compile(mod, program)) {
+        return 1;
+    }
+
+    VMExec vm;
+    vm.execute(program, 0);
+
+    // Without quickening
+    VMExec generic;
+    generic.warmup = 0;
+    generic.execute(program, 0);
+
+    std::cout << "tree: " << str(tree.eval(loop_call->body[0])) << " "
+              << str(tree.eval(fib_call->body[0])) << "\n";
+    std::cout << "  vm: " << str(vm.call("loop", {Value(10000)})) << " "
+              << str(vm.call("fib", {Value(15)})) << "\n";
+
+    // Only measure the interpreters, not their debug output
+    outlog().disable(LogLevel::Debug);
+    outlog().disable(LogLevel::Trace);
+
+    std::cout << fmt::format("{:>30} | {:>10} | {:>10} \n", "bench", "mean (us)", "total (us)");
+    bench("tree loop", [&]() { tree.eval(loop_call->body[0]); });
+    bench("vm loop", [&]() { vm.call("loop", {Value(10000)}); });
+    bench("vm loop (generic)", [&]() { generic.call("loop", {Value(10000)}); });
+    bench("tree fib", [&]() { tree.eval(fib_call->body[0]); });
+    bench("vm fib", [&]() { vm.call("fib", {Value(15)}); });
+    bench("vm fib (generic)", [&]() { generic.call("fib", {Value(15)}); });
+
+    std::cout << fmt::format("quickened: {} fused: {} deoptimized: {}\n",
+                             vm.quickened,
+                             vm.fused,
+                             vm.deoptimized);
+
+    delete loop_call;
+    delete fib_call;
+    delete mod;
+    return 0;
+}
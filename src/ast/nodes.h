@@ -8,6 +8,8 @@
 #include "dtypes.h"
 #include "lexer/token.h"
 #include "logging/logging.h"
+#include "stdlib/smalldict.h"
+#include "utilities/inline_cache.h"
 #include "utilities/names.h"
 #include "utilities/object.h"
 #include "utilities/optional.h"
@@ -653,6 +655,21 @@ struct YieldFrom: public ExprNode {
     YieldFrom(): ExprNode(NodeKind::YieldFrom) {}
 };
 
+// What a call site resolved to, cached by the evaluator
+struct CallTarget {
+    enum class Kind : int8_t
+    {
+        Script,
+        Native,
+        Generator,
+        Constructor,
+        NativeConstructor,
+    };
+
+    Kind                kind     = Kind::Script;
+    struct FunctionDef* function = nullptr;  // function to execute (__init__ for constructors)
+};
+
 struct Call: public ExprNode {
     ExprNode*        func = nullptr;
     Array<ExprNode*> args;
@@ -661,6 +678,13 @@ struct Call: public ExprNode {
 
     int jump_id = -1;
 
+    // SEMA: definition called, when the name of the callee is never rebound
+    Node* callee = nullptr;
+
+    // Evaluator: callee => target
+    KIGNORE()
+    InlineCache<Node*, CallTarget> cache;
+
     Call(): ExprNode(NodeKind::Call) {}
 };
 
@@ -684,6 +708,9 @@ struct Subscript: public ExprNode {
     ExprNode*   slice = nullptr;
     ExprContext ctx;
 
+    // Element type id when indexing a list of scalars, resolved by the sema
+    int elt_type = -1;
+
     Subscript(): ExprNode(NodeKind::Subscript) {}
 };
 
@@ -703,16 +730,28 @@ struct Name: public ExprNode {
 
     int store_id = -1;
     int load_id  = -1;
+    int slot     = -1;  // index in the frame of the enclosing function, -1 if not a local
 
     Name(): ExprNode(NodeKind::Name) {}
 
     bool is_leaf() override { return true; }
 };
 
+// How the elements of a list are stored at runtime
+enum class ArrayStorage : int8_t
+{
+    Boxed,    // Value
+    Int64,    // unboxed int64
+    Float64,  // unboxed float64
+};
+
 struct ListExpr: public ExprNode {
     Array<ExprNode*> elts;
     ExprContext      ctx;
 
+    // Resolved by the sema from the element type
+    ArrayStorage storage = ArrayStorage::Boxed;
+
     ListExpr(): ExprNode(NodeKind::ListExpr) {}
 };
 
@@ -813,6 +852,7 @@ struct FunctionDef: public StmtNode {
     // SEMA
     bool          generator;// : 1;
     struct Arrow* type = nullptr;
+    int           frame_size = 0;  // number of distinct local names (arguments included)
 
     Function native = nullptr;
 
@@ -836,6 +876,10 @@ struct ClassDef: public StmtNode {
 
     Arrow* ctor_t = nullptr;
 
+    // Evaluator: object with its attributes initialized, copied to create new instances
+    KIGNORE()
+    Value instance;
+
     ClassDef(): StmtNode(NodeKind::ClassDef) {}
 
     // Sema populates this, this is for nested classes
@@ -852,7 +896,7 @@ struct ClassDef: public StmtNode {
         {}
 
         StringRef name;
-        int       offset = -1;
+        int       offset = -1;  // slot of the attribute inside the instances
         StmtNode* stmt   = nullptr;
         ExprNode* type   = nullptr;
 
@@ -863,6 +907,10 @@ struct ClassDef: public StmtNode {
     };
     // Dict<StringRef, Attr> attributes;
     Array<Attr> attributes;  // <= Instantiated Object
+
+    // name => index in attributes, classes rarely have more than 16 attributes & methods
+    KIGNORE()
+    SmallDict<StringRef, int, 16, StdHash<StringRef>> attribute_ids;
     // Array<Attr> static_attributes;  // <= Namespaced Globals
     // Array<Attr> methods;
 
@@ -876,25 +924,23 @@ struct ClassDef: public StmtNode {
         }
     }
 
-    int get_attribute(StringRef name) {
-
-        int i = 0;
-        for (Attr& att: attributes) {
-            if (att.name == name) {
-                return i;
-            }
-
-            i += 1;
-        }
+    int get_attribute(StringRef name) const {
+        int attrid = -1;
+        attribute_ids.get(name, attrid);
+        return attrid;
+    }
 
-        return -1;
+    void add_attribute(StringRef name, StmtNode* stmt, ExprNode* type) {
+        int attrid = int(attributes.size());
+        attributes.emplace_back(name, attrid, stmt, type);
+        attribute_ids.insert(name, attrid);
     }
 
     bool insert_method(StringRef name, StmtNode* stmt = nullptr, ExprNode* type = nullptr) {
         int attrid = get_attribute(name);
 
         if (attrid == -1) {
-            attributes.emplace_back(name, int(attributes.size()), stmt, type);
+            add_attribute(name, stmt, type);
             return true;
         }
 
@@ -911,7 +957,7 @@ struct ClassDef: public StmtNode {
         int attrid = get_attribute(name);
 
         if (attrid == -1) {
-            attributes.emplace_back(name, int(attributes.size()), stmt, type);
+            add_attribute(name, stmt, type);
             return true;
         }
 
@@ -934,8 +980,12 @@ struct Attribute: public ExprNode {
     // Node* resolved = nullptr;
     ClassDef::Attr* resolved = nullptr;
 
-    // SEMA
-    int attrid = 0;
+    // SEMA: index of the attribute in its class, which is its slot inside the instances
+    int attrid = -1;
+
+    // Evaluator: type id => index of the native member (-1 for script objects)
+    KIGNORE()
+    InlineCache<int, int> cache;
 
     Attribute(): ExprNode(NodeKind::Attribute) {}
 };
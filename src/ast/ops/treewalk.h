@@ -246,6 +246,7 @@ struct TreeWalk: public BaseVisitor<TreeWalk<Implementation, isConst, VisitorTra
     virtual ExprRet listexpr(ListExpr_t* n, int depth, Args... args) {
         ListExpr_st cpy = new_from(n, depth, args...);
         KW_COPY(cpy->elts, n->elts);
+        cpy->storage = n->storage;
         return cpy;
     }
     virtual ExprRet tupleexpr(TupleExpr_t* n, int depth, Args... args) {
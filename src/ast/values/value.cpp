@@ -3,12 +3,12 @@
 namespace lython {
 
 bool Value::operator==(Value const& val) const {
-    if (tag == val.tag) {
+    if (type_id() == val.type_id()) {
         // is there a risk that when the value is smaller some garbage remain ?
-        switch (meta::ValueTypes(tag)) {
+        switch (meta::ValueTypes(type_id())) {
 
 #define CASE(type, name) \
-    case meta::ValueTypes::name: return value.name == val.value.name;
+    case meta::ValueTypes::name: return load<type>() == val.load<type>();
             KIWI_VALUE_TYPES(CASE)
 #undef CASE
     case meta::ValueTypes::Max:
@@ -70,10 +70,10 @@ std::ostream& ostream_op(std::ostream& os, Pointi const& v) { return os << "Poin
 std::ostream& ostream_op(std::ostream& os, Color const& v) { return os << "Color("<< v.r << ", " << v.g << v.b << ", " << v.a << ")"; }
 
 std::ostream& operator<<(std::ostream& os, Value const& v) {
-    switch (meta::ValueTypes(v.tag)) {
+    switch (meta::ValueTypes(v.type_id())) {
 #define CASE(type, name)                            \
     case meta::ValueTypes::name:                    \
-            return ostream_op(os, v.value.name);
+            return ostream_op(os, v.load<type>());
         
         KIWI_VALUE_TYPES(CASE)
 #undef CASE
@@ -83,12 +83,12 @@ std::ostream& operator<<(std::ostream& os, Value const& v) {
 
     static int strtid = meta::type_id<String>();
 
-    if (strtid == v.tag) {
+    if (strtid == v.type_id()) {
         return os << '"' << v.as<String const&>() << '"';
     }
 
     auto& registry = meta::TypeRegistry::instance();
-    auto& meta = registry.id_to_meta[v.tag];
+    auto& meta = registry.id_to_meta[v.type_id()];
 
     if (meta.printer) {
         meta.printer(os, v);
@@ -110,10 +110,10 @@ String Value::__repr__() const {
 }
 
 std::ostream& Value::debug_print(std::ostream& os) const {
-    switch (meta::ValueTypes(tag)) {
+    switch (meta::ValueTypes(type_id())) {
 #define CASE(type, name)                            \
     case meta::ValueTypes::name:                    \
-            return os << value.name << ": " << #type;
+            return os << load<type>() << ": " << #type;
         
         KIWI_VALUE_TYPES(CASE)
 #undef CASE
@@ -121,7 +121,7 @@ std::ostream& Value::debug_print(std::ostream& os) const {
     case meta::ValueTypes::Max: break;
     }
 
-    meta::ClassMetadata& meta = meta::classmeta(tag);
+    meta::ClassMetadata& meta = meta::classmeta(type_id());
     if (meta.printer) {
         meta.printer(os, *this);
         return os << ": " << meta.name;
@@ -131,7 +131,7 @@ std::ostream& Value::debug_print(std::ostream& os) const {
 
 
 bool Value::destroy() {
-    meta::ClassMetadata& metadata = meta::classmeta(tag);
+    meta::ClassMetadata& metadata = meta::classmeta(type_id());
 
     if (metadata.deleter) {
         metadata.deleter(nullptr, *this);
@@ -142,7 +142,7 @@ bool Value::destroy() {
 
 Value Value::copy() const {
     auto& registry = meta::TypeRegistry::instance();
-    auto& meta = registry.id_to_meta[tag];
+    auto& meta = registry.id_to_meta[type_id()];
     if (meta.copier) {
         return meta.copier(*this);
     }
@@ -151,7 +151,7 @@ Value Value::copy() const {
 
 Value Value::ref() {
     // skip lookup for common types
-    switch (meta::ValueTypes(tag)) {
+    switch (meta::ValueTypes(type_id())) {
 #define CASE(type, name)                            \
     case meta::ValueTypes::name:                    \
             return _ref<type>::ref(*this);
@@ -162,7 +162,7 @@ Value Value::ref() {
     }
 
     auto& registry = meta::TypeRegistry::instance();
-    auto& meta = registry.id_to_meta[tag];
+    auto& meta = registry.id_to_meta[type_id()];
     if (meta.ref) {
         return meta.ref(*this);
     }
@@ -172,7 +172,7 @@ Value Value::ref() {
 
 std::size_t Value::hash() const {
     auto& registry = meta::TypeRegistry::instance();
-    auto& meta = registry.id_to_meta[tag];
+    auto& meta = registry.id_to_meta[type_id()];
     if (meta.hasher) {
         return meta.hasher(*this);
     }
@@ -195,16 +195,16 @@ bool register_metadata(int type_id, const char* name, ValueDeleter deleter, Valu
 
 uint8* value_memory(meta::ClassMetadata const& meta, Value& obj) {
     if (meta.size <= sizeof(Value::Holder) && meta.is_trivially_copyable) {
-        return (uint8*)(&obj.value);
+        return obj.pointer<uint8>();
     } else {
-        return (uint8*)(obj.value.obj);
+        return (uint8*)(obj.object());
     }
 }
 
 
 Value getattr(Value obj, String const& name) 
 {
-    meta::ClassMetadata& meta = meta::classmeta(obj.tag);
+    meta::ClassMetadata& meta = meta::classmeta(obj.type_id());
     for(meta::Property& member: meta.members) {
         if (String(member.name.c_str()) == name) {
             int type = member.type;
@@ -218,15 +218,12 @@ Value getattr(Value obj, String const& name)
 }
 
 Value make_pointer(int tag, void* ptr) {
-    Value vptr;
-    vptr.tag = tag;
-    vptr.value.obj = ptr;
-    return vptr;
+    return Value(tag, ptr);
 };
 
 
 Value setattr(Value& obj, String const& name, Value val) {
-    meta::ClassMetadata& meta = meta::classmeta(obj.tag);
+    meta::ClassMetadata& meta = meta::classmeta(obj.type_id());
     for(meta::Property& member: meta.members) {
         if (String(member.name.c_str()) == name) {
             int type = member.type;
@@ -242,12 +239,69 @@ Value setattr(Value& obj, String const& name, Value val) {
 
 
 Value Value::operator() (void* ctx, Array<Value> args) {
-    if (meta::type_id<Function>() == tag) {
+    if (meta::type_id<Function>() == type_id()) {
         return as<Function>()(ctx, args);
     }
     return Value();
 }
 
+static ValueTracer value_tracer(Value const& val) {
+    if (val.type_id() < int(meta::ValueTypes::Max)) {
+        return nullptr;
+    }
+    return meta::classmeta(val.type_id()).tracer;
+}
+
+void gc_trace(Value const& val, GCVisitor& visitor) {
+    void* obj = val.object();
+    if (visitor.gc.is_pointer(GCGen::Root, obj)) {
+        visitor.visit(obj);
+        return;
+    }
+
+    ValueTracer tracer = value_tracer(val);
+    if (tracer == nullptr || obj == nullptr) {
+        return;
+    }
+    for (void const* parent: visitor.foreign_path) {
+        if (parent == obj) {
+            return;
+        }
+    }
+    visitor.foreign = true;
+    visitor.foreign_path.push_back(obj);
+    tracer(obj, visitor);
+    visitor.foreign_path.pop_back();
+}
+
+void gc_record_store(BoehmGarbageCollector& gc, void* owner, Value const& val) {
+    void* obj = val.object();
+    if (gc.is_pointer(GCGen::Root, obj)) {
+        gc.write_barrier(owner, obj);
+        return;
+    }
+    if (ValueTracer tracer = value_tracer(val)) {
+        if (obj != nullptr) {
+            gc.write_barrier(owner, obj, tracer);
+        }
+    }
+}
+
+#if WITH_VALUE_NANBOX
+// The values on the stack hold boxed pointers, the conservative scans decode them.
+// Pointers boxed inside a cell are not found, every pointer type gets a slot
+// until the slots run out (see NaNBox)
+static void* boxed_address(void* word) {
+    uint64 bits = uint64(uintptr_t(word));
+    if ((bits & Value::boxed_mask) != Value::boxed_mask || ((bits >> 48) & 7) < Value::PointerKind) {
+        return nullptr;
+    }
+    return reinterpret_cast<void*>((bits & Value::address_mask) << 3);
+}
+
+[[maybe_unused]] static bool registered_decoder = (garbage_collector().decode = boxed_address, true);
+#endif
+
 namespace meta {
 
 Value Property::getattr(void* obj) {
@@ -5,8 +5,17 @@
 //
 #include "stdlib/garbage.h"
 
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
 #define KIWI_SVO 1
 
+// Use the compact 8 bytes NaN-boxed layout for Value (see Value's NaN-boxing notes)
+#ifndef WITH_VALUE_NANBOX
+#    define WITH_VALUE_NANBOX 0
+#endif
+
 namespace lython {
 
 struct Value;
@@ -116,6 +125,10 @@ inline constexpr bool has_valid_sizeof_v = has_valid_sizeof<T>::value;
 //
 // We could have a version that removes the tag
 // for speeding up execution more (once SEMA is mature enough)
+//
+// WITH_VALUE_NANBOX=1 does fold the tag inside the 64 bits (see NaN-boxing below)
+// the layout above is then only used for the few values that need boxing
+//
 struct Value {
     union Holder {
 #define ATTR(type, name) type name;
@@ -125,6 +138,42 @@ struct Value {
         void* obj;
     };
 
+#if WITH_VALUE_NANBOX
+    // Boxed value, keeps the 16 bytes layout
+    struct Cell {
+        uint32 tag;
+        Holder value;
+    };
+
+    uint64 bits;
+
+    Value() { encode(meta::type_id<_Invalid>(), 0, 0, false); }
+
+    // A value owns its cell, copies get their own so writing through `pointer<T>()`
+    // or `as<T&>()` only modifies this value, like the 16 bytes layout
+    Value(Value const& val): bits(val.bits) { clone_cell(); }
+    Value(Value&& val) noexcept: bits(val.bits) { val.bits = invalid_bits(); }
+
+    Value& operator=(Value const& val) {
+        if (this != &val) {
+            free_cell();
+            bits = val.bits;
+            clone_cell();
+        }
+        return *this;
+    }
+
+    Value& operator=(Value&& val) noexcept {
+        if (this != &val) {
+            free_cell();
+            bits     = val.bits;
+            val.bits = invalid_bits();
+        }
+        return *this;
+    }
+
+    ~Value() { free_cell(); }
+#else
     // The VM might not need the type tag
     // once sema is passed we should be able to guarantee
     // the oprations are ok
@@ -132,6 +181,13 @@ struct Value {
     Holder                                 value;
 
     Value(): tag(meta::type_id<_Invalid>()) {}
+#endif
+
+    // Type id of the held value
+    int type_id() const;
+
+    // Pointer held by the value (objects and references)
+    void* object() const;
 
     // destroy the value using its tag to lookup the appropriate destructor
     bool  destroy();
@@ -143,16 +199,61 @@ struct Value {
 
     std::size_t hash() const;
 
+#if WITH_VALUE_NANBOX
+#define CTOR(type, name)                                        \
+    Value(type name): bits(0) {                                 \
+        static_assert(std::is_trivially_copyable<type>::value); \
+        store<type>(meta::type_id<type>(), name);               \
+    }
+#else
 #define CTOR(type, name)                                        \
     Value(type name): tag(meta::type_id<type>()) {              \
         static_assert(std::is_trivially_copyable<type>::value); \
         value.name = name;                                      \
     }
+#endif
 
     KIWI_VALUE_TYPES(CTOR)
 #undef CTOR
 
+#if WITH_VALUE_NANBOX
+    Value(int tag, void* ptr) { encode(tag, uint64(uintptr_t(ptr)), sizeof(ptr), true); }
+#else
     Value(int tag, void* ptr): tag(tag) { value.obj = ptr; }
+#endif
+
+    // Replace the held value by a copy of `val`, T needs to be small
+    template <typename T>
+    void store(int type, T const& val) {
+        static_assert(is_small<T>());
+#if WITH_VALUE_NANBOX
+        uint64 raw = 0;
+        std::memcpy(&raw, &val, sizeof(T));
+        free_cell();
+        encode(type, raw, sizeof(T), std::is_pointer_v<T>);
+#else
+        tag = type;
+        new (&value) T(val);
+#endif
+    }
+
+    // Copy of the held value, T needs to be small
+    template <typename T>
+    T load() const {
+        static_assert(is_small<T>());
+#if WITH_VALUE_NANBOX
+        T val;
+        if (is_boxed() && kind() == CellKind) {
+            std::memcpy(&val, &cell()->value, sizeof(T));
+        } else {
+            uint64 raw = payload();
+            std::memcpy(&val, &raw, sizeof(T));
+        }
+        return val;
+#else
+        return *pointer<T>();
+#endif
+    }
 
     // Value(Value&& v)  {
     //     memcpy(this, &v, sizeof(Value));
@@ -163,10 +264,20 @@ struct Value {
     // Value& operator= (Value const&) = default;
 
     KFUNCTION(type=bool(lython::Value::*)(int) const)
-    bool is_type(int obj_type_id) const { return obj_type_id == tag; }
+    bool is_type(int obj_type_id) const { return obj_type_id == type_id(); }
 
     template <typename T>
     bool is_type() const {
+#if WITH_VALUE_NANBOX
+        // builtin types are checked without decoding the value
+        if constexpr (std::is_same_v<T, float64>) {
+            return !is_boxed();
+        } else if constexpr (has_valid_sizeof_v<T> && !std::is_pointer_v<T>) {
+            if (sizeof(T) <= 4 && meta::type_id<T>() < int(meta::ValueTypes::Max)) {
+                return (bits >> 32) == ((box(InlineKind, 0) >> 32) | uint64(meta::type_id<T>()));
+            }
+        }
+#endif
         return is_type(meta::type_id<T>());
     }
 
@@ -174,7 +285,7 @@ struct Value {
 
     template <typename T>
     bool operator==(T const& val) const {
-        if (tag == meta::type_id<T>()) {
+        if (type_id() == meta::type_id<T>()) {
             return as<T>() == val;
         }
         return false;
@@ -251,24 +362,143 @@ struct Value {
     T* pointer() {
         // The pointer to the data is stored inside itself
         if constexpr (is_small<T>()) {
-            return reinterpret_cast<T*>(&value);
+            return reinterpret_cast<T*>(storage());
         } else {
             // The data is stored in dynamically allocated memory
-            return reinterpret_cast<T*>(value.obj);
+            return reinterpret_cast<T*>(object());
         }
     }
 
+    // NaN-boxed int64, uint64 and pointers are folded inside the 64 bits
+    // they have no storage a const value could point to, they need to be read by value
+    template <typename T>
+    static constexpr bool has_const_storage() {
+#if WITH_VALUE_NANBOX
+        using U = std::remove_cv_t<T>;
+        return !(std::is_same_v<U, int64> || std::is_same_v<U, uint64> || std::is_pointer_v<U>);
+#else
+        return true;
+#endif
+    }
+
+    // T const& when the value has storage for T, a copy otherwise
+    template <typename T>
+    using const_ref = std::conditional_t<has_const_storage<T>(), T const&, T>;
+
     template <typename T>
     T const* pointer() const {
+        static_assert(has_const_storage<T>(), "Value holds this type by value, use as<T>() or load<T>()");
+
         // The pointer to the data is stored inside itself
         if constexpr (is_small<T>()) {
-            return reinterpret_cast<T const*>(&value);
+            return reinterpret_cast<T const*>(storage());
         } else {
             // The data is stored in dynamically allocated memory
-            return reinterpret_cast<T const*>(value.obj);
+            return reinterpret_cast<T const*>(object());
         }
     }
 
+#if WITH_VALUE_NANBOX
+    //
+    // NaN-boxing
+    // ----------
+    //
+    // float64 are stored as is, everything else lives inside the negative quiet NaN space
+    // (the 13 upper bits are set) which leaves 3 bits of kind and a 48 bits payload
+    //
+    //  63           51 50  48 47             32 31              0
+    //  | 1111111111111 | kind | tag (16 bits)   | data (32 bits) |  Inline: bool, int8-32, float32, Color, None
+    //  | 1111111111111 | kind |          int48 or uint48          |  Int, UInt: int64 & uint64 that fit
+    //  | 1111111111111 | kind |          pointer (48 bits)        |  Cell: {tag, Holder} box
+    //  | 1111111111111 | k   | slot |   pointer >> 3 (44 bits)   |  Pointer: kind 4 to 7
+    //
+    // Pointers use 2 bits of kind and the 4 upper bits of the payload as a slot (64 slots)
+    // which maps to the pointer type id (see NaNBox::slot).
+    //
+    // Everything else (Pointi, Pointf, large integers, unaligned pointers, ...) is boxed
+    // in a Cell that holds the 16 bytes layout. The cell is owned by the value,
+    // it is copied with the value and freed with it.
+    //
+    enum Kind
+    {
+        InlineKind,
+        IntKind,
+        UIntKind,
+        CellKind,
+        PointerKind,
+    };
+
+    static constexpr uint64 boxed_mask     = 0xFFF8000000000000ull;
+    static constexpr uint64 payload_mask   = 0x0000FFFFFFFFFFFFull;
+    static constexpr uint64 canonical_nan  = 0x7FF8000000000000ull;
+    static constexpr uint64 address_bits   = 44;
+    static constexpr uint64 address_mask   = (1ull << address_bits) - 1;
+
+    bool is_boxed() const { return (bits & boxed_mask) == boxed_mask; }
+
+    int kind() const {
+        int k = int((bits >> 48) & 7);
+        return k >= PointerKind ? PointerKind : k;
+    }
+
+    Cell* cell() const { return reinterpret_cast<Cell*>(bits & payload_mask); }
+
+    int slot() const { return int((bits >> address_bits) & 0x3F); }
+
+    // held value widened to 64 bits
+    uint64 payload() const {
+        if (!is_boxed()) {
+            return bits;
+        }
+        switch (kind()) {
+        case InlineKind: return bits & 0xFFFFFFFFull;
+        case IntKind: return uint64(int64(bits << 16) >> 16);
+        case UIntKind: return bits & payload_mask;
+        case CellKind: return cell()->value.u64;
+        }
+        return (bits & address_mask) << 3;
+    }
+
+    private:
+    static uint64 box(int kind, uint64 payload) {
+        return boxed_mask | (uint64(kind) << 48) | (payload & payload_mask);
+    }
+
+    static uint64 invalid_bits() {
+        return box(InlineKind, uint64(meta::type_id<_Invalid>()) << 32);
+    }
+
+    void clone_cell() {
+        if (is_boxed() && kind() == CellKind) {
+            bits = box(CellKind, uint64(uintptr_t(new Cell(*cell()))));
+        }
+    }
+
+    void free_cell() {
+        if (is_boxed() && kind() == CellKind) {
+            delete cell();
+        }
+    }
+
+    // bits must not hold a cell
+    void encode(int type, uint64 raw, int size, bool is_pointer);
+
+    // address of the held value, values that are not addressable are moved to a cell
+    void* storage();
+
+    // address of the held value, Int, UInt and Pointer values are not addressable
+    // (see has_const_storage)
+    void const* storage() const;
+
+    public:
+#else
+    private:
+    void*       storage() { return &value; }
+    void const* storage() const { return &value; }
+
+    public:
+#endif
+
     KIGNORE()
     std::ostream& print(std::ostream& out) const;
     
@@ -278,6 +508,158 @@ struct Value {
     String __repr__() const;
 };
 
+#if WITH_VALUE_NANBOX
+static_assert(sizeof(Value) == 8, "NaN-boxed values should be 8 bytes");
+
+// Type id of the pointers held inside a Value, see Value's NaN-boxing notes
+//
+// Slots are assigned once and never change, reading an assigned slot does not lock
+struct NaNBox {
+    static constexpr int slot_count = 64;
+    static constexpr int max_type   = 4096;
+
+    static inline std::atomic<int>   slot_types[slot_count];
+    static inline std::atomic<uint8> type_slots[max_type];  // slot + 1, 0 when not assigned
+    static inline int                slot_used = 0;         // guarded by `lock`
+    static inline std::mutex         lock;
+
+    // returns -1 when the type cannot get a slot, the pointer is then boxed
+    static int slot(int type) {
+        if (type < 0 || type >= max_type) {
+            return -1;
+        }
+
+        uint8 assigned = type_slots[type].load(std::memory_order_acquire);
+        if (assigned != 0) {
+            return assigned - 1;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        assigned = type_slots[type].load(std::memory_order_relaxed);
+        if (assigned == 0) {
+            if (slot_used >= slot_count) {
+                return -1;
+            }
+            slot_types[slot_used].store(type, std::memory_order_relaxed);
+            slot_used += 1;
+            assigned = uint8(slot_used);
+            type_slots[type].store(assigned, std::memory_order_release);
+        }
+        return assigned - 1;
+    }
+
+    static int slot_type(int slot) { return slot_types[slot].load(std::memory_order_acquire); }
+};
+
+inline int Value::type_id() const {
+    if (!is_boxed()) {
+        return meta::type_id<float64>();
+    }
+    switch (kind()) {
+    case InlineKind: return int((bits >> 32) & 0xFFFF);
+    case IntKind: return meta::type_id<int64>();
+    case UIntKind: return meta::type_id<uint64>();
+    case CellKind: return int(cell()->tag);
+    }
+    return NaNBox::slot_type(slot());
+}
+
+inline void* Value::object() const { return reinterpret_cast<void*>(payload()); }
+
+inline void Value::encode(int type, uint64 raw, int size, bool is_pointer) {
+    if (type == meta::type_id<float64>()) {
+        // any other NaN could be mistaken for a boxed value
+        bits = ((raw & ~(1ull << 63)) > 0x7FF0000000000000ull) ? canonical_nan : raw;
+        return;
+    }
+
+    if (size <= 4 && !is_pointer && type >= 0 && type <= 0xFFFF) {
+        bits = box(InlineKind, (uint64(type) << 32) | (raw & 0xFFFFFFFFull));
+        return;
+    }
+
+    if (type == meta::type_id<int64>() && (int64(raw << 16) >> 16) == int64(raw)) {
+        bits = box(IntKind, raw);
+        return;
+    }
+
+    if (type == meta::type_id<uint64>() && raw <= payload_mask) {
+        bits = box(UIntKind, raw);
+        return;
+    }
+
+    if (is_pointer && (raw & 7) == 0 && (raw >> 3) <= address_mask) {
+        int slot = NaNBox::slot(type);
+        if (slot >= 0) {
+            bits = boxed_mask | (uint64(PointerKind) << 48) | (uint64(slot) << address_bits) | (raw >> 3);
+            return;
+        }
+    }
+
+    Cell* cell      = new Cell;
+    cell->tag       = uint32(type);
+    cell->value.u64 = raw;
+    bits            = box(CellKind, uint64(uintptr_t(cell)));
+}
+
+inline void* Value::storage() {
+    // Inline values live in the lower 32 bits (little endian)
+    // writing a NaN through a float64 pointer needs to use the canonical NaN
+    if (!is_boxed() || kind() == InlineKind) {
+        return &bits;
+    }
+
+    if (kind() != CellKind) {
+        Cell* boxed      = new Cell;
+        boxed->tag       = uint32(type_id());
+        boxed->value.u64 = payload();
+        bits             = box(CellKind, uint64(uintptr_t(boxed)));
+    }
+    return &cell()->value;
+}
+
+inline void const* Value::storage() const {
+    if (!is_boxed() || kind() == InlineKind) {
+        return &bits;
+    }
+    if (kind() == CellKind) {
+        return &cell()->value;
+    }
+    // only reached when the requested type does not match the held type
+    return nullptr;
+}
+#else
+inline int Value::type_id() const { return int(tag); }
+
+inline void* Value::object() const { return value.obj; }
+#endif
+
+// Visit the GC object held by a value, the containers the collector does not manage
+// are traced through with the tracer of their type (ClassMetadata::tracer)
+void gc_trace(Value const& val, GCVisitor& visitor);
+
+void gc_record_store(BoehmGarbageCollector& gc, void* owner, Value const& val);
+
+// Record the store of `val` inside `owner` for garbage_collector(),
+// owner is an object allocated by the collector, a container traced through
+// (ArrayNative, DictNative, ...) or nullptr for the roots (frames, globals).
+// Only the stores inside GC objects are remembered, the rest is scanned by every collection
+inline void write_barrier(void* owner, Value const& val) {
+    BoehmGarbageCollector& gc = garbage_collector();
+    if (gc.marking || gc.is_pointer(GCGen::Root, owner)) {
+        gc_record_store(gc, owner, val);
+    }
+}
+
+// Store a value inside an object allocated by the garbage collector,
+// the collector needs to know when an old or already scanned object
+// starts pointing to another object
+inline void gc_store(void* owner, Value& field, Value const& val) {
+    field = val;
+    write_barrier(owner, val);
+}
+
 //
 // Getter
 //
@@ -291,27 +673,30 @@ T Getter<T>::get(Value& v, GetterError& err) {
         return *v.as<NoConst*>(err);
     } else {
         // Storing int, we want int
-        if (v.tag == meta::type_id<NoConst>()) {
-            NoConst* ptr = v.pointer<NoConst>();
-            return *ptr;
+        if (v.type_id() == meta::type_id<NoConst>()) {
+            if constexpr (Value::is_small<NoConst>()) {
+                return v.load<NoConst>();
+            } else {
+                NoConst* ptr = v.pointer<NoConst>();
+                return *ptr;
+            }
         }
 
         // Storing int*, we want int
-        if (v.tag == meta::type_id<NoConst*>()) {
-            NoConst** ptr = v.pointer<NoConst*>();
-            return **ptr;
+        if (v.type_id() == meta::type_id<NoConst*>()) {
+            return *v.load<NoConst*>();
         }
 
         // Storing int, we want int*
         if constexpr (std::is_pointer_v<NoConst>) {
-            if (v.tag == meta::type_id<NoPointer>()) {
+            if (v.type_id() == meta::type_id<NoPointer>()) {
                 NoPointer* ptr = v.pointer<NoPointer>();
                 return ptr;
             }
         }
 
         err.failed += 1;
-        err.value_type_id     = v.tag;
+        err.value_type_id     = v.type_id();
         err.requested_type_id = meta::type_id<T>();
         return T();
     }
@@ -332,34 +717,37 @@ T const Getter<T>::get(Value const& v, GetterError& err) {
     } else {
         err.failed = false;
         // Storing int, we want int
-        if (v.tag == meta::type_id<NoConst>()) {
-            NoConst const* ptr = v.pointer<NoConst>();
-            return *ptr;
+        if (v.type_id() == meta::type_id<NoConst>()) {
+            if constexpr (Value::is_small<NoConst>()) {
+                return v.load<NoConst>();
+            } else {
+                NoConst const* ptr = v.pointer<NoConst>();
+                return *ptr;
+            }
         }
 
         // is this possible ? we are returning a copy anyway
         // Storing int*, we want int
-        if (v.tag == meta::type_id<NoConst*>()) {
-            NoConst const* const* ptr = v.pointer<NoConst const*>();
-            return **ptr;
+        if (v.type_id() == meta::type_id<NoConst*>()) {
+            return *v.load<NoConst const*>();
         }
 
-        if constexpr (std::is_pointer_v<NoConst>) {
+        // a const value only gives const pointers to what it holds
+        if constexpr (std::is_pointer_v<NoConst> && std::is_const_v<std::remove_pointer_t<NoConst>>) {
             // Storing int*, we want int const*
-            if (v.tag == meta::type_id<NoPointer*>()) {
-                NoPointer const* ptr = v.pointer<NoPointer const>();
-                return ptr;
+            if (v.type_id() == meta::type_id<NoPointer*>()) {
+                return v.load<NoPointer const*>();
             }
 
             // Storing int, we want int*
-            if (v.tag == meta::type_id<NoPointer>()) {
+            if (v.type_id() == meta::type_id<NoPointer>()) {
                 NoPointer const* ptr = v.pointer<NoPointer const>();
                 return ptr;
             }
         }
 
         err.failed += 1;
-        err.value_type_id     = v.tag;
+        err.value_type_id     = v.type_id();
         err.requested_type_id = meta::type_id<T>();
         return T();
     }
@@ -373,14 +761,14 @@ bool Query<T>::get(Value const& v) {
     if constexpr (std::is_reference<T>::value) {
         return Query<NoConst*>::get(v);
     } else {
-        if (v.tag == meta::type_id<NoConst>()) {
+        if (v.type_id() == meta::type_id<NoConst>()) {
             return true;
         }
-        if (v.tag == meta::type_id<NoConst*>()) {
+        if (v.type_id() == meta::type_id<NoConst*>()) {
             return true;
         }
         if constexpr (std::is_pointer_v<NoConst>) {
-            return v.tag == meta::type_id<NoPointer>();
+            return v.type_id() == meta::type_id<NoPointer>();
         }
         return false;
     }
@@ -395,17 +783,17 @@ bool Query<T>::get(Value const& v) {
     template <>                                                                    \
     struct Getter<type> {                                                          \
         static type get(Value& v, GetterError& err) {                              \
-            err.failed = v.tag != meta::type_id<type>();                           \
-            return v.value.name;                                                   \
+            err.failed = v.type_id() != meta::type_id<type>();                           \
+            return v.load<type>();                                                   \
         };                                                                         \
         static type get(Value const& v, GetterError& err) {                        \
-            err.failed = v.tag != meta::type_id<type>();                           \
-            return v.value.name;                                                   \
+            err.failed = v.type_id() != meta::type_id<type>();                           \
+            return v.load<type>();                                                   \
         };                                                                         \
     };                                                                             \
     template <>                                                                    \
     struct Query<type> {                                                           \
-        static bool get(Value const& v) { return v.tag == meta::type_id<type>(); } \
+        static bool get(Value const& v) { return v.type_id() == meta::type_id<type>(); } \
     };
 
 GETTER(Function, fun)
@@ -635,14 +1023,15 @@ using FreeFun = void (*)(void*);
 template <typename T, FreeFun free_fun = std::free>
 struct _destructor {
     static void free(void* ctx, Value& v) {
-        if (v.value.obj == nullptr) {
+        void* obj = v.object();
+        if (obj == nullptr) {
             return;
         }
 
         // call the destructor
-        ((T*)(v.value.obj))->~T();
+        ((T*)(obj))->~T();
 
-        free_fun(v.value.obj);
+        free_fun(obj);
 
         // NOTE: this only nullify current value so other copy of this value
         // might still think the value is valid
@@ -650,14 +1039,14 @@ struct _destructor {
         // on free the memory returns to the pool and it is marked as invalid
         // copied value will be able to check for the mark until the memory is reused
         // then same issue would be still be possible
-        v.value.obj = nullptr;  // just in case
+        v = Value(v.type_id(), nullptr);  // just in case
     }
 };
 
 template <FreeFun free_fun>
 struct _custom_free {
     static void free(void* ctx, Value& v) {
-        free_fun(v.value.obj);
+        free_fun(v.object());
 
         // NOTE: this only nullify current value so other copy of this value
         // might still think the value is valid
@@ -665,18 +1054,18 @@ struct _custom_free {
         // on free the memory returns to the pool and it is marked as invalid
         // copied value will be able to check for the mark until the memory is reused
         // then same issue would be still be possible
-        v.value.obj = nullptr;  // just in case
+        v = Value(v.type_id(), nullptr);  // just in case
     }
 };
 
 template <typename T>
 struct _hash {
-    static std::size_t hash(Value const& v) { return std::hash<T>()(v.as<T const&>()); }
+    static std::size_t hash(Value const& v) { return std::hash<T>()(v.as<Value::const_ref<T>>()); }
 };
 
 template <typename T>
 struct _printer {
-    static void print(std::ostream& out, Value const& v) { out << v.as<T const&>(); }
+    static void print(std::ostream& out, Value const& v) { out << v.as<Value::const_ref<T>>(); }
 };
 
 //
@@ -701,11 +1090,11 @@ Value _new_object(int _typeid, Args... args) {
 
 template <typename T, typename... Args>
 Value _new_object(BoehmGarbageCollector& gc, int _typeid, Args... args) {
-    // up to the user to free it correctly
-    void* memory = gc.malloc(sizeof(T));
+    // freed by the collector once it is not reachable,
+    // the values it holds are found by the tracer of its type
+    meta::ClassMetadata& metadata = meta::classmeta(_typeid);
+    void* memory = gc.malloc(sizeof(T), Finalizer<T>::finalize, metadata.tracer);
     new (memory) T(args...);
-    // now the deleter needs to know the gc
-    // unless the GC takes care of everything then no deleter needed
     return Value(_typeid, memory);
 }
 
@@ -716,8 +1105,7 @@ Value _new_value(int _typeid, Args... args) {
     // The value cannot have a destructor here
     static_assert(Value::is_small<T>());
     Value value;
-    new (&value.value) T(args...);
-    value.tag = _typeid;
+    value.store<T>(_typeid, T(args...));
 
     meta::ClassMetadata& metadata = meta::classmeta(_typeid);
     metadata.deleter              = noop_destructor;
@@ -784,11 +1172,9 @@ Value new_object(Args... args) {
 
 template <typename T, FreeFun fun, typename... Args>
 Value from_pointer(T* raw) {
-    Value v;
-    v.tag = meta::type_id<T*>();
-    new (v.pointer<T*>()) T*(raw);
+    Value v(meta::type_id<T*>(), (void*)(raw));
 
-    meta::ClassMetadata& metadata = meta::classmeta(v.tag);
+    meta::ClassMetadata& metadata = meta::classmeta(v.type_id());
     metadata.deleter              = _custom_free<fun>::free;
 
     return v;
@@ -822,7 +1208,7 @@ Value unary_invoke(void* ctx, Value fun, Value a);
 
 template <typename T>
 struct _copy {
-    static Value copy(Value const& v) { return make_value<T>(v.as<T const&>()); }
+    static Value copy(Value const& v) { return make_value<T>(v.as<Value::const_ref<T>>()); }
 };
 
 template <typename T>
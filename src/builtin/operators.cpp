@@ -2,6 +2,7 @@
 #include "builtin/operators.inc"
 #include "ast/nodes.h"
 #include "dependencies/coz_wrap.h"
+#include "stdlib/str.h"
 #include "utilities/names.h"
 
 #define LAMBDA(op, type) KIWI_WRAP((op<type>::call));
@@ -19,6 +20,9 @@ Dict<StringRef, Function> build_native_binary_operators() {
 
 
     // clang-format off
+    // String, concatenations share a growing buffer (see kiwi::StringBuilder)
+    map[StringRef(STR(JOIN(Add, str, str)))] = kiwi::str_add;
+
     // Float
     map[StringRef(STR(JOIN(Add, f32, f32)))] = LAMBDA(Add, float32);
     map[StringRef(STR(JOIN(Add, f64, f64)))] = LAMBDA(Add, float64);
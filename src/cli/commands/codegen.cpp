@@ -4,6 +4,7 @@
 // Kiwi
 #include "lexer/buffer.h"
 #include "lexer/lexer.h"
+#include "lowering/constant_folding.h"
 #include "parser/parser.h"
 #include "sema/sema.h"
 
@@ -19,6 +20,11 @@ argparse::ArgumentParser* CodegenCmd::parser() {
     p->add_argument("--file")  //
         .help("file to process");
 
+    p->add_argument("--no-fold")  //
+        .default_value(false)     //
+        .implicit_value(true)     //
+        .help("Disable compile time constant folding");
+
     return p;
 }
 
@@ -42,6 +48,11 @@ int CodegenCmd::main(argparse::ArgumentParser const& args) {
     sema.exec(mod, 0);
     sema.show_diagnostic(std::cout, &lex);
 
+    if (!args.get<bool>("--no-fold") && !sema.has_errors()) {
+        ConstantFolding folding;
+        folding.module(mod);
+    }
+
 #if WITH_CLANG_CODEGEN
     std::cout << "CLANG_CODE_GEN\n";
     ClangGen generator;
@@ -98,9 +98,9 @@ struct InteractiveContext {
                 String strval = str(val);
 
                 auto& registry = meta::TypeRegistry::instance();
-                auto& meta = registry.id_to_meta[val.tag];
+                auto& meta = registry.id_to_meta[val.type_id()];
 
-                self->out() << format("      {:>20} | {:>20} | {}\n", var.name, strval, meta.name);
+                self->out() << format("      {:>20} | {:>20} | {}\n", str(var.name), strval, meta.name);
             }
             self->out() << "\n";
         }},
@@ -160,9 +160,9 @@ struct InteractiveContext {
     }
 
     void output(Value v) {
-        if (v.tag == meta::type_id<_LyException*>()) {
+        if (v.type_id() == meta::type_id<_LyException*>()) {
             out() << v << "\n";
-        } else if (v.tag != meta::type_id<_Invalid>()) {
+        } else if (v.type_id() != meta::type_id<_Invalid>()) {
             out() << " [Out] " << v << "\n";
         }
         clear();
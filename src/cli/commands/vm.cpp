@@ -6,6 +6,7 @@
 #include "lexer/buffer.h"
 #include "lexer/lexer.h"
 #include "logging/logging.h"
+#include "lowering/constant_folding.h"
 #include "parser/parser.h"
 #include "sema/sema.h"
 #include "vm/tree.h"
@@ -21,11 +22,33 @@ argparse::ArgumentParser* VMCmd::parser() {
     p->add_argument("--file")  //
         .help("file to process");
 
+    p->add_argument("--no-fold")  //
+        .default_value(false)     //
+        .implicit_value(true)     //
+        .help("Disable compile time constant folding");
+
+    p->add_argument("--emit")  //
+        .help("write the compiled bytecode to a file");
+
+    p->add_argument("--load")  //
+        .help("execute a bytecode file produced by --emit, skipping the front end");
+
     return p;
 }
 
 int VMCmd::main(argparse::ArgumentParser const& args)
 {    
+    if (args.is_used("--load")) {
+        Program p;
+        if (!p.load(String(args.get<std::string>("--load").c_str()))) {
+            return 1;
+        }
+
+        VMExec vm;
+        vm.execute(p, 0);
+        return vm.has_exception;
+    }
+
     std::string file = "";
     if (args.is_used("--file")) {
         file = args.get<std::string>("--file");
@@ -53,48 +76,41 @@ int VMCmd::main(argparse::ArgumentParser const& args)
     sema.exec(mod, 0);
     sema.show_diagnostic(std::cout, &lex);
 
+    if (!args.get<bool>("--no-fold") && !sema.has_errors()) {
+        ConstantFolding folding;
+        folding.module(mod);
+    }
 
-    Program p = compile(mod);
-
-    std::cout << "\nVM\n";
-    std::cout << "====\n";
-
-
-    Label* label = nullptr;
-    int count = 0;
+    Program p;
+    bool    compiled = compile(mod, p);
 
-    for(int i = 0; i < p.instructions.size(); i++) {
-        Instruction& inst = p.instructions[i];
-        
-        count += 1;
-        for(Label& l: p.labels) {
-            if (l.index == i) {
-                label = &l;
-                count = 0;
-                break;
-            }
-        }
+    if (args.is_used("--emit") && (!compiled || parser.has_errors() || sema.has_errors())) {
+        // a bytecode file skips the front end, it must not hide its errors
+        std::cout << "\nRefusing to emit bytecode for a module with errors\n";
+        return 1;
+    }
 
-        int idt = 2;
-        if (label)  {
-            idt *= label->depth;
+    if (!compiled) {
+        // VMGen only lowers a subset of the language
+        std::cout << "\nVM cannot compile this module, running it with the tree evaluator\n";
+        return run_tree(mod);
+    }
 
-            if (count == 0) {
-                std::cout << fmt::format("{:4d}", i)  << "|" << String(idt, ' ') << "." << label->name << "\n";
-            }
+    if (args.is_used("--emit")) {
+        if (!p.save(String(args.get<std::string>("--emit").c_str()))) {
+            return 1;
         }
-        std::cout << "    |" << String(idt + 2, ' ') << str(inst.stmt) << "\n"; 
     }
 
+    std::cout << "\nVM\n";
+    std::cout << "====\n";
 
-    Value result = eval(p);
 
-    //
-    // std::cout << "\nExec\n";
-    // std::cout << "====\n";
-    // TreeEvaluator eval;
-    // eval.module(mod, 0);
-    return result.tag != meta::type_id<_Invalid>();
+    p.dump(std::cout);
+
+    VMExec vm;
+    vm.execute(p, 0);
+    return vm.has_exception;
 };  
 
 }
\ No newline at end of file
@@ -449,7 +449,7 @@ ExprRet LLVMGen::constant(Constant_t* n, int depth) {
     using Ty           = double;
 
     // clang-format off
-    switch (meta::ValueTypes(n->value.tag)) {
+    switch (meta::ValueTypes(n->value.type_id())) {
     #if 0
     case meta::ValueTypes::i8:  return ConstantFP::get(*context, APFloat((Ty)val.get<int8>   ()));
     case meta::ValueTypes::i16: return ConstantFP::get(*context, APFloat((Ty)val.get<int16>  ()));
@@ -15,6 +15,7 @@
 
 #include "dependencies/xx_hash.h"
 #include "utilities/allocator.h"
+#include "utilities/flat_map.h"
 
 
 #ifdef __linux__
@@ -112,7 +113,12 @@ template <typename A, typename B>
 using Pair = std::pair<A, B>;
 
 template <typename K, typename V, typename H = std::hash<K>>
-using Dict = std::unordered_map<K, V, H, std::equal_to<K>, AllocatorCPU<std::pair<K const, V>>>;
+using Dict = FlatMap<K, V, H, std::equal_to<K>, AllocatorCPU<std::pair<K const, V>>>;
+
+// Node based map, for the few places that keep references to values across insertions
+template <typename K, typename V, typename H = std::hash<K>>
+using StableDict =
+    std::unordered_map<K, V, H, std::equal_to<K>, AllocatorCPU<std::pair<K const, V>>>;
 
 template <typename V>
 using Set = std::unordered_set<V, std::hash<V>, std::equal_to<V>, AllocatorCPU<V>>;
@@ -76,10 +76,6 @@ void Logger::enable_all() {
     levels = ~0;
 }
 
-bool Logger::is_enabled(LogLevel level) const {
-    return levels & (std::uint64_t(1) << std::uint64_t(level));
-}
-
 void Logger::enable(LogLevel level) {
     std::uint64_t ilevel = std::uint64_t(level);
     levels = levels | (std::uint64_t(1) << ilevel); 
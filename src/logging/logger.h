@@ -156,7 +156,9 @@ struct KIGNORE() Logger {
     void verbosity(LogLevel level);
     void disable_all();
     void enable_all();
-    bool is_enabled(LogLevel level) const ;
+    bool is_enabled(LogLevel level) const {
+        return levels & (std::uint64_t(1) << std::uint64_t(level));
+    }
     void enable(LogLevel level) ;
     void disable(LogLevel level);
 
@@ -2,20 +2,46 @@
 
 #include "logging/logger.h"
 
+// Debug and trace points are in the interpreter hot paths,
+// they can be compiled out while keeping the other levels
+#ifndef WITH_LOG_DEBUG
+#   define WITH_LOG_DEBUG WITH_LOG
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define KW_LOG_UNLIKELY(expr) __builtin_expect(!!(expr), 0)
+#else
+#   define KW_LOG_UNLIKELY(expr) (expr)
+#endif
+
+// The level is checked before the arguments are evaluated
+// so a disabled log point does not format or copy anything
+#define KW_LOG_IF(ly_logref, level, call) \
+    (KW_LOG_UNLIKELY((ly_logref).is_enabled(lython::LogLevel::level)) ? (call) : void())
+
 // clang-format off
 #if WITH_LOG
 #   define lyassert(expr, message) assert_true(((bool)(expr)), (message), #expr, LOC)
 #   define kwassert(expr, message) assert_true(((bool)(expr)), (message), #expr, LOC)
 
-#   define kwinfo(ly_logref, ...)  (info(ly_logref, LOC, __VA_ARGS__))
-#   define kwwarn(ly_logref, ...)  (warn(ly_logref, LOC, __VA_ARGS__))
-#   define kwdebug(ly_logref, ...) (debug(ly_logref, LOC, __VA_ARGS__))
-#   define kwerror(ly_logref, ...) (err(ly_logref, LOC, __VA_ARGS__))
-#   define kwfatal(ly_logref, ...) (fatal(ly_logref, LOC, __VA_ARGS__))
+#   define kwinfo(ly_logref, ...)  KW_LOG_IF(ly_logref, Info, info(ly_logref, LOC, __VA_ARGS__))
+#   define kwwarn(ly_logref, ...)  KW_LOG_IF(ly_logref, Warn, warn(ly_logref, LOC, __VA_ARGS__))
+#   define kwerror(ly_logref, ...) KW_LOG_IF(ly_logref, Error, err(ly_logref, LOC, __VA_ARGS__))
+#   define kwfatal(ly_logref, ...) KW_LOG_IF(ly_logref, Fatal, fatal(ly_logref, LOC, __VA_ARGS__))
+
+#   if WITH_LOG_DEBUG
+#   define kwdebug(ly_logref, ...) KW_LOG_IF(ly_logref, Debug, debug(ly_logref, LOC, __VA_ARGS__))
+
+#   define kwtrace(ly_logref, depth, ...)       KW_LOG_IF(ly_logref, Trace, trace_trace<false>(ly_logref, LOC, depth, __VA_ARGS__))
+#   define kwtrace_start(ly_logref, depth, ...) KW_LOG_IF(ly_logref, Trace, trace_trace<false>(ly_logref, LOC, depth, __VA_ARGS__))
+#   define kwtrace_end(ly_logref, depth, ...)   KW_LOG_IF(ly_logref, Trace, trace_trace<true>(ly_logref, LOC, depth, __VA_ARGS__))
+#   else
+#   define kwdebug(log, ...)
 
-#   define kwtrace(ly_logref, depth, ...)       (trace_trace<false>(ly_logref, LOC, depth, __VA_ARGS__))
-#   define kwtrace_start(ly_logref, depth, ...) (trace_trace<false>(ly_logref, LOC, depth, __VA_ARGS__))
-#   define kwtrace_end(ly_logref, depth, ...)   (trace_trace<true>(ly_logref, LOC, depth, __VA_ARGS__))
+#   define kwtrace(log, depth, ...)
+#   define kwtrace_start(log, depth, ...)
+#   define kwtrace_end(log, depth, ...)
+#   endif
 
 #else
 #   define lyassert(expr, message)
@@ -0,0 +1,633 @@
+#include "lowering/constant_folding.h"
+#include "vm/tree.h"
+
+namespace lython {
+
+namespace {
+
+bool contains(Array<StringRef> const& scope, StringRef name) {
+    return std::find(scope.begin(), scope.end(), name) != scope.end();
+}
+
+void add_target(ExprNode* target, Array<StringRef>& scope) {
+    if (Name* name = cast<Name>(target)) {
+        scope.push_back(name->id);
+        return;
+    }
+
+    if (TupleExpr* tuple = cast<TupleExpr>(target)) {
+        for (ExprNode* elt: tuple->elts) {
+            add_target(elt, scope);
+        }
+    }
+}
+
+// Names bound inside a body, they shadow the module level functions
+void collect_locals(Array<StmtNode*> const& body, Array<StringRef>& scope) {
+    for (StmtNode* stmt: body) {
+        switch (stmt->kind) {
+        case NodeKind::Assign: {
+            for (ExprNode* target: cast<Assign>(stmt)->targets) {
+                add_target(target, scope);
+            }
+            break;
+        }
+        case NodeKind::AnnAssign: add_target(cast<AnnAssign>(stmt)->target, scope); break;
+        case NodeKind::AugAssign: add_target(cast<AugAssign>(stmt)->target, scope); break;
+        case NodeKind::FunctionDef: scope.push_back(cast<FunctionDef>(stmt)->name); break;
+        case NodeKind::ClassDef: scope.push_back(cast<ClassDef>(stmt)->name); break;
+        case NodeKind::For: {
+            For* loop = cast<For>(stmt);
+            add_target(loop->target, scope);
+            collect_locals(loop->body, scope);
+            collect_locals(loop->orelse, scope);
+            break;
+        }
+        case NodeKind::While: {
+            While* loop = cast<While>(stmt);
+            collect_locals(loop->body, scope);
+            collect_locals(loop->orelse, scope);
+            break;
+        }
+        case NodeKind::If: {
+            If* cond = cast<If>(stmt);
+            collect_locals(cond->body, scope);
+            for (Array<StmtNode*> const& branch: cond->bodies) {
+                collect_locals(branch, scope);
+            }
+            collect_locals(cond->orelse, scope);
+            break;
+        }
+        case NodeKind::With: {
+            With* with = cast<With>(stmt);
+            for (WithItem const& item: with->items) {
+                if (item.optional_vars.has_value()) {
+                    add_target(item.optional_vars.value(), scope);
+                }
+            }
+            collect_locals(with->body, scope);
+            break;
+        }
+        case NodeKind::Try: {
+            Try* trystmt = cast<Try>(stmt);
+            collect_locals(trystmt->body, scope);
+            for (ExceptHandler const& handler: trystmt->handlers) {
+                if (handler.name.has_value()) {
+                    scope.push_back(handler.name.value());
+                }
+                collect_locals(handler.body, scope);
+            }
+            collect_locals(trystmt->orelse, scope);
+            collect_locals(trystmt->finalbody, scope);
+            break;
+        }
+        default: break;
+        }
+    }
+}
+
+void collect_arguments(Arguments const& args, Array<StringRef>& scope) {
+    for (Arg const& arg: args.posonlyargs) {
+        scope.push_back(arg.arg);
+    }
+    for (Arg const& arg: args.args) {
+        scope.push_back(arg.arg);
+    }
+    for (Arg const& arg: args.kwonlyargs) {
+        scope.push_back(arg.arg);
+    }
+    if (args.vararg.has_value()) {
+        scope.push_back(args.vararg.value().arg);
+    }
+    if (args.kwarg.has_value()) {
+        scope.push_back(args.kwarg.value().arg);
+    }
+}
+
+// Only fold values that can be held inside a constant without owning memory
+bool is_scalar(Value const& value) {
+    return value.is_type<bool>() ||                                           //
+           value.is_type<int8>() || value.is_type<uint8>() ||                 //
+           value.is_type<int16>() || value.is_type<uint16>() ||               //
+           value.is_type<int32>() || value.is_type<uint32>() ||               //
+           value.is_type<int64>() || value.is_type<uint64>() ||               //
+           value.is_type<float32>() || value.is_type<float64>();
+}
+
+bool is_constant(ExprNode* expr) { return expr != nullptr && expr->kind == NodeKind::Constant; }
+
+bool is_division(BinaryOperator op) {
+    return op == BinaryOperator::Div || op == BinaryOperator::FloorDiv ||
+           op == BinaryOperator::Mod;
+}
+
+template <typename T>
+bool is_zero_as(Value const& value) {
+    return value.is_type<T>() && value.as<T>() == T(0);
+}
+
+// Integer division by zero traps (SIGFPE) instead of raising, it must never be evaluated
+bool is_integer_zero(ExprNode* expr) {
+    if (!is_constant(expr)) {
+        return false;
+    }
+    Value const& value = cast<Constant>(expr)->value;
+    return is_zero_as<int8>(value) || is_zero_as<uint8>(value) ||     //
+           is_zero_as<int16>(value) || is_zero_as<uint16>(value) ||   //
+           is_zero_as<int32>(value) || is_zero_as<uint32>(value) ||   //
+           is_zero_as<int64>(value) || is_zero_as<uint64>(value);
+}
+
+// The divisor is a constant that is known not to trap
+bool is_safe_divisor(ExprNode* expr) {
+    return is_constant(expr) && is_scalar(cast<Constant>(expr)->value) && !is_integer_zero(expr);
+}
+
+bool all_constant(Array<ExprNode*> const& exprs) {
+    for (ExprNode* expr: exprs) {
+        if (!is_constant(expr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+void ConstantFolding::module(Module* mod) {
+    functions.clear();
+    purity.clear();
+    locals.clear();
+
+    for (StmtNode* stmt: mod->body) {
+        if (FunctionDef* def = cast<FunctionDef>(stmt)) {
+            functions[def->name] = def;
+        }
+    }
+
+    // A function that gets reassigned does not have a single definition
+    Array<StringRef> globals;
+    collect_locals(mod->body, globals);
+
+    for (StringRef name: globals) {
+        if (std::count(globals.begin(), globals.end(), name) > 1) {
+            functions.erase(name);
+        }
+    }
+
+    body(mod->body);
+
+    kwdebug(outlog(), "Folded {} expressions, abandoned {}", folded, abandoned);
+}
+
+void ConstantFolding::body(Array<StmtNode*>& stmts) {
+    for (StmtNode* n: stmts) {
+        stmt(n);
+    }
+}
+
+void ConstantFolding::stmt(StmtNode* n) {
+    switch (n->kind) {
+    case NodeKind::Expr: {
+        Expr* expr = cast<Expr>(n);
+        fold(expr->value, expr);
+        return;
+    }
+    case NodeKind::Assign: {
+        Assign* assign = cast<Assign>(n);
+        fold(assign->value, assign);
+        return;
+    }
+    case NodeKind::AnnAssign: {
+        AnnAssign* assign = cast<AnnAssign>(n);
+        if (assign->value.has_value()) {
+            fold(assign->value.value(), assign);
+        }
+        return;
+    }
+    case NodeKind::AugAssign: {
+        AugAssign* assign = cast<AugAssign>(n);
+        fold(assign->value, assign);
+        return;
+    }
+    case NodeKind::Return: {
+        Return* ret = cast<Return>(n);
+        if (ret->value.has_value()) {
+            fold(ret->value.value(), ret);
+        }
+        return;
+    }
+    case NodeKind::Assert: {
+        Assert* assertion = cast<Assert>(n);
+        fold(assertion->test, assertion);
+        return;
+    }
+    case NodeKind::If: {
+        If* cond = cast<If>(n);
+        fold(cond->test, cond);
+        body(cond->body);
+
+        for (int i = 0; i < cond->tests.size(); i++) {
+            fold(cond->tests[i], cond);
+            body(cond->bodies[i]);
+        }
+        body(cond->orelse);
+        return;
+    }
+    case NodeKind::While: {
+        While* loop = cast<While>(n);
+        fold(loop->test, loop);
+        body(loop->body);
+        body(loop->orelse);
+        return;
+    }
+    case NodeKind::For: {
+        For* loop = cast<For>(n);
+        fold(loop->iter, loop);
+        body(loop->body);
+        body(loop->orelse);
+        return;
+    }
+    case NodeKind::With: {
+        body(cast<With>(n)->body);
+        return;
+    }
+    case NodeKind::Try: {
+        Try* trystmt = cast<Try>(n);
+        body(trystmt->body);
+        for (ExceptHandler& handler: trystmt->handlers) {
+            body(handler.body);
+        }
+        body(trystmt->orelse);
+        body(trystmt->finalbody);
+        return;
+    }
+    case NodeKind::ClassDef: {
+        body(cast<ClassDef>(n)->body);
+        return;
+    }
+    case NodeKind::FunctionDef: {
+        FunctionDef* def = cast<FunctionDef>(n);
+
+        // local variables shadow the module functions
+        std::size_t size = locals.size();
+        collect_arguments(def->args, locals);
+        collect_locals(def->body, locals);
+
+        body(def->body);
+
+        locals.resize(size);
+        return;
+    }
+    default: return;
+    }
+}
+
+void ConstantFolding::fold(ExprNode*& expr, GCObject* parent) {
+    if (expr == nullptr) {
+        return;
+    }
+
+    // Fold the operands first
+    switch (expr->kind) {
+    case NodeKind::BinOp: {
+        BinOp* binop = cast<BinOp>(expr);
+        fold(binop->left, binop);
+        fold(binop->right, binop);
+        break;
+    }
+    case NodeKind::UnaryOp: {
+        UnaryOp* unary = cast<UnaryOp>(expr);
+        fold(unary->operand, unary);
+        break;
+    }
+    case NodeKind::BoolOp: {
+        BoolOp* boolop = cast<BoolOp>(expr);
+        for (ExprNode*& value: boolop->values) {
+            fold(value, boolop);
+        }
+        break;
+    }
+    case NodeKind::Compare: {
+        Compare* compare = cast<Compare>(expr);
+        fold(compare->left, compare);
+        for (ExprNode*& comparator: compare->comparators) {
+            fold(comparator, compare);
+        }
+        break;
+    }
+    case NodeKind::IfExp: {
+        IfExp* ifexp = cast<IfExp>(expr);
+        fold(ifexp->test, ifexp);
+        fold(ifexp->body, ifexp);
+        fold(ifexp->orelse, ifexp);
+        break;
+    }
+    case NodeKind::Call: {
+        Call* call = cast<Call>(expr);
+        for (ExprNode*& arg: call->args) {
+            fold(arg, call);
+        }
+        break;
+    }
+    case NodeKind::ListExpr: {
+        ListExpr* list = cast<ListExpr>(expr);
+        for (ExprNode*& elt: list->elts) {
+            fold(elt, list);
+        }
+        break;
+    }
+    case NodeKind::TupleExpr: {
+        TupleExpr* tuple = cast<TupleExpr>(expr);
+        for (ExprNode*& elt: tuple->elts) {
+            fold(elt, tuple);
+        }
+        break;
+    }
+    case NodeKind::Attribute: {
+        Attribute* attr = cast<Attribute>(expr);
+        fold(attr->value, attr);
+        break;
+    }
+    case NodeKind::NamedExpr: {
+        NamedExpr* named = cast<NamedExpr>(expr);
+        fold(named->value, named);
+        break;
+    }
+    default: break;
+    }
+
+    if (!foldable(expr)) {
+        return;
+    }
+
+    Value result;
+    if (!evaluate(expr, result)) {
+        return;
+    }
+
+    Constant* cst       = parent->new_object<Constant>(result);
+    cst->lineno         = expr->lineno;
+    cst->col_offset     = expr->col_offset;
+    cst->end_lineno     = expr->end_lineno;
+    cst->end_col_offset = expr->end_col_offset;
+
+    kwdebug(outlog(), "Folded {} => {}", str(expr), str(cst));
+
+    parent->remove_child_if_parent(expr, false);
+    expr = cst;
+    folded += 1;
+}
+
+bool ConstantFolding::foldable(ExprNode* expr) {
+    switch (expr->kind) {
+    case NodeKind::BinOp: {
+        BinOp* binop = cast<BinOp>(expr);
+        if (is_division(binop->op) && is_integer_zero(binop->right)) {
+            return false;
+        }
+        return binop->native_operator != nullptr && is_constant(binop->left) &&
+               is_constant(binop->right);
+    }
+    case NodeKind::UnaryOp: {
+        UnaryOp* unary = cast<UnaryOp>(expr);
+        return unary->native_operator != nullptr && is_constant(unary->operand);
+    }
+    case NodeKind::BoolOp: {
+        BoolOp* boolop = cast<BoolOp>(expr);
+        return boolop->native_operator != nullptr && all_constant(boolop->values);
+    }
+    case NodeKind::Compare: {
+        Compare* compare = cast<Compare>(expr);
+
+        if (compare->native_operator.size() != compare->comparators.size()) {
+            return false;
+        }
+        for (Function native: compare->native_operator) {
+            if (native == nullptr) {
+                return false;
+            }
+        }
+        return is_constant(compare->left) && all_constant(compare->comparators);
+    }
+    case NodeKind::IfExp: {
+        IfExp* ifexp = cast<IfExp>(expr);
+        return is_constant(ifexp->test) && is_constant(ifexp->body) &&
+               is_constant(ifexp->orelse);
+    }
+    case NodeKind::Call: {
+        Call* call = cast<Call>(expr);
+        return all_constant(call->args) && resolve_call(call, locals) != nullptr;
+    }
+    default: return false;
+    }
+}
+
+bool ConstantFolding::evaluate(ExprNode* expr, Value& result) {
+    TreeEvaluator eval;
+    eval.budget = budget;
+
+    // Pure functions can only call pure functions
+    for (auto const& item: purity) {
+        if (item.second) {
+            eval.add_variable(item.first->name, make_value<Node*>(item.first));
+        }
+    }
+
+    result = eval.exec(expr, 0);
+
+    if (eval.has_exceptions()) {
+        kwdebug(outlog(), "Could not fold {}", str(expr));
+        abandoned += 1;
+        return false;
+    }
+
+    return is_scalar(result);
+}
+
+FunctionDef* ConstantFolding::resolve_call(Call* call, Array<StringRef> const& scope) {
+    Name* name = cast<Name>(call->func);
+
+    if (name == nullptr || !call->keywords.empty() || !call->varargs.empty()) {
+        return nullptr;
+    }
+
+    // shadowed by a local variable
+    if (contains(scope, name->id)) {
+        return nullptr;
+    }
+
+    auto found = functions.find(name->id);
+    if (found == functions.end()) {
+        return nullptr;
+    }
+
+    FunctionDef* def = found->second;
+    if (def->args.args.size() != call->args.size() || !is_pure(def)) {
+        return nullptr;
+    }
+    return def;
+}
+
+bool ConstantFolding::is_pure(FunctionDef* def) {
+    auto found = purity.find(def);
+    if (found != purity.end()) {
+        return found->second;
+    }
+
+    Arguments const& args = def->args;
+
+    if (def->native != nullptr || def->generator || def->async || !def->decorator_list.empty() ||
+        !args.posonlyargs.empty() || !args.kwonlyargs.empty() || args.vararg.has_value() ||
+        args.kwarg.has_value()) {
+        purity[def] = false;
+        return false;
+    }
+
+    // Assume recursive calls are pure, the budget bounds the recursion
+    purity[def] = true;
+
+    Array<StringRef> scope;
+    collect_arguments(args, scope);
+    collect_locals(def->body, scope);
+
+    bool pure = true;
+    for (StmtNode* stmt: def->body) {
+        pure = pure && is_pure(stmt, scope);
+    }
+
+    purity[def] = pure;
+    return pure;
+}
+
+bool ConstantFolding::is_pure(StmtNode* stmt, Array<StringRef> const& scope) {
+    auto pure_body = [&](Array<StmtNode*> const& body) {
+        for (StmtNode* stmt: body) {
+            if (!is_pure(stmt, scope)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    switch (stmt->kind) {
+    case NodeKind::Pass: return true;
+    case NodeKind::Expr: return is_pure(cast<Expr>(stmt)->value, scope);
+    case NodeKind::Return: {
+        Return* ret = cast<Return>(stmt);
+        return !ret->value.has_value() || is_pure(ret->value.value(), scope);
+    }
+    case NodeKind::Assign: {
+        Assign* assign = cast<Assign>(stmt);
+        return assign->targets.size() == 1 && cast<Name>(assign->targets[0]) != nullptr &&
+               is_pure(assign->value, scope);
+    }
+    case NodeKind::AnnAssign: {
+        AnnAssign* assign = cast<AnnAssign>(stmt);
+        return cast<Name>(assign->target) != nullptr &&
+               (!assign->value.has_value() || is_pure(assign->value.value(), scope));
+    }
+    case NodeKind::AugAssign: {
+        AugAssign* assign = cast<AugAssign>(stmt);
+        if (is_division(assign->op) && !is_safe_divisor(assign->value)) {
+            return false;
+        }
+        return assign->native_operator != nullptr && cast<Name>(assign->target) != nullptr &&
+               is_pure(assign->value, scope);
+    }
+    case NodeKind::If: {
+        If* cond = cast<If>(stmt);
+        for (ExprNode* test: cond->tests) {
+            if (!is_pure(test, scope)) {
+                return false;
+            }
+        }
+        for (Array<StmtNode*> const& branch: cond->bodies) {
+            if (!pure_body(branch)) {
+                return false;
+            }
+        }
+        return is_pure(cond->test, scope) && pure_body(cond->body) && pure_body(cond->orelse);
+    }
+    case NodeKind::While: {
+        // break & continue are not allowed so the loop can only stop through its test
+        While* loop = cast<While>(stmt);
+        return is_pure(loop->test, scope) && pure_body(loop->body) && pure_body(loop->orelse);
+    }
+    default: return false;
+    }
+}
+
+bool ConstantFolding::is_pure(ExprNode* expr, Array<StringRef> const& scope) {
+    if (expr == nullptr) {
+        return false;
+    }
+
+    switch (expr->kind) {
+    case NodeKind::Constant: return is_scalar(cast<Constant>(expr)->value);
+    case NodeKind::Name: {
+        // Only local variables can be read, globals could change between calls
+        Name* name = cast<Name>(expr);
+        return name->ctx == ExprContext::Load && contains(scope, name->id);
+    }
+    case NodeKind::BinOp: {
+        BinOp* binop = cast<BinOp>(expr);
+
+        // the divisor of a pure function depends on its arguments, it could be zero
+        if (is_division(binop->op) && !is_safe_divisor(binop->right)) {
+            return false;
+        }
+        return binop->native_operator != nullptr && is_pure(binop->left, scope) &&
+               is_pure(binop->right, scope);
+    }
+    case NodeKind::UnaryOp: {
+        UnaryOp* unary = cast<UnaryOp>(expr);
+        return unary->native_operator != nullptr && is_pure(unary->operand, scope);
+    }
+    case NodeKind::BoolOp: {
+        BoolOp* boolop = cast<BoolOp>(expr);
+        if (boolop->native_operator == nullptr) {
+            return false;
+        }
+        for (ExprNode* value: boolop->values) {
+            if (!is_pure(value, scope)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case NodeKind::Compare: {
+        Compare* compare = cast<Compare>(expr);
+        if (compare->native_operator.size() != compare->comparators.size()) {
+            return false;
+        }
+        for (int i = 0; i < compare->comparators.size(); i++) {
+            if (compare->native_operator[i] == nullptr ||
+                !is_pure(compare->comparators[i], scope)) {
+                return false;
+            }
+        }
+        return is_pure(compare->left, scope);
+    }
+    case NodeKind::IfExp: {
+        IfExp* ifexp = cast<IfExp>(expr);
+        return is_pure(ifexp->test, scope) && is_pure(ifexp->body, scope) &&
+               is_pure(ifexp->orelse, scope);
+    }
+    case NodeKind::Call: {
+        Call* call = cast<Call>(expr);
+        if (resolve_call(call, scope) == nullptr) {
+            return false;
+        }
+        for (ExprNode* arg: call->args) {
+            if (!is_pure(arg, scope)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    default: return false;
+    }
+}
+
+}  // namespace lython
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "ast/nodes.h"
+#include "dtypes.h"
+
+namespace lython {
+
+/*
+ * Replace pure expressions by their value, the value is computed at compile time
+ * by the TreeEvaluator. Runs after the semantic analysis which resolves the native operators.
+ *
+ * .. code-block:: python
+ *
+ *    def square(x: f64) -> f64:
+ *        return x * x
+ *
+ *    a = 2 * 3 + 1             # => a = 7
+ *    b = square(2.0) + 1.0     # => b = 5.0
+ *
+ * Only expressions made of constants, native operators and calls to pure functions
+ * with constant arguments are folded. A function is pure if it only reads its
+ * arguments and local variables, and only calls other pure functions.
+ *
+ * Every evaluation is given a budget of executed nodes, folding is abandoned
+ * when it runs out, so a function that never terminates does not hang the compiler.
+ */
+struct ConstantFolding {
+    // Maximum number of nodes executed to fold a single expression
+    int budget = 4096;
+
+    // Statistics
+    int folded    = 0;
+    int abandoned = 0;
+
+    void module(Module* mod);
+
+    private:
+    void body(Array<StmtNode*>& stmts);
+    void stmt(StmtNode* n);
+    void fold(ExprNode*& expr, GCObject* parent);
+
+    bool foldable(ExprNode* expr);
+    bool evaluate(ExprNode* expr, Value& result);
+
+    // Purity analysis
+    FunctionDef* resolve_call(Call* call, Array<StringRef> const& scope);
+    bool         is_pure(FunctionDef* def);
+    bool         is_pure(StmtNode* stmt, Array<StringRef> const& scope);
+    bool         is_pure(ExprNode* expr, Array<StringRef> const& scope);
+
+    Dict<StringRef, FunctionDef*> functions;  // module level functions
+    Dict<FunctionDef*, bool>      purity;     // memoized purity of the functions
+    Array<StringRef>              locals;     // local variables of the function being folded
+};
+
+}  // namespace lython
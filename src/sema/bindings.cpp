@@ -67,6 +67,11 @@ int Bindings::add(StringRef const& name, Node* value, TypeExpr* type, int type_i
     bool dynamic = !nested;
     bindings.push_back({name, value, type, type_id, size});
 
+    if (locals != nullptr && std::find(locals->begin(), locals->end(), name) == locals->end()) {
+        locals->push_back(name);
+    }
+    bound[name] += 1;
+
     if (!nested) {
         global_index += 1;
     }
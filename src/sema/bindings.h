@@ -87,6 +87,24 @@ struct Bindings {
     // so we know when we need to do a dynamic lookup of a static one
     int  global_index = 0;
     bool nested       = false;
+
+    // Distinct names bound inside the function being analysed
+    Array<StringRef>* locals = nullptr;
+
+    // Number of times each name was bound, in any scope
+    Dict<StringRef, int> bound;
+
+    // Index of a local in the frame of the function being analysed, -1 otherwise
+    int local_slot(StringRef const& name) const {
+        if (locals == nullptr) {
+            return -1;
+        }
+        auto found = std::find(locals->begin(), locals->end(), name);
+        if (found == locals->end()) {
+            return -1;
+        }
+        return int(found - locals->begin());
+    }
 };
 
 struct Scope {
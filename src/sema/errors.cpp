@@ -52,6 +52,14 @@ std::string TypeError::message() const {
     return message(_str(lhs_v), _str(lhs_t), _str(rhs_v), _str(rhs_t));
 }
 
+std::string NotCallable::message() const {
+    return fmt::format("{} is not callable", str(func));
+}
+
+std::string MissingArgument::message() const {
+    return fmt::format("Arguement {} is not set", str(name));
+}
+
 std::string NameError::message() const {
     return fmt::format("NameError: name '{}' is not defined", str(name));
 }
@@ -88,6 +96,34 @@ std::string RecursiveDefinition::message(ExprNode const* fun, ClassDef const* cl
     return "RecursiveDefinition: ";
 }
 
+void* SemaDiagnostics::allocate(std::size_t size, std::size_t align) {
+    if (current < blocks.size()) {
+        std::size_t start = (offset + align - 1) & ~(align - 1);
+
+        if (start + size <= block_size) {
+            offset = start + size;
+            return blocks[current].get() + start;
+        }
+        current += 1;
+    }
+
+    if (current == blocks.size()) {
+        blocks.emplace_back(new char[block_size]);
+    }
+
+    offset = size;
+    return blocks[current].get();
+}
+
+void SemaDiagnostics::clear() {
+    for (SemaException* diag: diagnostics) {
+        diag->~SemaException();
+    }
+    diagnostics.clear();
+    current = 0;
+    offset  = 0;
+}
+
 String get_parent(SemaException const& error) {
     if (error.stmt != nullptr) {
         return shortprint(get_parent(error.stmt));
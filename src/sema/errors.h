@@ -133,6 +133,24 @@ struct TypeError: public SemaException {
     TypeExpr* rhs_t = nullptr;
 };
 
+// TypeError: <func> is not callable
+struct NotCallable: public SemaException {
+    NotCallable(ExprNode* func): func(func) {}
+
+    std::string message() const override;
+
+    ExprNode* func = nullptr;
+};
+
+// TypeError: Arguement <name> is not set
+struct MissingArgument: public SemaException {
+    MissingArgument(StringRef name): name(name) {}
+
+    std::string message() const override;
+
+    StringRef name;
+};
+
 struct UnsupportedOperand: public SemaException {
     UnsupportedOperand(String const& str, TypeExpr* lhs_t, TypeExpr* rhs_t):
         operand(str), lhs_t(lhs_t), rhs_t(rhs_t) {}
@@ -180,6 +198,51 @@ struct ImportError: public SemaException {
     StringRef name;
 };
 
+// Diagnostics are recorded in a per-analysis arena, they keep the nodes
+// and arguments that caused them and only format a message when it is requested.
+// This keeps sema fast on error dense inputs (fuzzing, linting)
+// where the caller is only interested in the number of errors or the first one
+class SemaDiagnostics {
+    public:
+    static constexpr std::size_t block_size = 4096;
+
+    SemaDiagnostics() { diagnostics.reserve(64); }
+
+    SemaDiagnostics(SemaDiagnostics const&)            = delete;
+    SemaDiagnostics& operator=(SemaDiagnostics const&) = delete;
+
+    ~SemaDiagnostics() { clear(); }
+
+    template <typename T, typename... Args>
+    T* emplace(Args&&... args) {
+        static_assert(sizeof(T) <= block_size, "Diagnostic does not fit inside a block");
+
+        void* memory = allocate(sizeof(T), alignof(T));
+        T*    diag   = new (memory) T(std::forward<Args>(args)...);
+        diagnostics.push_back(diag);
+        return diag;
+    }
+
+    // Destroy the diagnostics, the arena is kept so it can be reused
+    void clear();
+
+    std::size_t size() const { return diagnostics.size(); }
+    bool        empty() const { return diagnostics.empty(); }
+
+    SemaException* operator[](std::size_t i) const { return diagnostics[i]; }
+
+    auto begin() const { return diagnostics.begin(); }
+    auto end() const { return diagnostics.end(); }
+
+    private:
+    void* allocate(std::size_t size, std::size_t align);
+
+    Array<std::unique_ptr<char[]>> blocks;
+    std::size_t                    current = 0;
+    std::size_t                    offset  = 0;
+    Array<SemaException*>          diagnostics;
+};
+
 struct SemaErrorPrinter: public BaseErrorPrinter {
     SemaErrorPrinter(std::ostream& out, class AbstractLexer* lexer = nullptr):
         BaseErrorPrinter(out, lexer)  //
@@ -7,6 +7,7 @@
 #include <cstdlib>
 
 #include <filesystem>
+#include <fstream>
 #include "utilities/printing.h"
 
 #include "lexer/buffer.h"
@@ -167,69 +168,142 @@ String ImportLib::lookup_module(StringRef const& module_path, Array<String> cons
     return "";
 }
 
-ImportLib::ImportedLib* ImportLib::importfile(StringRef const& modulepath) {
+static String read_source(String const& filepath) {
+    std::ifstream file(filepath.c_str(), std::ios::binary);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return String(ss.str().c_str());
+}
+
+ImportLib::ImportedLib* ImportLib::importfile(StringRef const& modulepath, bool analyse) {
 
     ImportedLib& importedlib = imported[modulepath];
 
     if (importedlib.mod == nullptr) {
-        Module* mod = internal_importfile(modulepath, syspaths);
-
-        if (mod != nullptr) {
-            // Check ownership of Module
-            // we could make the import statement the owner
-            // but it could be imported multiple times
-            // in that case we would like to avoid doing SEMA
-            // and reuse the same version
-            // we could also import modules using multiple threads
-            // so we will need a place to manage all those modules
-            // sounds like shared_ptr might the easiest
-            // mod->move(n);
-
-            // TODO: this needs to be kept somewhere
-            // TODO: this module also has init that will need to be called
+        String filepath = lookup_module(modulepath, syspaths);
+        if (filepath.empty()) {
+            kwwarn(outlog(), "Could not load file {}", modulepath);
+            return nullptr;
+        }
 
+        String  source = read_source(filepath);
+        Module* mod    = internal_importfile(filepath, source);
+
+        // Check ownership of Module
+        // we could make the import statement the owner
+        // but it could be imported multiple times
+        // in that case we would like to avoid doing SEMA
+        // and reuse the same version
+        // we could also import modules using multiple threads
+        // so we will need a place to manage all those modules
+        // sounds like shared_ptr might the easiest
+        // mod->move(n);
+
+        // TODO: this needs to be kept somewhere
+        // TODO: this module also has init that will need to be called
+
+        // set the module first so circular imports do not recurse forever
+        importedlib.mod = mod;
+
+        // the key depends on the imports, they need to be resolved first
+        uint64                        source_hash = SemaCache::hash_source(source);
+        Array<SemaCacheEntry::Import> imports     = import_keys(mod);
+        importedlib.key = SemaCache::module_key(source_hash, imports);
+
+        if (restore_cached(importedlib, filepath, source_hash)) {
+            kwdebug(outlog(), "Restored {} from cache", modulepath);
+        } else {
             // Run sema on this module
-            SemanticAnalyser* sema = new SemanticAnalyser(this);
-            sema->exec(mod, 0);
+            run_sema(importedlib);
+
+            if (!importedlib.sema->has_errors()) {
+                SemaCacheEntry entry;
+                entry.key         = importedlib.key;
+                entry.source_hash = source_hash;
+                entry.imports     = imports;
 
-            //
-            if (sema->has_errors()) {
-                // FIXME
+                if (SemaCache::extract(mod, importedlib.sema->bindings, entry)) {
+                    cache.save(filepath, entry);
+                }
             }
-            //
+        }
+    }
 
-            Dict<StringRef, ImportedLib>::iterator elem;
-            bool ok = false;
+    if (analyse && importedlib.sema == nullptr) {
+        run_sema(importedlib);
+    }
 
-            importedlib.mod = mod;
-            importedlib.sema = sema;
+    return &importedlib;
+}
+
+Array<SemaCacheEntry::Import> ImportLib::import_keys(Module* mod) {
+    Array<SemaCacheEntry::Import> keys;
 
-            return &importedlib;
-            // std::tie(elem, ok) = imported.insert({modulepath, ImportedLib{mod, sema}});
-            // if (ok) {
-            //     ImportedLib* val = &elem->second;
-            //     return val;
-            // }
-            // kwwarn("Could not insert imported module to system");
+    auto add_key = [&](StringRef const& name) {
+        ImportedLib* dep = importfile(name);
+        keys.push_back({str(name), dep != nullptr ? dep->key : 0});
+    };
+
+    for (StmtNode* stmt: mod->body) {
+        if (Import* import = cast<Import>(stmt)) {
+            for (Alias const& alias: import->names) {
+                add_key(alias.name);
+            }
         }
+        if (ImportFrom* import = cast<ImportFrom>(stmt)) {
+            if (import->module.has_value() && !import->level.has_value()) {
+                add_key(import->module.value());
+            }
+        }
+    }
 
-        kwwarn(outlog(), "Could not load file {}", modulepath);
-        return nullptr;;
+    return keys;
+}
+
+bool ImportLib::restore_cached(ImportedLib& lib, String const& filepath, uint64 source_hash) {
+    SemaCacheEntry entry;
+
+    if (!cache.load(filepath, entry)) {
+        return false;
     }
 
-    return &importedlib;
+    if (entry.key != lib.key || entry.source_hash != source_hash) {
+        return false;
+    }
+
+    // restore leaves the module untouched when it fails, sema runs on the parsed module
+    UniquePtr<Bindings> bindings = std::make_unique<Bindings>();
+
+    if (!SemaCache::restore(lib.mod, entry, *bindings)) {
+        return false;
+    }
+
+    lib.cached   = true;
+    lib.bindings = bindings.get();
+    cached_bindings.push_back(std::move(bindings));
+    return true;
 }
 
-Module* ImportLib::internal_importfile(StringRef const& modulepath, Array<String> const& paths) {
-    String filepath = lookup_module(modulepath, paths);
-    if (filepath.empty()) {
-        return nullptr;
+void ImportLib::run_sema(ImportedLib& lib) {
+    SemanticAnalyser* sema = new SemanticAnalyser(this);
+
+    // types restored from the cache must not short-circuit the analysis
+    sema->eager = lib.cached;
+    sema->exec(lib.mod, 0);
+
+    if (sema->has_errors()) {
+        // FIXME
     }
 
-    FileBuffer buffer(filepath);
-    Lexer      lexer(buffer);
-    Parser     parser(lexer);
-    Module*    mod = parser.parse_module();
+    lib.sema     = sema;
+    lib.bindings = &sema->bindings;
+}
+
+Module* ImportLib::internal_importfile(String const& filepath, String const& source) {
+    StringBuffer buffer(source, filepath);
+    Lexer        lexer(buffer);
+    Parser       parser(lexer);
+    Module*      mod = parser.parse_module();
     return mod;
 }
 
@@ -250,7 +324,7 @@ bool ImportLib::add_module(String const& name, Module* module)
     sema->exec(module, 0);
 
     bool ok = false;
-    std::tie(std::ignore, ok) = imported.insert({name, ImportedLib{module, sema}});
+    std::tie(std::ignore, ok) = imported.insert({name, ImportedLib{module, sema, &sema->bindings}});
 
     if (ok) {
         return true;
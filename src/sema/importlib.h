@@ -4,6 +4,7 @@
 #include "dtypes.h"
 #include "ast/nodes.h"
 #include "utilities/names.h"
+#include "sema/sema_cache.h"
 
 namespace lython {
 
@@ -24,9 +25,20 @@ public:
     struct ImportedLib {
         Module* mod = nullptr;
         struct SemanticAnalyser* sema = nullptr;
+
+        // Exported bindings, owned by sema or restored from the cache
+        Bindings* bindings = nullptr;
+
+        // hash of the source and the keys of its imports
+        uint64 key = 0;
+
+        // the nodes were annotated with the cached results
+        bool cached = false;
     };
 
-    ImportedLib* importfile(StringRef const& modulepath);
+    // Sema results are restored from the cache when possible,
+    // `analyse` forces sema to run on the module (i.e it is going to be executed)
+    ImportedLib* importfile(StringRef const& modulepath, bool analyse = false);
 
     static ImportLib* instance();
 
@@ -39,17 +51,28 @@ public:
 
     Module* newmodule(String const& name);
 
+    SemaCache cache;
+
 private:
 
     String lookup_module(StringRef const& module_path, Array<String> const& paths);
 
-    Module* internal_importfile(StringRef const& modulepath, Array<String> const& paths);
+    Module* internal_importfile(String const& filepath, String const& source);
 
-    Dict<StringRef, ImportedLib> imported;
+    Array<SemaCacheEntry::Import> import_keys(Module* mod);
+
+    bool restore_cached(ImportedLib& lib, String const& filepath, uint64 source_hash);
+
+    void run_sema(ImportedLib& lib);
+
+    // importfile hands out pointers to the entries while imports recurse
+    StableDict<StringRef, ImportedLib> imported;
 
     Array<String> syspaths = python_paths();
 
     Array<UniquePtr<Module>> modules;
+
+    Array<UniquePtr<Bindings>> cached_bindings;
 };
 
 }
\ No newline at end of file
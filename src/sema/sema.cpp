@@ -2,6 +2,7 @@
 #include "builtin/operators.h"
 #include "dependencies/fmt.h"
 #include "parser/format_spec.h"
+#include "stdlib/smalldict.h"
 #include "utilities/guard.h"
 #include "utilities/helpers.h"
 #include "utilities/printing.h"
@@ -29,6 +30,7 @@ bool SemanticAnalyser::add_name(ExprNode* expr, ExprNode* value, ExprNode* type)
         name->ctx      = ExprContext::Store;
         name->type     = type;
         add_name(name->id, value, type);
+        name->slot     = bindings.local_slot(name->id);
         return true;
     }
 
@@ -245,6 +247,14 @@ TypeExpr* SemanticAnalyser::compare(Compare* n, int depth) {
         auto* cmp   = n->comparators[i];
         auto* cmp_t = exec(cmp, depth);
 
+        // Membership in a list is handled by the list itself
+        if ((op == CmpOperator::In || op == CmpOperator::NotIn) && cast<ArrayType>(cmp_t)) {
+            n->native_operator.push_back(nullptr);
+            prev   = cmp;
+            prev_t = cmp_t;
+            continue;
+        }
+
         // Check if we have a native function to handle this
         String signature = join(String("-"), Array<String>{str(op), str(prev_t), str(cmp_t)});
 
@@ -477,6 +487,7 @@ BindingEntry const* SemanticAnalyser::lookup(Name_t* n) {
         // n->ctx = ExprContext::Load;
         n->store_id = found->store_id;
         n->load_id  = len(bindings.bindings);
+        n->slot     = bindings.local_slot(n->id);
 
 
 #if KW_SANITY_CHECK
@@ -787,6 +798,10 @@ TypeExpr* SemanticAnalyser::call(Call* n, int depth) {
             if (FunctionDef* def = cast<FunctionDef>(entry->value)){
                 is_call_valid = reorder_arguments(n, def);
             }
+            Node* callee = entry->value;
+            if (callee != nullptr && in(callee->kind, NodeKind::FunctionDef, NodeKind::ClassDef)) {
+                static_calls.push_back({n, callee});
+            }
         }
     }
 
@@ -795,7 +810,7 @@ TypeExpr* SemanticAnalyser::call(Call* n, int depth) {
     auto*     arrow  = get_arrow(n->func, type, depth, offset, cls);
 
     if (arrow == nullptr) {
-        SEMA_ERROR(n, TypeError, fmt::format("{} is not callable", str(n->func)));
+        SEMA_ERROR(n, NotCallable, n->func);
     }
 
     // Sort kwargs to make them positional
@@ -824,27 +839,27 @@ TypeExpr* SemanticAnalyser::call(Call* n, int depth) {
         got->add_arg_type(exec(arg, depth));
     }
 
-    Dict<StringRef, ExprNode*> kwargs;
+    SmallDict<StringRef, ExprNode*, 8, StdHash<StringRef>> kwargs;
     for (auto& kw: n->keywords) {
-        kwargs[kw.arg] = exec(kw.value, depth);
+        kwargs.upsert(kw.arg, exec(kw.value, depth));
     }
 
     if (arrow != nullptr) {
         for (int i = int(got->arg_count()); i < arrow->names.size(); i++) {
             auto name = arrow->names[i];
 
-            auto item = kwargs.find(name);
-            if (item == kwargs.end()) {
+            ExprNode* kwvalue = nullptr;
+            if (!kwargs.get(name, kwvalue)) {
                 auto value = got->defaults[name];
                 if (value) {
-                    SEMA_ERROR(n, TypeError, fmt::format("Arguement {} is not set", name));
+                    SEMA_ERROR(n, MissingArgument, name);
                 }
                 // Got default use the expected type
                 got->add_arg_type(arrow->args[i]);
                 continue;
             }
 
-            got->add_arg_type(item->second);
+            got->add_arg_type(kwvalue);
         }
     }
 
@@ -964,7 +979,7 @@ TypeExpr* SemanticAnalyser::formattedvalue(FormattedValue* n, int depth) {
 
 TypeExpr* SemanticAnalyser::placeholder(Placeholder* n, int depth) { return nullptr; }
 TypeExpr* SemanticAnalyser::constant(Constant* n, int depth) {
-    switch (meta::ValueTypes(n->value.tag)) {
+    switch (meta::ValueTypes(n->value.type_id())) {
     case meta::ValueTypes::i8: return make_ref(n, "i8", Type_t());
     case meta::ValueTypes::i16: return make_ref(n, "i16", Type_t());
     case meta::ValueTypes::i32: return make_ref(n, "i32", Type_t());
@@ -984,7 +999,7 @@ TypeExpr* SemanticAnalyser::constant(Constant* n, int depth) {
     }
 
     static int strid = meta::type_id<String>();
-    if (n->value.tag == strid) {
+    if (n->value.type_id() == strid) {
         return make_ref(n, "str", Type_t());
     }
 
@@ -1076,9 +1091,39 @@ TypeExpr* SemanticAnalyser::attribute_assign(Attribute* n, int depth, TypeExpr*
     return nullptr;
 }
 
+// Type id of a builtin scalar type, -1 for everything else
+static int scalar_type_id(TypeExpr* type) {
+    Name* name = cast<Name>(type);
+    if (name == nullptr) {
+        return -1;
+    }
+#define SCALAR(_, scalar)                     \
+    if (name->id == StringRef(#scalar)) {     \
+        return int(meta::ValueTypes::scalar); \
+    }
+    SCALAR(_, i8)
+    SCALAR(_, i16)
+    SCALAR(_, i32)
+    SCALAR(_, i64)
+    SCALAR(_, u8)
+    SCALAR(_, u16)
+    SCALAR(_, u32)
+    SCALAR(_, f32)
+    SCALAR(_, f64)
+#undef SCALAR
+    return -1;
+}
+
 TypeExpr* SemanticAnalyser::subscript(Subscript* n, int depth) {
     auto* class_t = exec(n->value, depth);
     exec(n->slice, depth);
+
+    // Lists return their element type, unboxed lists narrow the element back to it
+    if (ArrayType* array = cast<ArrayType>(class_t)) {
+        n->elt_type = scalar_type_id(array->value);
+        return array->value;
+    }
+
     // check that __getitem__ is defined in class_t
     return nullptr;
 }
@@ -1148,12 +1193,44 @@ TypeExpr* SemanticAnalyser::name(Name* n, int depth) {
 
 TypeExpr* SemanticAnalyser::comment(Comment* n, int depth) { return nullptr; }
 
+// Lists of scalars are stored unboxed, integers that fit are widened to int64
+// unknown types are boxed
+static ArrayStorage array_storage(TypeExpr* val_t) {
+    static StringRef integers[] = {
+        StringRef("i8"), StringRef("i16"), StringRef("i32"), StringRef("i64"),
+        StringRef("u8"), StringRef("u16"), StringRef("u32"),
+    };
+    static StringRef floats[] = {StringRef("f32"), StringRef("f64")};
+
+    Name* name = cast<Name>(val_t);
+    if (name == nullptr) {
+        return ArrayStorage::Boxed;
+    }
+    for (StringRef const& type: integers) {
+        if (name->id == type) {
+            return ArrayStorage::Int64;
+        }
+    }
+    for (StringRef const& type: floats) {
+        if (name->id == type) {
+            return ArrayStorage::Float64;
+        }
+    }
+    return ArrayStorage::Boxed;
+}
+
 TypeExpr* SemanticAnalyser::listexpr(ListExpr* n, int depth) {
-    TypeExpr* val_t = nullptr;
+    TypeExpr*    val_t   = nullptr;
+    ArrayStorage storage = ArrayStorage::Boxed;
 
     for (int i = 0; i < n->elts.size(); i++) {
         auto* val_type = exec(n->elts[i], depth);
 
+        // unboxed only when every element is a scalar of the same family,
+        // the elements are not converted when their types do not match
+        ArrayStorage elt_storage = array_storage(val_type);
+        storage = i == 0 || storage == elt_storage ? elt_storage : ArrayStorage::Boxed;
+
         if (val_type == nullptr) {
             // FIXME Could not find tyep for n->elts[i]
         } else if (val_t == nullptr && is_type(val_type, depth, LOC)) {
@@ -1163,6 +1240,8 @@ TypeExpr* SemanticAnalyser::listexpr(ListExpr* n, int depth) {
         }
     }
 
+    n->storage = storage;
+
     ArrayType* type = n->new_object<ArrayType>();
     type->value     = val_t;
     return type;
@@ -1344,6 +1423,11 @@ TypeExpr* SemanticAnalyser::functiondef(FunctionDef* n, int depth) {
     // Enter function context
     Scope scope(bindings);
 
+    // Collect the locals to size the frame of the function
+    Array<StringRef>  locals;
+    Array<StringRef>* enclosing = bindings.locals;
+    bindings.locals             = &locals;
+
     // Create the function type from the arguments
     // this will also add the arguments to the context
     Arrow*    fun_type = functiondef_arrow(n, lst, depth);
@@ -1372,8 +1456,11 @@ TypeExpr* SemanticAnalyser::functiondef(FunctionDef* n, int depth) {
         // TODO check the signature here
     }
 
-    n->type      = fun_type;
-    n->generator = get_context().yield;
+    bindings.locals = enclosing;
+
+    n->type       = fun_type;
+    n->generator  = get_context().yield;
+    n->frame_size = int(locals.size());
     return fun_type;
 }
 
@@ -1766,6 +1853,7 @@ TypeExpr* SemanticAnalyser::ifstmt(If* n, int depth) {
         exec<TypeExpr*>(n->bodies[i], depth);
     }
 
+    exec<TypeExpr*>(n->orelse, depth);
     return oneof(types);
 }
 TypeExpr* SemanticAnalyser::with(With* n, int depth) {
@@ -1965,6 +2053,13 @@ TypeExpr* SemanticAnalyser::module(Module* stmt, int depth) {
     }
     stmt->__init__ = entry;
 
+    // A name bound once always refers to its definition,
+    // the evaluator can call it without loading the name
+    for (auto& [call, callee]: static_calls) {
+        bool unique = bindings.bound[cast<Name>(call->func)->id] == 1;
+        call->callee = unique ? callee : nullptr;
+    }
+
     return nullptr;
 };
 
@@ -1978,7 +2073,7 @@ void SemanticAnalyser::show_diagnostic(std::ostream& out, class AbstractLexer* l
 
     for (auto& diag: errors) {
         std::cout << "  ";
-        printer.print(*diag.get());
+        printer.print(*diag);
         std::cout << "\n";
     }
 }
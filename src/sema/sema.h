@@ -97,7 +97,7 @@ struct SemaContext {
 struct SemanticAnalyser: public BaseVisitor<SemanticAnalyser, false, SemaVisitorTrait> {
     Bindings bindings;  // This should be outside of sema so it can live on after sema
     bool     forwardpass = false;
-    Array<std::unique_ptr<SemaException>> errors;
+    SemaDiagnostics                       errors;
     Array<StmtNode*>                      nested;
     Array<String>                         namespaces;
     Dict<StringRef, bool>                 flags;
@@ -116,6 +116,9 @@ struct SemanticAnalyser: public BaseVisitor<SemanticAnalyser, false, SemaVisitor
     // maybe conbine the semacontext with samespace
     Array<SemaContext> semactx;
 
+    // Calls to a function or class by name, resolved once the whole module is analysed
+    Array<std::pair<Call*, Node*>> static_calls;
+
     bool has_errors() const;
 
     BindingEntry const* lookup(Name_t* n);
@@ -145,14 +148,16 @@ struct SemanticAnalyser: public BaseVisitor<SemanticAnalyser, false, SemaVisitor
 
     template <typename T, typename... Args>
     void sema_error(Node* node, lython::CodeLocation const& loc, Args... args) {
-        errors.push_back(std::unique_ptr<SemaException>(new T(args...)));
-        SemaException* exception = errors[errors.size() - 1].get();
+        SemaException* exception = errors.emplace<T>(args...);
 
         // Populate location info
         exception->set_node(node);
 
+        // the message is generated on demand, only pay for it if someone is listening
         // use the LOC from parent function
-        lython::outlog().log(lython::LogLevel::Error, loc, "{}", exception->what());
+        if (lython::outlog().is_enabled(lython::LogLevel::Error)) {
+            lython::outlog().log(lython::LogLevel::Error, loc, "{}", exception->what());
+        }
     }
 
 #define SEMA_ERROR(expr, exception, ...) sema_error<exception>(expr, LOC, __VA_ARGS__)
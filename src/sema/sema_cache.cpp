@@ -0,0 +1,564 @@
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include "sema/sema_cache.h"
+#include "sema/importlib.h"
+#include "utilities/printing.h"
+#include "utilities/strings.h"
+
+namespace lython {
+
+//
+// Type Encoding
+// -------------
+//
+//  _                   nullptr
+//  B <name>            BuiltinType
+//  N <id>              Name
+//  C <name>            ClassType, the class must be defined by the module
+//  A <n> <args> <ret>  Arrow
+//  L <value>           ArrayType
+//  S <value>           SetType
+//  D <key> <value>     DictType
+//  T <n> <types>       TupleType
+//
+static bool encode_type(Module* mod, TypeExpr* type, std::ostream& out) {
+    if (type == nullptr) {
+        out << " _";
+        return true;
+    }
+
+    switch (type->kind) {
+    case NodeKind::BuiltinType: {
+        out << " B " << cast<BuiltinType>(type)->name;
+        return true;
+    }
+    case NodeKind::Name: {
+        out << " N " << cast<Name>(type)->id;
+        return true;
+    }
+    case NodeKind::ClassType: {
+        ClassType* cls = cast<ClassType>(type);
+
+        // classes are looked up by name in the module when decoding,
+        // a class imported from another module cannot be resolved
+        if (cls->def == nullptr || find(mod->body, cls->def->name) != cls->def) {
+            return false;
+        }
+        out << " C " << cls->def->name;
+        return true;
+    }
+    case NodeKind::Arrow: {
+        Arrow* arrow = cast<Arrow>(type);
+        out << " A " << arrow->args.size();
+
+        for (ExprNode* arg: arrow->args) {
+            if (!encode_type(mod, arg, out)) {
+                return false;
+            }
+        }
+        return encode_type(mod, arrow->returns, out);
+    }
+    case NodeKind::ArrayType: {
+        out << " L";
+        return encode_type(mod, cast<ArrayType>(type)->value, out);
+    }
+    case NodeKind::SetType: {
+        out << " S";
+        return encode_type(mod, cast<SetType>(type)->value, out);
+    }
+    case NodeKind::DictType: {
+        DictType* dict = cast<DictType>(type);
+        out << " D";
+        return encode_type(mod, dict->key, out) && encode_type(mod, dict->value, out);
+    }
+    case NodeKind::TupleType: {
+        TupleType* tuple = cast<TupleType>(type);
+        out << " T " << tuple->types.size();
+
+        for (ExprNode* elt: tuple->types) {
+            if (!encode_type(mod, elt, out)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    default: return false;
+    }
+}
+
+String encode_type(Module* mod, TypeExpr* type) {
+    StringStream ss;
+    if (!encode_type(mod, type, ss)) {
+        return String();
+    }
+    return strip(ss.str());
+}
+
+struct TypeDecoder {
+    Module*              mod;
+    Array<String> const& tokens;
+    Array<GCObject*>&    allocated;  // nodes created by the decoding
+    std::size_t          i  = 0;
+    bool                 ok = true;
+
+    template <typename T>
+    T* make() {
+        T* node = mod->new_object<T>();
+        allocated.push_back(node);
+        return node;
+    }
+
+    String const& next() {
+        static String empty;
+        if (i >= tokens.size()) {
+            ok = false;
+            return empty;
+        }
+        return tokens[i++];
+    }
+
+    int count() {
+        String const& tok = next();
+        if (!ok) {
+            return 0;
+        }
+        return std::atoi(tok.c_str());
+    }
+
+    TypeExpr* builtin(String const& name) {
+#define TYPE(type, _)      \
+    if (name == #type) {   \
+        return type##_t(); \
+    }
+
+        BUILTIN_TYPES(TYPE)
+
+#undef TYPE
+        ok = false;
+        return nullptr;
+    }
+
+    TypeExpr* decode() {
+        String const& tag = next();
+
+        if (!ok || tag == "_") {
+            return nullptr;
+        }
+
+        if (tag == "B") {
+            return builtin(next());
+        }
+        if (tag == "N") {
+            Name* name = make<Name>();
+            name->id   = StringRef(next());
+            name->ctx  = ExprContext::Load;
+            name->type = Type_t();
+            return name;
+        }
+        if (tag == "C") {
+            ClassType* cls = make<ClassType>();
+            cls->def       = cast<ClassDef>(find(mod->body, StringRef(next())));
+            ok             = ok && cls->def != nullptr;
+            return cls;
+        }
+        if (tag == "A") {
+            Arrow* arrow = make<Arrow>();
+            int    n     = count();
+
+            for (int k = 0; k < n && ok; k++) {
+                arrow->args.push_back(decode());
+            }
+            arrow->returns = decode();
+            return arrow;
+        }
+        if (tag == "L") {
+            ArrayType* array = make<ArrayType>();
+            array->value     = decode();
+            return array;
+        }
+        if (tag == "S") {
+            SetType* set = make<SetType>();
+            set->value   = decode();
+            return set;
+        }
+        if (tag == "D") {
+            DictType* dict = make<DictType>();
+            dict->key      = decode();
+            dict->value    = decode();
+            return dict;
+        }
+        if (tag == "T") {
+            TupleType* tuple = make<TupleType>();
+            int        n     = count();
+
+            for (int k = 0; k < n && ok; k++) {
+                tuple->types.push_back(decode());
+            }
+            return tuple;
+        }
+
+        ok = false;
+        return nullptr;
+    }
+};
+
+static bool
+decode_type(Module* mod, String const& encoded, TypeExpr*& type, Array<GCObject*>& allocated) {
+    Array<String> tokens = split(' ', encoded);
+    TypeDecoder   decoder{mod, tokens, allocated};
+
+    type = decoder.decode();
+    return decoder.ok && decoder.i == tokens.size();
+}
+
+static void discard(Array<GCObject*>& allocated) {
+    for (GCObject* node: allocated) {
+        GCObject::free(node);
+    }
+    allocated.clear();
+}
+
+TypeExpr* decode_type(Module* mod, String const& encoded) {
+    Array<GCObject*> allocated;
+    TypeExpr*        type = nullptr;
+
+    if (!decode_type(mod, encoded, type, allocated)) {
+        discard(allocated);
+        return nullptr;
+    }
+    return type;
+}
+
+//
+// Cache
+// -----
+//
+uint64 SemaCache::hash_source(String const& source) {
+    return uint64(xx_hash_3(source.data(), source.size()));
+}
+
+uint64 SemaCache::module_key(uint64 source_hash, Array<SemaCacheEntry::Import> const& imports) {
+    StringStream ss;
+    ss << std::hex << source_hash;
+
+    for (SemaCacheEntry::Import const& import: imports) {
+        ss << ';' << import.module << ':' << import.key;
+    }
+
+    String data = ss.str();
+    return uint64(xx_hash_3(data.data(), data.size()));
+}
+
+String SemaCache::cache_path(String const& filepath) {
+    namespace fs = std::filesystem;
+
+    fs::path path(filepath.c_str());
+    fs::path cache = path.parent_path() / "__lycache__" / path.stem();
+    cache += ".lysema";
+
+    return String(cache.string().c_str());
+}
+
+bool SemaCache::load(String const& filepath, SemaCacheEntry& entry) const {
+    if (!enabled) {
+        return false;
+    }
+
+    std::ifstream file(cache_path(filepath).c_str());
+    if (!file.good()) {
+        return false;
+    }
+
+    std::string line;
+    std::getline(file, line);
+    if (line != "lysema 2") {
+        return false;
+    }
+
+    // a truncated file is missing entries or its end line
+    bool ended = false;
+
+    while (std::getline(file, line)) {
+        std::istringstream ss(line);
+        std::string        tag;
+        ss >> tag;
+
+        if (ended) {
+            return false;
+        }
+
+        if (tag == "end") {
+            std::size_t imports = 0, bindings = 0, attributes = 0;
+            ss >> imports >> bindings >> attributes;
+
+            ended = imports == entry.imports.size() && bindings == entry.bindings.size() &&
+                    attributes == entry.attributes.size();
+            if (!ended) {
+                kwdebug(outlog(), "Cache entry is incomplete");
+                return false;
+            }
+        } else if (tag == "key") {
+            ss >> std::hex >> entry.key;
+        } else if (tag == "source") {
+            ss >> std::hex >> entry.source_hash;
+        } else if (tag == "import") {
+            std::string module;
+            uint64      key = 0;
+            ss >> module >> std::hex >> key;
+            entry.imports.push_back({String(module.c_str()), key});
+        } else if (tag == "bind") {
+            std::string name, type;
+            ss >> name;
+            std::getline(ss, type);
+            entry.bindings.push_back({String(name.c_str()), strip(String(type.c_str()))});
+        } else if (tag == "attr") {
+            std::string cls, name, type;
+            ss >> cls >> name;
+            std::getline(ss, type);
+            entry.attributes.push_back(
+                {String(cls.c_str()), String(name.c_str()), strip(String(type.c_str()))});
+        } else {
+            kwdebug(outlog(), "Unknown cache entry {}", line);
+            return false;
+        }
+
+        if (ss.fail()) {
+            return false;
+        }
+    }
+
+    return ended;
+}
+
+bool SemaCache::save(String const& filepath, SemaCacheEntry const& entry) const {
+    namespace fs = std::filesystem;
+
+    if (!enabled) {
+        return false;
+    }
+
+    String          path = cache_path(filepath);
+    std::error_code err;
+    fs::create_directories(fs::path(path.c_str()).parent_path(), err);
+
+    if (err) {
+        kwdebug(outlog(), "Could not create cache folder for {}: {}", path, err.message());
+        return false;
+    }
+
+    // written next to the entry and renamed over it,
+    // a concurrent load never sees a partially written entry
+    String tmp = path + String(fmt::format(".{:x}.tmp", std::random_device()()).c_str());
+
+    std::ofstream file(tmp.c_str());
+    if (!file.good()) {
+        return false;
+    }
+
+    file << "lysema 2\n";
+    file << "key " << std::hex << entry.key << "\n";
+    file << "source " << std::hex << entry.source_hash << "\n";
+
+    for (SemaCacheEntry::Import const& import: entry.imports) {
+        file << "import " << import.module << " " << std::hex << import.key << "\n";
+    }
+    for (SemaCacheEntry::Binding const& binding: entry.bindings) {
+        file << "bind " << binding.name << " " << binding.type << "\n";
+    }
+    for (SemaCacheEntry::Attribute const& attr: entry.attributes) {
+        file << "attr " << attr.cls << " " << attr.name << " " << attr.type << "\n";
+    }
+    file << "end " << std::dec << entry.imports.size() << " " << entry.bindings.size() << " "
+         << entry.attributes.size() << "\n";
+
+    file.close();
+    if (file.fail()) {
+        fs::remove(fs::path(tmp.c_str()), err);
+        return false;
+    }
+
+    fs::rename(fs::path(tmp.c_str()), fs::path(path.c_str()), err);
+    if (err) {
+        kwdebug(outlog(), "Could not write cache {}: {}", path, err.message());
+        fs::remove(fs::path(tmp.c_str()), err);
+        return false;
+    }
+    return true;
+}
+
+static int builtin_binding_count() {
+    static int count = int(Bindings().bindings.size());
+    return count;
+}
+
+// `node` is a statement of `body` or of the classes it defines
+static bool defines(Array<StmtNode*> const& body, Node* node) {
+    for (StmtNode* stmt: body) {
+        if (stmt == node) {
+            return true;
+        }
+
+        ClassDef* cls = cast<ClassDef>(stmt);
+        if (cls != nullptr && defines(cls->body, node)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Resolve `name` or the namespaced `Class.method`
+static StmtNode* resolve_value(Module* mod, String const& name) {
+    Array<String> frags = split('.', name);
+
+    Array<StmtNode*>* body  = &mod->body;
+    StmtNode*         value = nullptr;
+
+    for (String const& frag: frags) {
+        value = find(*body, StringRef(frag));
+
+        ClassDef* cls = cast<ClassDef>(value);
+        if (cls == nullptr) {
+            break;
+        }
+        body = &cls->body;
+    }
+
+    return value;
+}
+
+bool SemaCache::extract(Module* mod, Bindings const& bindings, SemaCacheEntry& entry) {
+    // Global bindings defined by the module
+    for (int i = builtin_binding_count(); i < bindings.bindings.size(); i++) {
+        BindingEntry const& binding = bindings.bindings[i];
+
+        // Imported modules are not part of the exported state
+        if (binding.type == Module_t()) {
+            continue;
+        }
+
+        // Names imported from another module resolve to its nodes,
+        // restore only looks up the nodes of this module
+        if (binding.value != nullptr && binding.value != mod->__init__ &&
+            !defines(mod->body, binding.value)) {
+            kwdebug(outlog(), "{} is not defined by the module", binding.name);
+            return false;
+        }
+
+        String type = encode_type(mod, binding.type);
+        if (binding.type != nullptr && type.empty()) {
+            kwdebug(outlog(), "Could not encode type of {}", binding.name);
+            return false;
+        }
+
+        entry.bindings.push_back({str(binding.name), type});
+    }
+
+    // Class attributes, this includes the methods used to resolve operators
+    for (StmtNode* stmt: mod->body) {
+        ClassDef* cls = cast<ClassDef>(stmt);
+
+        if (cls == nullptr) {
+            continue;
+        }
+
+        for (ClassDef::Attr const& attr: cls->attributes) {
+            String type = encode_type(mod, attr.type);
+
+            if (attr.type != nullptr && type.empty()) {
+                kwdebug(outlog(), "Could not encode type of {}.{}", cls->name, attr.name);
+                return false;
+            }
+
+            entry.attributes.push_back({str(cls->name), str(attr.name), type});
+        }
+    }
+
+    return true;
+}
+
+bool SemaCache::restore(Module* mod, SemaCacheEntry const& entry, Bindings& bindings) {
+    struct Binding {
+        StringRef name;
+        StmtNode* value;
+        TypeExpr* type;
+    };
+
+    struct Attribute {
+        ClassDef* cls;
+        StringRef name;
+        StmtNode* stmt;
+        TypeExpr* type;
+    };
+
+    // Decode the whole entry before touching the module,
+    // if the entry does not match the module is left as the parser produced it
+    Array<GCObject*> allocated;
+    Array<Binding>   decoded_bindings;
+    Array<Attribute> decoded_attributes;
+
+    // functions are typed by an arrow
+    auto type_matches = [](StmtNode* stmt, TypeExpr* type) {
+        return cast<FunctionDef>(stmt) == nullptr || type == nullptr || cast<Arrow>(type) != nullptr;
+    };
+
+    for (SemaCacheEntry::Binding const& binding: entry.bindings) {
+        TypeExpr* type = nullptr;
+
+        if (!decode_type(mod, binding.type, type, allocated)) {
+            discard(allocated);
+            return false;
+        }
+
+        StmtNode* value = resolve_value(mod, binding.name);
+
+        if (!type_matches(value, type)) {
+            discard(allocated);
+            return false;
+        }
+
+        decoded_bindings.push_back({StringRef(binding.name), value, type});
+    }
+
+    for (SemaCacheEntry::Attribute const& attr: entry.attributes) {
+        ClassDef* cls  = cast<ClassDef>(find(mod->body, StringRef(attr.cls)));
+        TypeExpr* type = nullptr;
+
+        if (cls == nullptr || !decode_type(mod, attr.type, type, allocated)) {
+            discard(allocated);
+            return false;
+        }
+
+        // attributes defined inside the constructor do not have a statement in the class body
+        StmtNode* stmt = find(cls->body, StringRef(attr.name));
+
+        if (!type_matches(stmt, type)) {
+            discard(allocated);
+            return false;
+        }
+
+        decoded_attributes.push_back({cls, StringRef(attr.name), stmt, type});
+    }
+
+    // Apply
+    for (Binding const& binding: decoded_bindings) {
+        if (FunctionDef* def = cast<FunctionDef>(binding.value)) {
+            def->type = cast<Arrow>(binding.type);
+        }
+
+        bindings.add(binding.name, binding.value, binding.type);
+    }
+
+    for (Attribute const& attr: decoded_attributes) {
+        if (FunctionDef* def = cast<FunctionDef>(attr.stmt)) {
+            def->type = cast<Arrow>(attr.type);
+        }
+
+        attr.cls->insert_attribute(attr.name, attr.stmt, attr.type);
+    }
+
+    return true;
+}
+
+}  // namespace lython
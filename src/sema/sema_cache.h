@@ -0,0 +1,80 @@
+#pragma once
+
+#include "dtypes.h"
+#include "ast/nodes.h"
+#include "sema/bindings.h"
+
+namespace lython {
+
+// What downstream modules need from an analysed module
+// The types are stored in a small prefix encoding (see encode_type)
+//
+//  lysema 2
+//  key <hex>                       <= hash(source, import keys)
+//  source <hex>                    <= hash of the source file
+//  import <module> <hex>           <= key of the import when it was cached
+//  bind <name> <type>              <= global bindings exported by the module
+//  attr <class> <name> <type>      <= class attributes & methods (operators)
+//  end <imports> <binds> <attrs>   <= number of entries, a truncated file is rejected
+//
+struct SemaCacheEntry {
+    struct Import {
+        String module;
+        uint64 key = 0;
+    };
+
+    struct Binding {
+        String name;
+        String type;
+    };
+
+    struct Attribute {
+        String cls;
+        String name;
+        String type;
+    };
+
+    uint64 key         = 0;
+    uint64 source_hash = 0;
+
+    Array<Import>    imports;
+    Array<Binding>   bindings;
+    Array<Attribute> attributes;
+};
+
+// On-disk cache of the semantic analysis results.
+// The entries are saved next to the source in a `__lycache__` folder
+// similar to python's `__pycache__`
+//
+// A module is never re-analysed if its source and the source of its imports
+// did not change, its exported bindings are restored from the cache instead
+class SemaCache {
+    public:
+    static uint64 hash_source(String const& source);
+
+    // combine the source hash with the key of each imports
+    static uint64 module_key(uint64 source_hash, Array<SemaCacheEntry::Import> const& imports);
+
+    static String cache_path(String const& filepath);
+
+    bool load(String const& filepath, SemaCacheEntry& entry) const;
+
+    bool save(String const& filepath, SemaCacheEntry const& entry) const;
+
+    // Extract the exported state of an analysed module
+    // returns false if some types could not be encoded (module is not cacheable)
+    static bool extract(Module* mod, Bindings const& bindings, SemaCacheEntry& entry);
+
+    // Restore the exported state of a module from a cache entry
+    // returns false if the entry does not match the module, the module is then left untouched
+    static bool restore(Module* mod, SemaCacheEntry const& entry, Bindings& bindings);
+
+    bool enabled = true;
+};
+
+// Returns an empty string if the type cannot be encoded
+// i.e. it refers to a class that is not defined by `mod`
+String    encode_type(Module* mod, TypeExpr* type);
+TypeExpr* decode_type(Module* mod, String const& encoded);
+
+}  // namespace lython
@@ -126,7 +126,7 @@ TypeExpr* SemanticAnalyser::importfrom(ImportFrom* n, int depth) {
             continue;
         }
 
-        Bindings& import_bindings = imported->sema->bindings;
+        Bindings* import_bindings = imported->bindings;
 
         //auto  varid = import_bindings.get_varid(nm);
         //auto* type  = import_bindings.get_type(varid);
@@ -144,12 +144,12 @@ TypeExpr* SemanticAnalyser::importfrom(ImportFrom* n, int depth) {
 
         #if 0
             Exported* e_value = n->new_object<Exported>();
-            e_value->source = &import_bindings;
+            e_value->source = import_bindings;
             e_value->dest = &bindings;
             e_value->node = value;
 
             Exported* e_type = n->new_object<Exported>();
-            e_type->source = &import_bindings;
+            e_type->source = import_bindings;
             e_type->dest = &bindings;
             e_type->node = type;
 
@@ -158,7 +158,12 @@ TypeExpr* SemanticAnalyser::importfrom(ImportFrom* n, int depth) {
             // type attached to this value might 
             // not have the right var id
             ExprNode* type = nullptr;
-            if (BindingEntry* entry = import_bindings.find(nm)) {
+            // bindings are not available yet on circular imports
+            BindingEntry* entry = nullptr;
+            if (import_bindings != nullptr) {
+                entry = import_bindings->find(nm);
+            }
+            if (entry != nullptr) {
                 type = entry->type;
             }
             bindings.add(nm, value, type);
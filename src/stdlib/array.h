@@ -5,10 +5,16 @@
 #include <algorithm>
 #include <cstddef>
 #include <iterator>
+#include <limits>
 #include <optional>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "array_kernels.h"
+#include "cow.h"
+#include "sort.h"
+
 #define KIWI_STANDALONE
 #ifdef KIWI_STANDALONE
 namespace lython {
@@ -24,6 +30,7 @@ namespace kiwi {
 struct StopIteration {};
 struct ValueError {};
 struct IndexError {};
+struct KeyError {};
 
 
 struct Slice {
@@ -54,6 +61,12 @@ struct PyIter {
 };
 
 struct error {};
+
+// int64_t and double are stored unboxed, the sema picks them
+// when the element type of a list is known (see ListExpr::storage).
+// The search methods use the SIMD kernels for them and for interned strings,
+// sort and sum use the kernels over the raw buffer.
+// Other element types are sorted with a stable TimSort (see stdlib/sort.h)
 template <typename V>  //
 struct ArrayNative {
 
@@ -72,6 +85,9 @@ struct ArrayNative {
     }
 
     bool __contains__(V const& key) const {
+        if constexpr (kernels::is_searchable<V>) {
+            return kernels::find(values.data(), values.size(), key) < values.size();
+        }
         for (auto const& v: this->values) {
             if (v == key) {
                 return true;
@@ -82,16 +98,31 @@ struct ArrayNative {
 
     int __len__() const { return this->values.size(); }
 
-    void append(V const& val) { this->values.push_back(val); }
+    void append(V const& val) {
+        this->values.push_back(val);
+        write_barrier(this, val);
+    }
 
     void extend(ArrayNative<V> const& other) {
         this->values.reserve(other.size() + this->values.size());
         for (auto const& v: other.values) {
             this->values.push_back(v);
+            write_barrier(this, v);
         }
     }
-    void insert(int i, V const& val) { this->values.insert(this->values.begin() + i, val); }
+    void insert(int i, V const& val) {
+        this->values.insert(this->values.begin() + i, val);
+        write_barrier(this, val);
+    }
     std::optional<ValueError> remove(V const& val) {
+        if constexpr (kernels::is_searchable<V>) {
+            std::size_t i = kernels::find(values.data(), values.size(), val);
+            if (i < values.size()) {
+                this->values.erase(this->values.begin() + i);
+                return {};
+            }
+            return ValueError();
+        }
         for (int i = 0; i < this->values.size(); i++) {
             if (this->values[i] == val) {
                 this->values.erase(this->values.begin() + i);
@@ -116,13 +147,26 @@ struct ArrayNative {
     }
     void clear() { this->values.clear(); }
 
-    std::variant<int, ValueError> index(V const& val, int start = 0, int end = -1) {
+    std::variant<int, ValueError> index(V const& val,
+                                        int      start = 0,
+                                        int      end   = std::numeric_limits<int>::max()) const {
         if (start < 0) {
-            start += int(this->values.size());
+            start = std::max(start + int(this->values.size()), 0);
         }
         if (end < 0) {
             end += int(this->values.size());
         }
+        end = std::min(end, int(this->values.size()));
+
+        if constexpr (kernels::is_searchable<V>) {
+            if (start < end) {
+                std::size_t i = kernels::find(values.data() + start, std::size_t(end - start), val);
+                if (i < std::size_t(end - start)) {
+                    return start + int(i);
+                }
+            }
+            return ValueError();
+        }
         for (int i = start; i < end; i++) {
             if (this->values[i] == val) {
                 return i;
@@ -131,7 +175,10 @@ struct ArrayNative {
         return ValueError();
     }
 
-    int count(V const& val) {
+    int count(V const& val) const {
+        if constexpr (kernels::is_searchable<V>) {
+            return int(kernels::count(values.data(), values.size(), val));
+        }
         int acc = 0;
         for (V const& v: this->values) {
             if (v == val) {
@@ -141,7 +188,58 @@ struct ArrayNative {
         return acc;
     }
 
-    void sort() { std::sort(this->values.begin(), this->values.end()); }
+    // list.sort(reverse=...), stable, equal elements keep their order
+    void sort(bool reverse = false) {
+        if constexpr (kernels::is_unboxed<V>) {
+            kernels::sort(values.data(), values.size(), reverse);
+        } else if (reverse) {
+            sorting::stable_sort(values.data(), values.size(), [](V const& a, V const& b) { return b < a; });
+        } else {
+            sorting::stable_sort(values.data(), values.size(), [](V const& a, V const& b) { return a < b; });
+        }
+    }
+
+    // list.sort(key=..., reverse=...), the key is computed once per element
+    template <typename Key>
+    void sort(Key key, bool reverse = false) {
+        using K         = std::decay_t<decltype(key(std::declval<V const&>()))>;
+        using Decorated = std::pair<K, std::size_t>;
+
+        std::vector<Decorated> decorated;
+        decorated.reserve(values.size());
+        for (std::size_t i = 0; i < values.size(); i++) {
+            decorated.emplace_back(key(values[i]), i);
+        }
+
+        if (reverse) {
+            sorting::stable_sort(decorated.data(), decorated.size(), [](Decorated const& a, Decorated const& b) {
+                return b.first < a.first;
+            });
+        } else {
+            sorting::stable_sort(decorated.data(), decorated.size(), [](Decorated const& a, Decorated const& b) {
+                return a.first < b.first;
+            });
+        }
+
+        lython::Array<V> sorted;
+        sorted.reserve(values.size());
+        for (Decorated& item: decorated) {
+            sorted.push_back(std::move(values[item.second]));
+        }
+        values = std::move(sorted);
+    }
+
+    // builtin sum(list)
+    V sum() const {
+        if constexpr (kernels::is_unboxed<V>) {
+            return kernels::sum(values.data(), values.size());
+        }
+        V acc = V();
+        for (auto const& v: this->values) {
+            acc = acc + v;
+        }
+        return acc;
+    }
 
     struct Reverse {
         // C++20
@@ -150,13 +248,13 @@ struct ArrayNative {
 
         using difference_type = std::ptrdiff_t;
         using value_type      = V;
-        using pointer         = V*;
-        using reference       = V&;
+        using pointer         = V const*;
+        using reference       = V const&;
 
         // clang-format: off
                         operator bool() const { return i > 0; }
-        reference       operator*() const { return self.values[i]; }
-        pointer         operator->() const { return &self.values[i]; }
+        reference       operator*() const { return std::as_const(self.values)[i]; }
+        pointer         operator->() const { return &std::as_const(self.values)[i]; }
         bool            operator<(Reverse const& other) const { return i > other.i; }
         bool            operator>(Reverse const& other) const { return i < other.i; }
         bool            operator<=(Reverse const& other) const { return i >= other.i; }
@@ -201,7 +299,7 @@ struct ArrayNative {
             if (c < 0) {
                 return StopIteration{};
             }
-            return self.values[c];
+            return std::as_const(self.values)[c];
         }
 
         ArrayNative<V>& self;
@@ -219,13 +317,13 @@ struct ArrayNative {
 
         using difference_type = std::ptrdiff_t;
         using value_type      = V;
-        using pointer         = V*;
-        using reference       = V&;
+        using pointer         = V const*;
+        using reference       = V const&;
 
         // clang-format: off
                         operator bool() const { return i < self.values.size(); }
-        reference       operator*() const { return self.values[i]; }
-        pointer         operator->() const { return &self.values[i]; }
+        reference       operator*() const { return std::as_const(self.values)[i]; }
+        pointer         operator->() const { return &std::as_const(self.values)[i]; }
         bool            operator<(const Iterator& other) const { return i < other.i; }
         bool            operator>(const Iterator& other) const { return i > other.i; }
         bool            operator<=(const Iterator& other) const { return i <= other.i; }
@@ -272,7 +370,7 @@ struct ArrayNative {
                 // raise StopException
                 return StopIteration{};
             }
-            return self.values[c];
+            return std::as_const(self.values)[c];
         }
 
         ArrayNative<V>& self;
@@ -284,7 +382,8 @@ struct ArrayNative {
     Iterator end() { return Iterator{*this, int(this->values.size())}; }
     Iterator __iter__() { return Iterator{*this}; }
 
-    ArrayNative<V> copy() { return this; }
+    // O(1), the values are shared until one of the lists is modified
+    ArrayNative<V> copy() const { return *this; }
 
     ArrayNative<V> __add__(ArrayNative<V> const& other) const {
         ArrayNative<V> result;
@@ -343,6 +442,7 @@ struct ArrayNative {
             return IndexError();
         }
         this->values[key] = val;
+        write_barrier(this, val);
     }
 
     template<typename It>
@@ -381,7 +481,7 @@ struct ArrayNative {
         this->values.erase(this->values.begin() + key);
     }
 
-    lython::Array<V> values;
+    CowArray<V> values;
 };
 
 #define KIWI_ARRAY_METHOD(X) \
@@ -0,0 +1,297 @@
+#include "stdlib/array_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#    include <emmintrin.h>
+#    define LY_KERNELS_SSE2 1
+#else
+#    define LY_KERNELS_SSE2 0
+#endif
+
+// AVX2 code is compiled with a target attribute, the rest of the library stays SSE2
+#if LY_KERNELS_SSE2 && (defined(__GNUC__) || defined(__clang__))
+#    include <immintrin.h>
+#    define LY_KERNELS_AVX2 1
+#    define LY_TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#    define LY_KERNELS_AVX2 0
+#endif
+
+namespace kiwi {
+namespace kernels {
+
+#if LY_KERNELS_SSE2
+namespace sse2 {
+
+// SSE2 has no 64 bits compare, both 32 bits halves need to match
+inline __m128i cmpeq_epi64(__m128i a, __m128i b) {
+    __m128i eq = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+inline __m128i load(int64_t const* p) { return _mm_loadu_si128((__m128i const*)p); }
+
+inline __m128i compare(int64_t const* p, __m128i key) { return cmpeq_epi64(load(p), key); }
+
+inline __m128i compare(double const* p, __m128d key) {
+    return _mm_castpd_si128(_mm_cmpeq_pd(_mm_loadu_pd(p), key));
+}
+
+inline __m128i broadcast(int64_t key) { return _mm_set1_epi64x(key); }
+inline __m128d broadcast(double key) { return _mm_set1_pd(key); }
+
+// 8 elements per iteration, the block is only scanned on a hit
+template <typename V>
+std::size_t find(V const* data, std::size_t n, V key) {
+    auto        needle = broadcast(key);
+    std::size_t i      = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i hit = _mm_or_si128(_mm_or_si128(compare(data + i + 0, needle), compare(data + i + 2, needle)),
+                                   _mm_or_si128(compare(data + i + 4, needle), compare(data + i + 6, needle)));
+
+        if (_mm_movemask_epi8(hit) != 0) {
+            break;
+        }
+    }
+    return i + portable::find(data + i, n - i, key);
+}
+
+template <typename V>
+std::size_t count(V const* data, std::size_t n, V key) {
+    auto        needle = broadcast(key);
+    __m128i     acc    = _mm_setzero_si128();
+    std::size_t i      = 0;
+
+    // matches are -1, subtracting them counts them
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_sub_epi64(acc, compare(data + i, needle));
+    }
+
+    alignas(16) uint64_t lanes[2];
+    _mm_store_si128((__m128i*)lanes, acc);
+    return std::size_t(lanes[0] + lanes[1]) + portable::count(data + i, n - i, key);
+}
+
+}  // namespace sse2
+#endif
+
+#if LY_KERNELS_AVX2
+namespace avx2 {
+
+LY_TARGET_AVX2 inline __m256i compare(int64_t const* p, __m256i key) {
+    return _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i const*)p), key);
+}
+
+LY_TARGET_AVX2 inline __m256i compare(double const* p, __m256d key) {
+    return _mm256_castpd_si256(_mm256_cmp_pd(_mm256_loadu_pd(p), key, _CMP_EQ_OQ));
+}
+
+LY_TARGET_AVX2 inline __m256i broadcast(int64_t key) { return _mm256_set1_epi64x(key); }
+LY_TARGET_AVX2 inline __m256d broadcast(double key) { return _mm256_set1_pd(key); }
+
+// 16 elements per iteration, the block is only scanned on a hit
+template <typename V>
+LY_TARGET_AVX2 std::size_t find(V const* data, std::size_t n, V key) {
+    auto        needle = broadcast(key);
+    std::size_t i      = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i hit = _mm256_or_si256(
+            _mm256_or_si256(compare(data + i + 0, needle), compare(data + i + 4, needle)),
+            _mm256_or_si256(compare(data + i + 8, needle), compare(data + i + 12, needle)));
+
+        if (!_mm256_testz_si256(hit, hit)) {
+            break;
+        }
+    }
+    return i + portable::find(data + i, n - i, key);
+}
+
+template <typename V>
+LY_TARGET_AVX2 std::size_t count(V const* data, std::size_t n, V key) {
+    auto        needle = broadcast(key);
+    __m256i     acc0   = _mm256_setzero_si256();
+    __m256i     acc1   = _mm256_setzero_si256();
+    std::size_t i      = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_sub_epi64(acc0, compare(data + i + 0, needle));
+        acc1 = _mm256_sub_epi64(acc1, compare(data + i + 4, needle));
+    }
+
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256((__m256i*)lanes, _mm256_add_epi64(acc0, acc1));
+    return std::size_t(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+           portable::count(data + i, n - i, key);
+}
+
+// Ids are gathered 4 at a time
+LY_TARGET_AVX2 std::size_t find_strided(uint64_t const* data, std::size_t stride, std::size_t n, uint64_t key) {
+    __m256i     needle = _mm256_set1_epi64x(int64_t(key));
+    __m256i     offset = _mm256_setr_epi64x(0, int64_t(stride), int64_t(2 * stride), int64_t(3 * stride));
+    std::size_t i      = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256i ids = _mm256_i64gather_epi64((long long const*)(data + i * stride), offset, 8);
+        __m256i hit = _mm256_cmpeq_epi64(ids, needle);
+
+        if (!_mm256_testz_si256(hit, hit)) {
+            break;
+        }
+    }
+    return i + portable::find_strided(data + i * stride, stride, n - i, key);
+}
+
+LY_TARGET_AVX2 std::size_t count_strided(uint64_t const* data, std::size_t stride, std::size_t n, uint64_t key) {
+    __m256i     needle = _mm256_set1_epi64x(int64_t(key));
+    __m256i     offset = _mm256_setr_epi64x(0, int64_t(stride), int64_t(2 * stride), int64_t(3 * stride));
+    __m256i     acc    = _mm256_setzero_si256();
+    std::size_t i      = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256i ids = _mm256_i64gather_epi64((long long const*)(data + i * stride), offset, 8);
+        acc         = _mm256_sub_epi64(acc, _mm256_cmpeq_epi64(ids, needle));
+    }
+
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256((__m256i*)lanes, acc);
+    return std::size_t(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+           portable::count_strided(data + i * stride, stride, n - i, key);
+}
+
+}  // namespace avx2
+#endif
+
+namespace {
+
+struct Dispatch {
+    Isa isa;
+
+    std::size_t (*find_i64)(int64_t const*, std::size_t, int64_t);
+    std::size_t (*find_f64)(double const*, std::size_t, double);
+    std::size_t (*find_strided)(uint64_t const*, std::size_t, std::size_t, uint64_t);
+
+    std::size_t (*count_i64)(int64_t const*, std::size_t, int64_t);
+    std::size_t (*count_f64)(double const*, std::size_t, double);
+    std::size_t (*count_strided)(uint64_t const*, std::size_t, std::size_t, uint64_t);
+};
+
+Dispatch const portable_dispatch = {
+    Isa::Portable,
+    portable::find<int64_t>,
+    portable::find<double>,
+    portable::find_strided,
+    portable::count<int64_t>,
+    portable::count<double>,
+    portable::count_strided,
+};
+
+#if LY_KERNELS_SSE2
+// there is no gather before AVX2, interned ids use the portable loops
+Dispatch const sse2_dispatch = {
+    Isa::SSE2,
+    sse2::find<int64_t>,
+    sse2::find<double>,
+    portable::find_strided,
+    sse2::count<int64_t>,
+    sse2::count<double>,
+    portable::count_strided,
+};
+#endif
+
+#if LY_KERNELS_AVX2
+Dispatch const avx2_dispatch = {
+    Isa::AVX2,
+    avx2::find<int64_t>,
+    avx2::find<double>,
+    avx2::find_strided,
+    avx2::count<int64_t>,
+    avx2::count<double>,
+    avx2::count_strided,
+};
+#endif
+
+bool supports(Isa isa) {
+    switch (isa) {
+    case Isa::Portable: return true;
+    case Isa::SSE2: return LY_KERNELS_SSE2;
+    case Isa::AVX2:
+#if LY_KERNELS_AVX2
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+Dispatch const* select(Isa isa) {
+    switch (isa) {
+#if LY_KERNELS_AVX2
+    case Isa::AVX2: return &avx2_dispatch;
+#endif
+#if LY_KERNELS_SSE2
+    case Isa::SSE2: return &sse2_dispatch;
+#endif
+    default: break;
+    }
+    return &portable_dispatch;
+}
+
+Dispatch const* best() {
+    for (Isa isa: {Isa::AVX2, Isa::SSE2}) {
+        if (supports(isa)) {
+            return select(isa);
+        }
+    }
+    return &portable_dispatch;
+}
+
+Dispatch const*& dispatch() {
+    static Dispatch const* current = best();
+    return current;
+}
+
+}  // namespace
+
+Isa isa() { return dispatch()->isa; }
+
+const char* isa_name(Isa isa) {
+    switch (isa) {
+    case Isa::Portable: return "portable";
+    case Isa::SSE2: return "sse2";
+    case Isa::AVX2: return "avx2";
+    }
+    return "";
+}
+
+bool force_isa(Isa isa) {
+    if (!supports(isa)) {
+        return false;
+    }
+    dispatch() = select(isa);
+    return true;
+}
+
+std::size_t find_i64(int64_t const* data, std::size_t n, int64_t key) {
+    return dispatch()->find_i64(data, n, key);
+}
+std::size_t find_f64(double const* data, std::size_t n, double key) {
+    return dispatch()->find_f64(data, n, key);
+}
+std::size_t find_strided(uint64_t const* data, std::size_t stride, std::size_t n, uint64_t key) {
+    return dispatch()->find_strided(data, stride, n, key);
+}
+
+std::size_t count_i64(int64_t const* data, std::size_t n, int64_t key) {
+    return dispatch()->count_i64(data, n, key);
+}
+std::size_t count_f64(double const* data, std::size_t n, double key) {
+    return dispatch()->count_f64(data, n, key);
+}
+std::size_t count_strided(uint64_t const* data, std::size_t stride, std::size_t n, uint64_t key) {
+    return dispatch()->count_strided(data, stride, n, key);
+}
+
+}  // namespace kernels
+}  // namespace kiwi
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace kiwi {
+namespace kernels {
+
+//
+// Kernels over the raw buffer of the unboxed arrays (ArrayNative<int64_t>, ArrayNative<double>)
+//
+// The portable loops are written so the compiler can vectorise them:
+// no early exit inside the hot loop, independent accumulators
+// and a scalar tail for the remaining elements.
+//
+
+template <typename V>
+inline constexpr bool is_unboxed = std::is_same_v<V, int64_t> || std::is_same_v<V, double>;
+
+// Elements processed per iteration of the unrolled loops
+constexpr std::size_t lanes = 8;
+
+template <typename V>
+V sum(V const* data, std::size_t n) {
+    V acc[4] = {0, 0, 0, 0};
+
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc[0] += data[i + 0];
+        acc[1] += data[i + 1];
+        acc[2] += data[i + 2];
+        acc[3] += data[i + 3];
+    }
+
+    V total = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    for (; i < n; i++) {
+        total += data[i];
+    }
+    return total;
+}
+
+// Portable loops, used when the CPU has no SSE2 and as the reference for the SIMD kernels
+namespace portable {
+
+template <typename V>
+std::size_t count(V const* data, std::size_t n, V key) {
+    std::size_t acc = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        acc += std::size_t(data[i] == key);
+    }
+    return acc;
+}
+
+// Index of the first element equal to key, n if none
+template <typename V>
+std::size_t find(V const* data, std::size_t n, V key) {
+    std::size_t i = 0;
+
+    for (; i + lanes <= n; i += lanes) {
+        // check the whole block at once and only look for the position on a hit
+        bool hit = false;
+        for (std::size_t j = 0; j < lanes; j++) {
+            hit |= data[i + j] == key;
+        }
+
+        if (hit) {
+            break;
+        }
+    }
+
+    for (; i < n; i++) {
+        if (data[i] == key) {
+            return i;
+        }
+    }
+    return n;
+}
+
+// Same as find/count but the 64 bits ids are `stride` words apart
+inline std::size_t find_strided(uint64_t const* data, std::size_t stride, std::size_t n, uint64_t key) {
+    for (std::size_t i = 0; i < n; i++) {
+        if (data[i * stride] == key) {
+            return i;
+        }
+    }
+    return n;
+}
+
+inline std::size_t count_strided(uint64_t const* data, std::size_t stride, std::size_t n, uint64_t key) {
+    std::size_t acc = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        acc += std::size_t(data[i * stride] == key);
+    }
+    return acc;
+}
+
+}  // namespace portable
+
+//
+// Runtime dispatched search kernels (array_kernels.cpp)
+//
+// The instruction set is picked once on first use: AVX2 when the CPU supports it,
+// SSE2 otherwise. Interned strings (StringRef) are compared by id,
+// ids are read in place so they use the strided kernels.
+//
+enum class Isa
+{
+    Portable,
+    SSE2,
+    AVX2,
+};
+
+// Instruction set used by the kernels
+Isa         isa();
+const char* isa_name(Isa isa);
+
+// Only for testing and benchmarking, returns false if the CPU does not support it
+bool force_isa(Isa isa);
+
+std::size_t find_i64(int64_t const* data, std::size_t n, int64_t key);
+std::size_t find_f64(double const* data, std::size_t n, double key);
+std::size_t find_strided(uint64_t const* data, std::size_t stride, std::size_t n, uint64_t key);
+
+std::size_t count_i64(int64_t const* data, std::size_t n, int64_t key);
+std::size_t count_f64(double const* data, std::size_t n, double key);
+std::size_t count_strided(uint64_t const* data, std::size_t stride, std::size_t n, uint64_t key);
+
+// Types holding an interned id, they need to expose the address of their id
+template <typename V, typename = void>
+struct has_interned_id: std::false_type {};
+
+template <typename V>
+struct has_interned_id<V, std::void_t<decltype(std::declval<V const&>().id_address())>>
+    : std::true_type {};
+
+template <typename V>
+inline constexpr bool is_searchable = is_unboxed<V> || has_interned_id<V>::value;
+
+template <typename V>
+uint64_t const* ids(V const* data) {
+    static_assert(sizeof(V) % sizeof(uint64_t) == 0 && sizeof(*data->id_address()) == sizeof(uint64_t));
+    return reinterpret_cast<uint64_t const*>(data->id_address());
+}
+
+template <typename V>
+std::size_t find(V const* data, std::size_t n, V const& key) {
+    if constexpr (std::is_same_v<V, int64_t>) {
+        return find_i64(data, n, key);
+    } else if constexpr (std::is_same_v<V, double>) {
+        return find_f64(data, n, key);
+    } else {
+        if (n == 0) {
+            return 0;
+        }
+        return find_strided(ids(data), sizeof(V) / sizeof(uint64_t), n, *ids(&key));
+    }
+}
+
+template <typename V>
+std::size_t count(V const* data, std::size_t n, V const& key) {
+    if constexpr (std::is_same_v<V, int64_t>) {
+        return count_i64(data, n, key);
+    } else if constexpr (std::is_same_v<V, double>) {
+        return count_f64(data, n, key);
+    } else {
+        if (n == 0) {
+            return 0;
+        }
+        return count_strided(ids(data), sizeof(V) / sizeof(uint64_t), n, *ids(&key));
+    }
+}
+
+// Map the value to an unsigned integer with the same ordering
+inline uint64_t radix_key(int64_t v) { return uint64_t(v) ^ (uint64_t(1) << 63); }
+
+inline uint64_t radix_key(double v) {
+    // -0.0 == 0.0, they share a key so the sort keeps them in their order
+    if (v == 0) {
+        v = 0.0;
+    }
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    // negative numbers have all their bits flipped, positive only the sign
+    uint64_t mask = uint64_t(int64_t(bits) >> 63) | (uint64_t(1) << 63);
+    return bits ^ mask;
+}
+
+// Below this size std::sort is faster than the radix passes
+constexpr std::size_t radix_threshold = 512;
+
+// LSD radix sort on 8 bits digits, digits that are the same for every element are skipped
+// which makes arrays of small integers only take a couple of passes.
+// The sort is stable, a descending sort complements the keys instead of reversing
+// the result so equal elements keep their order too.
+// NaNs are sorted after +inf (-NaN before -inf)
+template <typename V>
+void sort(V* data, std::size_t n, bool descending = false) {
+    uint64_t flip   = descending ? ~uint64_t(0) : 0;
+    auto     key_of = [flip](V v) { return radix_key(v) ^ flip; };
+
+    if (n < radix_threshold) {
+        std::stable_sort(data, data + n, [&key_of](V a, V b) { return key_of(a) < key_of(b); });
+        return;
+    }
+
+    // the values are moved with their keys, ±0.0 cannot be rebuilt from a shared key
+    std::vector<uint64_t> keys(n);
+    std::vector<uint64_t> swap(n);
+    std::vector<V>        values(n);
+
+    std::size_t histogram[8][256] = {};
+    for (std::size_t i = 0; i < n; i++) {
+        uint64_t key = key_of(data[i]);
+        keys[i]      = key;
+
+        for (int d = 0; d < 8; d++) {
+            histogram[d][(key >> (d * 8)) & 0xFF] += 1;
+        }
+    }
+
+    uint64_t* src        = keys.data();
+    uint64_t* dst        = swap.data();
+    V*        src_values = data;
+    V*        dst_values = values.data();
+
+    for (int d = 0; d < 8; d++) {
+        std::size_t* counts = histogram[d];
+        int          shift  = d * 8;
+
+        if (counts[(src[0] >> shift) & 0xFF] == n) {
+            continue;
+        }
+
+        std::size_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            std::size_t c = counts[b];
+            counts[b]     = offset;
+            offset += c;
+        }
+
+        for (std::size_t i = 0; i < n; i++) {
+            std::size_t pos = counts[(src[i] >> shift) & 0xFF]++;
+            dst[pos]        = src[i];
+            dst_values[pos] = src_values[i];
+        }
+        std::swap(src, dst);
+        std::swap(src_values, dst_values);
+    }
+
+    if (src_values != data) {
+        std::copy(src_values, src_values + n, data);
+    }
+}
+
+}  // namespace kernels
+}  // namespace kiwi
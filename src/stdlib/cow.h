@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <utility>
+
+#include "dtypes.h"
+
+namespace kiwi {
+
+// Called once an element is stored inside a container, lython::Value has an overload
+// found by argument dependent lookup which records the store for the garbage collector
+// (see lython::write_barrier), the other element types have nothing to record
+template <typename V>
+void write_barrier(void* owner, V const& val) {}
+
+//
+// Copy on write storage of the runtime containers (ArrayNative, TupleNative, DictNative)
+//
+// Copying a container only shares its storage and bumps a reference count,
+// the storage is copied by the first mutation of a container that shares it.
+// This makes `Value::copy()`, and passing or returning containers by value, O(1).
+//
+// Aliasing is unchanged: values holding the same container still see each other's
+// mutations, only independent containers (copies) get detached.
+//
+// Const accessors never copy, the non-const ones (including begin() and operator[])
+// detach first, so references and iterators obtained before a copy must not be
+// used to write after it.
+//
+template <typename V>
+class CowArray {
+    public:
+    using Storage         = lython::Array<V>;
+    using value_type      = V;
+    using size_type       = typename Storage::size_type;
+    using reference       = V&;
+    using const_reference = V const&;
+    using iterator        = typename Storage::iterator;
+    using const_iterator  = typename Storage::const_iterator;
+
+    CowArray() = default;
+
+    CowArray(Storage values): storage(std::make_shared<Storage>(std::move(values))) {}
+
+    CowArray(std::initializer_list<V> values): storage(std::make_shared<Storage>(values)) {}
+
+    CowArray(size_type n, V const& value): storage(std::make_shared<Storage>(n, value)) {}
+
+    // Read
+    size_type size() const { return storage ? storage->size() : 0; }
+    size_type capacity() const { return storage ? storage->capacity() : 0; }
+    bool      empty() const { return size() == 0; }
+
+    V const*       data() const { return read().data(); }
+    const_iterator begin() const { return read().begin(); }
+    const_iterator end() const { return read().end(); }
+    V const&       operator[](size_type i) const { return read()[i]; }
+    V const&       front() const { return read().front(); }
+    V const&       back() const { return read().back(); }
+
+    operator Storage const&() const { return read(); }
+
+    bool operator==(CowArray const& other) const {
+        return storage == other.storage || read() == other.read();
+    }
+    bool operator==(Storage const& other) const { return read() == other; }
+
+    // Write
+    V*       data() { return write().data(); }
+    iterator begin() { return write().begin(); }
+    iterator end() { return write().end(); }
+    V&       operator[](size_type i) { return write()[i]; }
+    V&       front() { return write().front(); }
+    V&       back() { return write().back(); }
+
+    void push_back(V const& value) { write().push_back(value); }
+    void push_back(V&& value) { write().push_back(std::move(value)); }
+
+    template <typename... Args>
+    V& emplace_back(Args&&... args) {
+        return write().emplace_back(std::forward<Args>(args)...);
+    }
+
+    void pop_back() { write().pop_back(); }
+    void reserve(size_type n) { write().reserve(n); }
+    void resize(size_type n) { write().resize(n); }
+    void assign(size_type n, V const& value) { write().assign(n, value); }
+
+    // `pos` can point into the shared storage, it is applied as an offset after detaching
+    iterator insert(const_iterator pos, V const& value) {
+        auto     offset = pos - read().begin();
+        Storage& values = write();
+        return values.insert(values.begin() + offset, value);
+    }
+    iterator erase(const_iterator pos) {
+        auto     offset = pos - read().begin();
+        Storage& values = write();
+        return values.erase(values.begin() + offset);
+    }
+
+    // a shared storage is dropped instead of being copied
+    void clear() {
+        if (shared()) {
+            storage.reset();
+        } else if (storage) {
+            storage->clear();
+        }
+    }
+
+    // Containers sharing this storage, 0 when nothing was allocated yet
+    long use_count() const { return storage.use_count(); }
+    bool shared() const { return storage.use_count() > 1; }
+    bool shares(CowArray const& other) const { return storage && storage == other.storage; }
+
+    private:
+    Storage const& read() const {
+        static Storage const empty;
+        return storage ? *storage : empty;
+    }
+
+    Storage& write() {
+        if (!storage) {
+            storage = std::make_shared<Storage>();
+        } else if (shared()) {
+            storage = std::make_shared<Storage>(*storage);
+        }
+        return *storage;
+    }
+
+    std::shared_ptr<Storage> storage;
+};
+
+}  // namespace kiwi
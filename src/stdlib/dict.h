@@ -2,203 +2,425 @@
 
 #include "ast/values/value.h"
 #include "dtypes.h"
+#include "stdlib/array.h"
+#include "stdlib/cow.h"
+#include "stdlib/hashtable.h"
 
 namespace kiwi {
 
+// Script dictionaries can be filled from untrusted input (files, network),
+// their string keys use the keyed SipHash so they cannot be flooded with collisions
+template <typename K>
+struct DictHash {
+    std::size_t operator()(K const& key) const {
+        if constexpr (lython::is_byte_string<K>::value) {
+            return std::size_t(lython::SipHash<K>::hash(key));
+        } else {
+            return std::hash<K>()(key);
+        }
+    }
+};
+
+template <>
+struct DictHash<lython::Value> {
+    std::size_t operator()(lython::Value const& key) const { return key.hash(); }
+};
+
+//
+// Insertion ordered associative DS, laid out like the CPython dict
+//
+//  * entries are stored densely in insertion order with their hash
+//  * a small open addressed index maps a hash to its entry
 //
-// Simple associative DS, should be fast for a small number of keys
-// it will do for now, the api is fixed so changing the implementation
-// is just a matter or changing a typedef
+// Lookups probe the index then compare the cached hash before the key,
+// iterating is a linear walk over the entries.
+// Deleted entries are left in place until the next resize compacts them.
 //
-template<typename K, typename V>
+template <typename K, typename V, typename H = DictHash<K>>
 struct DictNative {
     struct Pair {
         K key;
-        V Value;
+        V value;
+
+        bool operator==(Pair const& other) const {
+            return key == other.key && value == other.value;
+        }
     };
-    lython::Array<Pair> pairs;
 
-    template<typenae T>
-    static Pair* _find(T* self, K const& key) {
-        for(auto const& pair: self->pairs) {
-            if (pair.key == key) 
-                return &pair;
+    struct Entry {
+        std::size_t hash;
+        Pair        pair;
+        bool        deleted = false;
+    };
+
+    static constexpr lython::int32 empty_slot = -1;
+    static constexpr lython::int32 dummy_slot = -2;  // deleted entry, keeps the probe chain
+    static constexpr std::size_t   min_size   = 8;
+
+    // both are copy on write, copying a dictionary is O(1)
+    CowArray<Entry>         entries;
+    CowArray<lython::int32> indices;
+    int                          alive = 0;
+    int                          filled = 0;  // index slots in use, live or deleted entries
+
+    DictNative() = default;
+
+    DictNative(std::initializer_list<Pair> items) {
+        for (Pair const& item: items) {
+            __setitem__(item.key, item.value);
+        }
+    }
+
+    static std::size_t _hash(K const& key) { return H()(key); }
+
+    // index of the key's entry or -1
+    int _find_index(K const& key, std::size_t hash) const {
+        if (indices.empty()) {
+            return -1;
         }
-        return nullptr;
+        std::size_t mask    = indices.size() - 1;
+        std::size_t perturb = hash;
+        std::size_t i       = hash & mask;
+        while (true) {
+            lython::int32 ix = indices[i];
+            if (ix == empty_slot) {
+                return -1;
+            }
+            if (ix >= 0) {
+                Entry const& entry = entries[ix];
+                if (entry.hash == hash && entry.pair.key == key) {
+                    return ix;
+                }
+            }
+            perturb >>= 5;
+            i = (i * 5 + perturb + 1) & mask;
+        }
+    }
+
+    // slot of the index pointing to the entry `ix`
+    std::size_t _find_slot(std::size_t hash, int ix) const {
+        std::size_t mask    = indices.size() - 1;
+        std::size_t perturb = hash;
+        std::size_t i       = hash & mask;
+        while (indices[i] != ix) {
+            perturb >>= 5;
+            i = (i * 5 + perturb + 1) & mask;
+        }
+        return i;
+    }
+
+    void _insert_index(std::size_t hash, int ix) {
+        std::size_t mask    = indices.size() - 1;
+        std::size_t perturb = hash;
+        std::size_t i       = hash & mask;
+        while (indices[i] != empty_slot) {
+            perturb >>= 5;
+            i = (i * 5 + perturb + 1) & mask;
+        }
+        indices[i] = ix;
+    }
+
+    // the index is kept at most 2/3 full, counting the deleted entries
+    bool _needs_resize() const { return std::size_t(filled + 1) * 3 > indices.size() * 2; }
+
+    void _resize(std::size_t minused) {
+        std::size_t size = min_size;
+        while (size * 2 < minused * 3) {
+            size *= 2;
+        }
+
+        // drop the deleted entries
+        if (std::size_t(alive) != entries.size()) {
+            std::size_t n = 0;
+            for (std::size_t ix = 0; ix < entries.size(); ix++) {
+                if (!entries[ix].deleted) {
+                    if (n != ix) {
+                        entries[n] = std::move(entries[ix]);
+                    }
+                    n += 1;
+                }
+            }
+            entries.resize(n);
+        }
+
+        indices.assign(size, empty_slot);
+        for (std::size_t ix = 0; ix < entries.size(); ix++) {
+            _insert_index(entries[ix].hash, int(ix));
+        }
+        filled = int(entries.size());
+    }
+
+    Pair* _find(K const& key) {
+        int ix = _find_index(key, _hash(key));
+        return ix >= 0 ? &entries[ix].pair : nullptr;
+    }
+
+    Pair const* _find(K const& key) const {
+        int ix = _find_index(key, _hash(key));
+        return ix >= 0 ? &entries[ix].pair : nullptr;
     }
 
-    template<typenae T>
-    static int _find_index(T* self, K const& key) {
-        for(int i = 0; i < self->pairs.size(); i++) {
-            if (pairs[i].key == key) 
-                return i;
+    // insert a key that is not in the dictionary yet
+    Pair& _insert(std::size_t hash, K const& key, V const& val) {
+        if (_needs_resize()) {
+            _resize(std::size_t(alive + 1) * 2);
         }
-        return -1;
+        int ix = int(entries.size());
+        entries.push_back(Entry{hash, Pair{key, val}});
+        write_barrier(this, key);
+        write_barrier(this, val);
+        _insert_index(hash, ix);
+        alive += 1;
+        filled += 1;
+        return entries[ix].pair;
+    }
+
+    void _remove(std::size_t hash, int ix) {
+        indices[_find_slot(hash, ix)] = dummy_slot;
+        entries[ix].deleted           = true;
+        entries[ix].pair              = Pair();
+        alive -= 1;
     }
 
     std::size_t __sizeof__() const {
-        return sizeof(this) + sizeof(Pair) * pairs.size();
+        return sizeof(*this) + sizeof(Entry) * entries.capacity() +
+               sizeof(lython::int32) * indices.capacity();
     }
 
-    bool __contains__(K const& key) const { return _find(this, key) != nullptr; }
+    bool __contains__(K const& key) const { return _find(key) != nullptr; }
 
     V get(K const& key, V const& default_val) const {
-        if (Pair* found = _find(this, key)) {
-            return found.value;
+        if (Pair const* found = _find(key)) {
+            return found->value;
         }
         return default_val;
     }
 
-    lython::Array<K>    keys() const {
+    lython::Array<K> keys() const {
         lython::Array<K> k;
-        k.reserve(pairs.size());
-        for(auto& pair: pairs) {
+        k.reserve(alive);
+        for (Pair const& pair: *this) {
             k.emplace_back(pair.key);
         }
         return k;
     }
-    lython::Array<V>    values() const {
+    lython::Array<V> values() const {
         lython::Array<V> k;
-        k.reserve(pairs.size());
-        for(auto& pair: pairs) {
+        k.reserve(alive);
+        for (Pair const& pair: *this) {
             k.emplace_back(pair.value);
         }
         return k;
     }
     lython::Array<Pair> items() const {
-        return pairs;
+        lython::Array<Pair> k;
+        k.reserve(alive);
+        for (Pair const& pair: *this) {
+            k.emplace_back(pair);
+        }
+        return k;
     }
 
-    V setfefault(K const& key, V const& default_val) {
-        if (Pair* found = _find(this, key)) {
-            return found.value;
+    V setdefault(K const& key, V const& default_val) {
+        std::size_t hash = _hash(key);
+        int         ix   = _find_index(key, hash);
+        if (ix >= 0) {
+            return std::as_const(entries)[ix].pair.value;
         }
-        pairs.emplace_back(v, default_val);
-        return default_val;
+        return _insert(hash, key, default_val).value;
     }
-    
-    V pop(K const& key, V const& default_val) {
-        int i = _find_index(this, key);
 
-        if (i >= 0) {
-            V value =  pairs[i].value;
-            std::erase(v.begin() + i);
+    V pop(K const& key, V const& default_val) {
+        std::size_t hash = _hash(key);
+        int         ix   = _find_index(key, hash);
+        if (ix >= 0) {
+            V value = entries[ix].pair.value;
+            _remove(hash, ix);
             return value;
         }
         return default_val;
     }
 
-    template<typename T>
+    std::variant<V, KeyError> pop(K const& key) {
+        std::size_t hash = _hash(key);
+        int         ix   = _find_index(key, hash);
+        if (ix >= 0) {
+            V value = entries[ix].pair.value;
+            _remove(hash, ix);
+            return value;
+        }
+        return KeyError();
+    }
+
+    template <typename T>
     void update(T const& dict_like) {
-        for(Pair const& item: dict_like) {
+        for (Pair const& item: dict_like) {
             __setitem__(item.key, item.value);
         }
     }
 
-    V __getitem__(K const& key) const {
-        if (Pair* found = _find(this, key)) {
-            return found->Value;
+    std::variant<V, KeyError> __getitem__(K const& key) const {
+        if (Pair const* found = _find(key)) {
+            return found->value;
         }
-        // raise
+        return KeyError();
     }
 
     void __setitem__(K const& key, V const& val) {
-        if (Pair* found = _find(this, key)) {
-            found.value = val;
+        std::size_t hash = _hash(key);
+        int         ix   = _find_index(key, hash);
+        if (ix >= 0) {
+            entries[ix].pair.value = val;
+            write_barrier(this, val);
         } else {
-            pairs.emplace_back(key, val);
+            _insert(hash, key, val);
         }
     }
 
-    void __detitem__(K const& key) {
-        v.erase(std::remove_if(v.begin(), v.end(), [&key](Pair const& item) -> bool {
-            return item.key == key;
-        }));
-        // raise
+    std::optional<KeyError> __delitem__(K const& key) {
+        std::size_t hash = _hash(key);
+        int         ix   = _find_index(key, hash);
+        if (ix < 0) {
+            return KeyError();
+        }
+        _remove(hash, ix);
+        return {};
     }
 
-    V popitem() {
-        if (pairs.size() > 0) {
-            Pair last = (*pairs.rbegin());
-            pairs.pop_back();
-            return last;
+    // remove the last inserted item
+    std::variant<Pair, KeyError> popitem() {
+        int ix = int(entries.size()) - 1;
+        while (ix >= 0 && entries[ix].deleted) {
+            ix -= 1;
+        }
+        if (ix < 0) {
+            return KeyError();
         }
-        // raise
+        Pair item = entries[ix].pair;
+        _remove(entries[ix].hash, ix);
+
+        // drop the deleted tail so the next popitem does not scan it again,
+        // their index slots stay deleted and still count in `filled`
+        entries.resize(ix);
+        return item;
     }
 
-    struct Iterator {
-        K __next__() {
-            int c = i;
+    // C++ iteration over the items, skipping deleted entries
+    template <typename Self, typename T>
+    struct ItemIterator {
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = Pair;
+        using pointer           = T*;
+        using reference         = T&;
+
+        reference     operator*() const { return std::as_const(self->entries)[i].pair; }
+        pointer       operator->() const { return &std::as_const(self->entries)[i].pair; }
+        bool          operator==(ItemIterator const& other) const { return i == other.i; }
+        bool          operator!=(ItemIterator const& other) const { return i != other.i; }
+        ItemIterator& operator++() {
             i += 1;
+            skip();
+            return *this;
+        }
 
-            if (c >= self.pairs.size()) {
-                // raise StopException
+        void skip() {
+            while (i < self->entries.size() && std::as_const(self->entries)[i].deleted) {
+                i += 1;
             }
-            return self.pairs[c];
         }
 
-        DictNative& self;
-        int i = 0;
-    }
+        Self*       self;
+        std::size_t i;
+    };
+
+    // iterating only reads the entries, it never detaches a shared storage
+    using iterator       = ItemIterator<DictNative, Pair const>;
+    using const_iterator = ItemIterator<DictNative const, Pair const>;
 
-    // return Iterable
-    Iterator __iter__() {
-        return Iterator{*this};
+    iterator begin() {
+        iterator it{this, 0};
+        it.skip();
+        return it;
     }
+    iterator       end() { return iterator{this, entries.size()}; }
+    const_iterator begin() const {
+        const_iterator it{this, 0};
+        it.skip();
+        return it;
+    }
+    const_iterator end() const { return const_iterator{this, entries.size()}; }
+
+    // Python iteration over the keys
+    struct Iterator {
+        std::variant<K, StopIteration> __next__() {
+            auto const& entries = std::as_const(self.entries);
+
+            while (i < int(entries.size()) && entries[i].deleted) {
+                i += 1;
+            }
+            if (i >= int(entries.size())) {
+                return StopIteration();
+            }
+            i += 1;
+            return entries[i - 1].pair.key;
+        }
+
+        DictNative& self;
+        int         i = 0;
+    };
+
+    Iterator __iter__() { return Iterator{*this}; }
 
     struct Reverse {
-        K __next__() {
-            int c = i;
-            i -= 1;
+        std::variant<K, StopIteration> __next__() {
+            auto const& entries = std::as_const(self.entries);
 
-            if (c < 0) {
-                // raise StopException
+            while (i >= 0 && entries[i].deleted) {
+                i -= 1;
+            }
+            if (i < 0) {
+                return StopIteration();
             }
-            return self.pairs[c];
+            i -= 1;
+            return entries[i + 1].pair.key;
         }
 
         DictNative& self;
-        int i;
-    }
+        int         i;
+    };
 
-    Reverse __reversed__() {
-        return Reverse{this, int(pairs.size()) - 1}; 
-    }
+    Reverse __reversed__() { return Reverse{*this, int(entries.size()) - 1}; }
 
-    template<typename Iterable>
+    template <typename Iterable>
     static DictNative fromkeys(Iterable const& iter, V const& val) {
         DictNative newdict;
-        for(K const& key: iter) {
-            newdict.pairs.emplace_back(key, val);
+        for (K const& key: iter) {
+            newdict.__setitem__(key, val);
         }
-        return newdit;
+        return newdict;
     }
 
-    int __len__() const {
-        return int(pairs.size());
-    }
+    int __len__() const { return alive; }
 
-    DictNative copy () {
-        DictNative cpy;
-        cpy.pairs = pairs;
-        return cpy;
-    }
+    DictNative copy() const { return *this; }
 
     void clear() {
-        pairs.clear();
+        entries.clear();
+        indices.clear();
+        alive  = 0;
+        filled = 0;
     }
 
-    bool __ne__(DictNative const& other) {
-        return !__eq__(other);
-    }
-    bool __eq__(DictNative const& other) {
+    bool __ne__(DictNative const& other) const { return !__eq__(other); }
+    bool __eq__(DictNative const& other) const {
         if (other.__len__() != __len__()) {
             return false;
         }
 
-        for(Pair const& pair: pairs) {
-            Pair const* other = _find(other, pair.key);
-            if (!other || other.value != pair.value) {
+        for (Pair const& pair: *this) {
+            Pair const* found = other._find(pair.key);
+            if (!found || !(found->value == pair.value)) {
                 return false;
             }
         }
@@ -250,4 +472,4 @@ struct DictNative {
 
 using Dict = DictNative<lython::Value, lython::Value>;
 
-}  // namespace kiwi
\ No newline at end of file
+}  // namespace kiwi
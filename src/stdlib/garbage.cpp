@@ -1,9 +1,206 @@
 #include "garbage.h"
+#include "utilities/stopwatch.h"
 
 #include <algorithm>
 
 namespace lython {
 
+namespace {
+// Shades the objects of the collected generations
+struct ShadeVisitor: public GCVisitor {
+    ShadeVisitor(BoehmGarbageCollector& gc, GCGen gen, Mark source):
+        GCVisitor(gc), gen(gen), source(source) {}
+
+    void visit(void* ptr) override {
+        if (gc.is_pointer(gen, ptr)) {
+            gc.shade(ptr, gen, source);
+        }
+    }
+
+    GCGen gen;
+    Mark  source;
+};
+
+struct YoungerVisitor: public GCVisitor {
+    YoungerVisitor(BoehmGarbageCollector& gc, GCGen younger): GCVisitor(gc), younger(younger) {}
+
+    void visit(void* ptr) override { found = found || gc.is_pointer(younger, ptr); }
+
+    GCGen younger;
+    bool  found = false;
+};
+}  // namespace
+
+const std::size_t BoehmGarbageCollector::size_classes[BoehmGarbageCollector::size_class_count] = {
+    32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 2048, 4096,
+};
+
+int BoehmGarbageCollector::size_class(std::size_t block_size) {
+    // size classes are multiples of 16, lookup table indexed by the number of 16 bytes chunks
+    static constexpr std::size_t largest = 4096;
+    static Array<int8> const     classes = []() {
+        Array<int8> table(largest / 16 + 1);
+        int         cls = 0;
+        for (std::size_t i = 0; i < table.size(); i++) {
+            while (size_classes[cls] < i * 16) {
+                cls += 1;
+            }
+            table[i] = int8(cls);
+        }
+        return table;
+    }();
+
+    if (block_size > largest) {
+        return -1;
+    }
+    return classes[(block_size + 15) / 16];
+}
+
+GCPage* BoehmGarbageCollector::page(void* ptr) {
+    uintptr_t addr = uintptr_t(ptr);
+    if (addr < page_start || addr >= page_end) {
+        return nullptr;
+    }
+    auto it = page_map.find(addr & ~uintptr_t(GCPage::size - 1));
+    if (it == page_map.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+GCPage* BoehmGarbageCollector::new_page(int cls, std::size_t block_size) {
+    std::size_t bytes = GCPage::size;
+    if (cls < 0) {
+        bytes      = (block_size + GCPage::size - 1) & ~(GCPage::size - 1);
+        block_size = bytes;
+    }
+
+    GCPage* page = new GCPage();
+    if (cls >= 0 && !spare_pages.empty()) {
+        page->memory = spare_pages.back();
+        spare_pages.pop_back();
+    } else {
+        page->memory = (char*)page_alloc(bytes);
+    }
+    page->bytes      = bytes;
+    page->block_size = block_size;
+    page->count      = bytes / block_size;
+    page->size_class = cls;
+
+    pages.push_back(page);
+    page_map[uintptr_t(page->memory)] = page;
+    page_start = std::min(page_start, uintptr_t(page->memory));
+    page_end   = std::max(page_end, uintptr_t(page->memory) + bytes);
+
+    kwdebug(outlog(), "New page {} ({} x {})", (void*)page->memory, page->count, block_size);
+    return page;
+}
+
+void BoehmGarbageCollector::free_page(GCPage* page) {
+    page_map.erase(uintptr_t(page->memory));
+
+    // keep some memory around, fresh pages are expensive to touch
+    if (page->size_class >= 0 && spare_pages.size() < max_spare_pages) {
+        spare_pages.push_back(page->memory);
+    } else {
+        page_free(page->memory);
+    }
+    delete page;
+}
+
+GCObjectHeader* BoehmGarbageCollector::allocate_block(std::size_t size) {
+    std::size_t block_size = size + sizeof(GCObjectHeader);
+    int         cls        = size_class(block_size);
+
+    if (cls < 0) {
+        GCPage* page = new_page(cls, block_size);
+        page->bump   = 1;
+        page->used   = 1;
+        return page->block(0);
+    }
+
+    Array<GCPage*>& pages_with_space = available[cls];
+    if (pages_with_space.empty()) {
+        pages_with_space.push_back(new_page(cls, size_classes[cls]));
+    }
+
+    GCPage*         page = pages_with_space.back();
+    GCObjectHeader* hdr  = page->free_list;
+    if (hdr != nullptr) {
+        page->free_list = *(GCObjectHeader**)(hdr->data());
+    } else {
+        hdr = page->block(page->bump);
+        page->bump += 1;
+    }
+    page->used += 1;
+
+    if (page->full()) {
+        pages_with_space.pop_back();
+    }
+    return hdr;
+}
+
+void BoehmGarbageCollector::free_block(GCPage* page, GCObjectHeader* hdr) {
+    bool was_full = page->full();
+
+    hdr->~GCObjectHeader();
+    hdr->live                        = 0;
+    hdr->marked                      = 0;
+    *(GCObjectHeader**)(hdr->data()) = page->free_list;
+    page->free_list                  = hdr;
+    page->used -= 1;
+
+    // large pages are released during the next sweep
+    if (was_full && page->size_class >= 0 && !page->owned) {
+        available[page->size_class].push_back(page);
+    }
+}
+
+void BoehmGarbageCollector::release_pages() {
+    // Empty pages are given back, one is kept per size class
+    // so a young generation that dies entirely does not allocate new pages every time
+    bool kept[size_class_count] = {false};
+
+    for (Array<GCPage*>& pages_with_space: available) {
+        pages_with_space.clear();
+    }
+
+    std::size_t n = 0;
+    for (GCPage* page: pages) {
+        if (page->owned) {
+            pages[n] = page;
+            n += 1;
+            continue;
+        }
+        if (page->used == 0) {
+            if (page->size_class < 0 || kept[page->size_class]) {
+                free_page(page);
+                continue;
+            }
+            kept[page->size_class] = true;
+        }
+        if (page->size_class >= 0 && !page->full()) {
+            available[page->size_class].push_back(page);
+        }
+        pages[n] = page;
+        n += 1;
+    }
+    pages.resize(n);
+}
+
+Array<GCObjectHeader*> BoehmGarbageCollector::allocations(GCGen gen) {
+    Array<GCObjectHeader*> allocs;
+    for (GCPage* page: pages) {
+        for (std::size_t i = 0; i < page->bump; i++) {
+            GCObjectHeader* hdr = page->block(i);
+            if (hdr->live && hdr->gen == int(gen)) {
+                allocs.push_back(hdr);
+            }
+        }
+    }
+    return allocs;
+}
+
 int BoehmGarbageCollector::is_pointer(GCGen gen, void* ptr) {
     // Check if the pointer is within the heap range
 
@@ -12,39 +209,224 @@ int BoehmGarbageCollector::is_pointer(GCGen gen, void* ptr) {
     //    return false;
     }
 
-    // Check alignment: must be aligned to pointer size
-    // if (reinterpret_cast<uintptr_t>(ptr) % alignof(void*) != 0) {
-    //    return false;
-    // }
+    GCPage* pg = page(ptr);
+    if (pg == nullptr) {
+        // this happens all the time
+        // kwdebug(outlog(), "Bad {}", ptr);
+        return false;
+    }
+
+    // Only pointers to the start of an object are valid
+    std::size_t offset = (char*)(ptr) - pg->memory - sizeof(GCObjectHeader);
+    if (offset % pg->block_size != 0 || offset / pg->block_size >= pg->bump) {
+        return false;
+    }
 
     // Check if the pointer is an actual allocated object
+    // of the generation or a younger one
     GCObjectHeader* hdr = header(ptr);
-    if (std::find(allocations(gen).begin(), allocations(gen).end(), hdr) !=
-        allocations(gen).end()) {
-        // kwdebug(outlog(), "Good");
-        return true;
+    return hdr->live && hdr->gen <= int(gen);
+}
+
+std::mutex& BoehmGarbageCollector::registry_lock() {
+    static std::mutex lock;
+    return lock;
+}
+
+Dict<uint64, BoehmGarbageCollector*>& BoehmGarbageCollector::registry() {
+    static Dict<uint64, BoehmGarbageCollector*> collectors;
+    return collectors;
+}
+
+static GCThreadCache& local_cache() {
+    thread_local GCThreadCache cache;
+    return cache;
+}
+
+void GCThreadCache::release() {
+    if (collector != 0) {
+        std::lock_guard<std::mutex> guard(BoehmGarbageCollector::registry_lock());
+
+        auto& collectors = BoehmGarbageCollector::registry();
+        auto  it         = collectors.find(collector);
+        if (it != collectors.end()) {
+            BoehmGarbageCollector&      gc = *it->second;
+            std::lock_guard<std::mutex> collector_guard(gc.lock);
+            gc.allocated += allocated;
+            gc.threads -= 1;
+            gc.retire(*this);
+        }
     }
 
-    // this happens all the time
-    // kwdebug(outlog(), "Bad {}", ptr);
-    return false;
+    collector = 0;
+    allocated = 0;
+    limit     = 0;
+    for (GCAllocBuffer& buffer: buffers) {
+        buffer = GCAllocBuffer();
+    }
+}
+
+GCThreadCache& BoehmGarbageCollector::thread_cache() {
+    GCThreadCache& cache = local_cache();
+
+    // the pages reserved from the previous collector would never be released
+    if (cache.collector != id) {
+        cache.release();
+        cache.collector = id;
+
+        std::lock_guard<std::mutex> guard(lock);
+        threads += 1;
+    }
+    return cache;
+}
+
+bool BoehmGarbageCollector::exclusive() {
+    bool attached = local_cache().collector == id;
+    return threads == (attached ? 1 : 0);
+}
+
+void BoehmGarbageCollector::retire(GCThreadCache& cache) {
+    for (GCAllocBuffer& buffer: cache.buffers) {
+        retire(buffer);
+    }
+    cache.limit = 0;
+}
+
+void BoehmGarbageCollector::retire(GCAllocBuffer& buffer) {
+    GCPage* page = buffer.page;
+    if (page == nullptr) {
+        return;
+    }
+
+    // the blocks that were not handed out are free again
+    for (char* block = buffer.cursor; block < buffer.end; block += page->block_size) {
+        GCObjectHeader* hdr              = (GCObjectHeader*)(block);
+        *(GCObjectHeader**)(hdr->data()) = buffer.free_list;
+        buffer.free_list                 = hdr;
+    }
+    while (buffer.free_list != nullptr) {
+        GCObjectHeader* hdr              = buffer.free_list;
+        buffer.free_list                 = *(GCObjectHeader**)(hdr->data());
+        *(GCObjectHeader**)(hdr->data()) = page->free_list;
+        page->free_list                  = hdr;
+    }
+
+    page->owned = false;
+    if (!page->full()) {
+        available[page->size_class].push_back(page);
+    }
+    buffer = GCAllocBuffer();
+}
+
+void BoehmGarbageCollector::refill(GCAllocBuffer& buffer, int cls) {
+    retire(buffer);
+
+    Array<GCPage*>& pages_with_space = available[cls];
+    GCPage*         page             = nullptr;
+    if (pages_with_space.empty()) {
+        page = new_page(cls, size_classes[cls]);
+    } else {
+        page = pages_with_space.back();
+        pages_with_space.pop_back();
+    }
+
+    // the page blocks that were never allocated are reserved for the thread
+    for (std::size_t i = page->bump; i < page->count; i++) {
+        page->block(i)->live = 0;
+    }
+
+    buffer.page      = page;
+    buffer.cursor    = (char*)page->block(page->bump);
+    buffer.end       = (char*)page->block(page->count);
+    buffer.free_list = page->free_list;
+    page->bump       = page->count;
+    page->free_list  = nullptr;
+    page->owned      = true;
+}
+
+GCObjectHeader* BoehmGarbageCollector::allocate_slow(GCThreadCache& cache, std::size_t size, int cls) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    allocated += cache.allocated;
+    cache.allocated = 0;
+
+    // collect before allocating, the new object is not reachable yet
+    if (marking) {
+        mark_slice();
+    } else if (auto_collect && allocated >= minor_budget) {
+        GCGen gen = promoted >= major_budget ? GCGen::Long : GCGen::Temporary;
+        if (incremental && exclusive()) {
+            start_marking(gen);
+        } else {
+            collect_locked(gen);
+        }
+    }
+    allocated += size;
+
+    // go through the slow path again once the budget is consumed,
+    // every allocation does while marking so it can do some marking work
+    cache.limit = 0;
+    if (!marking && thread_local_buffers) {
+        cache.limit = auto_collect ? minor_budget - std::min(allocated, minor_budget) : std::size_t(-1);
+    }
+
+    if (cls < 0 || !thread_local_buffers) {
+        return allocate_block(size);
+    }
+
+    GCAllocBuffer& buffer = cache.buffers[cls];
+    if (buffer.cursor == buffer.end && buffer.free_list == nullptr) {
+        refill(buffer, cls);
+    }
+
+    GCObjectHeader* hdr = buffer.free_list;
+    if (hdr != nullptr) {
+        buffer.free_list = *(GCObjectHeader**)(hdr->data());
+    } else {
+        hdr = (GCObjectHeader*)(buffer.cursor);
+        buffer.cursor += size_classes[cls];
+    }
+    buffer.page->used += 1;
+    return hdr;
 }
 
-void* BoehmGarbageCollector::malloc(std::size_t size, void (*finalizer)(void*)) {
+void* BoehmGarbageCollector::malloc(std::size_t size, void (*finalizer)(void*), GCTracer tracer) {
+    GCThreadCache&  cache = thread_cache();
+    int             cls   = size_class(size + sizeof(GCObjectHeader));
+    GCObjectHeader* hdr   = nullptr;
+
+    // Fast path: bump allocation inside the thread buffer
+    if (cls >= 0 && cache.allocated + size <= cache.limit) {
+        GCAllocBuffer& buffer = cache.buffers[cls];
+        if (buffer.cursor < buffer.end) {
+            hdr = (GCObjectHeader*)(buffer.cursor);
+            buffer.cursor += size_classes[cls];
+        } else if (buffer.free_list != nullptr) {
+            hdr              = buffer.free_list;
+            buffer.free_list = *(GCObjectHeader**)(hdr->data());
+        }
+        if (hdr != nullptr) {
+            buffer.page->used.fetch_add(1, std::memory_order_relaxed);
+            cache.allocated += size;
+        }
+    }
+
+    if (hdr == nullptr) {
+        hdr = allocate_slow(cache, size, cls);
+    }
+
     // TODO handle alignment
-    void*           mem = (GCObjectHeader*)std::malloc(size + sizeof(GCObjectHeader));
-    GCObjectHeader* hdr = new (mem) GCObjectHeader();
+    hdr = new (hdr) GCObjectHeader();
     kwdebug(outlog(), "Allocating {} - {}", (void*)(hdr), hdr->data());
 
-    hdr->size      = size;
-    hdr->marked    = 0;
-    hdr->finalizer = finalizer;
-    add(GCGen::Temporary, hdr);
-
-#if KIWI_ALLOCATION_DEBUG
-    get_heap_bounds();
-    kwassert(mem >= heap_start && mem < heap_end, "Pointer needs to be inside heap bounds");
-#endif
+    hdr->size       = size;
+    hdr->marked     = marking;  // allocated black during an incremental cycle
+    hdr->live       = 1;
+    hdr->remembered = 0;
+    hdr->age        = 0;
+    hdr->gen        = int(GCGen::Temporary);
+    hdr->finalizer  = finalizer;
+    hdr->tracer     = tracer;
 
     return hdr->data();
 }
@@ -53,79 +435,328 @@ void BoehmGarbageCollector::free(void* ptr) {
     if (ptr == nullptr) {
         return;
     }
-    // TODO: remove the ptr from the allocation
     GCObjectHeader* hdr = header(ptr);
     if (hdr->finalizer) {
         hdr->finalizer(ptr);
     }
-    hdr->~GCObjectHeader();
     kwdebug(outlog(), "free {}", (void*)(hdr));
-    std::free(hdr);
+    std::lock_guard<std::mutex> guard(lock);
+    free_block(page(ptr), hdr);
 }
 
-void BoehmGarbageCollector::mark_obj(void* obj, GCGen gen, Mark source) {
-    pointers = {obj};
-    // kwdebug(outlog(), "marking {}", obj);
-    int j = 0;
-    while (!pointers.empty()) {
+void BoehmGarbageCollector::shade(void* obj, GCGen gen, Mark source) {
+    if (obj == nullptr || is_marked(obj)) {
+        return;
+    }
+
+    GCObjectHeader* hdr = header(obj);
+    hdr->marked         = true;
+#if KIWI_ALLOCATION_DEBUG
+    hdr->mark_source |= (1 << int(source));
+#endif
+    kwdebug(outlog(), "marked {}", (void*)(hdr));
+    pointers.push_back(obj);
+}
+
+bool BoehmGarbageCollector::mark_step(GCGen gen, std::size_t budget) {
+    ShadeVisitor visitor(*this, gen, Mark::Child);
+
+    for (std::size_t j = 0; j < budget && !pointers.empty(); j++) {
         void* ptr = *pointers.rbegin();
         pointers.pop_back();
 
-        if (ptr == nullptr || is_marked(ptr)) {
-            kwdebug(outlog(), "{} already marked", j);
+        // freed while it was grey
+        GCObjectHeader* hdr = header(ptr);
+        if (!hdr->live) {
             continue;
         }
-
-        GCObjectHeader* hdr = header(ptr);
-        hdr->marked         = true;
-#if KIWI_ALLOCATION_DEBUG
-        hdr->mark_source |= (1 << int(source));
-        if (j > 0) {
-            hdr->mark_source |= (1 << int(Mark::Child));
+        if (hdr->tracer != nullptr) {
+            hdr->tracer(ptr, visitor);
+            continue;
         }
-#endif
-
-        kwdebug(outlog(), "{} marked {}", j, (void*)(hdr));
-        j += 1;
-
-        for (int i = 0; i < hdr->size; i += 1) {
+        for (std::size_t i = 0; i + sizeof(void*) <= hdr->size; i += sizeof(void*)) {
             char* member = reinterpret_cast<char*>(ptr) + i;
             if (is_pointer(gen, *(void**)(member))) {
-                pointers.push_back(*(void**)(member));
+                shade(*(void**)(member), gen, Mark::Child);
             }
         }
     }
+    return pointers.empty();
 }
 
-void BoehmGarbageCollector::sweep(GCGen gen) {
-    Array<GCObjectHeader*> allocs;
-    for (GCObjectHeader* obj: allocations(gen)) {
-        if (obj == nullptr) {
+void BoehmGarbageCollector::mark_obj(void* obj, GCGen gen, Mark source) {
+    shade(obj, gen, source);
+    mark_step(gen, std::size_t(-1));
+}
+
+void BoehmGarbageCollector::collect(GCGen gen) {
+    std::lock_guard<std::mutex> guard(lock);
+    collect_locked(gen);
+}
+
+void BoehmGarbageCollector::collect_locked(GCGen gen) {
+    // the stacks of the other threads are not scanned
+    if (!exclusive()) {
+        stats.deferred += 1;
+        return;
+    }
+
+    // finish the current cycle, its marks would be reused otherwise
+    if (marking) {
+        finish_marking();
+    }
+
+    StopWatch<double, std::chrono::microseconds> pause;
+    get_heap_bounds();
+
+    // Mark
+    mark(gen);
+
+    // Sweep
+    sweep(gen);
+
+    end_collection(gen);
+    stats.record_pause(pause.stop());
+}
+
+void BoehmGarbageCollector::end_collection(GCGen gen) {
+    allocated = 0;
+    if (gen == GCGen::Temporary) {
+        stats.minor += 1;
+    } else {
+        stats.major += 1;
+        promoted = 0;
+    }
+}
+
+void BoehmGarbageCollector::start_marking(GCGen gen) {
+    StopWatch<double, std::chrono::microseconds> pause;
+    get_heap_bounds();
+
+    marking     = true;
+    marking_gen = gen;
+    allocated   = 0;
+    mark_roots(gen);
+
+    stats.record_pause(pause.stop());
+}
+
+void BoehmGarbageCollector::mark_slice() {
+    StopWatch<double, std::chrono::microseconds> pause;
+    bool done = mark_step(marking_gen, slice_budget);
+    stats.slices += 1;
+    stats.record_pause(pause.stop());
+
+    // the cycle stays open until the other threads detach
+    if (done && exclusive()) {
+        finish_marking();
+    }
+}
+
+void BoehmGarbageCollector::finish_marking() {
+    StopWatch<double, std::chrono::microseconds> pause;
+
+    // the stack and the registers are not behind a barrier,
+    // the objects they point to were not necessarily marked
+    mark_roots(marking_gen);
+    mark_step(marking_gen, std::size_t(-1));
+
+    marking = false;
+    sweep(marking_gen);
+    end_collection(marking_gen);
+
+    stats.record_pause(pause.stop());
+}
+
+void BoehmGarbageCollector::remember(GCObjectHeader* hdr) {
+    hdr->remembered = 1;
+    remembered.push_back(hdr);
+}
+
+bool BoehmGarbageCollector::points_to_younger(GCObjectHeader* hdr) {
+    if (hdr->gen == int(GCGen::Temporary)) {
+        return false;
+    }
+    GCGen younger = GCGen(hdr->gen - 1);
+    if (hdr->tracer != nullptr) {
+        // objects holding foreign containers stay remembered,
+        // the stores inside the containers are not recorded
+        YoungerVisitor visitor(*this, younger);
+        hdr->tracer(hdr->data(), visitor);
+        return visitor.found || visitor.foreign;
+    }
+    for (std::size_t i = 0; i + sizeof(void*) <= hdr->size; i += sizeof(void*)) {
+        void* member = *(void**)(reinterpret_cast<char*>(hdr->data()) + i);
+        if (is_pointer(younger, member)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BoehmGarbageCollector::mark_remembered(GCGen gen) {
+    // the old objects are not traced, their members are roots
+    ShadeVisitor visitor(*this, gen, Mark::Global);
+    for (GCObjectHeader* hdr: remembered) {
+        if (hdr->gen <= int(gen)) {
+            continue;
+        }
+        if (hdr->tracer != nullptr) {
+            hdr->tracer(hdr->data(), visitor);
             continue;
         }
-        if (!obj->marked) {
-            kwdebug(outlog(), "free {}", (void*)(obj));
-            if (obj->finalizer) {
-                obj->finalizer(obj->data());
+        char* data = reinterpret_cast<char*>(hdr->data());
+        for (std::size_t i = 0; i + sizeof(void*) <= hdr->size; i += sizeof(void*)) {
+            possible_pointer(gen, (void**)(data + i), Mark::Global);
+        }
+    }
+}
+
+void BoehmGarbageCollector::mark_added_roots(GCGen gen) {
+    ShadeVisitor visitor(*this, gen, Mark::Global);
+    for (GCRoot const& root: roots) {
+        root.scan(root.ctx, visitor);
+    }
+}
+
+void BoehmGarbageCollector::add_root(void* ctx, void (*scan)(void* ctx, GCVisitor& visitor)) {
+    std::lock_guard<std::mutex> guard(lock);
+    roots.push_back(GCRoot{ctx, scan});
+}
+
+void BoehmGarbageCollector::remove_root(void* ctx) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (std::size_t i = roots.size(); i > 0; i--) {
+        if (roots[i - 1].ctx == ctx) {
+            roots.erase(roots.begin() + (i - 1));
+            return;
+        }
+    }
+}
+
+void BoehmGarbageCollector::write_barrier(void* owner, void* obj, GCTracer tracer) {
+    // a black owner is not scanned again, neither are the containers it holds
+    if (marking) {
+        ShadeVisitor visitor(*this, marking_gen, Mark::Child);
+        visitor.foreign_path.push_back(obj);
+        tracer(obj, visitor);
+    }
+    if (!is_pointer(GCGen::Root, owner)) {
+        return;
+    }
+    GCObjectHeader* hdr = header(owner);
+    if (!hdr->remembered && hdr->gen > int(GCGen::Temporary)) {
+        remember(hdr);
+    }
+}
+
+void BoehmGarbageCollector::sweep(GCGen gen) {
+    // the blocks reserved by the collecting thread are swept with the rest,
+    // the pages of the other threads buffers are only allocated from by their thread
+    GCThreadCache& cache = local_cache();
+    if (cache.collector == id) {
+        retire(cache);
+    }
+
+    // Remembered objects that are about to be freed
+    Array<GCObjectHeader*> old_remembered;
+    std::swap(old_remembered, remembered);
+    for (GCObjectHeader* obj: old_remembered) {
+        if (obj->gen > int(gen) || obj->marked) {
+            remembered.push_back(obj);
+        }
+    }
+
+    Array<GCObjectHeader*> promotions;
+    for (GCPage* page: pages) {
+        for (std::size_t i = 0; i < page->bump; i++) {
+            GCObjectHeader* obj = page->block(i);
+            if (!obj->live || obj->gen > int(gen)) {
+                continue;
             }
-            std::free(obj);
-        } else {
+            if (!obj->marked) {
+                // the owning thread might still be holding it in a register
+                if (page->owned) {
+                    continue;
+                }
+                kwdebug(outlog(), "free {}", (void*)(obj));
+                stats.freed += obj->size;
+                if (obj->finalizer) {
+                    obj->finalizer(obj->data());
+                }
+                free_block(page, obj);
+                continue;
+            }
+
             obj->marked = 0;
-            allocs.push_back(obj);
+            obj->age    = obj->age < 7 ? obj->age + 1 : obj->age;
+            if (should_promote(obj)) {
+                obj->gen = int(promotion(GCGen(obj->gen)));
+                obj->age = 0;
+                promoted += obj->size;
+                stats.promoted += obj->size;
+                if (!obj->remembered) {
+                    promotions.push_back(obj);
+                }
+            }
         }
     }
 
-    allocations(gen).clear();
-    GCGen ngen = promotion(gen);
-    for (GCObjectHeader* hdr: allocs) {
-        if (should_promote(hdr)) {
-            allocations(ngen).push_back(hdr);
+    // the promoted objects might be pointing to younger objects,
+    // checked once the garbage is gone
+    for (GCObjectHeader* obj: promotions) {
+        if (points_to_younger(obj)) {
+            remember(obj);
+        }
+    }
+
+    release_pages();
+
+    // Drop the objects that do not point to younger objects anymore
+    std::swap(old_remembered, remembered);
+    remembered.clear();
+    for (GCObjectHeader* obj: old_remembered) {
+        if (points_to_younger(obj)) {
+            remembered.push_back(obj);
         } else {
-            allocations(gen).push_back(hdr);
+            obj->remembered = 0;
         }
     }
 }
 
+void GCStats::record_pause(double us) {
+    int i = 0;
+    while (i < bucket_count - 1 && us > pause_buckets[i]) {
+        i += 1;
+    }
+    pauses[i] += 1;
+    total_pause += us;
+    max_pause = std::max(max_pause, us);
+}
+
+void GCStats::show(std::ostream& out) const {
+    std::size_t count = 0;
+    for (std::size_t n: pauses) {
+        count += n;
+    }
+
+    auto line = std::string(12 + 10 + 1, '-');
+    out << fmt::format("minor: {} major: {} slices: {} deferred: {}\n", minor, major, slices, deferred);
+    out << fmt::format("freed: {} promoted: {}\n", freed, promoted);
+    out << fmt::format("pause max: {:.1f} us mean: {:.1f} us\n",
+                       max_pause,
+                       count > 0 ? total_pause / double(count) : 0.0);
+    out << line << '\n';
+    out << fmt::format("{:>12} {:>10}\n", "pause (us)", "count");
+    out << line << '\n';
+    for (int i = 0; i < bucket_count; i++) {
+        std::string bucket = i < bucket_count - 1 ? fmt::format("<= {}", pause_buckets[i])
+                                                  : std::string("more");
+        out << fmt::format("{:>12} {:>10}\n", bucket, pauses[i]);
+    }
+    out << line << '\n';
+}
+
 std::string sources(uint8_t source) {
     bool        stack  = source & (1 << int(Mark::Stack));
     bool        reg    = source & (1 << int(Mark::Register));
@@ -151,10 +782,11 @@ std::string sources(uint8_t source) {
 void BoehmGarbageCollector::dump(std::ostream& out) {
     get_heap_bounds();
 
-    for (Generation& gen: generations) {
-        if (gen.allocations.size() > 0) {
+    for (int g = 0; g < int(GCGen::Max); g++) {
+        Array<GCObjectHeader*> allocs = allocations(GCGen(g));
+        if (allocs.size() > 0) {
             out << fmt::format("+-->  {} | {}\n", heap_start, 0);
-            for (GCObjectHeader* obj: gen.allocations) {
+            for (GCObjectHeader* obj: allocs) {
                 auto diff = (char*)(obj) - (char*)(heap_start);
                 out << fmt::format("| +-> {} | {}\n", (void*)(obj), diff);
 #if KIWI_ALLOCATION_DEBUG
@@ -3,6 +3,9 @@
 
 #include "dtypes.h"
 
+#include <atomic>
+#include <mutex>
+
 namespace lython {
 
 template <typename T>
@@ -21,6 +24,36 @@ struct Finalizer {
 #define KIWI_NOINLINE __declspec(noinline)
 #endif
 
+struct BoehmGarbageCollector;
+
+// Receives the words held by an object or a root, see GCObjectHeader::tracer
+struct GCVisitor {
+    GCVisitor(BoehmGarbageCollector& gc): gc(gc) {}
+    virtual ~GCVisitor() = default;
+
+    // ptr can be any word, it is ignored when it is not a GC object
+    virtual void visit(void* ptr) = 0;
+
+    BoehmGarbageCollector& gc;
+
+    // Set when the traced object holds values inside memory the collector does not manage
+    // (a std heap container), the container is traced through instead of marked
+    // so the object is scanned by every collection, see `points_to_younger`
+    bool foreign = false;
+
+    // Containers being traced through, they have no mark bit to stop on cycles
+    Array<void const*> foreign_path;
+};
+
+// Visits the members of an object which are not inside its block
+using GCTracer = void (*)(void* obj, GCVisitor& visitor);
+
+// Precise root, `scan` visits the values held by `ctx`
+struct GCRoot {
+    void* ctx;
+    void (*scan)(void* ctx, GCVisitor& visitor);
+};
+
 enum class Mark {
     None,
     Stack,
@@ -32,7 +65,12 @@ enum class Mark {
 struct GCObjectHeader {
     std::size_t size = 0;
     bool        marked : 1;
+    bool        live : 1;        // the block holds an object
+    bool        remembered : 1;  // inside the remembered set
+    uint8       age : 3;         // number of collections survived in its generation
+    uint8       gen : 2;         // GCGen the object belongs to
     void (*finalizer)(void*) = nullptr;
+    GCTracer    tracer       = nullptr;  // the block is scanned word by word without it
 
 #if KIWI_ALLOCATION_DEBUG
     uint8_t      mark_source;
@@ -46,10 +84,41 @@ struct GCObjectHeader {
     void* data() { return ((char*)(this)) + sizeof(GCObjectHeader); }
 };
 
-struct Generation {
-    Array<GCObjectHeader*> allocations;
+// Objects are allocated inside pages holding blocks of the same size,
+// the page of a pointer is found by masking its address, which makes
+// pointer validation constant time.
+// Objects bigger than the largest size class get a page for themselves.
+struct GCPage {
+    static constexpr std::size_t size = 64 * 1024;
+
+    char*                    memory     = nullptr;  // aligned on GCPage::size
+    std::size_t              bytes      = 0;
+    std::size_t              block_size = 0;        // header included
+    std::size_t              count      = 0;        // number of blocks
+    std::atomic<std::size_t> used       = 0;        // number of live blocks, also counted by
+                                                    // the thread buffers without the lock
+    std::size_t              bump       = 0;        // blocks after this one were never allocated
+    int                      size_class = -1;       // -1 for large objects
+    bool                     owned      = false;    // a thread allocates from it, see GCAllocBuffer
+    GCObjectHeader*          free_list  = nullptr;  // freed blocks, linked through their data
+
+    GCObjectHeader* block(std::size_t i) { return (GCObjectHeader*)(memory + i * block_size); }
+
+    bool full() const { return free_list == nullptr && bump == count; }
+};
+
+// Thread local allocation buffer, blocks of a page reserved for a thread.
+// Allocating is a pointer bump or a pop from the free list the thread took
+// from the page, no lock is taken until the buffer is exhausted.
+struct GCAllocBuffer {
+    char*           cursor    = nullptr;
+    char*           end       = nullptr;
+    GCObjectHeader* free_list = nullptr;
+    GCPage*         page      = nullptr;
 };
 
+struct GCThreadCache;
+
 template <typename T>
 class ReversedIterable {
 public:
@@ -76,13 +145,33 @@ enum class GCGen
     Max,
 };
 
+struct GCStats {
+    static constexpr int    bucket_count = 10;
+    static constexpr double pause_buckets[bucket_count] = {  // upper bounds in us
+        10, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 1e300};
+
+    int         minor     = 0;  // collections of the temporary generation
+    int         major     = 0;  // collections of every generation
+    int         slices    = 0;  // incremental marking steps
+    int         deferred  = 0;  // collections skipped while other threads were attached
+    std::size_t freed     = 0;  // bytes
+    std::size_t promoted  = 0;  // bytes
+
+    // Pause time histogram, the mutator is stopped during a collection,
+    // a marking slice or the start and end of an incremental cycle
+    std::size_t pauses[bucket_count] = {0};
+    double      max_pause            = 0;  // us
+    double      total_pause          = 0;  // us
+
+    void record_pause(double us);
+    void show(std::ostream& out) const;
+};
+
 /** very basic garbage collector
- * perf wise pointer lookup is probably the main issue
- *   creating generation of pointers to keep the pointer lookup fast
- *   for the most checked generation
- * 
- * buckets or values could be created to avoid allocating memory too often
- * so the temporary objects can keep reusing the same memory
+ * Objects live in size class pages (see GCPage), a pointer is validated by looking up
+ * its page in `page_map` and checking it lands on a live block, so marking is linear
+ * in the live heap. Freed blocks are reused by the next allocations of the same size.
+ * Sweeping walks the pages, promotion only updates the generation stored in the header.
  *
  * Selecting a smaller memory region to scan might be too dangerous
  * because the GC will free the value so we have to make sure it is nowhere else
@@ -99,15 +188,54 @@ enum class GCGen
  * The header could also be dynamically allocated separately for common
  * type/size 
  * 
- * Currently the GC never runs, some heuristic needs to be put in place
- * to make it run periodically
+ * When `auto_collect` is set (the default), collections are triggered by allocations:
+ *   - every `minor_budget` bytes the temporary generation is collected
+ *   - every `major_budget` bytes promoted all the generations are collected
+ *
+ * Besides the stack, the registers and the globals, the roots registered with `add_root`
+ * are scanned precisely. Objects keeping their members outside of their block
+ * (a script object and its slots) are scanned by the `tracer` given to `malloc`.
+ * The runtime stores its values through `gc_store` (see value.h) which calls `write_barrier`.
+ *
+ * Collecting a generation collects the younger ones as well, objects that survive
+ * `promote_age` collections move to the next generation.
+ * Older objects are not scanned during a young collection, pointers from an old object
+ * to a young one need to go through `write_barrier` so the old object is added to
+ * the remembered set, which is scanned as a root.
+ *
+ * When `incremental` is set, collections triggered by allocations are split in slices:
+ *   - the roots are shaded (marked and pushed to the grey list)
+ *   - every allocation scans `slice_budget` grey objects
+ *   - once the grey list is empty the roots are scanned again and the generation swept
+ * Objects allocated during marking are black, stores inside an object need to go through
+ * `write_barrier` which shades the stored object so a scanned object never
+ * points to an unmarked one. Pauses are recorded in `stats`.
+ *
+ * Small objects are bump allocated from thread local buffers (GCAllocBuffer),
+ * the lock is only taken when a buffer runs out or the allocation budget is consumed.
+ * Collections only scan the stack of the thread running them, the other threads could be
+ * holding unrooted references in their stack or registers. A thread allocating from
+ * the collector stays attached to it until it exits or allocates from another collector,
+ * collections are deferred while a thread other than the collecting one is attached
+ * (counted in `stats.deferred`).
  */
 struct BoehmGarbageCollector {
 
 public:
-    BoehmGarbageCollector() { generations.resize(int(GCGen::Max)); }
+    BoehmGarbageCollector(): id(next_id()) {
+        available.resize(size_class_count);
+
+        std::lock_guard<std::mutex> guard(registry_lock());
+        registry()[id] = this;
+    }
 
     ~BoehmGarbageCollector() {
+        {
+            // the thread caches still pointing to our pages drop them
+            std::lock_guard<std::mutex> guard(registry_lock());
+            registry().erase(id);
+        }
+
         // freeing the remaining memory might be tricky
         // usually it is better to free the latest first
         // Note: that we do a simple delete without taking into account
@@ -115,15 +243,22 @@ public:
         // so we delete members first then the main object
         // currently I think the allocation order is mainly kept in our DS
         // so maybe it is not an issue
-        for(Generation& gen: generations) {
-            for(GCObjectHeader* hdr: reversed(gen.allocations)) {
-                if (hdr->finalizer) {
+        for(GCPage* page: reversed(pages)) {
+            for(std::size_t i = page->bump; i > 0; i--) {
+                GCObjectHeader* hdr = page->block(i - 1);
+                if (hdr->live && hdr->finalizer) {
                     hdr->finalizer(hdr->data());
                 }
-                std::free(hdr);
             }
-            gen.allocations.clear();
         }
+        for(GCPage* page: pages) {
+            free_page(page);
+        }
+        pages.clear();
+        for(char* memory: spare_pages) {
+            page_free(memory);
+        }
+        spare_pages.clear();
     }
     int is_pointer(GCGen gen, void* ptr);
 
@@ -132,7 +267,7 @@ public:
         return (T*)malloc(sizeof(T), Finalizer<T>::finalize);
     }
 
-    void* malloc(std::size_t size, void (*finalizer)(void*) = nullptr);
+    void* malloc(std::size_t size, void (*finalizer)(void*) = nullptr, GCTracer tracer = nullptr);
 
     void free(void* ptr);
 
@@ -144,27 +279,70 @@ public:
         return (GCObjectHeader*)((char*)(ptr) - sizeof(GCObjectHeader));
     }
 
-    void collect(GCGen gen = GCGen::Temporary) {
-        get_heap_bounds();
+    // Takes the lock, does nothing while other threads are attached
+    void collect(GCGen gen = GCGen::Temporary);
 
-        // Mark
-        mark(gen);
+    // Record a store of `value` inside `owner`
+    // value can be any word, it is ignored if it is not a GC object.
+    // owner is only remembered when it is a GC object, the roots (nullptr)
+    // are scanned by every collection
+    void write_barrier(void* owner, void* value) {
+        if (!is_pointer(GCGen::Root, value)) {
+            return;
+        }
+        if (marking && header(value)->gen <= int(marking_gen)) {
+            shade(value, marking_gen, Mark::Child);
+        }
+        if (!is_pointer(GCGen::Root, owner)) {
+            return;
+        }
+        GCObjectHeader* hdr = header(owner);
+        if (!hdr->remembered && hdr->gen > header(value)->gen) {
+            remember(hdr);
+        }
+    }
 
-        // Sweep
-        sweep(gen);
+    // Record a store of `obj`, a container the collector does not manage,
+    // inside `owner`, the container is traced through by `tracer`
+    void write_barrier(void* owner, void* obj, GCTracer tracer);
+
+    // Values held outside of the GC objects, `scan` is called by every collection
+    void add_root(void* ctx, void (*scan)(void* ctx, GCVisitor& visitor));
+    void remove_root(void* ctx);
+
+    template <typename T, typename V>
+    void store(void* owner, T*& field, V* value) {
+        field = value;
+        write_barrier(owner, value);
     }
 
-    // mark an object as live
+    // mark an object and everything it points to as live
     void mark_obj(void* obj, GCGen gen = GCGen::Temporary, Mark source = Mark::None);
 
+    // mark an object as live, its members are scanned by `mark_step`
+    void shade(void* obj, GCGen gen, Mark source);
+
+    // scan the members of `budget` grey objects, returns true when there is nothing left
+    bool mark_step(GCGen gen, std::size_t budget);
+
     void possible_pointer(GCGen gen, void** current, Mark source) {
         // maye this could be relocatable
         // Mark object as reachable in GC
         if (is_pointer(gen, *current)) {
-            mark_obj(*current, gen, source);
+            shade(*current, gen, source);
+        } else if (decode != nullptr) {
+            void* ptr = decode(*current);
+            if (is_pointer(gen, ptr)) {
+                shade(ptr, gen, source);
+            }
         }
     }
 
+    // Incremental collection
+    void start_marking(GCGen gen);
+    void mark_slice();
+    void finish_marking();
+
     #if 0
     void possible_pointer(GCGen gen, void* current, Mark source) {
         // Mark object as reachable in GC
@@ -186,7 +364,7 @@ public:
     }
 
     bool should_promote(GCObjectHeader* obj) {
-        return false;
+        return obj->gen < int(GCGen::Long) && obj->age >= promote_age;
     }
 
     void mark(GCGen gen) {
@@ -200,11 +378,58 @@ public:
         }
         #endif
 
+        mark_roots(gen);
+        mark_step(gen, std::size_t(-1));
+    }
+    // the caller holds `lock`
+    void collect_locked(GCGen gen);
+
+    // the calling thread is the only one attached, its stack holds every root
+    bool exclusive();
+
+    void mark_roots(GCGen gen) {
         mark_stack(gen);
         mark_globals(gen);
         mark_registers(gen);
+        mark_remembered(gen);
+        mark_added_roots(gen);
     }
     void sweep(GCGen gen);
+    void end_collection(GCGen gen);
+
+    // Pages
+    static int  size_class(std::size_t block_size);
+    GCPage*     page(void* ptr);
+    GCPage*     new_page(int size_class, std::size_t block_size);
+    void        free_page(GCPage* page);
+    void        release_pages();
+    void*       page_alloc(std::size_t bytes);
+    void        page_free(void* memory);
+
+    GCObjectHeader* allocate_block(std::size_t size);
+    void            free_block(GCPage* page, GCObjectHeader* hdr);
+
+    // Thread local allocation
+    GCThreadCache&  thread_cache();
+    GCObjectHeader* allocate_slow(GCThreadCache& cache, std::size_t size, int cls);
+    void            refill(GCAllocBuffer& buffer, int cls);
+    void            retire(GCAllocBuffer& buffer);
+    void            retire(GCThreadCache& cache);
+
+    static uint64 next_id() {
+        static std::atomic<uint64> counter(0);
+        return ++counter;
+    }
+
+    // Live collectors, a thread cache gives its buffers back to its collector
+    // when the thread exits or starts allocating from another collector
+    static std::mutex&                          registry_lock();
+    static Dict<uint64, BoehmGarbageCollector*>& registry();
+
+    void mark_remembered(GCGen gen);
+    void mark_added_roots(GCGen gen);
+    void remember(GCObjectHeader* hdr);
+    bool points_to_younger(GCObjectHeader* hdr);
 
     void mark_stack(GCGen gen);
     void mark_globals(GCGen gen);
@@ -214,14 +439,44 @@ public:
     void dump(std::ostream& out);
 
 public:
-    void add(GCGen gen, GCObjectHeader* obj) { generations[int(gen)].allocations.push_back(obj); }
-
-    Array<GCObjectHeader*>& allocations(GCGen gen) { return generations[int(gen)].allocations; }
-
-    Array<void*>      pointers;     // pre allocated work space for mark
-    Array<Generation> generations;  // list of allocations
-    void*             heap_start = nullptr;
-    void*             heap_end   = nullptr;
+    // Live objects of a generation, walks all the pages
+    Array<GCObjectHeader*> allocations(GCGen gen);
+
+    static constexpr int size_class_count = 13;
+    static const std::size_t size_classes[size_class_count];
+
+    Array<void*>              pointers;     // grey objects, marked but not scanned yet
+    Array<GCPage*>            pages;        // in allocation order
+    Array<Array<GCPage*>>     available;    // pages with free blocks for each size class
+    Dict<uintptr_t, GCPage*>  page_map;     // page address to page
+    Array<char*>              spare_pages;  // memory of released pages, reused by new pages
+    std::size_t               max_spare_pages = 64;
+    Array<GCObjectHeader*>    remembered;   // old objects that might point to younger ones
+    Array<GCRoot>             roots;        // see add_root
+    void*                     heap_start = nullptr;
+    void*                     heap_end   = nullptr;
+    uintptr_t                 page_start = uintptr_t(-1);  // address range covered by the pages
+    uintptr_t                 page_end   = 0;
+    uint64                    id;           // identifies the collector inside the thread caches
+    std::mutex                lock;         // allocation slow path and collections
+    std::size_t               threads = 0;  // threads attached, guarded by `lock`
+    bool                      thread_local_buffers = true;
+
+    // Address of a tagged pointer (a NaN boxed Value) found by the conservative scans
+    void* (*decode)(void* word) = nullptr;
+
+    // Heuristics
+    bool        auto_collect = true;      // collect from the allocation budgets
+    std::size_t minor_budget = 4 << 20;   // bytes allocated before a temporary collection
+    std::size_t major_budget = 32 << 20;  // bytes promoted before a full collection
+    int         promote_age  = 2;         // collections survived before promotion
+    bool        incremental  = false;     // split the collections triggered by allocations
+    std::size_t slice_budget = 256;       // objects scanned per marking slice
+    bool        marking      = false;     // an incremental cycle is in progress
+    GCGen       marking_gen  = GCGen::Temporary;
+    std::size_t allocated    = 0;         // since the last collection
+    std::size_t promoted     = 0;         // since the last full collection
+    GCStats     stats;
 
     // insert location info inside the header
     template<typename T>
@@ -248,11 +503,23 @@ public:
         return (T*)malloc(sizeof(T), loc, Finalizer<T>::finalize);
     }
     
-    void* malloc(std::size_t size, CodeLocation const& loc, void (*finalizer)(void*) = nullptr) {
-        return located(malloc(size, finalizer), loc);
+    void* malloc(std::size_t size, CodeLocation const& loc, void (*finalizer)(void*) = nullptr, GCTracer tracer = nullptr) {
+        return located(malloc(size, finalizer, tracer), loc);
     }
 };
 
+struct GCThreadCache {
+    uint64        collector = 0;  // id of the collector the buffers belong to
+    std::size_t   allocated = 0;  // bytes allocated since the last slow path
+    std::size_t   limit     = 0;  // bytes that can be allocated before taking the slow path
+    GCAllocBuffer buffers[BoehmGarbageCollector::size_class_count];
+
+    ~GCThreadCache() { release(); }
+
+    // retire the buffers if their collector is still alive, its pages are gone otherwise
+    void release();
+};
+
 
 inline
 BoehmGarbageCollector& garbage_collector() {
@@ -46,7 +46,7 @@ void BoehmGarbageCollector::mark_registers(GCGen gen) {
     for (int i = 0; i < 16; ++i) {
         // relocating registers mean changing their values
         if (is_pointer(gen, registers[i])) {
-            mark_obj(registers[i], gen, Mark::Register);
+            shade(registers[i], gen, Mark::Register);
         }
     }
 #endif
@@ -95,10 +95,15 @@ void BoehmGarbageCollector::mark_globals(GCGen gen) {
         }
 
         // Check if the section is writable and belongs to the main executable or shared libraries
-        if (strchr(perms, 'w') != NULL && strstr(pathname, "[heap]") == NULL) {
+        // the live part of the stack is scanned by mark_stack, the rest holds dead frames
+        if (strchr(perms, 'w') != NULL && strstr(pathname, "[heap]") == NULL &&
+            strstr(pathname, "[stack]") == NULL) {
             // Scan each potential pointer location
             for (void **current = (void **)start; current < (void **)end; ++current) {
-                possible_pointer(gen, current, Mark::Global);
+                // the pages are scanned when their objects are marked
+                if (page(current) == nullptr) {
+                    possible_pointer(gen, current, Mark::Global);
+                }
             }
         }
     }
@@ -144,6 +149,15 @@ void BoehmGarbageCollector::get_heap_bounds() {
     heap_start = (void*)lowestAddress;
     heap_end = (void*)highestAddress;
 }
+
+void* BoehmGarbageCollector::page_alloc(std::size_t bytes) {
+    return std::aligned_alloc(GCPage::size, bytes);
+}
+
+void BoehmGarbageCollector::page_free(void* memory) {
+    std::free(memory);
+}
+
 #endif
 
 }
\ No newline at end of file
@@ -37,7 +37,7 @@ void BoehmGarbageCollector::mark_registers(GCGen gen) {
     // Check each register to see if it contains a pointer
     for (int i = 0; i < 16; ++i) {
         if (is_pointer(gen, registers[i])) {
-            mark_obj(registers[i], gen, Mark::Register);
+            shade(registers[i], gen, Mark::Register);
         }
     }
 }
@@ -64,7 +64,7 @@ void BoehmGarbageCollector::mark_stack(GCGen gen) {
     for (void** current = stack_pointer; current < stack_base; ++current) {
         if (current >= stack_limit && current < stack_base) { 
             if (is_pointer(gen, *current)) {
-                mark_obj(*current, gen, Mark::Stack);
+                shade(*current, gen, Mark::Stack);
             }
         }
     }
@@ -91,7 +91,7 @@ void BoehmGarbageCollector::mark_globals(GCGen gen) {
             for (void** current = (void**)start; current < (void**)end; ++current) {
                 if (is_pointer(gen, *current)) {
                     // Mark object as reachable in GC
-                    mark_obj(*current, gen, Mark::Global);
+                    shade(*current, gen, Mark::Global);
                 }
             }
         }
@@ -131,6 +131,14 @@ void BoehmGarbageCollector::get_heap_bounds() {
             (char*)(heap_end) - (char*)(heap_start));
 }
 
+void* BoehmGarbageCollector::page_alloc(std::size_t bytes) {
+    return _aligned_malloc(bytes, GCPage::size);
+}
+
+void BoehmGarbageCollector::page_free(void* memory) {
+    _aligned_free(memory);
+}
+
 #endif
 
 }
\ No newline at end of file
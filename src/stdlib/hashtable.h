@@ -2,37 +2,244 @@
 #ifndef LYTHON_HASHTABLE_HEADER
 #define LYTHON_HASHTABLE_HEADER
 
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <random>
 #include <sstream>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include <iostream>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define LY_HASHTABLE_SSE2 1
+#    include <emmintrin.h>
+#else
+#    define LY_HASHTABLE_SSE2 0
+#endif
+
+#if defined(_MSC_VER)
+#    include <intrin.h>
+#endif
+
+#include "dependencies/xx_hash.h"
 #include "siphash.h"
 
 namespace lython {
 
-const char* SALT = "dW8(2!?GTfDFJ@Le";
+// SipHash key, drawn once per process so colliding keys cannot be computed ahead of time
+inline const uint8_t* sip_key() {
+    static const std::array<uint8_t, 16> key = []() {
+        std::random_device         device;
+        std::array<uint8_t, 16> bytes;
+        for (std::size_t i = 0; i < bytes.size(); i += sizeof(uint32_t)) {
+            uint32_t random = uint32_t(device());
+            std::memcpy(bytes.data() + i, &random, sizeof(uint32_t));
+        }
+        return bytes;
+    }();
+    return key.data();
+}
+
+// Byte strings (std::string, String, StringView) are hashed on their content
+template <typename T, typename = void>
+struct is_byte_string: std::false_type {};
 
 template <typename T>
-struct Hash {
+struct is_byte_string<
+    T,
+    std::enable_if_t<std::is_same_v<typename T::value_type, char>,
+                     std::void_t<decltype(std::declval<T const&>().data()),
+                                 decltype(std::declval<T const&>().size())>>>: std::true_type {};
+
+// Keys that provide their own hash (StringRef mixes its interned id)
+template <typename T, typename = void>
+struct has_precomputed_hash: std::false_type {};
+
+template <typename T>
+struct has_precomputed_hash<T, std::void_t<decltype(std::declval<T const&>().__hash__())>>
+    : std::true_type {};
+
+// SipHash keyed with a random key (``sip_key``), slower but resistant to hash flooding.
+// Use it for tables whose keys come from untrusted input.
+template <typename T>
+struct SipHash {
     static uint64_t hash(T const& k) noexcept {
         uint64_t value = 0;
-        siphash(
-            (const void*)&k, (size_t)sizeof(T), SALT, (uint8_t*)&value, (size_t)sizeof(uint64_t));
+        if constexpr (is_byte_string<T>::value) {
+            siphash((const void*)k.data(),
+                    (size_t)k.size(),
+                    sip_key(),
+                    (uint8_t*)&value,
+                    (size_t)sizeof(uint64_t));
+        } else {
+            siphash((const void*)&k,
+                    (size_t)sizeof(T),
+                    sip_key(),
+                    (uint8_t*)&value,
+                    (size_t)sizeof(uint64_t));
+        }
         return value;
     }
 };
 
-template <>
-struct Hash<std::string> {
-    static uint64_t hash(std::string const& k) noexcept {
-        uint64_t value = 0;
-        siphash(
-            (const void*)&k[0], (size_t)k.size(), SALT, (uint8_t*)&value, (size_t)sizeof(uint64_t));
+// std::hash adapter, for keys that hash by identity (StringRef, pointers)
+template <typename T>
+struct StdHash {
+    static uint64_t hash(T const& k) noexcept { return uint64_t(std::hash<T>()(k)); }
+};
 
-        return value;
+// XXH3, fast hash for trusted keys
+// Other keys are hashed as raw bytes, padding or several representations
+// of the same value would make equal keys hash differently
+template <typename T>
+struct XXHash {
+    static uint64_t hash(T const& k) noexcept {
+        if constexpr (is_byte_string<T>::value) {
+            return xx_hash_3((const void*)k.data(), k.size());
+        } else {
+            static_assert(std::has_unique_object_representations_v<T>,
+                          "Key bytes do not identify its value");
+            return xx_hash_3((const void*)&k, sizeof(T));
+        }
+    }
+};
+
+namespace wy {
+// wyhash final version 4 (public domain, Wang Yi)
+static const uint64_t secret[4] = {
+    0x2d358dccaa6c78a5ull,
+    0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull,
+    0x4d5a2da51de1aa47ull,
+};
+
+inline void mum(uint64_t* a, uint64_t* b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    *a = _umul128(*a, *b, b);
+#else
+    __uint128_t r = *a;
+    r *= *b;
+    *a = uint64_t(r);
+    *b = uint64_t(r >> 64);
+#endif
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+    mum(&a, &b);
+    return a ^ b;
+}
+
+inline uint64_t r8(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint64_t r4(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t r3(const uint8_t* p, size_t k) {
+    return (uint64_t(p[0]) << 16) | (uint64_t(p[k >> 1]) << 8) | p[k - 1];
+}
+
+inline uint64_t hash(const void* key, size_t len, uint64_t seed = 0) {
+    const uint8_t* p = (const uint8_t*)key;
+    uint64_t       a = 0;
+    uint64_t       b = 0;
+
+    seed ^= mix(seed ^ secret[0], secret[1]);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (r4(p) << 32) | r4(p + ((len >> 3) << 2));
+            b = (r4(p + len - 4) << 32) | r4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = r3(p, len);
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed;
+            uint64_t see2 = seed;
+            do {
+                seed = mix(r8(p) ^ secret[1], r8(p + 8) ^ seed);
+                see1 = mix(r8(p + 16) ^ secret[2], r8(p + 24) ^ see1);
+                see2 = mix(r8(p + 32) ^ secret[3], r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = mix(r8(p) ^ secret[1], r8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = r8(p + i - 16);
+        b = r8(p + i - 8);
+    }
+
+    a ^= secret[1];
+    b ^= seed;
+    mum(&a, &b);
+    return mix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+}  // namespace wy
+
+// wyhash, fast hash for trusted keys, integers only need a single multiply
+// Other keys are hashed as raw bytes, see XXHash
+template <typename T>
+struct WyHash {
+    static uint64_t hash(T const& k) noexcept {
+        if constexpr (std::is_integral_v<T> && sizeof(T) <= sizeof(uint64_t)) {
+            return wy::mix(uint64_t(k) ^ wy::secret[0], wy::secret[1]);
+        } else if constexpr (is_byte_string<T>::value) {
+            return wy::hash((const void*)k.data(), k.size());
+        } else {
+            static_assert(std::has_unique_object_representations_v<T>,
+                          "Key bytes do not identify its value");
+            return wy::hash((const void*)&k, sizeof(T));
+        }
+    }
+};
+
+
+// Default hashing policy, picks the cheapest hash that is good enough for the key
+//
+//  * integers, enums and pointers: a single multiply-xor mixer
+//  * floating points: XXH3 of the value, with -0.0 hashed as 0.0 since they compare equal
+//  * keys with their own hash (interned strings): ``__hash__()``
+//  * byte strings and other keys whose bytes identify the value: XXH3
+//
+// None of them is seeded so ``Hash`` is not resistant to hash flooding (HashDoS),
+// tables filled from untrusted input should use SipHash.
+template <typename T>
+struct Hash {
+    static uint64_t hash(T const& k) noexcept {
+        if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+            return wy::mix(uint64_t(k) ^ wy::secret[0], wy::secret[1]);
+        } else if constexpr (std::is_pointer_v<T>) {
+            return wy::mix(uint64_t(uintptr_t(k)) ^ wy::secret[0], wy::secret[1]);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            T value = k == T(0) ? T(0) : k;
+            return xx_hash_3((const void*)&value, sizeof(T));
+        } else if constexpr (has_precomputed_hash<T>::value) {
+            return uint64_t(k.__hash__());
+        } else if constexpr (is_byte_string<T>::value) {
+            return xx_hash_3((const void*)k.data(), k.size());
+        } else {
+            static_assert(std::has_unique_object_representations_v<T>,
+                          "Key needs a hash specialisation, its bytes do not identify its value");
+            return xx_hash_3((const void*)&k, sizeof(T));
+        }
     }
 };
 
@@ -49,92 +256,139 @@ inline uint64_t fast_mod_p2(uint64_t i, uint64_t mod) { return P2_MOD(i, mod); }
 
 inline bool is_power2(uint64_t x) { return (x != 0) && ((x & (x - 1)) == 0); }
 
-// TODO: rewrite this with a Storage for Key-Values
-// and a HashTable for Key->Index
-// the HasTable will be bigger than the number of values so it is useful
-// to make it as small as possible
-// but then it is not exactly linear probing
+namespace swiss {
+// Control byte of a slot, full slots store the 7 low bits of their hash
+using Ctrl = int8_t;
 
-/* Hashtable with Open addressing and linear probing.
- *
- * Linear probing improves lookup times due to locality of references
- *
- * The table is rehashed once we reach a load factor of 0.75,
- * rehashing less or more frequently would impact performance negatively.
- *
- * Everytime the table needs to be rehashed the storage size is doubled
- *
- */
-template <typename Key, typename Value, typename H = Hash<Key>>
-struct HashTable {
-    private:
-    struct _Item {
-        _Item(): key(Key()), used(false), deleted(true) {}
+enum : Ctrl
+{
+    Empty   = -128,  // 0b10000000
+    Deleted = -2,    // 0b11111110
+};
 
-        _Item(Key const& k, Value const& v): key(k), value(v), used(true), deleted(true) {}
+inline bool is_full(Ctrl c) { return c >= 0; }
 
-        Key const key;
-        Value     value;
-        bool      used : 1;
-        bool      deleted : 1;
+inline int lowest_bit(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
 
-        inline void set_hash(uint64_t) {}
+// Slots of a group that matched, one bit per slot
+struct BitMask {
+    uint32_t mask;
 
-        inline uint64_t hash() const { return H::hash(key); }
+    explicit operator bool() const { return mask != 0; }
 
-        _Item& operator=(_Item const& i) {
-            Key& mutkey = (Key&)key;
-            mutkey      = i.key;
-            value       = i.value;
-            used        = true;
-            deleted     = false;
-            return *this;
-        }
-    };
+    int lowest() const { return lowest_bit(mask); }
 
-    // Save the Hash next to the key-value pair
-    struct _ItemCached: public _Item {
-        _ItemCached(): _Item() {}
+    void clear_lowest() { mask &= mask - 1; }
+};
+
+// 16 control bytes compared at once
+struct Group {
+    static constexpr int width = 16;
 
-        _ItemCached(Key const& k, Value const& v): _Item(k, v) {}
+#if LY_HASHTABLE_SSE2
+    explicit Group(Ctrl const* pos): ctrl(_mm_loadu_si128((__m128i const*)pos)) {}
 
-        mutable uint64_t hash_value = 0;
+    BitMask match(Ctrl h2) const {
+        return {uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2))))};
+    }
 
-        inline void set_hash(uint64_t h) { hash_value = h; }
+    BitMask match_empty() const { return match(Empty); }
 
-        inline uint64_t hash() const {
-            if (hash_value == 0) {
-                hash_value = H::hash(_Item::key);
-            }
-            return hash_value;
+    // Empty and Deleted are the only control bytes with the sign bit set
+    BitMask match_empty_or_deleted() const { return {uint32_t(_mm_movemask_epi8(ctrl))}; }
+
+    __m128i ctrl;
+#else
+    explicit Group(Ctrl const* pos) { memcpy(ctrl, pos, width); }
+
+    BitMask match(Ctrl h2) const {
+        uint32_t mask = 0;
+        for (int i = 0; i < width; i++) {
+            mask |= uint32_t(ctrl[i] == h2) << i;
+        }
+        return {mask};
+    }
+
+    BitMask match_empty() const { return match(Empty); }
+
+    BitMask match_empty_or_deleted() const {
+        uint32_t mask = 0;
+        for (int i = 0; i < width; i++) {
+            mask |= uint32_t(ctrl[i] < 0) << i;
         }
+        return {mask};
+    }
+
+    Ctrl ctrl[width];
+#endif
+};
+}  // namespace swiss
+
+/* Hashtable with open addressing and group probing (SwissTable).
+ *
+ * Key-value pairs live in a slot array, the index is a separate array of
+ * one byte per slot holding either Empty, Deleted or the 7 low bits of the key hash.
+ * Lookups scan a group of 16 control bytes with a single SIMD compare
+ * and only touch the slots whose control byte matched,
+ * so most misses never read a key.
+ *
+ * Groups are probed quadratically (triangular numbers), which visits every group
+ * because the number of groups is a power of 2.
+ *
+ * The table grows once live and deleted slots reach 7/8 of the capacity,
+ * if most of them are tombstones the table is rebuilt in place instead of doubling.
+ *
+ * The hasher is a template parameter. The default ``Hash`` picks a fast unseeded hash
+ * per key type, it is NOT resistant to hash flooding (HashDoS): tables whose keys
+ * come from untrusted input should use the keyed ``SipHash``.
+ */
+template <typename Key, typename Value, typename H = Hash<Key>>
+struct HashTable {
+    private:
+    struct Slot {
+        Key   key;
+        Value value;
     };
 
-    using Item    = _ItemCached;
-    using Storage = std::vector<Item>;
+    using Ctrl    = swiss::Ctrl;
+    using Group   = swiss::Group;
+    using BitMask = swiss::BitMask;
+    using Storage = std::vector<Slot>;
 
-    // Makes sure we always use a power of 2 as size
-    static int round_size(int x) {
-        int size = 1;
+    // Makes sure we always use a power of 2 as size, with at least one group
+    static std::size_t round_size(std::size_t x) {
+        std::size_t size = Group::width;
         while (size < x) {
             size *= 2;
         }
         return size;
     }
 
+    static uint64_t h1(uint64_t hash) { return hash >> 7; }
+
+    static Ctrl h2(uint64_t hash) { return Ctrl(hash & 0x7F); }
+
     public:
-    HashTable(int buckets = 128): _storage(Storage(round_size(buckets))) {}
+    HashTable(int buckets = 128) { init(round_size(std::size_t(buckets))); }
 
-    float load_factor() const { return float(used) / float(_storage.size()); }
+    float load_factor() const { return float(used) / float(capacity()); }
 
     bool get(const Key& name, Value& v) const {
-        Item const* item = _find(name);
+        std::size_t i = 0;
 
-        if (item == nullptr) {
+        if (!find(name, H::hash(name), i)) {
             return false;
         }
 
-        v = item->value;
+        v = _slots[i].value;
         return true;
     }
 
@@ -143,13 +397,24 @@ struct HashTable {
     bool upsert(const Key& name, const Value& value) { return track_insert(name, value, true); }
 
     bool remove(const Key& name) {
-        Item* item = (Item*)_find(name);
+        std::size_t i = 0;
 
-        if (item == nullptr) {
+        if (!find(name, H::hash(name), i)) {
             return false;
         }
 
-        item->deleted = true;
+        // A lookup stops at the first group with an empty slot,
+        // so if this group still has one no probe ever went past it
+        // and the slot can be freed instead of leaving a tombstone
+        std::size_t base = i & ~std::size_t(Group::width - 1);
+        if (Group(&_ctrl[base]).match_empty()) {
+            _ctrl[i] = swiss::Empty;
+        } else {
+            _ctrl[i] = swiss::Deleted;
+            deleted += 1;
+        }
+
+        _slots[i] = Slot();
         used -= 1;
         return true;
     }
@@ -157,30 +422,32 @@ struct HashTable {
     int size() const { return used; }
 
     void clear() {
-        for (auto& item: _storage) {
-            item.used = false;
-        }
+        std::fill(_ctrl.begin(), _ctrl.end(), Ctrl(swiss::Empty));
+        used    = 0;
+        deleted = 0;
     }
 
-    void reserve(std::size_t n) { resize(n); }
+    void reserve(std::size_t n) {
+        if (n > max_load()) {
+            resize(n * 8 / 7 + 1);
+        }
+    }
 
     std::string __str__() const {
         std::stringstream ss;
         bool              comma = false;
-        bool              all   = false;
         ss << "{";
-        for (auto i = 0; i < _storage.size(); i++) {
-
-            auto& item = _storage[i];
-
-            if (item.used && !item.deleted) {
-                if (comma) {
-                    ss << ", ";
-                }
+        for (std::size_t i = 0; i < capacity(); i++) {
+            if (!swiss::is_full(_ctrl[i])) {
+                continue;
+            }
 
-                ss << item.key << ": " << item.value;
-                comma = true;
+            if (comma) {
+                ss << ", ";
             }
+
+            ss << _slots[i].key << ": " << _slots[i].value;
+            comma = true;
         }
         ss << "}";
         return ss.str();
@@ -189,102 +456,143 @@ struct HashTable {
     void resize(std::size_t n) { resize_force(n); }
 
     // force a full resize with all the entries being reinserted
+    // tombstones are dropped, the table never shrinks below its entries
     void resize_force(std::size_t n) {
-        Storage storage(round_size(int(n)));
-        int     a = 0;
-        int     b = 0;
+        std::size_t size = round_size(n);
+        while (std::size_t(used) > size * 7 / 8) {
+            size *= 2;
+        }
 
-        for (auto& item: _storage) {
-            if (!item.used || item.deleted) {
+        std::vector<Ctrl> ctrl  = std::move(_ctrl);
+        Storage           slots = std::move(_slots);
+        init(size);
+
+        for (std::size_t i = 0; i < ctrl.size(); i++) {
+            if (!swiss::is_full(ctrl[i])) {
                 continue;
             }
-            insert(storage, item, false, a, b);
-        }
 
-        _storage = storage;
+            uint64_t    hash = H::hash(slots[i].key);
+            std::size_t j    = find_free(hash);
+            _ctrl[j]         = h2(hash);
+            _slots[j]        = std::move(slots[i]);
+        }
     }
 
     // Rebuild the hash using a bigger storage
     // used multiplier == 1 to remove deleted entries
     // can speed up insertion if a lot of keys got deleted
     void rehash(float multiplier = 2.f) {
-        resize(_storage.size() * uint64_t(multiplier >= 1 ? multiplier : 2));
+        resize(std::size_t(float(capacity()) * (multiplier >= 1 ? multiplier : 2)));
     }
 
     private:
-    // this cannot be exposed because it returns a pointer
-    // that could change once rehash is called
-    Item const* _find(const Key& name) const {
-        assert(is_power2(_storage.size()));
-        uint64_t i = H::hash(name);
-
-        // linear probing
-        for (uint64_t offset = 0; offset < _storage.size(); offset++) {
-            // for(int m = -1; m < 2; m += 2) {
-            auto& item = _storage[P2_MOD((i + offset), _storage.size())];
-
-            // item was not used, so we know there was no collision
-            // and no linear probe insert was done after this
-            if (!item.used) {
-                return nullptr;
+    std::size_t capacity() const { return _ctrl.size(); }
+
+    std::size_t max_load() const { return capacity() * 7 / 8; }
+
+    std::size_t group_mask() const { return capacity() / Group::width - 1; }
+
+    void init(std::size_t size) {
+        assert(is_power2(size) && size >= std::size_t(Group::width));
+        _ctrl.assign(size, Ctrl(swiss::Empty));
+        _slots.clear();
+        _slots.resize(size);
+        deleted = 0;
+    }
+
+    // this cannot expose a pointer, it would be invalidated by a rehash
+    bool find(const Key& name, uint64_t hash, std::size_t& index) const {
+        Ctrl        tag = h2(hash);
+        std::size_t g   = h1(hash) & group_mask();
+
+        for (std::size_t step = 1; step <= group_mask() + 1; step++) {
+            std::size_t base = g * Group::width;
+            Group       group(&_ctrl[base]);
+
+            for (BitMask match = group.match(tag); match; match.clear_lowest()) {
+                std::size_t i = base + match.lowest();
+
+                if (_slots[i].key == name) {
+                    index = i;
+                    return true;
+                }
             }
 
-            // Item is not deleted and key matches
-            if (!item.deleted && item.key == name) {
-                return &item;
+            // key would have been inserted in this group
+            if (group.match_empty()) {
+                return false;
             }
-            //}
+
+            g = (g + step) & group_mask();
         }
 
-        return nullptr;
+        return false;
     }
 
-    // insert a key value pair
-    // if the key already exist does not insert
-    bool track_insert(const Key& name, const Value& value, bool upsert) {
-        if (load_factor() >= 0.75) {
-            rehash();
-        }
+    // first empty or deleted slot on the probe sequence of hash
+    std::size_t find_free(uint64_t hash) {
+        std::size_t g = h1(hash) & group_mask();
 
-        Item item(name, value);
-        return insert(_storage, item, upsert, this->used, this->collision);
-    }
+        for (std::size_t step = 1;; step++) {
+            std::size_t base  = g * Group::width;
+            BitMask     match = Group(&_ctrl[base]).match_empty_or_deleted();
 
-    // insert is slower than std::unordered_map
-    static bool
-    insert(Storage& data, Item const& inserted_item, bool upsert, int& used, int& collision) {
+            if (match) {
+                return base + match.lowest();
+            }
 
-        assert(is_power2(data.size()));
-        uint64_t i = inserted_item.hash();
+            collision += 1;
+            g = (g + step) & group_mask();
+        }
+    }
 
-        for (uint64_t offset = 0; offset < data.size(); offset++) {
-            Item& item = data[P2_MOD((i + offset), data.size())];
+    // insert a key value pair
+    // if the key already exist does not insert
+    bool track_insert(const Key& name, const Value& value, bool upsert) {
+        uint64_t    hash = H::hash(name);
+        std::size_t i    = 0;
 
-            if (!item.used || item.deleted) {
-                item = inserted_item;
-                used += 1;
-                return true;
+        if (find(name, hash, i)) {
+            if (upsert) {
+                _slots[i].value = value;
             }
+            return upsert;
+        }
 
-            if (item.key == inserted_item.key) {
-                if (upsert) {
-                    item.value = inserted_item.value;
-                    item.set_hash(i);
-                    return true;
-                }
-                return false;
-            }
+        i = find_free(hash);
 
-            collision += 1;
-            //}
+        // reusing a tombstone does not make the probe sequences longer
+        if (_ctrl[i] == swiss::Empty && std::size_t(used + deleted) >= max_load()) {
+            grow();
+            i = find_free(hash);
         }
 
-        return false;
+        if (_ctrl[i] == swiss::Deleted) {
+            deleted -= 1;
+        }
+
+        _ctrl[i]  = h2(hash);
+        _slots[i] = Slot{name, value};
+        used += 1;
+        return true;
+    }
+
+    // Tombstones are removed by rehashing in place when they make up most of the load
+    // otherwise the capacity is doubled
+    void grow() {
+        if (std::size_t(used) * 2 <= max_load()) {
+            resize_force(capacity());
+        } else {
+            resize_force(capacity() * 2);
+        }
     }
 
-    int     used      = 0;
-    int     collision = 0;
-    Storage _storage;
+    int               used      = 0;
+    int               deleted   = 0;
+    int               collision = 0;
+    std::vector<Ctrl> _ctrl;
+    Storage           _slots;
 
     public:
     int collided() const { return collision; }
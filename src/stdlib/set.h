@@ -2,211 +2,228 @@
 
 #include "ast/values/value.h"
 #include "dtypes.h"
+#include "stdlib/dict.h"
 
 namespace kiwi {
 
-template <typename V>
+//
+// Insertion ordered set, a compact dictionary without values
+//
+template <typename V, typename H = DictHash<V>>
 struct SetNative {
+    struct Unit {
+        bool operator==(Unit const&) const { return true; }
+    };
+    using Table = DictNative<V, Unit, H>;
 
-    std::size_t __sizeof__() const {
-        return sizeof(this) + sizeof(V) * values.size();
-    }
+    SetNative() = default;
 
-    template<typename T>
-    static V* _find(T* self, T const& key) {
-        for(V& value: self->values) {
-            if (value == key) 
-                return &value;
+    SetNative(std::initializer_list<V> items) {
+        for (V const& item: items) {
+            add(item);
         }
-        return nullptr;
     }
 
-    bool __contains__(V const& key) const { 
-        for(auto const& v: values) {
-            if (v == key) {
-                return true;
+    std::size_t __sizeof__() const { return table.__sizeof__(); }
+
+    bool __contains__(V const& key) const { return table.__contains__(key); }
+
+    int __len__() const { return table.__len__(); }
+
+    bool isdisjoint(SetNative const& other) const {
+        for (V const& value: smallest(*this, other)) {
+            if (largest(*this, other).__contains__(value)) {
+                return false;
             }
         }
-        return false;
+        return true;
     }
-
-    int __len__() const {
-        return values.size();
+    bool issubset(SetNative const& other) const {
+        if (__len__() > other.__len__()) {
+            return false;
+        }
+        for (V const& value: *this) {
+            if (!other.__contains__(value)) {
+                return false;
+            }
+        }
+        return true;
     }
-
-    bool isdisjoint(SetNative<V>const& other) {}
-    bool issubset(SetNative<V>const& other) {}
-    bool issuperset(SetNative<V>const& other) {}
-    bool __lte__(SetNative<V>const& other) {}
-    bool __lt__(SetNative<V>const& other) {}
-    bool __gte__(SetNative<V>const& other) {}
-    bool __gt__(SetNative<V>const& other) {}
-
-    SetNative<V> intersection(SetNative<V>const& other) {}
-    SetNative<V> __and__(SetNative<V>const& other) {}
-
-    SetNative<V> union_(SetNative<V>const& other) {}
-    SetNative<V> __or__(SetNative<V>const& other) {}
-
-    SetNative<V> difference(SetNative<V>const& other) {}
-    SetNative<V> __sub__(SetNative<V>const& other) {}
-    
-    SetNative<V> symmetric_difference(SetNative<V>const& other) {}
-    SetNative<V> __xor__(SetNative<V>const& other) {}
-    
-    void update(SetNative<V>const& other) {}
-    void intersection_update(SetNative<V>const& other) {}
-    void difference_update(SetNative<V>const& other) {}
-    void symmetric_difference_update(SetNative<V>const& other) {}
-    
-    void add(V const& val){  values.push_back(val);  }
-    void discard(V const& val) {}
-    void remove(V const& val){
-        for(int i = 0; i < values.size(); i++) {
-            if (values[i] == val) {
-                values.erase(values.begin() + i);
-                return;
+    bool issuperset(SetNative const& other) const { return other.issubset(*this); }
+    bool __le__(SetNative const& other) const { return issubset(other); }
+    bool __lt__(SetNative const& other) const { return __len__() < other.__len__() && issubset(other); }
+    bool __ge__(SetNative const& other) const { return issuperset(other); }
+    bool __gt__(SetNative const& other) const { return __len__() > other.__len__() && issuperset(other); }
+    bool __eq__(SetNative const& other) const { return __len__() == other.__len__() && issubset(other); }
+    bool __ne__(SetNative const& other) const { return !__eq__(other); }
+
+    SetNative intersection(SetNative const& other) const {
+        SetNative result;
+        for (V const& value: *this) {
+            if (other.__contains__(value)) {
+                result.add(value);
             }
         }
-        // raise KeyError
+        return result;
     }
+    SetNative __and__(SetNative const& other) const { return intersection(other); }
 
-    V pop() {
-        V val = *values.rbegin();
-        values.pop_back();
-        return val;
-        // raise KeyError
+    SetNative union_(SetNative const& other) const {
+        SetNative result = copy();
+        result.update(other);
+        return result;
     }
-    void clear(){ values.clear(); }
+    SetNative __or__(SetNative const& other) const { return union_(other); }
 
-    void index(V const& val, int start=0, int end=-1){
-        if (start < 0) {
-            start += int(values.size());
-        }
-        if (end < 0) {
-            end += int(values.size());
-        }
-        for(int i = start; i < end; i++) {
-            if (values[i] == val) {
-                return i;
+    SetNative difference(SetNative const& other) const {
+        SetNative result;
+        for (V const& value: *this) {
+            if (!other.__contains__(value)) {
+                result.add(value);
             }
         }
-        // raise ValueError
+        return result;
     }
+    SetNative __sub__(SetNative const& other) const { return difference(other); }
 
-    struct Reverse {
-        V __next__() {
-            int c = i;
-            i -= 1;
-
-            if (c < 0) {
-                // raise StopException
+    SetNative symmetric_difference(SetNative const& other) const {
+        SetNative result = difference(other);
+        for (V const& value: other) {
+            if (!__contains__(value)) {
+                result.add(value);
             }
-            return self.values[c];
         }
+        return result;
+    }
+    SetNative __xor__(SetNative const& other) const { return symmetric_difference(other); }
 
-        ArrayNative<V>& self;
-        int i;
+    void update(SetNative const& other) {
+        for (V const& value: other) {
+            add(value);
+        }
     }
+    void intersection_update(SetNative const& other) { *this = intersection(other); }
+    void difference_update(SetNative const& other) {
+        for (V const& value: other) {
+            discard(value);
+        }
+    }
+    void symmetric_difference_update(SetNative const& other) { *this = symmetric_difference(other); }
+
+    void add(V const& val) { table.setdefault(val, Unit()); }
+    void discard(V const& val) { table.__delitem__(val); }
+
+    std::optional<KeyError> remove(V const& val) { return table.__delitem__(val); }
 
-    Reverse reverse(){
-        return Reverse{this, int(values.size()) - 1}; 
+    std::variant<V, KeyError> pop() {
+        auto item = table.popitem();
+        if (item.index() == 1) {
+            return KeyError();
+        }
+        return std::get<0>(item).key;
     }
 
-    struct Iterator {
-        using iterator_category = std::forward_iterator_tag;
-        using value_type = T;
-        using difference_type = std::ptrdiff_t;
-        using pointer = T*;
-        using reference = T&;
+    void clear() { table.clear(); }
 
-        reference operator*() const { return *ptr_; }
-         pointer operator->() const { return ptr_; }
+    SetNative copy() const { return *this; }
 
-        V __next__() {
-            int c = i;
-            i += 1;
+    std::optional<KeyError> __delitem__(V const& key) { return remove(key); }
 
-            if (c >= self.values.size()) {
-                // raise StopException
-            }
-            return self.values[c];
+    // C++ iteration
+    struct ConstIterator {
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = V;
+        using pointer           = V const*;
+        using reference         = V const&;
+
+        reference      operator*() const { return it->key; }
+        pointer        operator->() const { return &it->key; }
+        bool           operator==(ConstIterator const& other) const { return it == other.it; }
+        bool           operator!=(ConstIterator const& other) const { return it != other.it; }
+        ConstIterator& operator++() {
+            ++it;
+            return *this;
         }
 
-        bool operator==(Iterator const& other) const {
-            return i == other.i;
-        }
+        typename Table::const_iterator it;
+    };
 
-        SetNative<T>& values;
-        int i = 0;
-    }
+    ConstIterator begin() const { return ConstIterator{table.begin()}; }
+    ConstIterator end() const { return ConstIterator{table.end()}; }
 
-    Iterator begin() { return Iterator{0, self.values.size()}; }
-    Iterator end() { return Iterator{self.values.size()}; }
+    // Python iteration
+    typename Table::Iterator __iter__() { return table.__iter__(); }
 
-    // return Iterable
-    Iterator __iter__() {
-        return Iterator{*this};
-    }
-    
-    ArrayNative<V> copy(){ return this; }
+    Table table;
 
-    void __detitem__(V const& key) {
-        remove(key);
+    private:
+    static SetNative const& smallest(SetNative const& a, SetNative const& b) {
+        return a.__len__() <= b.__len__() ? a : b;
+    }
+    static SetNative const& largest(SetNative const& a, SetNative const& b) {
+        return a.__len__() <= b.__len__() ? b : a;
     }
-
-    lython::Array<V> values;
 };
 
-#define KIWI_ARRAY_METHOD(X) \
-    X(__add__)               \
-    X(__class__)             \
-    X(__class_getitem__)     \
-    X(__contains__)          \
-    X(__delattr__)           \
-    X(__delitem__)           \
-    X(__dir__)               \
-    X(__doc__)               \
-    X(__eq__)                \
-    X(__format__)            \
-    X(__ge__)                \
-    X(__getattribute__)      \
-    X(__getitem__)           \
-    X(__gt__)                \
-    X(__hash__)              \
-    X(__iadd__)              \
-    X(__imul__)              \
-    X(__init__)              \
-    X(__init_subclass__)     \
-    X(__iter__)              \
-    X(__le__)                \
-    X(__len__)               \
-    X(__lt__)                \
-    X(__mul__)               \
-    X(__ne__)                \
-    X(__new__)               \
-    X(__reduce__)            \
-    X(__reduce_ex__)         \
-    X(__repr__)              \
-    X(__reversed__)          \
-    X(__rmul__)              \
-    X(__setattr__)           \
-    X(__setitem__)           \
-    X(__sizeof__)            \
-    X(__str__)               \
-    X(__subclasshook__)      \
-    X(append)                \
-    X(clear)                 \
-    X(copy)                  \
-    X(count)                 \
-    X(extend)                \
-    X(index)                 \
-    X(insert)                \
-    X(pop)                   \
-    X(remove)                \
-    X(reverse)               \
-    X(sort)
+#define KIWI_SET_METHOD(X)          \
+    X(__and__)                      \
+    X(__class__)                    \
+    X(__class_getitem__)            \
+    X(__contains__)                 \
+    X(__delattr__)                  \
+    X(__dir__)                      \
+    X(__doc__)                      \
+    X(__eq__)                       \
+    X(__format__)                   \
+    X(__ge__)                       \
+    X(__getattribute__)             \
+    X(__gt__)                       \
+    X(__hash__)                     \
+    X(__iand__)                     \
+    X(__init__)                     \
+    X(__init_subclass__)            \
+    X(__ior__)                      \
+    X(__isub__)                     \
+    X(__iter__)                     \
+    X(__ixor__)                     \
+    X(__le__)                       \
+    X(__len__)                      \
+    X(__lt__)                       \
+    X(__ne__)                       \
+    X(__new__)                      \
+    X(__or__)                       \
+    X(__rand__)                     \
+    X(__reduce__)                   \
+    X(__reduce_ex__)                \
+    X(__repr__)                     \
+    X(__ror__)                      \
+    X(__rsub__)                     \
+    X(__rxor__)                     \
+    X(__setattr__)                  \
+    X(__sizeof__)                   \
+    X(__str__)                      \
+    X(__sub__)                      \
+    X(__subclasshook__)             \
+    X(__xor__)                      \
+    X(add)                          \
+    X(clear)                        \
+    X(copy)                         \
+    X(difference)                   \
+    X(difference_update)            \
+    X(discard)                      \
+    X(intersection)                 \
+    X(intersection_update)          \
+    X(isdisjoint)                   \
+    X(issubset)                     \
+    X(issuperset)                   \
+    X(pop)                          \
+    X(remove)                       \
+    X(symmetric_difference)         \
+    X(symmetric_difference_update)  \
+    X(union)                        \
+    X(update)
 
 using Set = SetNative<lython::Value>;
 
-}  // namespace kiwi
\ No newline at end of file
+}  // namespace kiwi
@@ -1,83 +1,241 @@
-
 #ifndef LYTHON_SMALLDICT_HEADER
 #define LYTHON_SMALLDICT_HEADER
 
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "hashtable.h"
+
+#if defined(__AVX2__)
+#    include <immintrin.h>
+#endif
+
 namespace lython {
 
-template <typename Key, typename Value>
+/* Map for a handful of entries (keyword arguments, attribute tables)
+ *
+ * The first N entries are stored inline, no allocation happens until the map overflows.
+ * A 32-bit tag of every key hash is kept in a separate array,
+ * a lookup compares the tags of all the entries at once with SSE2/AVX2
+ * and only compares the keys whose tag matched.
+ *
+ * Inserting the N + 1 entry moves everything to a HashTable,
+ * the map stays promoted until it is destroyed.
+ */
+template <typename Key, typename Value, int N = 8, typename H = Hash<Key>>
 class SmallDict {
+    static_assert(N % 4 == 0 && N <= 16, "N must be a multiple of 4, up to 16");
+
     public:
-    struct _Item {
-        _Item(): key(Key()) {}
+    using Item  = std::pair<Key, Value>;
+    using Table = HashTable<Key, Value, H>;
 
-        _Item(Key const& k, Value const& v): key(k), value(v) {}
+    SmallDict(int buckets = 0) {
+        if (buckets > N) {
+            promote(buckets);
+        }
+    }
 
-        Key const key;
-        Value     value;
+    SmallDict(SmallDict const& other) { copy(other); }
 
-        _Item& operator=(_Item const& i) {
-            Key& mutkey = (Key&)key;
-            mutkey      = i.key;
-            value       = i.value;
-            return *this;
+    SmallDict(SmallDict&& other) noexcept: _table(std::move(other._table)) {
+        for (int i = 0; i < other._size; i++) {
+            new (item(i)) Item(std::move(*other.item(i)));
+            _tags[i] = other._tags[i];
         }
-    };
+        _size = other._size;
+        other.destroy();
+    }
 
-    using Item    = _Item;
-    using Storage = std::vector<Item>;
+    SmallDict& operator=(SmallDict const& other) {
+        if (this != &other) {
+            destroy();
+            _table.reset();
+            copy(other);
+        }
+        return *this;
+    }
 
-    SmallDict(int buckets = 128): _storage(buckets) {}
+    ~SmallDict() { destroy(); }
 
     bool get(const Key& name, Value& v) const {
-        for (Item const& item: _storage) {
-            if (name == item.key) {
-                v = item.value;
-                return true;
-            }
+        if (_table) {
+            return _table->get(name, v);
+        }
+
+        int i = find(name, tag(name));
+        if (i < 0) {
+            return false;
         }
-        return false;
+
+        v = item(i)->second;
+        return true;
     }
 
-    bool insert(const Key& name, const Value& value) {
-        for (Item const& item: _storage) {
-            if (name == item.key) {
-                return false;
-            }
+    bool insert(const Key& name, const Value& value) { return track_insert(name, value, false); }
+
+    bool upsert(const Key& name, const Value& value) { return track_insert(name, value, true); }
+
+    bool remove(const Key& name) {
+        if (_table) {
+            return _table->remove(name);
+        }
+
+        int i = find(name, tag(name));
+        if (i < 0) {
+            return false;
         }
 
-        _storage.emplace_back(name, value);
+        // order is not preserved, the last entry takes the free spot
+        int last = _size - 1;
+        if (i != last) {
+            *item(i) = std::move(*item(last));
+            _tags[i] = _tags[last];
+        }
+        item(last)->~Item();
+        _size -= 1;
         return true;
     }
 
-    bool upsert(const Key& name, const Value& value) {
-        for (Item& item: _storage) {
-            if (name == item.key) {
-                item.value = value;
-                return true;
+    bool has_key(const Key& name) const {
+        if (_table) {
+            Value v;
+            return _table->get(name, v);
+        }
+        return find(name, tag(name)) >= 0;
+    }
+
+    int size() const { return _table ? _table->size() : _size; }
+
+    bool promoted() const { return _table != nullptr; }
+
+    void clear() {
+        if (_table) {
+            _table->clear();
+        }
+        destroy();
+    }
+
+    void reserve(int n) {
+        if (n > N && !_table) {
+            promote(n);
+        }
+    }
+
+    private:
+    static uint32_t tag(Key const& name) {
+        uint64_t h = H::hash(name);
+        return uint32_t(h ^ (h >> 32));
+    }
+
+    Item* item(int i) { return reinterpret_cast<Item*>(_storage) + i; }
+
+    Item const* item(int i) const { return reinterpret_cast<Item const*>(_storage) + i; }
+
+    // Bit i is set if the tag of entry i matches
+    uint32_t match(uint32_t value) const {
+        uint32_t mask = 0;
+
+#if defined(__AVX2__)
+        if constexpr (N % 8 == 0) {
+            __m256i needle = _mm256_set1_epi32(int(value));
+            for (int i = 0; i < N; i += 8) {
+                __m256i tags = _mm256_loadu_si256((__m256i const*)(_tags + i));
+                __m256i eq   = _mm256_cmpeq_epi32(tags, needle);
+                mask |= uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(eq))) << i;
             }
+            return mask & ((1u << _size) - 1);
+        }
+#endif
+
+#if LY_HASHTABLE_SSE2
+        __m128i needle = _mm_set1_epi32(int(value));
+        for (int i = 0; i < N; i += 4) {
+            __m128i tags = _mm_loadu_si128((__m128i const*)(_tags + i));
+            __m128i eq   = _mm_cmpeq_epi32(tags, needle);
+            mask |= uint32_t(_mm_movemask_ps(_mm_castsi128_ps(eq))) << i;
+        }
+#else
+        for (int i = 0; i < N; i++) {
+            mask |= uint32_t(_tags[i] == value) << i;
         }
+#endif
+        return mask & ((1u << _size) - 1);
+    }
 
-        _storage.emplace_back(name, value);
-        return true;
+    int find(Key const& name, uint32_t value) const {
+        for (uint32_t mask = match(value); mask != 0; mask &= mask - 1) {
+            int i = swiss::lowest_bit(mask);
+            if (item(i)->first == name) {
+                return i;
+            }
+        }
+        return -1;
     }
 
-    void clear() { _storage.clear(); }
+    bool track_insert(const Key& name, const Value& value, bool upsert) {
+        if (_table) {
+            return upsert ? _table->upsert(name, value) : _table->insert(name, value);
+        }
 
-    void reserve(int n) { _storage.resize(n); }
+        uint32_t t = tag(name);
+        int      i = find(name, t);
 
-    bool has_key(const Key& name) const {
-        for (Item const& item: _storage) {
-            if (name == item.key) {
-                return true;
+        if (i >= 0) {
+            if (upsert) {
+                item(i)->second = value;
             }
+            return upsert;
+        }
+
+        if (_size == N) {
+            promote(N * 4);
+            return _table->insert(name, value);
         }
-        return false;
+
+        new (item(_size)) Item(name, value);
+        _tags[_size] = t;
+        _size += 1;
+        return true;
     }
 
-    private:
-    int     _size = 0;
-    Storage _storage;
+    void promote(int buckets) {
+        _table = std::make_unique<Table>(buckets);
+
+        for (int i = 0; i < _size; i++) {
+            _table->insert(item(i)->first, item(i)->second);
+        }
+        destroy();
+    }
+
+    void copy(SmallDict const& other) {
+        if (other._table) {
+            _table = std::make_unique<Table>(*other._table);
+            return;
+        }
+
+        for (int i = 0; i < other._size; i++) {
+            new (item(i)) Item(*other.item(i));
+            _tags[i] = other._tags[i];
+        }
+        _size = other._size;
+    }
+
+    // destroy the inline entries
+    void destroy() {
+        for (int i = 0; i < _size; i++) {
+            item(i)->~Item();
+        }
+        _size = 0;
+    }
+
+    int                    _size    = 0;
+    uint32_t               _tags[N] = {0};
+    std::unique_ptr<Table> _table;
+
+    alignas(Item) unsigned char _storage[N * sizeof(Item)];
 };
 }  // namespace lython
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "utilities/pool.h"
+
+namespace kiwi {
+namespace sorting {
+
+//
+// Stable adaptive merge sort (TimSort)
+//
+// The input is split in natural runs, strictly descending runs are reversed
+// and short runs are extended to `min_run_length` with a binary insertion sort.
+// Runs are pushed on a stack and merged so their lengths keep decreasing (Java's fixed invariants).
+// Before merging two runs, the elements already in place at both ends are skipped with a gallop;
+// this is what makes already sorted or partially sorted inputs close to O(n).
+//
+
+// Inputs smaller than this are sorted with a single binary insertion sort
+constexpr std::ptrdiff_t min_merge = 32;
+
+inline std::ptrdiff_t min_run_length(std::ptrdiff_t n) {
+    std::ptrdiff_t r = 0;
+    while (n >= min_merge) {
+        r |= n & 1;
+        n >>= 1;
+    }
+    return n + r;
+}
+
+// Length of the run starting at first, a strictly descending run is reversed in place
+template <typename It, typename Compare>
+std::ptrdiff_t count_run(It first, It last, Compare& comp) {
+    It next = first + 1;
+    if (next == last) {
+        return 1;
+    }
+
+    if (comp(*next, *first)) {
+        while (next + 1 != last && comp(*(next + 1), *next)) {
+            ++next;
+        }
+        ++next;
+        std::reverse(first, next);
+    } else {
+        while (next + 1 != last && !comp(*(next + 1), *next)) {
+            ++next;
+        }
+        ++next;
+    }
+    return next - first;
+}
+
+// [first, start) is sorted, insert the elements of [start, last) after their equals
+template <typename It, typename Compare>
+void binary_insertion(It first, It start, It last, Compare& comp) {
+    for (It i = start; i != last; ++i) {
+        auto value = std::move(*i);
+        It   pos   = std::upper_bound(first, i, value, comp);
+        std::move_backward(pos, i, i + 1);
+        *pos = std::move(value);
+    }
+}
+
+// upper_bound searching from the left: exponential steps then a binary search
+template <typename It, typename T, typename Compare>
+It gallop_right(It first, It last, T const& key, Compare& comp) {
+    std::ptrdiff_t n    = last - first;
+    std::ptrdiff_t prev = 0;
+    std::ptrdiff_t step = 1;
+
+    while (step < n && !comp(key, first[step - 1])) {
+        prev = step;
+        step = step * 2 + 1;
+    }
+    return std::upper_bound(first + prev, first + std::min(step, n), key, comp);
+}
+
+// lower_bound searching from the right
+template <typename It, typename T, typename Compare>
+It gallop_left(It first, It last, T const& key, Compare& comp) {
+    std::ptrdiff_t n    = last - first;
+    std::ptrdiff_t prev = 0;
+    std::ptrdiff_t step = 1;
+
+    while (step < n && !comp(last[-step], key)) {
+        prev = step;
+        step = step * 2 + 1;
+    }
+    return std::lower_bound(last - std::min(step, n), last - prev, key, comp);
+}
+
+template <typename It, typename Compare>
+class TimSort {
+    public:
+    using T = typename std::iterator_traits<It>::value_type;
+
+    TimSort(It first, Compare comp): first(first), comp(comp) {}
+
+    void sort(It last) {
+        std::ptrdiff_t n = last - first;
+        if (n < 2) {
+            return;
+        }
+
+        if (n < min_merge) {
+            std::ptrdiff_t run = count_run(first, last, comp);
+            binary_insertion(first, first + run, last, comp);
+            return;
+        }
+
+        std::ptrdiff_t min_run = min_run_length(n);
+        It             lo      = first;
+
+        while (lo != last) {
+            std::ptrdiff_t run = count_run(lo, last, comp);
+
+            if (run < min_run) {
+                std::ptrdiff_t forced = std::min(min_run, std::ptrdiff_t(last - lo));
+                binary_insertion(lo, lo + run, lo + forced, comp);
+                run = forced;
+            }
+
+            runs.push_back(Run{lo - first, run});
+            merge_collapse();
+            lo += run;
+        }
+
+        merge_force_collapse();
+    }
+
+    private:
+    struct Run {
+        std::ptrdiff_t base;
+        std::ptrdiff_t len;
+    };
+
+    void merge_collapse() {
+        while (runs.size() > 1) {
+            std::ptrdiff_t n = std::ptrdiff_t(runs.size()) - 2;
+
+            if ((n > 0 && runs[n - 1].len <= runs[n].len + runs[n + 1].len) ||
+                (n > 1 && runs[n - 2].len <= runs[n - 1].len + runs[n].len)) {
+                if (runs[n - 1].len < runs[n + 1].len) {
+                    n -= 1;
+                }
+            } else if (runs[n].len > runs[n + 1].len) {
+                break;
+            }
+            merge_at(n);
+        }
+    }
+
+    void merge_force_collapse() {
+        while (runs.size() > 1) {
+            std::ptrdiff_t n = std::ptrdiff_t(runs.size()) - 2;
+            if (n > 0 && runs[n - 1].len < runs[n + 1].len) {
+                n -= 1;
+            }
+            merge_at(n);
+        }
+    }
+
+    void merge_at(std::ptrdiff_t i) {
+        Run& a = runs[i];
+        Run& b = runs[i + 1];
+
+        merge(first + a.base, first + b.base, first + b.base + b.len);
+
+        a.len += b.len;
+        runs.erase(runs.begin() + i + 1);
+    }
+
+    void merge(It lo, It middle, It hi) {
+        // elements of the first run smaller than the second run are already in place
+        lo = gallop_right(lo, middle, *middle, comp);
+        if (lo == middle) {
+            return;
+        }
+
+        // elements of the second run bigger than the first run are already in place
+        hi = gallop_left(middle, hi, *(middle - 1), comp);
+
+        if (middle - lo <= hi - middle) {
+            merge_lo(lo, middle, hi);
+        } else {
+            merge_hi(lo, middle, hi);
+        }
+    }
+
+    // the first run is the smallest, it is moved out and the merge goes forward
+    void merge_lo(It lo, It middle, It hi) {
+        buffer.clear();
+        buffer.insert(buffer.end(), std::make_move_iterator(lo), std::make_move_iterator(middle));
+
+        auto a   = buffer.begin();
+        It   b   = middle;
+        It   out = lo;
+
+        while (a != buffer.end() && b != hi) {
+            if (comp(*b, *a)) {
+                *out++ = std::move(*b++);
+            } else {
+                *out++ = std::move(*a++);
+            }
+        }
+        std::move(a, buffer.end(), out);
+    }
+
+    // the second run is the smallest, it is moved out and the merge goes backward
+    void merge_hi(It lo, It middle, It hi) {
+        buffer.clear();
+        buffer.insert(buffer.end(), std::make_move_iterator(middle), std::make_move_iterator(hi));
+
+        auto b   = buffer.end();
+        It   a   = middle;
+        It   out = hi;
+
+        while (a != lo && b != buffer.begin()) {
+            if (comp(*(b - 1), *(a - 1))) {
+                *--out = std::move(*--a);
+            } else {
+                *--out = std::move(*--b);
+            }
+        }
+        std::move_backward(buffer.begin(), b, out);
+    }
+
+    It               first;
+    Compare          comp;
+    std::vector<Run> runs;
+    std::vector<T>   buffer;
+};
+
+template <typename It, typename Compare>
+void timsort(It first, It last, Compare comp) {
+    TimSort<It, Compare>(first, comp).sort(last);
+}
+
+//
+// Parallel sort
+//
+// The array is cut in one chunk per worker, the chunks are sorted with timsort concurrently
+// and then merged pairwise. Every merge is split in independent pieces with the merge path
+// co-ranking so all the workers stay busy until the last merge.
+//
+
+// Below this size the parallel sort does not pay for the tasks
+constexpr std::size_t parallel_threshold = std::size_t(1) << 16;
+
+// Number of elements of `a` among the first `d` elements of the stable merge of `a` and `b`
+template <typename T, typename Compare>
+std::size_t co_rank(std::size_t d, T const* a, std::size_t na, T const* b, std::size_t nb, Compare& comp) {
+    std::size_t lo = d > nb ? d - nb : 0;
+    std::size_t hi = std::min(d, na);
+
+    while (lo < hi) {
+        std::size_t mid = lo + (hi - lo) / 2;
+        // ties go to `a`
+        if (!comp(b[d - mid - 1], a[mid])) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+#if !BUILD_WEBASSEMBLY
+template <typename T, typename Compare>
+void parallel_sort(T* data, std::size_t n, Compare comp, lython::ThreadPool& pool) {
+    std::size_t workers = pool.size();
+
+    if (workers < 2 || n < parallel_threshold) {
+        timsort(data, data + n, comp);
+        return;
+    }
+
+    // every task is waited for before rethrowing, they still use the buffers.
+    // A comparison that throws leaves the elements in an unspecified state, like timsort
+    std::vector<std::future<void>> tasks;
+    auto                           wait = [&tasks]() {
+        for (auto& task: tasks) {
+            task.wait();
+        }
+        std::vector<std::future<void>> done = std::move(tasks);
+        tasks.clear();
+        for (auto& task: done) {
+            task.get();
+        }
+    };
+
+    std::vector<std::size_t> bounds;
+    for (std::size_t k = 0; k <= workers; k++) {
+        bounds.push_back(k * n / workers);
+    }
+
+    for (std::size_t k = 0; k + 1 < bounds.size(); k++) {
+        T* lo = data + bounds[k];
+        T* hi = data + bounds[k + 1];
+        tasks.push_back(pool.queue_task([lo, hi, comp]() { timsort(lo, hi, comp); }));
+    }
+    wait();
+
+    std::vector<T> buffer(n);
+    T*             src = data;
+    T*             dst = buffer.data();
+
+    while (bounds.size() > 2) {
+        std::vector<std::size_t> merged;
+        std::size_t              pairs  = (bounds.size() - 1) / 2;
+        std::size_t              pieces = std::max(workers / std::max(pairs, std::size_t(1)), std::size_t(1));
+
+        std::size_t k = 0;
+        for (; k + 2 < bounds.size(); k += 2) {
+            T const*    a  = src + bounds[k];
+            T const*    b  = src + bounds[k + 1];
+            std::size_t na = bounds[k + 1] - bounds[k];
+            std::size_t nb = bounds[k + 2] - bounds[k + 1];
+            T*          out = dst + bounds[k];
+
+            for (std::size_t p = 0; p < pieces; p++) {
+                std::size_t d0 = p * (na + nb) / pieces;
+                std::size_t d1 = (p + 1) * (na + nb) / pieces;
+
+                tasks.push_back(pool.queue_task([=]() {
+                    Compare     cmp = comp;
+                    std::size_t i0  = co_rank(d0, a, na, b, nb, cmp);
+                    std::size_t i1  = co_rank(d1, a, na, b, nb, cmp);
+
+                    std::merge(std::make_move_iterator(const_cast<T*>(a) + i0),
+                               std::make_move_iterator(const_cast<T*>(a) + i1),
+                               std::make_move_iterator(const_cast<T*>(b) + (d0 - i0)),
+                               std::make_move_iterator(const_cast<T*>(b) + (d1 - i1)),
+                               out + d0,
+                               cmp);
+                }));
+            }
+            merged.push_back(bounds[k]);
+        }
+
+        // odd chunk out, it is only moved
+        if (k + 1 < bounds.size()) {
+            std::move(src + bounds[k], src + bounds[k + 1], dst + bounds[k]);
+            merged.push_back(bounds[k]);
+        }
+        merged.push_back(n);
+
+        wait();
+        bounds = std::move(merged);
+        std::swap(src, dst);
+    }
+
+    if (src != data) {
+        std::move(src, src + n, data);
+    }
+}
+
+// Workers of the parallel sort, started on the first large sort
+inline lython::ThreadPool& sort_pool() {
+    static lython::ThreadPool pool;
+    return pool;
+}
+#endif
+
+// Sort used by the runtime containers, parallel above `parallel_threshold`
+template <typename T, typename Compare>
+void stable_sort(T* data, std::size_t n, Compare comp) {
+#if !BUILD_WEBASSEMBLY
+    if (n >= parallel_threshold) {
+        parallel_sort(data, n, comp, sort_pool());
+        return;
+    }
+#endif
+    timsort(data, data + n, comp);
+}
+
+}  // namespace sorting
+}  // namespace kiwi
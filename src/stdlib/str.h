@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "ast/values/value.h"
+#include "dtypes.h"
+#include "stdlib/array.h"
+
+namespace kiwi {
+
+//
+// Runtime representation of the strings built by concatenation
+//
+// `s = s + part` in a loop would copy `s` on every iteration.
+// Instead the result of a concatenation shares an append only buffer with its left operand:
+// appending to the value that ends the buffer writes in place (the capacity doubles),
+// the other values only see their own prefix so strings keep their value semantic.
+// Appending to a value that does not end the buffer copies its prefix in a new buffer first.
+//
+// The characters are always contiguous, reading the string never needs to flatten it.
+//
+struct StringBuilder {
+    StringBuilder() = default;
+
+    StringBuilder(lython::StringView str): buffer(std::make_shared<lython::String>()) {
+        buffer->reserve(std::max(str.size() * 2, min_capacity));
+        buffer->append(str.data(), str.size());
+        length = str.size();
+    }
+
+    StringBuilder concat(lython::StringView str) const {
+        StringBuilder result;
+
+        if (buffer != nullptr && buffer->size() == length) {
+            // `str` can point inside the buffer (s + s), append handles the aliasing
+            result.buffer = buffer;
+        } else {
+            result.buffer = std::make_shared<lython::String>();
+            result.buffer->reserve(std::max((length + str.size()) * 2, min_capacity));
+            result.buffer->append(view());
+        }
+
+        result.buffer->append(str.data(), str.size());
+        result.length = length + str.size();
+        return result;
+    }
+
+    lython::StringView view() const {
+        if (buffer == nullptr) {
+            return lython::StringView();
+        }
+        return lython::StringView(buffer->data(), length);
+    }
+
+    lython::String str() const { return lython::String(view()); }
+
+    int __len__() const { return int(length); }
+
+    bool operator==(StringBuilder const& other) const { return view() == other.view(); }
+
+    static constexpr std::size_t min_capacity = 32;
+
+    std::shared_ptr<lython::String> buffer;
+    std::size_t                     length = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& out, StringBuilder const& str) {
+    return out << '"' << str.view() << '"';
+}
+
+}  // namespace kiwi
+
+template <>
+struct std::hash<kiwi::StringBuilder> {
+    // same hash as the String with the same characters
+    std::size_t operator()(kiwi::StringBuilder const& str) const noexcept {
+        lython::StringView view = str.view();
+        return lython::xx_hash_3(view.data(), view.size());
+    }
+};
+
+namespace kiwi {
+
+// Characters of a str value, whichever representation it uses
+inline lython::StringView string_view(lython::Value const& value) {
+    if (value.is_type<StringBuilder>()) {
+        return value.as<StringBuilder const&>().view();
+    }
+    return value.as<lython::String const&>();
+}
+
+// Add-str-str, the result shares the buffer of the left operand when it can
+inline lython::Value str_add(void* ctx, lython::Array<lython::Value>& args) {
+    lython::register_value<StringBuilder>();
+
+    lython::StringView rhs = string_view(args[1]);
+
+    if (args[0].is_type<StringBuilder>()) {
+        return lython::make_value<StringBuilder>(args[0].as<StringBuilder const&>().concat(rhs));
+    }
+    return lython::make_value<StringBuilder>(StringBuilder(string_view(args[0])).concat(rhs));
+}
+
+// sep.join(strs), the size is computed first so the result is allocated once
+template <typename It>
+lython::String join(lython::StringView sep, It first, It last) {
+    std::size_t count = 0;
+    std::size_t size  = 0;
+    for (It it = first; it != last; ++it) {
+        size += string_view(*it).size();
+        count += 1;
+    }
+
+    if (count == 0) {
+        return lython::String();
+    }
+
+    lython::String result(size + sep.size() * (count - 1), '\0');
+    char*          out = result.data();
+
+    for (It it = first; it != last; ++it) {
+        if (it != first) {
+            std::memcpy(out, sep.data(), sep.size());
+            out += sep.size();
+        }
+        lython::StringView str = string_view(*it);
+        std::memcpy(out, str.data(), str.size());
+        out += str.size();
+    }
+    return result;
+}
+
+inline lython::String join(lython::StringView sep, ArrayNative<lython::Value> const& strs) {
+    return join(sep, strs.values.begin(), strs.values.end());
+}
+
+// str.join(sep, list)
+inline lython::Value str_join(void* ctx, lython::Array<lython::Value>& args) {
+    ArrayNative<lython::Value> const& strs = args[1].as<ArrayNative<lython::Value> const&>();
+    return lython::make_value<lython::String>(join(string_view(args[0]), strs));
+}
+
+}  // namespace kiwi
@@ -2,6 +2,8 @@
 
 #include "ast/values/value.h"
 #include "dtypes.h"
+#include "stdlib/array.h"
+#include "stdlib/cow.h"
 
 namespace kiwi {
 
@@ -13,6 +15,9 @@ struct TupleNative {
     }
 
     bool __contains__(V const& key) const { 
+        if constexpr (kernels::is_searchable<V>) {
+            return kernels::find(values.data(), values.size(), key) < values.size();
+        }
         for(auto const& v: values) {
             if (v == key) {
                 return true;
@@ -36,12 +41,12 @@ struct TupleNative {
             return self.values[c];
         }
 
-        ArrayNative<V>& self;
+        TupleNative<V>& self;
         int i;
-    }
+    };
 
     Reverse reverse(){
-        return Reverse{this, int(values.size()) - 1}; 
+        return Reverse{*this, int(values.size()) - 1}; 
     }
 
     struct Iterator {
@@ -55,7 +60,7 @@ struct TupleNative {
             return self.values[c];
         }
 
-        ArrayNative<V>& self;
+        TupleNative<V>& self;
         int i = 0;
     };
 
@@ -64,11 +69,11 @@ struct TupleNative {
         return Iterator{*this};
     }
     
-    TupleNative<V> copy(){ return this; }
+    TupleNative<V> copy(){ return *this; }
 
     TupleNative<V> __add__(TupleNative<V> const& other) const {
-        ArrayNative<V> result;
-        result.values.reserve(other.size() + values.size());
+        TupleNative<V> result;
+        result.values.reserve(other.values.size() + values.size());
         for(auto const& v: values) {
             result.values.push_back(v);
         }
@@ -79,7 +84,7 @@ struct TupleNative {
     }
 
     V __getitem__(int const& key) const {
-        return result.values[key];
+        return values[key];
         // raise
     }
 
@@ -91,7 +96,7 @@ struct TupleNative {
         // raise TypeError
     }
 
-    lython::Array<V> values;
+    CowArray<V> values;
 };
 
 #define KIWI_ARRAY_METHOD(X) \
@@ -0,0 +1,473 @@
+#ifndef LYTHON_UTILITIES_FLAT_MAP_HEADER
+#define LYTHON_UTILITIES_FLAT_MAP_HEADER
+
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#include "stdlib/hashtable.h"
+
+namespace lython {
+
+/* Flat open addressing map implementing the subset of std::unordered_map used by the code base.
+ *
+ * Entries are stored inline in a slot array indexed by one control byte per slot
+ * (see HashTable), a lookup is usually one cache miss in the control bytes
+ * and one in the slots instead of walking the bucket list of a node based map.
+ * Empty maps do not allocate.
+ *
+ * Unlike std::unordered_map, growing the table moves the entries:
+ * references, pointers and iterators are invalidated by insertions.
+ */
+template <typename K,
+          typename V,
+          typename H     = std::hash<K>,
+          typename Eq    = std::equal_to<K>,
+          typename Alloc = std::allocator<std::pair<K const, V>>>
+class FlatMap {
+    public:
+    using key_type       = K;
+    using mapped_type    = V;
+    using value_type     = std::pair<K const, V>;
+    using size_type      = std::size_t;
+    using hasher         = H;
+    using key_equal      = Eq;
+    using allocator_type = Alloc;
+
+    private:
+    using Ctrl      = swiss::Ctrl;
+    using Group     = swiss::Group;
+    using BitMask   = swiss::BitMask;
+    using CtrlAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Ctrl>;
+    using SlotAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<value_type>;
+
+    template <bool Const>
+    class Iterator {
+        public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = FlatMap::value_type;
+        using difference_type   = std::ptrdiff_t;
+        using reference = std::conditional_t<Const, value_type const&, value_type&>;
+        using pointer   = std::conditional_t<Const, value_type const*, value_type*>;
+
+        Iterator() = default;
+
+        template <bool C = Const, typename = std::enable_if_t<C>>
+        Iterator(Iterator<false> const& it): ctrl(it.ctrl), end(it.end), slot(it.slot) {}
+
+        reference operator*() const { return *slot; }
+
+        pointer operator->() const { return slot; }
+
+        Iterator& operator++() {
+            ++ctrl;
+            ++slot;
+            skip();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator it = *this;
+            ++(*this);
+            return it;
+        }
+
+        template <bool C>
+        bool operator==(Iterator<C> const& other) const {
+            return ctrl == other.ctrl;
+        }
+
+        template <bool C>
+        bool operator!=(Iterator<C> const& other) const {
+            return ctrl != other.ctrl;
+        }
+
+        private:
+        Iterator(Ctrl const* ctrl, Ctrl const* end, pointer slot): ctrl(ctrl), end(end), slot(slot) {
+            skip();
+        }
+
+        void skip() {
+            while (ctrl != end && !swiss::is_full(*ctrl)) {
+                ++ctrl;
+                ++slot;
+            }
+        }
+
+        Ctrl const* ctrl = nullptr;
+        Ctrl const* end  = nullptr;
+        pointer     slot = nullptr;
+
+        friend class FlatMap;
+        template <bool>
+        friend class Iterator;
+    };
+
+    public:
+    using iterator       = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatMap() = default;
+
+    explicit FlatMap(size_type n) { reserve(n); }
+
+    FlatMap(std::initializer_list<value_type> init) {
+        reserve(init.size());
+        for (auto const& item: init) {
+            insert(item);
+        }
+    }
+
+    FlatMap(FlatMap const& other) {
+        reserve(other.size());
+        for (auto const& item: other) {
+            insert(item);
+        }
+    }
+
+    FlatMap(FlatMap&& other) noexcept { swap(other); }
+
+    FlatMap& operator=(FlatMap other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~FlatMap() { release(); }
+
+    void swap(FlatMap& other) noexcept {
+        std::swap(_ctrl, other._ctrl);
+        std::swap(_slots, other._slots);
+        std::swap(_capacity, other._capacity);
+        std::swap(_size, other._size);
+        std::swap(_deleted, other._deleted);
+    }
+
+    iterator begin() { return iterator(_ctrl, _ctrl + _capacity, _slots); }
+    iterator end() { return iterator(_ctrl + _capacity, _ctrl + _capacity, _slots + _capacity); }
+
+    const_iterator begin() const { return const_iterator(_ctrl, _ctrl + _capacity, _slots); }
+    const_iterator end() const {
+        return const_iterator(_ctrl + _capacity, _ctrl + _capacity, _slots + _capacity);
+    }
+
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    size_type size() const { return _size; }
+
+    bool empty() const { return _size == 0; }
+
+    size_type bucket_count() const { return _capacity; }
+
+    float load_factor() const { return _capacity == 0 ? 0.f : float(_size) / float(_capacity); }
+
+    // keeps the memory around
+    void clear() {
+        destroy_slots();
+        std::fill(_ctrl, _ctrl + _capacity, Ctrl(swiss::Empty));
+        _size    = 0;
+        _deleted = 0;
+    }
+
+    void reserve(size_type n) {
+        if (n > max_load(_capacity)) {
+            rehash_to(capacity_for(n));
+        }
+    }
+
+    iterator find(K const& key) {
+        size_type i = 0;
+        if (find_index(key, hash(key), i)) {
+            return iterator_at(i);
+        }
+        return end();
+    }
+
+    const_iterator find(K const& key) const {
+        size_type i = 0;
+        if (find_index(key, hash(key), i)) {
+            return const_iterator(_ctrl + i, _ctrl + _capacity, _slots + i);
+        }
+        return end();
+    }
+
+    size_type count(K const& key) const {
+        size_type i = 0;
+        return find_index(key, hash(key), i) ? 1 : 0;
+    }
+
+    bool contains(K const& key) const { return count(key) == 1; }
+
+    V& at(K const& key) {
+        auto it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("FlatMap::at");
+        }
+        return it->second;
+    }
+
+    V const& at(K const& key) const {
+        auto it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("FlatMap::at");
+        }
+        return it->second;
+    }
+
+    V& operator[](K const& key) { return try_emplace(key).first->second; }
+
+    V& operator[](K&& key) { return try_emplace(std::move(key)).first->second; }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(K const& key, Args&&... args) {
+        return emplace_key(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        return emplace_key(std::move(key), std::forward<Args>(args)...);
+    }
+
+    std::pair<iterator, bool> insert(value_type const& item) {
+        return emplace_key(item.first, item.second);
+    }
+
+    template <typename P>
+    std::pair<iterator, bool> insert(P&& item) {
+        return emplace(std::forward<P>(item));
+    }
+
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(K const& key, M&& value) {
+        auto result = emplace_key(key, std::forward<M>(value));
+        if (!result.second) {
+            result.first->second = std::forward<M>(value);
+        }
+        return result;
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        std::pair<K, V> item(std::forward<Args>(args)...);
+        return emplace_key(std::move(item.first), std::move(item.second));
+    }
+
+    size_type erase(K const& key) {
+        size_type i = 0;
+        if (!find_index(key, hash(key), i)) {
+            return 0;
+        }
+        erase_index(i);
+        return 1;
+    }
+
+    iterator erase(const_iterator pos) {
+        size_type i = size_type(pos.ctrl - _ctrl);
+        erase_index(i);
+        return iterator(_ctrl + i + 1, _ctrl + _capacity, _slots + i + 1);
+    }
+
+    iterator erase(iterator pos) { return erase(const_iterator(pos)); }
+
+    bool operator==(FlatMap const& other) const {
+        if (size() != other.size()) {
+            return false;
+        }
+        for (auto const& item: *this) {
+            auto it = other.find(item.first);
+            if (it == other.end() || !(it->second == item.second)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool operator!=(FlatMap const& other) const { return !(*this == other); }
+
+    private:
+    // std::hash is the identity for integers and pointers,
+    // mix it so both the group index and the control byte get entropy
+    static uint64_t hash(K const& key) {
+        return wy::mix(uint64_t(H()(key)), 0x9E3779B97F4A7C15ull);
+    }
+
+    static uint64_t h1(uint64_t hash) { return hash >> 7; }
+
+    static Ctrl h2(uint64_t hash) { return Ctrl(hash & 0x7F); }
+
+    static size_type max_load(size_type capacity) { return capacity - capacity / 8; }
+
+    static size_type capacity_for(size_type n) {
+        size_type capacity = Group::width;
+        while (max_load(capacity) < n) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    size_type group_mask() const { return _capacity / Group::width - 1; }
+
+    iterator iterator_at(size_type i) {
+        return iterator(_ctrl + i, _ctrl + _capacity, _slots + i);
+    }
+
+    bool find_index(K const& key, uint64_t hash, size_type& index) const {
+        if (_capacity == 0) {
+            return false;
+        }
+
+        Ctrl      tag = h2(hash);
+        size_type g   = h1(hash) & group_mask();
+
+        for (size_type step = 1; step <= group_mask() + 1; step++) {
+            size_type base = g * Group::width;
+            Group     group(_ctrl + base);
+
+            for (BitMask match = group.match(tag); match; match.clear_lowest()) {
+                size_type i = base + match.lowest();
+
+                if (Eq()(_slots[i].first, key)) {
+                    index = i;
+                    return true;
+                }
+            }
+
+            if (group.match_empty()) {
+                return false;
+            }
+
+            g = (g + step) & group_mask();
+        }
+        return false;
+    }
+
+    size_type find_free(uint64_t hash) const {
+        size_type g = h1(hash) & group_mask();
+
+        for (size_type step = 1;; step++) {
+            size_type base  = g * Group::width;
+            BitMask   match = Group(_ctrl + base).match_empty_or_deleted();
+
+            if (match) {
+                return base + match.lowest();
+            }
+            g = (g + step) & group_mask();
+        }
+    }
+
+    template <typename KK, typename... Args>
+    std::pair<iterator, bool> emplace_key(KK&& key, Args&&... args) {
+        uint64_t  h = hash(key);
+        size_type i = 0;
+
+        if (find_index(key, h, i)) {
+            return {iterator_at(i), false};
+        }
+
+        if (_capacity == 0) {
+            rehash_to(Group::width);
+        }
+
+        i = find_free(h);
+
+        // reusing a tombstone does not make the probe sequences longer
+        if (_ctrl[i] == swiss::Empty && _size + _deleted >= max_load(_capacity)) {
+            // rebuild in place if most of the load is tombstones
+            rehash_to(_size * 2 <= max_load(_capacity) ? _capacity : _capacity * 2);
+            i = find_free(h);
+        }
+
+        new (_slots + i) value_type(std::piecewise_construct,
+                                    std::forward_as_tuple(std::forward<KK>(key)),
+                                    std::forward_as_tuple(std::forward<Args>(args)...));
+
+        if (_ctrl[i] == swiss::Deleted) {
+            _deleted -= 1;
+        }
+        _ctrl[i] = h2(h);
+        _size += 1;
+        return {iterator_at(i), true};
+    }
+
+    void erase_index(size_type i) {
+        _slots[i].~value_type();
+
+        // probing stops at the first group with an empty slot,
+        // if this group has one no probe sequence goes through it
+        size_type base = i & ~size_type(Group::width - 1);
+        if (Group(_ctrl + base).match_empty()) {
+            _ctrl[i] = swiss::Empty;
+        } else {
+            _ctrl[i] = swiss::Deleted;
+            _deleted += 1;
+        }
+        _size -= 1;
+    }
+
+    void rehash_to(size_type capacity) {
+        Ctrl*       ctrl         = _ctrl;
+        value_type* slots        = _slots;
+        size_type   old_capacity = _capacity;
+
+        _ctrl     = CtrlAlloc().allocate(capacity);
+        _slots    = SlotAlloc().allocate(capacity);
+        _capacity = capacity;
+        _deleted  = 0;
+        std::fill(_ctrl, _ctrl + _capacity, Ctrl(swiss::Empty));
+
+        for (size_type i = 0; i < old_capacity; i++) {
+            if (!swiss::is_full(ctrl[i])) {
+                continue;
+            }
+
+            uint64_t  h = hash(slots[i].first);
+            size_type j = find_free(h);
+
+            // The key is const in value_type, it is copied and the value moved
+            new (_slots + j) value_type(std::move(slots[i]));
+            slots[i].~value_type();
+            _ctrl[j] = h2(h);
+        }
+
+        if (old_capacity > 0) {
+            CtrlAlloc().deallocate(ctrl, old_capacity);
+            SlotAlloc().deallocate(slots, old_capacity);
+        }
+    }
+
+    void destroy_slots() {
+        for (size_type i = 0; i < _capacity; i++) {
+            if (swiss::is_full(_ctrl[i])) {
+                _slots[i].~value_type();
+            }
+        }
+    }
+
+    void release() {
+        if (_capacity == 0) {
+            return;
+        }
+        destroy_slots();
+        CtrlAlloc().deallocate(_ctrl, _capacity);
+        SlotAlloc().deallocate(_slots, _capacity);
+        _ctrl     = nullptr;
+        _slots    = nullptr;
+        _capacity = 0;
+        _size     = 0;
+        _deleted  = 0;
+    }
+
+    Ctrl*       _ctrl     = nullptr;
+    value_type* _slots    = nullptr;
+    size_type   _capacity = 0;
+    size_type   _size     = 0;
+    size_type   _deleted  = 0;
+};
+
+}  // namespace lython
+
+#endif
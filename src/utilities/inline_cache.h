@@ -0,0 +1,61 @@
+#ifndef LYTHON_INLINE_CACHE_H
+#define LYTHON_INLINE_CACHE_H
+
+namespace lython {
+
+// Small cache stored on a node (call site, attribute access)
+// that remembers what a dynamic lookup resolved to for a given key.
+//
+// The cache starts monomorphic (a single key), becomes polymorphic
+// when new keys show up and stops caching after `N` keys (megamorphic),
+// lookups then fallback to the slow path.
+//
+// .. code-block:: python
+//
+//    for p in points:
+//        p.x               # <= Attribute cache: type(p) => slot of x
+//        dist(p, origin)   # <= Call cache: dist => resolved function
+//
+template <typename Key, typename Entry, int N = 4>
+struct InlineCache {
+    struct Item {
+        Key   key;
+        Entry entry;
+    };
+
+    Entry* find(Key const& key) {
+        for (int i = 0; i < count; i++) {
+            if (items[i].key == key) {
+                hits += 1;
+                return &items[i].entry;
+            }
+        }
+        misses += 1;
+        return nullptr;
+    }
+
+    // returns null when the site is megamorphic
+    Entry* insert(Key const& key, Entry const& entry) {
+        if (count >= N) {
+            return nullptr;
+        }
+        items[count] = Item{key, entry};
+        count += 1;
+        return &items[count - 1].entry;
+    }
+
+    void clear() { count = 0; }
+
+    int  size() const { return count; }
+    bool is_monomorphic() const { return count == 1; }
+    bool is_megamorphic() const { return count >= N; }
+
+    Item items[N];
+    int  count  = 0;
+    int  hits   = 0;
+    int  misses = 0;
+};
+
+}  // namespace lython
+
+#endif
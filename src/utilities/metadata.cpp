@@ -153,61 +153,24 @@ bool _metadata_init_names() {
         HashNodeInternal<std::pair<const StringRef, lython::ImportLib::ImportedLib>, false>>(
         "Pair[Ref, ImportLib::ImportedLib]");
 
-    meta::override_typename<HashNodeInternal<std::pair<const String, lython::OpConfig>, false>>(
-        "Pair[String, OpConfig]");
-
-    meta::override_typename<HashNodeInternal<std::pair<const String, lython::TokenType>, false>>(
-        "Pair[String, TokenType]");
-
-    meta::override_typename<HashNodeInternal<std::pair<const String, TokenType>, true>>(
-        "Pair[String, TokenType]");
-
-    meta::override_typename<HashNodeInternal<std::pair<const String, OpConfig>, true>>(
-        "Pair[String, OpConfig]");
-
-    meta::override_typename<HashNodeInternal<std::pair<const StringRef, bool>, true>>(
-        "Pair[String, bool]");
-
-    meta::override_typename<HashNodeInternal<std::pair<const StringRef, lython::ExprNode*>, true>>(
-        "Pair[String, ExprNode*]");
-
-    meta::override_typename<
-        HashNodeInternal<std::pair<const StringRef, Function>, true>>(
-        "Pair[String, Function]");
-
     // String Database
     meta::override_typename<Array<StringDatabase::StringEntry>*>("Array[StringEntry]*");
 
-    // StringDatabase
-    meta::override_typename<HashNodeInternal<std::pair<const StringView, std::size_t>, true>>(
-        "Pair[StringView, size_t]");
-
-    meta::override_typename<HashNodeInternal<std::pair<const StringRef, lython::ExprNode*>, false>>(
-        "Pair[StringRef, ExprNode*]");
-
-    meta::override_typename<
-        HashNodeInternal<std::pair<const StringRef, Function>, false>>(
-        "Pair[StringRef, Function]");
-
-    meta::override_typename<HashNodeInternal<std::pair<const StringRef, bool>, false>>(
-        "Pair[StringRef, bool]");
-
-    // module
-    meta::override_typename<HashNodeInternal<std::pair<const String, int>, true>>(
-        "Pair[String, Index]");
-
-    // module precedence_table
-    meta::override_typename<HashNodeInternal<std::pair<const String, std::tuple<int, bool>>, true>>(
-        "Pair[String, Tuple[int, bool]]");
-
-    // Keyword to string
-    meta::override_typename<HashNodeInternal<std::pair<const int, String>, false>>(
-        "Pair[int, String]");
-
     // Set Keyword
     meta::override_typename<HashNodeInternal<char, false>>("Set[char]");
 #endif
 
+    // Dict slots
+    meta::override_typename<std::pair<const String, OpConfig>>("Pair[String, OpConfig]");
+    meta::override_typename<std::pair<const String, TokenType>>("Pair[String, TokenType]");
+    meta::override_typename<std::pair<const int, String>>("Pair[int, String]");
+    meta::override_typename<std::pair<const StringRef, bool>>("Pair[StringRef, bool]");
+    meta::override_typename<std::pair<const StringRef, lython::ExprNode*>>(
+        "Pair[StringRef, ExprNode*]");
+    meta::override_typename<std::pair<const StringRef, Function>>("Pair[StringRef, Function]");
+    meta::override_typename<std::pair<const StringView, std::size_t>>("Pair[StringView, size_t]");
+    meta::override_typename<std::pair<const String, uint32>>("Pair[String, Index]");
+
 #define INIT_METADATA(name, typname) meta::type_name<name>();
 
     TYPES_METADATA(INIT_METADATA)
@@ -10,6 +10,7 @@
 namespace lython {
 
 struct Value;
+struct GCVisitor;
 
 using ValueDeleter = void(*)(void*, Value&);
 using ValueCopier  = Value(*)(Value const&);
@@ -17,6 +18,7 @@ using ValueAssign  = void(*)(Value&, Value const&);
 using ValuePrinter = void(*)(std::ostream&, Value const&);
 using ValueHash    = std::size_t(*)(Value const&);
 using ValueRef      = Value(*)(Value&);
+using ValueTracer   = void(*)(void*, GCVisitor&);
 
 struct _None {
     bool operator== (_None const& val) const {
@@ -137,6 +139,7 @@ struct ClassMetadata {
     ValueHash    hasher  = nullptr;
     ValueRef     ref     = nullptr;
     ValueAssign  assign  = nullptr;
+    ValueTracer  tracer  = nullptr;  // values held by the object, see gc_trace
 };
 
 struct TypeRegistry {
@@ -140,6 +140,13 @@ class StringRef {
         STRING_VIEW(debug_view = StringDatabase::instance()[ref]);
     }
 
+    // Steals the reference, the moved from ref becomes the empty string
+    // which is not reference counted so relocating a StringRef does not lock
+    StringRef(StringRef&& name) noexcept: ref(name.ref), debug_view(name.debug_view) {
+        name.ref = 0;
+        STRING_VIEW(name.debug_view = StringView());
+    }
+
     StringRef(StringRef const&& name): ref(StringDatabase::instance().inc(name.ref)) {
         lyassert(ref < StringDatabase::instance().count(), "StringRef is valid");
         STRING_VIEW(debug_view = StringDatabase::instance()[ref]);
@@ -173,6 +180,18 @@ class StringRef {
 
     std::size_t __id__() const { return ref; }
 
+    // Interned strings are equal when their ids are, the id is mixed (splitmix64)
+    // so hash tables get well spread bits, without locking the database
+    uint64 __hash__() const {
+        uint64 h = uint64(ref);
+        h        = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h        = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        return h ^ (h >> 31);
+    }
+
+    // Arrays of StringRef are searched by id in place (see kiwi::kernels)
+    std::size_t const* id_address() const { return &ref; }
+
     private:
     std::size_t ref = 0;
     StringView  debug_view;
@@ -31,6 +31,19 @@ std::optional<ThreadPool::Task_t> ThreadPool::pop() {
     return task;
 }
 
+std::optional<ThreadPool::Task_t> ThreadPool::wait(std::size_t n) {
+    std::unique_lock      lock(mux);
+    std::optional<Task_t> task;
+
+    cond.wait(lock, [&]() { return tasks.size() > 0 || !stats[n].running; });
+
+    if (stats[n].running && tasks.size() > 0) {
+        task = std::move(tasks.back());
+        tasks.pop_back();
+    }
+    return task;
+}
+
 void ThreadPool::insert_worker() {
     std::size_t n = threads.size();
     stats.emplace_back();
@@ -38,9 +51,13 @@ void ThreadPool::insert_worker() {
 }
 
 void ThreadPool::shutdown(bool wait) {
-    for (auto& state: stats) {
-        state.running = false;
+    {
+        std::lock_guard lock(mux);
+        for (auto& state: stats) {
+            state.running = false;
+        }
     }
+    cond.notify_all();
 
     if (wait) {
         for (auto& thread: threads) {
@@ -80,7 +97,8 @@ void worker_loop(ThreadPool* pool, std::size_t n) {
     pool->stats[n].start = StopWatch<>::Clock::now();
 
     while (pool->stats[n].running) {
-        auto maybe_task = pool->pop();
+        // sleeps until there is something to do
+        auto maybe_task = pool->wait(n);
 
         if (maybe_task.has_value()) {
             pool->stats[n].sleeping = false;
@@ -92,8 +110,6 @@ void worker_loop(ThreadPool* pool, std::size_t n) {
             pool->stats[n].work_time += float(chrono.stop());
             pool->stats[n].task += 1;
             pool->stats[n].sleeping = true;
-        } else {
-            std::this_thread::yield();
         }
     }
 }
@@ -1,9 +1,14 @@
+#ifndef LYTHON_UTILITIES_POOL_HEADER
+#define LYTHON_UTILITIES_POOL_HEADER
+
 #include <functional>
 
 #include <optional>
 
 #if !BUILD_WEBASSEMBLY
+#    include <condition_variable>
 #    include <future>
+#    include <mutex>
 #    include <thread>
 #endif
 
@@ -59,11 +64,23 @@ class ThreadPool {
         // promise need to outlive this scope and die when the task is over
         auto prom = std::make_shared<std::promise<Return_t<Fun, Args...>>>();
 
+        // exceptions are rethrown by future::get, they would terminate the worker otherwise
         tasks.emplace_back([prom, task]() {
-            auto result = task();
-            prom->set_value(result);
+            try {
+                if constexpr (std::is_void_v<Return_t<Fun, Args...>>) {
+                    task();
+                    prom->set_value();
+                } else {
+                    auto result = task();
+                    prom->set_value(result);
+                }
+            } catch (...) {
+                prom->set_exception(std::current_exception());
+            }
         });
 
+        // wake up a sleeping worker
+        cond.notify_one();
         return prom->get_future();
     }
 
@@ -94,7 +111,11 @@ class ThreadPool {
         bool                   sleeping  = true;  // is the worker processing a task
     };
 
+    //! Block until a task is available or the worker is stopped
+    std::optional<Task_t> wait(std::size_t n);
+
     std::mutex               mux;
+    std::condition_variable  cond;
     std::vector<std::thread> threads;
     std::vector<Stat_t>      stats;
     std::vector<Task_t>      tasks;
@@ -102,3 +123,5 @@ class ThreadPool {
 
 #endif
 }  // namespace lython
+
+#endif
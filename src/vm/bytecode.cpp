@@ -0,0 +1,540 @@
+#include "builtin/operators.h"
+#include "vm/vm.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if __has_include(<sys/mman.h>)
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#    define KW_VM_MMAP 1
+#else
+#    define KW_VM_MMAP 0
+#endif
+
+namespace lython {
+
+// Bytecode file
+// =============
+//
+// The file is a header followed by sections, every section is 8 bytes aligned.
+// Instructions are stored as they are in memory, so they are loaded in a single copy.
+// Strings (names, globals, string constants, native signatures) are stored once in a
+// string table and referenced by offset.
+//
+// .. code-block:: text
+//
+//    | header | instructions | labels | constants | natives | globals | strings |
+//
+// Natives cannot be stored as function pointers, they are stored using their signature
+// (``Add-i32-i32``) and resolved again when the program is loaded.
+//
+// Values are written in the byte order of the host, the header records it so a file
+// written on a different host is rejected instead of being misread.
+
+static constexpr char   bytecode_magic[4] = {'L', 'Y', 'B', 'C'};
+static constexpr uint32 bytecode_version  = 1;
+static constexpr uint32 bytecode_endian   = 0x01020304;
+
+struct BytecodeSection {
+    uint32 offset = 0;
+    uint32 count  = 0;
+};
+
+struct BytecodeHeader {
+    char            magic[4];
+    uint32          version;
+    uint32          endian;
+    uint32          reserved;
+    BytecodeSection instructions;
+    BytecodeSection labels;
+    BytecodeSection constants;
+    BytecodeSection natives;
+    BytecodeSection globals;
+    BytecodeSection strings;  // count is the size of the table in bytes
+};
+
+struct BytecodeLabel {
+    uint32 name;
+    int32  index;
+    int32  depth;
+    int32  argc;
+    int32  registers;
+};
+
+// Constant kinds, independent from the runtime type ids
+#define KW_BYTECODE_CONSTANTS(X) \
+    X(Bool, bool, i1)            \
+    X(I8, int8, i8)              \
+    X(I16, int16, i16)           \
+    X(I32, int32, i32)           \
+    X(I64, int64, i64)           \
+    X(U8, uint8, u8)             \
+    X(U16, uint16, u16)          \
+    X(U32, uint32, u32)          \
+    X(U64, uint64, u64)          \
+    X(F32, float32, f32)         \
+    X(F64, float64, f64)
+
+enum class BytecodeConstantKind : uint32
+{
+    None,
+#define KIND(name, type, field) name,
+    KW_BYTECODE_CONSTANTS(KIND)
+#undef KIND
+    String,
+};
+
+struct BytecodeConstant {
+    uint32 kind;
+    uint32 string;  // offset of the string for string constants
+    uint64 bits;    // raw value for the other kinds
+};
+
+enum class BytecodeNativeKind : uint32
+{
+    Binary,
+    Unary,
+    Compare,
+    Bool,
+};
+
+struct BytecodeNative {
+    uint32 kind;
+    uint32 signature;
+    uint32 name;
+    int32  argc;
+    int32  op;
+};
+
+static_assert(sizeof(Instruction) % 8 == 0, "Instructions must keep the sections aligned");
+
+//
+// Write
+// -----
+//
+
+struct StringTable {
+    String           data;
+    Dict<String, uint32> offsets;
+
+    uint32 insert(String const& value) {
+        auto it = offsets.find(value);
+        if (it != offsets.end()) {
+            return it->second;
+        }
+
+        uint32 offset = uint32(data.size());
+        data.append(value.c_str(), value.size() + 1);
+        offsets[value] = offset;
+        return offset;
+    }
+};
+
+// Find the signature of a native operator from its function pointer
+static bool native_signature(Function fun, BytecodeNativeKind& kind, String& signature) {
+    struct Table {
+        BytecodeNativeKind               kind;
+        Dict<StringRef, Function> const& ops;
+    };
+
+    Table tables[] = {
+        {BytecodeNativeKind::Binary, native_binary_operators()},
+        {BytecodeNativeKind::Unary, native_unary_operators()},
+        {BytecodeNativeKind::Compare, native_cmp_operators()},
+        {BytecodeNativeKind::Bool, native_bool_operators()},
+    };
+
+    for (Table const& table: tables) {
+        for (auto const& item: table.ops) {
+            if (item.second == fun) {
+                kind      = table.kind;
+                signature = str(item.first);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+template <typename T>
+static void write_section(String& out, BytecodeSection& section, Array<T> const& items) {
+    out.resize((out.size() + 7) & ~std::size_t(7), '\0');
+
+    section.offset = uint32(out.size());
+    section.count  = uint32(items.size());
+    out.append(reinterpret_cast<char const*>(items.data()), items.size() * sizeof(T));
+}
+
+bool Program::save(String const& path) const {
+    StringTable strings;
+
+    Array<BytecodeLabel> out_labels;
+    for (Label const& label: labels) {
+        out_labels.push_back(
+            {strings.insert(label.name), label.index, label.depth, label.argc, label.registers});
+    }
+
+    Array<BytecodeConstant> out_constants;
+    for (Value const& value: constants) {
+        BytecodeConstant cst{0, 0, 0};
+
+        if (value.is_type<_None>()) {
+            cst.kind = uint32(BytecodeConstantKind::None);
+        }
+#define KIND(name, type, field)                                   \
+    else if (value.is_type<type>()) {                             \
+        cst.kind = uint32(BytecodeConstantKind::name);            \
+        type const bits = value.load<type>();                     \
+        std::memcpy(&cst.bits, &bits, sizeof(type));              \
+    }
+        KW_BYTECODE_CONSTANTS(KIND)
+#undef KIND
+        else if (value.is_type<String>()) {
+            cst.kind   = uint32(BytecodeConstantKind::String);
+            cst.string = strings.insert(value.as<String>());
+        }
+        else {
+            kwerror(outlog(), "Constant {} cannot be serialized", str(value));
+            return false;
+        }
+        out_constants.push_back(cst);
+    }
+
+    Array<BytecodeNative> out_natives;
+    for (NativeEntry const& entry: natives) {
+        BytecodeNativeKind kind;
+        String             signature;
+
+        if (!native_signature(entry.fun, kind, signature)) {
+            kwerror(outlog(), "Native function {} cannot be serialized", entry.name);
+            return false;
+        }
+
+        out_natives.push_back({uint32(kind),
+                               strings.insert(signature),
+                               strings.insert(entry.name),
+                               entry.argc,
+                               int32(entry.op)});
+    }
+
+    Array<uint32> out_globals;
+    for (String const& global: globals) {
+        out_globals.push_back(strings.insert(global));
+    }
+
+    BytecodeHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, bytecode_magic, sizeof(bytecode_magic));
+    header.version = bytecode_version;
+    header.endian  = bytecode_endian;
+
+    String out;
+    out.resize(sizeof(BytecodeHeader), '\0');
+
+    write_section(out, header.instructions, instructions);
+    write_section(out, header.labels, out_labels);
+    write_section(out, header.constants, out_constants);
+    write_section(out, header.natives, out_natives);
+    write_section(out, header.globals, out_globals);
+
+    out.resize((out.size() + 7) & ~std::size_t(7), '\0');
+    header.strings.offset = uint32(out.size());
+    header.strings.count  = uint32(strings.data.size());
+    out.append(strings.data);
+
+    std::memcpy(&out[0], &header, sizeof(header));
+
+    std::ofstream file(path.c_str(), std::ios::binary);
+    if (!file) {
+        kwerror(outlog(), "Could not open {}", path);
+        return false;
+    }
+    file.write(out.data(), out.size());
+    return bool(file);
+}
+
+//
+// Read
+// ----
+//
+
+// Read only view of a bytecode file, mapped in memory when supported
+struct MappedFile {
+    char const*  data = nullptr;
+    std::size_t  size = 0;
+    String       buffer;  // fallback when mmap is not available
+
+#if KW_VM_MMAP
+    bool mapped = false;
+
+    bool open(String const& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+
+        void* ptr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (ptr == MAP_FAILED) {
+            return false;
+        }
+
+        data   = static_cast<char const*>(ptr);
+        size   = std::size_t(info.st_size);
+        mapped = true;
+        return true;
+    }
+
+    ~MappedFile() {
+        if (mapped) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+#else
+    bool open(String const& path) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+        return size > 0;
+    }
+#endif
+};
+
+template <typename T>
+static T const* read_section(MappedFile const& file, BytecodeSection const& section) {
+    std::size_t end = std::size_t(section.offset) + std::size_t(section.count) * sizeof(T);
+
+    if (section.offset % alignof(T) != 0 || end > file.size) {
+        return nullptr;
+    }
+    return reinterpret_cast<T const*>(file.data + section.offset);
+}
+
+// Check that the operands of the instructions reference existing entries
+// Registers used by an instruction must be inside the frame of its function
+static bool valid_registers(Program const& program, Instruction const& inst, int registers) {
+    auto reg    = [&](int r) { return r < registers; };
+    auto window = [&](int first, int count) { return first + count <= registers; };
+
+    switch (inst.op) {
+    case OpCode::LoadConst:
+    case OpCode::LoadGlobal: return reg(inst.a);
+    case OpCode::StoreGlobal:
+    case OpCode::JumpIfFalse:
+    case OpCode::JumpIfTrue:
+    case OpCode::Return:
+    case OpCode::Raise: return reg(inst.b);
+    case OpCode::Move:
+    case OpCode::Unary: return reg(inst.a) && reg(inst.b);
+    case OpCode::Binary: return reg(inst.a) && reg(inst.b) && reg(inst.c);
+    case OpCode::CallNative: return reg(inst.a) && window(inst.b, inst.c);
+    case OpCode::Call:
+        // the arguments become the first registers of the callee frame
+        return reg(inst.a) && window(inst.b, inst.c) && inst.c == program.labels[inst.d].argc;
+    default: return true;
+    }
+}
+
+static bool validate(Program const& program) {
+    int size = int(program.instructions.size());
+
+    for (Label const& label: program.labels) {
+        if (label.index < 0 || label.index >= size || label.argc < 0 ||
+            label.argc > label.registers || label.registers > VMMaxRegisters) {
+            kwerror(outlog(), "Invalid label {}", label.name);
+            return false;
+        }
+    }
+
+    // Functions are contiguous, the code of a function ends where the next one starts
+    Array<Label const*> starts;
+    for (Label const& label: program.labels) {
+        starts.push_back(&label);
+    }
+    std::sort(starts.begin(), starts.end(), [](Label const* a, Label const* b) {
+        return a->index < b->index;
+    });
+
+    // Function each instruction belongs to and the end of its code
+    Array<Label const*> owners(size, nullptr);
+    Array<int>          ends(size, 0);
+
+    for (int i = 0; i < starts.size(); i++) {
+        int start = starts[i]->index;
+        int end   = i + 1 < starts.size() ? starts[i + 1]->index : size;
+
+        // execution must not run off the end of a function
+        OpCode last = end > start ? program.instructions[end - 1].op : OpCode::Nop;
+        if (last != OpCode::Return && last != OpCode::Jump && last != OpCode::Raise) {
+            kwerror(outlog(), "Function {} does not end with a return", starts[i]->name);
+            return false;
+        }
+
+        for (int k = start; k < end; k++) {
+            owners[k] = starts[i];
+            ends[k]   = end;
+        }
+    }
+
+    for (int k = 0; k < size; k++) {
+        Instruction const& inst  = program.instructions[k];
+        int                d     = inst.d;
+        bool               valid = true;
+
+        switch (inst.op) {
+        case OpCode::LoadConst: valid = d >= 0 && d < program.constants.size(); break;
+        case OpCode::LoadGlobal:
+        case OpCode::StoreGlobal: valid = d >= 0 && d < program.globals.size(); break;
+        case OpCode::Unary:
+        case OpCode::Binary:
+        case OpCode::CallNative: valid = d >= 0 && d < program.natives.size(); break;
+        case OpCode::Call: valid = d >= 0 && d < program.labels.size(); break;
+        // jumps stay inside their function
+        case OpCode::Jump:
+        case OpCode::JumpIfFalse:
+        case OpCode::JumpIfTrue:
+            valid = owners[k] != nullptr && d >= owners[k]->index && d < ends[k];
+            break;
+        case OpCode::Nop:
+        case OpCode::Move:
+        case OpCode::Return:
+        case OpCode::Raise: break;
+        // quickened instructions only exist at runtime
+        default: valid = false;
+        }
+
+        if (!valid) {
+            kwerror(outlog(), "Invalid instruction {}", str(inst.op));
+            return false;
+        }
+
+        if (owners[k] == nullptr || !valid_registers(program, inst, owners[k]->registers)) {
+            kwerror(outlog(), "Instruction {} uses registers outside of its frame", k);
+            return false;
+        }
+    }
+    return !program.labels.empty();
+}
+
+bool Program::load(String const& path) {
+    MappedFile file;
+
+    if (!file.open(path) || file.size < sizeof(BytecodeHeader)) {
+        kwerror(outlog(), "Could not read {}", path);
+        return false;
+    }
+
+    BytecodeHeader header;
+    std::memcpy(&header, file.data, sizeof(header));
+
+    if (std::memcmp(header.magic, bytecode_magic, sizeof(bytecode_magic)) != 0 ||
+        header.version != bytecode_version || header.endian != bytecode_endian) {
+        kwerror(outlog(), "{} is not a bytecode file of version {}", path, bytecode_version);
+        return false;
+    }
+
+    auto const* in_instructions = read_section<Instruction>(file, header.instructions);
+    auto const* in_labels       = read_section<BytecodeLabel>(file, header.labels);
+    auto const* in_constants    = read_section<BytecodeConstant>(file, header.constants);
+    auto const* in_natives      = read_section<BytecodeNative>(file, header.natives);
+    auto const* in_globals      = read_section<uint32>(file, header.globals);
+    auto const* in_strings      = read_section<char>(file, header.strings);
+
+    if (!in_instructions || !in_labels || !in_constants || !in_natives || !in_globals ||
+        !in_strings || header.strings.count == 0 || in_strings[header.strings.count - 1] != '\0') {
+        kwerror(outlog(), "{} is corrupted", path);
+        return false;
+    }
+
+    bool corrupted = false;
+    auto string    = [&](uint32 offset) -> String {
+        if (offset >= header.strings.count) {
+            corrupted = true;
+            return String();
+        }
+        return String(in_strings + offset);
+    };
+
+    instructions.assign(in_instructions, in_instructions + header.instructions.count);
+
+    labels.clear();
+    for (uint32 i = 0; i < header.labels.count; i++) {
+        BytecodeLabel const& label = in_labels[i];
+
+        Label entry{nullptr, string(label.name), label.index, label.depth};
+        entry.argc      = label.argc;
+        entry.registers = label.registers;
+        labels.push_back(entry);
+    }
+
+    constants.clear();
+    for (uint32 i = 0; i < header.constants.count; i++) {
+        BytecodeConstant const& cst = in_constants[i];
+
+        switch (BytecodeConstantKind(cst.kind)) {
+        case BytecodeConstantKind::None: constants.push_back(Value(_None())); break;
+#define KIND(name, type, field)                           \
+    case BytecodeConstantKind::name: {                    \
+        type value;                                       \
+        std::memcpy(&value, &cst.bits, sizeof(type));     \
+        constants.push_back(Value(value));                \
+        break;                                            \
+    }
+            KW_BYTECODE_CONSTANTS(KIND)
+#undef KIND
+        case BytecodeConstantKind::String:
+            constants.push_back(make_value<String>(string(cst.string)));
+            break;
+        default: corrupted = true;
+        }
+    }
+
+    natives.clear();
+    for (uint32 i = 0; i < header.natives.count; i++) {
+        BytecodeNative const& native    = in_natives[i];
+        String                signature = string(native.signature);
+        Function              fun       = nullptr;
+
+        switch (BytecodeNativeKind(native.kind)) {
+        case BytecodeNativeKind::Binary: fun = get_native_binary_operation(signature); break;
+        case BytecodeNativeKind::Unary: fun = get_native_unary_operation(signature); break;
+        case BytecodeNativeKind::Compare: fun = get_native_cmp_operation(signature); break;
+        case BytecodeNativeKind::Bool: fun = get_native_bool_operation(signature); break;
+        default: break;
+        }
+
+        if (fun == nullptr) {
+            kwerror(outlog(), "Could not resolve native {}", signature);
+            return false;
+        }
+        natives.push_back({fun, native.argc, string(native.name), QuickOp(native.op)});
+    }
+
+    globals.clear();
+    for (uint32 i = 0; i < header.globals.count; i++) {
+        globals.push_back(string(in_globals[i]));
+    }
+
+    if (corrupted || !validate(*this)) {
+        kwerror(outlog(), "{} is corrupted", path);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace lython
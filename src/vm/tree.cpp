@@ -7,8 +7,10 @@
 #include "parser/parsing_error.h"
 #include "utilities/guard.h"
 #include "sema/importlib.h"
-
-#define MAKE_NAME(type, name) ((StringStream() << type << (name)).str())
+#include "stdlib/array.h"
+#include "stdlib/dict.h"
+#include "stdlib/str.h"
+#include "stdlib/tuple.h"
 
 namespace lython {
 template<typename T>
@@ -30,9 +32,10 @@ void pop(Array<T>& array, CodeLocation const& loc) {
 #define KW_EXEC_BLOCK_BODY(body, start, dbname, tryhandler, withhandler)            \
     {                                                                               \
         auto* blocks = get_blocks();                                                \
+        int _block_idx = int(blocks->size());                                       \
         ExecBlock& _block = blocks->emplace_back();                                 \
         kwdebug(outlog(), "Insert block {} {}", (void*)blocks, blocks->size());     \
-        _block.block      = (body);                                                 \
+        _block.block      = &(body);                                                \
         _block.name       = (dbname);                                               \
         _block.exception_handler = tryhandler;                                      \
         _block.resources         = withhandler;                                     \
@@ -40,7 +43,8 @@ void pop(Array<T>& array, CodeLocation const& loc) {
         for (int i = start; i < body.size(); i++) {                                 \
             StmtNode* stmt = body[i];                                               \
             exec(stmt, depth);                                                      \
-            _block.i = i + 1;                                                       \
+            /* calls can move the blocks, do not keep references across exec */     \
+            (*get_blocks())[_block_idx].i = i + 1;                                  \
             if (has_exceptions()) {                                                 \
                 pop(*get_blocks(), LOC);                                            \
                 return flag::done();                                                \
@@ -89,7 +93,7 @@ namespace flag {
 
 Value TreeEvaluator::execbody(Array<StmtNode*>& body, Array<StmtNode*>& newbod, int depth) {
     ExecBlock& block = get_blocks()->emplace_back();
-    block.block      = newbod;
+    block.block      = &newbod;
     block.name = "here";
     auto* blocks = get_blocks();
 
@@ -126,10 +130,9 @@ Value TreeEvaluator::execbody(Array<StmtNode*>& body, Array<StmtNode*>& newbod,
 void TreeEvaluator::raise_exception(Value exception, Value cause) {
     // Create the exception object
 
-    _LyException* except = root.new_object<_LyException>(traces);
+    _LyException* except = root.new_object<_LyException>(active_traces());
     except->custom       = exception;
     except->cause        = cause;
-    except->traces       = traces;
 
     exceptions.push_back(except);
 }
@@ -155,8 +158,12 @@ Value TreeEvaluator::compare(Compare_t* n, int depth) {
 
         if (is_concrete(left) && is_concrete(right)) {
             Value value;
+            auto  op = n->ops[i];
+
+            if (op == CmpOperator::In || op == CmpOperator::NotIn) {
+                value = Value(contains_value(right, left) == (op == CmpOperator::In));
 
-            if (!bnative) {
+            } else if (!bnative) {
                 auto KW_IDT(_) = new_scope();
                 add_variable(StringRef(), left);
                 add_variable(StringRef(), right);
@@ -400,7 +407,11 @@ Value TreeEvaluator::ifexp(IfExp_t* n, int depth) {
 
 Value TreeEvaluator::call_native(Call_t* call, FunctionDef_t* function, int depth) {
     Array<Value> args;
-    StackTrace&  trace = traces[traces.size() - 1];
+    StackTrace&  trace = get_trace();
+
+    // the arguments are only held by `args` while the next ones are evaluated
+    temporaries.push_back(&args);
+    KW_DEFERRED([&]() { temporaries.pop_back(); });
 
     Value self;
     if (auto attr = cast<Attribute>(call->func)) {
@@ -450,6 +461,10 @@ Value TreeEvaluator::call_script(Call_t* call, FunctionDef_t* function, int dept
 
     bool partial_call = false;
 
+    // arguments are evaluated in the frame of the caller
+    int base = int(variables.size());
+    reserve_frame(std::max(function->frame_size, int(call->args.size())));
+
     // insert arguments to the context
     for (int i = 0; i < call->args.size(); i++) {
         Value arg = exec(call->args[i], depth);
@@ -462,37 +477,43 @@ Value TreeEvaluator::call_script(Call_t* call, FunctionDef_t* function, int dept
         add_variable(arg_name, arg);
     }
 
+    // the arguments are the first locals, the rest of the frame is bound by the body
+    variables.resize(std::max(variables.size(), std::size_t(base + function->frame_size)));
+
+    int previous       = frame;
+    int previous_slots = slots;
+    frame              = base;
+    slots              = function->frame_size;
+    KW_DEFERRED([&]() {
+        frame = previous;
+        slots = previous_slots;
+    });
+
+    // EXEC_BODY returns early on `return`, run it inside its own frame
+    // so the returned value reaches the caller
+    auto exec_body = [&]() -> Value {
+        EXEC_BODY(function->body, 0, "call");
+        return flag::done();
+    };
+
     partial.push_back(partial_call);
-    EXEC_BODY(function->body, 0, MAKE_NAME("call ", str(function->name)));
+    exec_body();
     partial.pop_back();
-    return returned();
-}
 
-struct ScriptObject {
-    // Name - Value
-    // We would like to get rid of the name if possible
-    // during SEMA we can resolve the name to the ID
-    // so we would never have to lookup by name
-    // If some need the name at runtime this is reflection stuff
-    // and that would be handled by a different datastructure
-    // for now it will have to do
-    //
-    // Usually methods will not be stored there
-    // but it can happen when the code assign method as attributes
-    //
-    Array<Tuple<String, Value>> attributes;
-
-    ScriptObject(std::size_t reserve) { attributes.reserve(reserve); }
-};
+    // the return belongs to this call, the caller keeps executing
+    Value result = returned();
+    reset();
+    return result;
+}
 
-Value object__new__(GCObject* parent, ClassDef* class_t) {
+void register_script_object() {
     // Move this to sema
     ValuePrinter printer = [](std::ostream& out, Value const& val) {
         Array<int> attributes;
 
         auto& obj = val.as<ScriptObject const&>();
-        for (int i = 0; i < obj.attributes.size(); i++) {
-            if (std::get<1>(obj.attributes[i]).is_valid<Node*>()) {
+        for (int i = 0; i < obj.slots.size(); i++) {
+            if (obj.slots[i].is_valid<Node*>()) {
                 continue;
             }
             attributes.push_back(i);
@@ -501,8 +522,11 @@ Value object__new__(GCObject* parent, ClassDef* class_t) {
         int n = int(attributes.size()) - 1;
         out << "(";
         for (int i = 0; i < attributes.size(); i++) {
-            auto& attr = obj.attributes[attributes[i]];
-            out << std::get<0>(attr) << "=" << std::get<1>(attr);
+            int slot = attributes[i];
+            if (obj.class_t != nullptr) {
+                out << obj.class_t->attributes[slot].name << "=";
+            }
+            out << obj.slots[slot];
             if (i < n) {
                 out << ", ";
             }
@@ -510,60 +534,130 @@ Value object__new__(GCObject* parent, ClassDef* class_t) {
         out << ")";
     };
     register_value<ScriptObject>(printer);
+}
 
-    if (class_t->type_id < 0) {
-        class_t->type_id = meta::_new_type();
+// Values held by the runtime objects, see gc_trace
+void trace_script_object(void* obj, GCVisitor& visitor) {
+    for (Value const& slot: static_cast<ScriptObject*>(obj)->slots) {
+        gc_trace(slot, visitor);
     }
-    // <<<
+}
 
-    // Create a new runtime object of a specific type
-    auto val = make_value<ScriptObject>(class_t->attributes.size());
-    ScriptObject& obj   = val.as<ScriptObject&>();
-
-    for (int i = 0; i < class_t->attributes.size(); i++) {
-        auto  attr = class_t->attributes[i];
-        Value value;
-        if (FunctionDef* def = cast<FunctionDef>(attr.stmt)) {
-            value = make_value<Node*>(def);
-        }
-        obj.attributes.emplace_back(attr.name, value);
+template <typename Container>
+void trace_values(void* obj, GCVisitor& visitor) {
+    for (Value const& val: std::as_const(static_cast<Container*>(obj)->values)) {
+        gc_trace(val, visitor);
     }
+}
 
-    //
-    // Note maybe we could save a template object and simply copy it every time
-    //
-    return val;
+void trace_dict(void* obj, GCVisitor& visitor) {
+    for (auto const& pair: std::as_const(*static_cast<kiwi::Dict*>(obj))) {
+        gc_trace(pair.key, visitor);
+        gc_trace(pair.value, visitor);
+    }
 }
 
-Value TreeEvaluator::call_constructor(Call_t* call, ClassDef_t* cls, int depth) {
+void register_tracers() {
+    meta::classmeta(meta::type_id<ScriptObject>()).tracer                  = trace_script_object;
+    meta::classmeta(meta::type_id<kiwi::ArrayNative<Value>>()).tracer      = trace_values<kiwi::ArrayNative<Value>>;
+    meta::classmeta(meta::type_id<kiwi::TupleNative<Value>>()).tracer      = trace_values<kiwi::TupleNative<Value>>;
+    meta::classmeta(meta::type_id<kiwi::Dict>()).tracer                    = trace_dict;
+}
 
-    // std::cout << "wtf" << std::endl;
-    FunctionDef* ctor = nullptr;
-    for (auto stmt: cls->body) {
-        if (FunctionDef* def = cast<FunctionDef>(stmt)) {
-            if (def->name == StringRef("__init__")) {
-                ctor = def;
-                break;
+void TreeEvaluator::use_garbage_collector() {
+    [[maybe_unused]] static bool registered = (register_tracers(), true);
+
+    if (!collected) {
+        collected = true;
+        garbage_collector().add_root(this, scan_roots);
+    }
+}
+
+void TreeEvaluator::scan_roots(void* ctx, GCVisitor& visitor) {
+    TreeEvaluator* self = static_cast<TreeEvaluator*>(ctx);
+
+    for (ValuePair const& var: self->variables) {
+        gc_trace(var.value, visitor);
+    }
+    for (Array<Value> const* values: self->temporaries) {
+        for (Value const& val: *values) {
+            gc_trace(val, visitor);
+        }
+    }
+    for (StackTrace const& trace: self->traces) {
+        for (ExecBlock const& block: trace.blocks) {
+            for (Value const& val: block.resources) {
+                gc_trace(val, visitor);
             }
         }
     }
+    for (Generator* gen: self->gens) {
+        for (ValuePair const& var: gen->environment) {
+            gc_trace(var.value, visitor);
+        }
+    }
+    for (_LyException* except: self->exceptions) {
+        gc_trace(except->custom, visitor);
+        gc_trace(except->cause, visitor);
+    }
+    gc_trace(self->return_value, visitor);
+    gc_trace(self->property, visitor);
+    gc_trace(self->cause, visitor);
+}
 
-    if (ctor == nullptr) {
-        static StringRef name("__init__");
-        for (StmtNode* stmt: cls->body) {
-            if (FunctionDef* def = cast<FunctionDef>(stmt)) {
-                if (def->name == name) {
-                    ctor = def;
-                }
+// gc allocates the object when set, it is malloc'd and never freed otherwise
+Value object__new__(BoehmGarbageCollector* gc, ClassDef* class_t) {
+    [[maybe_unused]] static bool registered = (register_script_object(), true);
+
+    if (class_t->type_id < 0) {
+        class_t->type_id = meta::_new_type();
+    }
+    // <<<
+
+    // Template object shared by all the instances of the class,
+    // rebuilt if sema added attributes since it was created
+    Value& instance = class_t->instance;
+
+    if (!instance.is_type<ScriptObject>() ||
+        instance.as<ScriptObject const&>().slots.size() != class_t->attributes.size()) {
+        instance          = make_value<ScriptObject>(class_t, class_t->attributes.size());
+        ScriptObject& obj = instance.as<ScriptObject&>();
+
+        for (ClassDef::Attr const& attr: class_t->attributes) {
+            if (FunctionDef* def = cast<FunctionDef>(attr.stmt)) {
+                obj.slots[attr.offset] = make_value<Node*>(def);
             }
         }
+    }
+
+    // Create a new runtime object of a specific type
+    if (gc != nullptr) {
+        return _new_object<ScriptObject>(*gc, meta::type_id<ScriptObject>(), instance.as<ScriptObject const&>());
+    }
+    return make_value<ScriptObject>(instance.as<ScriptObject const&>());
+}
+
+FunctionDef* find_constructor(ClassDef* cls) {
+    static StringRef name("__init__");
 
+    for (StmtNode* stmt: cls->body) {
+        if (FunctionDef* def = cast<FunctionDef>(stmt)) {
+            if (def->name == name) {
+                return def;
+            }
+        }
     }
+    return nullptr;
+}
 
+Value TreeEvaluator::call_constructor(Call_t* call, ClassDef_t* cls, FunctionDef* ctor, int depth) {
     if (ctor && ctor->native) {
         Array<Value> value_args;
         value_args.reserve(call->args.size());
 
+        temporaries.push_back(&value_args);
+        KW_DEFERRED([&]() { temporaries.pop_back(); });
+
         bool compile_time = true;
 
         for (int i = 0; i < call->args.size(); i++) {
@@ -583,9 +677,12 @@ Value TreeEvaluator::call_constructor(Call_t* call, ClassDef_t* cls, int depth)
     auto KW_IDT(_) = new_scope();
 
     // Create the object
-    Value obj = object__new__(&root, cls);
+    Value obj = object__new__(collected ? &garbage_collector() : nullptr, cls);
 
     if (ctor != nullptr) {
+        int base = int(variables.size());
+        reserve_frame(std::max(ctor->frame_size, int(call->args.size()) + 1));
+
         add_variable(ctor->args.args[0].arg, obj);
 
         int i = 0;
@@ -594,6 +691,17 @@ Value TreeEvaluator::call_constructor(Call_t* call, ClassDef_t* cls, int depth)
             i += 1;
         }
 
+        variables.resize(std::max(variables.size(), std::size_t(base + ctor->frame_size)));
+
+        int previous       = frame;
+        int previous_slots = slots;
+        frame              = base;
+        slots              = ctor->frame_size;
+        KW_DEFERRED([&]() {
+            frame = previous;
+            slots = previous_slots;
+        });
+
         for (auto& stmt: ctor->body) {
             exec(stmt, depth);
 
@@ -669,7 +777,7 @@ void TreeEvaluator::show_variables(std::ostream& out, Variables& variables) {
         StringStream ss;
         var.value.debug_print(ss);
 
-        out << fmt::format("{:>30} - {}\n", var.name, ss.str());
+        out << fmt::format("{:>30} - {}\n", str(var.name), ss.str());
     }
 }
 
@@ -691,14 +799,14 @@ Value TreeEvaluator::make_generator(Call_t* call, FunctionDef_t* n, int depth) {
     gen->environment = variables;
     gen->blocks      = *get_blocks();
     gen->function    = n;
-    gen->blocks.push_back(ExecBlock{0, n->body, MAKE_NAME("generator ", n->name)});
+    gen->blocks.push_back(ExecBlock{0, &n->body, "generator"});
 
     show_variables(std::cout, gen->environment);
 
     // Call to function that yields only create the generator
     // to fetch values from it
     // execute the body
-    // EXEC_BODY(n->body, 0, MAKE_NAME("call ", str(function->name)));
+    // EXEC_BODY(n->body, 0, "call");
 
     gens.pop_back();
     return make_value<Generator*>(gen);
@@ -709,38 +817,60 @@ Value TreeEvaluator::call(Call_t* n, int depth) {
     // Populate current stack with the expression that will branch out
     get_trace().expr = n;
 
-    StackTrace& trace = traces.emplace_back();
+    push_trace();
     KW_DEFERRED([&]{
-        kwdebug(treelog, "Stack pop {}", traces.size());
-        traces.pop_back();
+        kwdebug(treelog, "Stack pop {}", trace_depth);
+        pop_trace();
     });
 
-    // fetch the function we need to call
+    // fetch the function we need to call, unless sema resolved it
     // the issue is that we need the object called in the case of a method
-    Value function = exec(n->func, depth);
+    Node* node = n->callee;
 
-    if (function.is_valid<Function>()) {
-        return Value();
+    if (node == nullptr) {
+        Value function = exec(n->func, depth);
+
+        if (function.is_valid<Node*>()) {
+            node = function.as<Node*>();
+        }
     }
 
-    if (function.is_valid<Node*>()) {
+    if (node != nullptr) {
         reset();
 
-        Node* node = function.as<Node*>();
+        CallTarget* target = n->cache.find(node);
+
+        if (target == nullptr) {
+            CallTarget resolved;
+
+            if (FunctionDef_t* fun = cast<FunctionDef>(node)) {
+                resolved.function = fun;
+                resolved.kind     = CallTarget::Kind::Script;
 
-        if (FunctionDef_t* fun = cast<FunctionDef>(node)) {
-            if (fun->generator) {
-                return make_generator(n, fun, depth);
+                if (fun->generator) {
+                    resolved.kind = CallTarget::Kind::Generator;
+                } else if (fun->native) {
+                    resolved.kind = CallTarget::Kind::Native;
+                }
+            } else if (ClassDef_t* cls = cast<ClassDef_t>(node)) {
+                resolved.function = find_constructor(cls);
+                resolved.kind     = CallTarget::Kind::Constructor;
+
+                if (resolved.function && resolved.function->native) {
+                    resolved.kind = CallTarget::Kind::NativeConstructor;
+                }
+            } else {
+                return Value();
             }
-            if (fun->native) {
-                return call_native(n, fun, depth);
+
+            // Megamorphic sites are resolved every time
+            target = n->cache.insert(node, resolved);
+            if (target == nullptr) {
+                return dispatch(n, node, resolved, depth);
             }
-            return call_script(n, fun, depth);
         }
 
-        if (ClassDef_t* cls = cast<ClassDef_t>(node)) {
-            return call_constructor(n, cls, depth);
-        }
+        return dispatch(n, node, *target, depth);
     }
 
     /*
@@ -759,6 +889,18 @@ Value TreeEvaluator::call(Call_t* n, int depth) {
     return Value();
 }
 
+Value TreeEvaluator::dispatch(Call_t* n, Node* callee, CallTarget const& target, int depth) {
+    switch (target.kind) {
+    case CallTarget::Kind::Generator: return make_generator(n, target.function, depth);
+    case CallTarget::Kind::Native: return call_native(n, target.function, depth);
+    case CallTarget::Kind::Script: return call_script(n, target.function, depth);
+    case CallTarget::Kind::Constructor:
+    case CallTarget::Kind::NativeConstructor:
+        return call_constructor(n, cast<ClassDef>(callee), target.function, depth);
+    }
+    return Value();
+}
+
 Value TreeEvaluator::placeholder(Placeholder_t* n, int depth) { return nullptr; }
 
 Value TreeEvaluator::constant(Constant_t* n, int depth) { return n->value; }
@@ -766,6 +908,13 @@ Value TreeEvaluator::constant(Constant_t* n, int depth) { return n->value; }
 Value TreeEvaluator::comment(Comment_t* n, int depth) { return nullptr; }
 
 Value* TreeEvaluator::fetch_name(Name_t* n, int depth) {
+    // a local that is not bound yet falls back to the enclosing scopes
+    if (ValuePair* var = local(n)) {
+        if (var->name == n->id) {
+            return &var->value;
+        }
+    }
+
     lyassert(variables.size() > 0, "");
     int last = int(variables.size()) - 1;
 
@@ -783,7 +932,7 @@ Value* TreeEvaluator::fetch_name(Name_t* n, int depth) {
 Value TreeEvaluator::name(Name_t* n, int depth) {
 
     if (n->ctx == ExprContext::Store) {
-        return add_variable(n->id, Value());
+        return store_local(n, Value());
     }
 
     return *fetch_name(n, depth);
@@ -792,7 +941,7 @@ Value TreeEvaluator::name(Name_t* n, int depth) {
 Value TreeEvaluator::functiondef(FunctionDef_t* n, int depth) {
     // this should not be called
     // return_value = nullptr;
-    // EXEC_BODY(n->body, 0, MAKE_NAME("call ", str(function->name)));
+    // EXEC_BODY(n->body, 0, "call");
     add_variable(n->name, make_value<Node*>(n));
     return flag::done();
 }
@@ -834,13 +983,14 @@ Value TreeEvaluator::assign(Assign_t* n, int depth) {
             // create a new variable
             if (Name* target_name = cast<Name>(target)) {
                 name = target_name->id;
-                add_variable(name, values->elts[i]);
+                store_variable(name, values->elts[i]);
             }
 
             // Update attrubyte
             if (Attribute* attr = cast<Attribute>(target)) {
-                Value& val = fetch_attribute(attr, depth);
-                val     = values->elts[i];
+                void*  owner = nullptr;
+                Value& val   = fetch_attribute(attr, depth, &owner);
+                gc_store(owner, val, values->elts[i]);
             }
         }
         return flag::done();
@@ -850,12 +1000,13 @@ Value TreeEvaluator::assign(Assign_t* n, int depth) {
         auto* target = n->targets[0];
 
         if (Attribute* attr = cast<Attribute>(target)) {
-            Value val = fetch_attribute(attr, depth);
-            (val)     = value;
+            void*  owner = nullptr;
+            Value& val   = fetch_attribute(attr, depth, &owner);
+            gc_store(owner, val, value);
         }
 
         if (Name* name = cast<Name>(target)) {
-            add_variable(name->id, value);
+            store_local(name, value);
         }
 
         return flag::done();
@@ -864,9 +1015,9 @@ Value TreeEvaluator::assign(Assign_t* n, int depth) {
     return flag::done();
 }
 
-Value* TreeEvaluator::fetch_store_target(ExprNode* n, int depth) {
+Value* TreeEvaluator::fetch_store_target(ExprNode* n, int depth, void** owner) {
     if (Attribute* attr = cast<Attribute>(n)) {
-        return &fetch_attribute(attr, depth);
+        return &fetch_attribute(attr, depth, owner);
     }
 
     if (Name* name = cast<Name>(n)) {
@@ -878,8 +1029,9 @@ Value* TreeEvaluator::fetch_store_target(ExprNode* n, int depth) {
 }
 
 Value TreeEvaluator::augassign(AugAssign_t* n, int depth) {
-    Value* left  = fetch_store_target(n->target, depth);  // load a
-    Value  right = exec(n->value, depth);                 // load b
+    void*  owner = nullptr;
+    Value* left  = fetch_store_target(n->target, depth, &owner);  // load a
+    Value  right = exec(n->value, depth);                         // load b
 
     if (is_concrete(left) && is_concrete(right)) {
         Value value = nullptr;
@@ -891,11 +1043,11 @@ Value TreeEvaluator::augassign(AugAssign_t* n, int depth) {
             // Fetch the argument name from the operator
             add_variable(StringRef(), (*left));
             add_variable(StringRef(), right);
-            (*left) = exec(n->resolved_operator, depth);
+            gc_store(owner, *left, exec(n->resolved_operator, depth));
         } else if (n->native_operator != nullptr) {
             Value oldleft = (*left);
 
-            (*left) = binary_invoke((void*)this, n->native_operator, oldleft, right);
+            gc_store(owner, *left, binary_invoke((void*)this, n->native_operator, oldleft, right));
             kwdebug(treelog, "{} = {} {} {}", str(*left), str(oldleft), str(n->op), str(right));
         } else {
             kwerror(treelog, "Operator does not have implementation!");
@@ -919,12 +1071,12 @@ Value TreeEvaluator::annassign(AnnAssign_t* n, int depth) {
         value = exec(n->value.value(), depth);
     }
 
-    StringRef name;
     if (Name* node_name = cast<Name>(n->target)) {
-        name = node_name->id;
+        store_local(node_name, value);
+        return flag::done();
     }
 
-    add_variable(name, value);
+    store_variable(StringRef(), value);
     return flag::done();
 }
 
@@ -939,9 +1091,14 @@ Value TreeEvaluator::forstmt(For_t* n, int depth) {
 
     // insert target into the context
     // exec(n->target, depth);
-    StringRef target_name = get_name(n->target);
-    int       value_idx   = int(variables.size());
-    Value*    target      = add_variable(target_name, Value());
+    int value_idx = int(variables.size());
+
+    if (ValuePair* var = local(cast<Name>(n->target))) {
+        var->name = get_name(n->target);
+        value_idx = int(var - variables.data());
+    } else {
+        add_variable(get_name(n->target), Value());
+    }
 
     Value iterator = exec(n->iter, depth);
 
@@ -997,7 +1154,7 @@ Value TreeEvaluator::forstmt(For_t* n, int depth) {
         }
     }
 
-    EXEC_BODY(n->orelse, 0, MAKE_NAME("for ", "orlese"));
+    EXEC_BODY(n->orelse, 0, "for orelse");
     return flag::done();
 }
 Value TreeEvaluator::whilestmt(While_t* n, int depth) {
@@ -1010,29 +1167,35 @@ Value TreeEvaluator::whilestmt(While_t* n, int depth) {
         Value value     = exec(n->test, depth);
         bool  bcontinue = value.as<bool>();
 
+        if (has_exceptions()) {
+            return flag::done();
+        }
+
         if (!bcontinue || broke) {
             break;
         }
 
-        auto*      blocks = get_blocks();
-        ExecBlock& _block = blocks->emplace_back();
-        _block.block      = n->body;
-        _block.name       = "while body";
+        // calls can move the blocks, do not keep references across exec
+        auto*      blocks    = get_blocks();
+        int        block_idx = int(blocks->size());
+        ExecBlock& _block    = blocks->emplace_back();
+        _block.block         = &n->body;
+        _block.name          = "while body";
         kwdebug(outlog(), "Insert block {} {} + 1", (void*)blocks, blocks->size());
 
         _block.i = 0;
         for (StmtNode* stmt: n->body) {
             exec(stmt, depth);
-            _block.i += 1;
+            (*get_blocks())[block_idx].i += 1;
 
             if (has_exceptions()) {
-                pop(*blocks, LOC);
+                pop(*get_blocks(), LOC);
                 return Value();
             }
 
             if (has_returned()) {
                 if (!yielding) {
-                    pop(*blocks, LOC);
+                    pop(*get_blocks(), LOC);
                     return flag::done();
                 }
                 return flag::paused();
@@ -1047,7 +1210,7 @@ Value TreeEvaluator::whilestmt(While_t* n, int depth) {
                 break;
             }
         }
-        pop(*blocks, LOC);
+        pop(*get_blocks(), LOC);
 
         // reset
         loop_break    = false;
@@ -1058,31 +1221,14 @@ Value TreeEvaluator::whilestmt(While_t* n, int depth) {
         }
     }
 
-    EXEC_BODY(n->orelse, 0, MAKE_NAME("while ", "orelse"));
+    EXEC_BODY(n->orelse, 0, "while orelse");
     return flag::done();
 }
 
 Value TreeEvaluator::ifstmt(If_t* n, int depth) {
+    // Do not use a reference here, assigning to it would overwrite the orelse branch
+    Array<StmtNode*>* body = &n->orelse;
 
-    Array<StmtNode*>& body = n->orelse;
-    // Chained
-    if (!n->tests.empty()) {
-        for (int i = 0; i < n->tests.size(); i++) {
-            Value value = exec(n->test, depth);
-
-            bool btrue = value.as<bool>();
-            if (btrue) {
-                body = n->bodies[i];
-                break;
-            }
-        }
-
-        EXEC_BODY(body, 0, MAKE_NAME("if ", "body"));
-
-        return flag::done();
-    }
-
-    // Simple
     Value test  = exec(n->test, depth);
     bool  btrue = test.as<bool>();
 
@@ -1090,24 +1236,35 @@ Value TreeEvaluator::ifstmt(If_t* n, int depth) {
     // ic() += 1;
 
     if (btrue) {
-        body = n->body;
+        body = &n->body;
+    } else {
+        // Chained
+        for (int i = 0; i < n->tests.size(); i++) {
+            Value value = exec(n->tests[i], depth);
+
+            if (value.as<bool>()) {
+                body = &n->bodies[i];
+                break;
+            }
+        }
     }
 
-    EXEC_BODY(body, 0, MAKE_NAME("if ", "body"));
+    EXEC_BODY((*body), 0, "if body");
     return flag::done();
 }
 
-Value assert_error(Value message) {
-    auto v        = make_value<ScriptObject>(2);
+Value runtime_error(const char* type, Value message) {
+    auto          v    = make_value<ScriptObject>(nullptr, 2);
     ScriptObject& self = v.as<ScriptObject&>();
 
-    auto t = make_value<String>("AssertionError");
-
-    self.attributes.emplace_back("type", t);
-    self.attributes.emplace_back("message", message);
+    // type, message
+    self.slots[0] = make_value<String>(type);
+    self.slots[1] = message;
     return v;
 }
 
+Value assert_error(Value message) { return runtime_error("AssertionError", message); }
+
 Value TreeEvaluator::assertstmt(Assert_t* n, int depth) {
     Value btest = exec(n->test, depth);
 
@@ -1148,7 +1305,7 @@ Value TreeEvaluator::continuestmt(Continue_t* n, int depth) {
 
 Value TreeEvaluator::inlinestmt(Inline_t* n, int depth) {
 
-    EXEC_BODY(n->body, 0, MAKE_NAME("inline ", "body"));
+    EXEC_BODY(n->body, 0, "inline body");
 
     return flag::done();
 }
@@ -1212,7 +1369,7 @@ Value TreeEvaluator::except(Try_t* n, int depth) {
                 add_variable(matched->name.value(), &exception);
             }
 
-            EXEC_BODY(matched->body, 0, MAKE_NAME("match ", "body"));
+            EXEC_BODY(matched->body, 0, "match body");
 
             // Exception was handled!
             exceptions.pop_back();
@@ -1222,13 +1379,13 @@ Value TreeEvaluator::except(Try_t* n, int depth) {
         // leave the exception as is so we continue moving back
 
     } else {
-        EXEC_BODY(n->orelse, 0, MAKE_NAME("match ", "orelse"));
+        EXEC_BODY(n->orelse, 0, "match orelse");
     }
 
     auto _ = HandleException(this);
 
     {   //
-        EXEC_BODY(n->finalbody, 0, MAKE_NAME("match ", "finalbody")); 
+        EXEC_BODY(n->finalbody, 0, "match finalbody"); 
         //
     }
     // we are not handling exception anymore
@@ -1241,7 +1398,7 @@ Value TreeEvaluator::trystmt(Try_t* n, int depth) {
     // the block needs to be aware of the exceptions
 
     {   //
-        KW_EXEC_BLOCK_BODY(n->body, 0, MAKE_NAME("trystmt ", "body"), n, {}); 
+        KW_EXEC_BLOCK_BODY(n->body, 0, "try body", n, {}); 
         //    
     }
 
@@ -1286,6 +1443,8 @@ Value TreeEvaluator::with_exit(With_t* n, Array<Value>& contexts, int depth) {
 Value TreeEvaluator::with(With_t* n, int depth) {
     // Call enter
     Array<Value> contexts;
+    temporaries.push_back(&contexts);
+    KW_DEFERRED([&]() { temporaries.pop_back(); });
 
     for (auto& item: n->items) {
         auto ctx = exec(item.context_expr, depth);
@@ -1301,7 +1460,7 @@ Value TreeEvaluator::with(With_t* n, int depth) {
         add_variable(name, result);
     }
 
-    KW_EXEC_BLOCK_BODY(n->body, 0, MAKE_NAME("with ", "body"), nullptr, contexts);
+    KW_EXEC_BLOCK_BODY(n->body, 0, "with body", nullptr, contexts);
 
     if (!yielding) {
         with_exit(n, contexts, depth);
@@ -1330,7 +1489,8 @@ Value TreeEvaluator::importfrom(ImportFrom_t* n, int depth) {
     ImportLib::ImportedLib* imported = nullptr;
 
     if (n->module.has_value()) {
-        imported = importsys->importfile(n->module.value());
+        // the module is going to be executed, it needs a full sema
+        imported = importsys->importfile(n->module.value(), true);
     }
 
     if (imported) {
@@ -1380,7 +1540,116 @@ Value TreeEvaluator::joinedstr(JoinedStr_t* n, int depth) { return nullptr; }
 Value TreeEvaluator::formattedvalue(FormattedValue_t* n, int depth) { return nullptr; }
 
 Value TreeEvaluator::starred(Starred_t* n, int depth) { return nullptr; }
-Value TreeEvaluator::listexpr(ListExpr_t* n, int depth) { return nullptr; }
+// Convert a scalar to T, returns false if the value is not a scalar
+template <typename T>
+bool scalar_cast(Value const& v, T& out) {
+    switch (meta::ValueTypes(v.type_id())) {
+#define CASE(type, name)                           \
+    case meta::ValueTypes::name: out = T(v.as<type>()); return true;
+        CASE(int8, i8)
+        CASE(int16, i16)
+        CASE(int32, i32)
+        CASE(int64, i64)
+        CASE(uint8, u8)
+        CASE(uint16, u16)
+        CASE(uint32, u32)
+        CASE(uint64, u64)
+        CASE(float32, f32)
+        CASE(float64, f64)
+#undef CASE
+    default: return false;
+    }
+}
+
+static bool is_floating(Value const& v) {
+    auto type = meta::ValueTypes(v.type_id());
+    return type == meta::ValueTypes::f32 || type == meta::ValueTypes::f64;
+}
+
+// Widen a scalar to the element type of an unboxed list,
+// the sema only unboxes lists whose elements all are of the same family
+template <typename T>
+T scalar_as(Value const& v) {
+    kwassert(is_floating(v) == std::is_floating_point_v<T>, "Element does not match the list storage");
+
+    T    out = T();
+    bool ok  = scalar_cast(v, out);
+    kwassert(ok, "Unboxed lists only hold scalars");
+    return out;
+}
+
+// Narrow an element of an unboxed list back to the element type of the list
+template <typename V>
+Value scalar_value(V v, int elt_type) {
+    switch (meta::ValueTypes(elt_type)) {
+#define CASE(type, name) \
+    case meta::ValueTypes::name: return Value(type(v));
+        CASE(int8, i8)
+        CASE(int16, i16)
+        CASE(int32, i32)
+        CASE(int64, i64)
+        CASE(uint8, u8)
+        CASE(uint16, u16)
+        CASE(uint32, u32)
+        CASE(float32, f32)
+        CASE(float64, f64)
+#undef CASE
+    default: return Value(v);
+    }
+}
+
+// `key in list`, keys of the other scalar family compare by value
+template <typename V>
+bool contains(kiwi::ArrayNative<V> const& array, Value const& key) {
+    if constexpr (std::is_same_v<V, Value>) {
+        return array.__contains__(key);
+    } else {
+        if constexpr (std::is_integral_v<V>) {
+            if (is_floating(key)) {
+                float64 value = 0;
+                scalar_cast(key, value);
+                return V(value) == value && array.__contains__(V(value));
+            }
+        }
+
+        V value = V();
+        return scalar_cast(key, value) && array.__contains__(value);
+    }
+}
+
+template <typename V>
+Value TreeEvaluator::make_list(ListExpr_t* n, int depth) {
+    // Value::copy() shares the values until one of the lists is modified
+    register_value<kiwi::ArrayNative<V>>();
+
+    Value                 list  = make_object<kiwi::ArrayNative<V>>();
+    kiwi::ArrayNative<V>& array = list.ref<kiwi::ArrayNative<V>>();
+
+    array.values.reserve(n->elts.size());
+    for (ExprNode* elt: n->elts) {
+        Value value = exec(elt, depth);
+
+        if (has_exceptions()) {
+            return Value();
+        }
+
+        if constexpr (std::is_same_v<V, Value>) {
+            array.append(value);
+        } else {
+            array.values.push_back(scalar_as<V>(value));
+        }
+    }
+    return list;
+}
+
+Value TreeEvaluator::listexpr(ListExpr_t* n, int depth) {
+    switch (n->storage) {
+    case ArrayStorage::Int64: return make_list<int64>(n, depth);
+    case ArrayStorage::Float64: return make_list<float64>(n, depth);
+    case ArrayStorage::Boxed: break;
+    }
+    return make_list<Value>(n, depth);
+}
 Value TreeEvaluator::tupleexpr(TupleExpr_t* n, int depth) { return nullptr; }
 Value TreeEvaluator::deletestmt(Delete_t* n, int depth) { return nullptr; }
 
@@ -1389,40 +1658,51 @@ Value TreeEvaluator::await(Await_t* n, int depth) { return nullptr; }
 // Objects
 Value TreeEvaluator::slice(Slice_t* n, int depth) { return nullptr; }
 
-Value& TreeEvaluator::fetch_attribute(Attribute_t* n, int depth) {
-    Value obj = exec(n->value, depth);
-
-    meta::ClassMetadata const& meta = meta::classmeta(obj.tag);
-
-    int member_id = -1;
+int find_member(meta::ClassMetadata const& meta, StringRef attr) {
     int i = 0;
-    for(meta::Property const& member: meta.members) {
-        if (StringRef(member.name.c_str()) == n->attr) {
-            member_id = i;
-            break;
+    for (meta::Property const& member: meta.members) {
+        if (StringRef(member.name.c_str()) == attr) {
+            return i;
         }
         i += 1;
     }
+    return -1;
+}
+
+Value& TreeEvaluator::fetch_attribute(Attribute_t* n, int depth, void** owner) {
+    Value obj = exec(n->value, depth);
+
+    meta::ClassMetadata const& meta = meta::classmeta(obj.type_id());
+
+    // Native members are looked up by name, cache the lookup per type
+    int* cached    = n->cache.find(int(obj.type_id()));
+    int  member_id = cached != nullptr ? *cached : find_member(meta, n->attr);
+
+    if (cached == nullptr) {
+        n->cache.insert(int(obj.type_id()), member_id);
+    }
 
-    if (i >= 0) {
-        Value property;
+    if (member_id >= 0) {
         meta::Property const& member = meta.members[member_id];
         int type = member.type;
         int refid = meta::classmeta(type).weakref_type_id;
 
-        property.tag = refid;
+        void* address = nullptr;
         if (meta.size <= sizeof(Value::Holder) && meta.is_trivially_copyable) {
-            property.value.obj = ((char*)&obj) + member.offset;
+            address = ((char*)&obj) + member.offset;
         }
+        property = Value(refid, address);
         return property;
     }
 
-    kwassert(obj.tag == meta::type_id<ScriptObject>(), "Attribute should be an object");
+    kwassert(obj.type_id() == meta::type_id<ScriptObject>(), "Attribute should be an object");
     ScriptObject&         dat  = obj.as<ScriptObject&>();
 
-    if (dat.attributes.size() > 0) {
-        Tuple<String, Value>& attr = dat.attributes[n->attrid];
-        return std::get<1>(attr);
+    if (n->attrid >= 0 && n->attrid < dat.slots.size()) {
+        if (owner != nullptr) {
+            *owner = obj.object();
+        }
+        return dat.slots[n->attrid];
     }
 
     static Value invalid;
@@ -1432,18 +1712,80 @@ Value& TreeEvaluator::fetch_attribute(Attribute_t* n, int depth) {
 Value TreeEvaluator::attribute(Attribute_t* n, int depth) { 
     Value& val = fetch_attribute(n, depth);
 
-    if (val.tag != meta::type_id<_Invalid>()) {
+    if (val.type_id() != meta::type_id<_Invalid>()) {
         return val;
     }
 
     kwdebug(treelog, "Attribute not found {}", n->attr);
     return Value(_None());
 }
-Value TreeEvaluator::subscript(Subscript_t* n, int depth) { return nullptr; }
+template <typename V>
+Value TreeEvaluator::get_item(kiwi::ArrayNative<V> const& array, Value const& index, int elt_type) {
+    int64 i = 0;
+    if (is_floating(index) || !scalar_cast(index, i)) {
+        raise_exception(runtime_error("TypeError", make_value<String>("list indices must be integers")),
+                        Value());
+        return Value();
+    }
+
+    int64 size = int64(array.values.size());
+    if (i < 0) {
+        i += size;
+    }
+    if (i < 0 || i >= size) {
+        raise_exception(runtime_error("IndexError", make_value<String>("list index out of range")),
+                        Value());
+        return Value();
+    }
+
+    if constexpr (std::is_same_v<V, Value>) {
+        return array.values[i];
+    } else {
+        return scalar_value(array.values[i], elt_type);
+    }
+}
+
+Value TreeEvaluator::subscript(Subscript_t* n, int depth) {
+    Value container = exec(n->value, depth);
+    Value index     = exec(n->slice, depth);
+
+    if (has_exceptions()) {
+        return Value();
+    }
+
+    int type = container.type_id();
+    if (type == meta::type_id<kiwi::ArrayNative<int64>>()) {
+        return get_item(container.as<kiwi::ArrayNative<int64> const&>(), index, n->elt_type);
+    }
+    if (type == meta::type_id<kiwi::ArrayNative<float64>>()) {
+        return get_item(container.as<kiwi::ArrayNative<float64> const&>(), index, n->elt_type);
+    }
+    if (type == meta::type_id<kiwi::ArrayNative<Value>>()) {
+        return get_item(container.as<kiwi::ArrayNative<Value> const&>(), index, n->elt_type);
+    }
+
+    kwdebug(treelog, "Subscript is not supported for {}", meta::type_name(type));
+    return Value();
+}
+
+bool TreeEvaluator::contains_value(Value const& container, Value const& key) {
+    int type = container.type_id();
+    if (type == meta::type_id<kiwi::ArrayNative<int64>>()) {
+        return contains(container.as<kiwi::ArrayNative<int64> const&>(), key);
+    }
+    if (type == meta::type_id<kiwi::ArrayNative<float64>>()) {
+        return contains(container.as<kiwi::ArrayNative<float64> const&>(), key);
+    }
+    if (type == meta::type_id<kiwi::ArrayNative<Value>>()) {
+        return contains(container.as<kiwi::ArrayNative<Value> const&>(), key);
+    }
+    kwdebug(treelog, "Membership is not supported for {}", meta::type_name(type));
+    return false;
+}
 
 // Call __next__ for a given object
 Value TreeEvaluator::get_next(Value v, int depth) {
-    if (v.tag == meta::type_id<Generator*>()) {
+    if (v.type_id() == meta::type_id<Generator*>()) {
         return resume(v.as<Generator*>(), depth);
     }
     // FIXME: implement me
@@ -1549,8 +1891,8 @@ Value TreeEvaluator::eval(StmtNode_t* stmt) {
 
             if (except->custom.is_valid<ScriptObject const&>()) {
                 ScriptObject const& obj = except->custom.as<ScriptObject const&>();
-                exception_type          = std::get<1>(obj.attributes[0]).as<String>();
-                exception_msg           = std::get<1>(obj.attributes[1]).as<String>();
+                exception_type          = String(kiwi::string_view(obj.slots[0]));
+                exception_msg           = String(kiwi::string_view(obj.slots[1]));
             }
 
             fmt::print(out, "{}: {}\n", exception_type, exception_msg);
@@ -1600,18 +1942,21 @@ Value TreeEvaluator::resume(Generator* n, int depth) {
     Variables previous;
     std::swap(variables, previous);
 
+    int previous_frame = frame;
+    int previous_slots = slots;
+    frame              = 0;
+    slots              = 0;
+
     // Restore generator state
     std::swap(variables, n->environment);
 
     int   finished_block = 0;
     Value result;
     {
-        using TraceGuard = PopGuard<Array<StackTrace>, StackTrace>;
-
         // Insert a call
-        TraceGuard  _(traces);
-        StackTrace& trace = traces.emplace_back();
+        StackTrace& trace = push_trace();
         trace.blocks      = n->blocks;
+        KW_DEFERRED([&]() { pop_trace(); });
 
         gens.emplace_back(n);
 
@@ -1623,7 +1968,7 @@ Value TreeEvaluator::resume(Generator* n, int depth) {
 
             for (int k = int(blocks.size()) - 1; k >= 0; k--) {
                 ExecBlock& block = blocks[k];
-                auto& body = block.block;
+                auto& body = *block.block;
 
                 kwdebug(treelog, "Resume {} at {}", block.name, block.i);
 
@@ -1634,7 +1979,7 @@ Value TreeEvaluator::resume(Generator* n, int depth) {
 
                         // We cannot always increase like this
                         // if stmt is a while loop, the while might not be done
-                        block.i = i + int(flag.tag != meta::type_id<_paused>());
+                        block.i = i + int(flag.type_id() != meta::type_id<_paused>());
 
                         if (has_exceptions()) {
                             // we should probably break here and
@@ -1694,6 +2039,8 @@ Value TreeEvaluator::resume(Generator* n, int depth) {
 
     // Restore state
     std::swap(variables, previous);
+    frame = previous_frame;
+    slots = previous_slots;
     return result;
 }
 
@@ -11,6 +11,11 @@
 #include "utilities/printing.h"
 #include "utilities/strings.h"
 
+namespace kiwi {
+template <typename V>
+struct ArrayNative;
+}
+
 namespace lython {
 
 using PartialResult = Value;
@@ -30,9 +35,9 @@ struct TreeEvaluatorTrait {
 };
 
 struct ExecBlock {
-    int              i = 0;  // Instruction pointer
-    Array<StmtNode*> block;  // List of instructions
-    String           name;   // Name of the block for debugging
+    int                     i     = 0;        // Instruction pointer
+    Array<StmtNode*> const* block = nullptr;  // List of instructions, owned by the AST
+    char const*             name  = "";       // Name of the block for debugging
 
     Try*         exception_handler = nullptr;
     Array<Value> resources;
@@ -50,12 +55,26 @@ struct StackTrace {
 };
 
 struct ValuePair {
-    String name;
-    Value  value;
+    StringRef name;
+    Value     value;
 };
 
 using Variables = Array<ValuePair>;
 
+struct ScriptObject {
+    // Attribute values, indexed by the slot sema assigned to the attribute
+    // (``Attribute::attrid``); attribute names are only kept in the class
+    // metadata (``ClassDef::attributes``) for reflection.
+    //
+    // Usually methods will not be stored there
+    // but it can happen when the code assign method as attributes
+    //
+    Array<Value> slots;
+    ClassDef*    class_t = nullptr;
+
+    ScriptObject(ClassDef* class_t, std::size_t size): slots(size), class_t(class_t) {}
+};
+
 // Resumable execution
 // blocks record the control flow allowing for resumption
 struct Generator: public GCObject {
@@ -130,9 +149,38 @@ struct TreeEvaluator: public BaseVisitor<TreeEvaluator, false, TreeEvaluatorTrai
 
     int eval();
 
-    TreeEvaluator() { traces.push_back(StackTrace()); }
+    TreeEvaluator() {
+        variables.reserve(256);
+        push_trace();
+    }
+
+    ~TreeEvaluator() {
+        if (collected) {
+            garbage_collector().remove_root(this);
+        }
+    }
+
+    // Allocate the script objects and the lists with garbage_collector(),
+    // the evaluator becomes one of its roots (see scan_roots).
+    // Objects are never freed without it, compile time evaluation (constant folding)
+    // keeps its results inside the AST where the collector does not look
+    void use_garbage_collector();
+    bool collected = false;
+
+    template <typename T, typename... Args>
+    Value make_object(Args... args) {
+        if (collected) {
+            return _new_object<T>(garbage_collector(), meta::type_id<T>(), args...);
+        }
+        return make_value<T>(args...);
+    }
+
+    // Values held by the evaluator: the value stack, the return value, the exceptions, ...
+    static void scan_roots(void* self, GCVisitor& visitor);
 
-    ~TreeEvaluator() {}
+    // Arrays of values held by the C++ frames of the evaluator (call arguments),
+    // the GC objects held directly by a frame are found by the stack scan
+    Array<Array<Value> const*> temporaries;
 
     template <typename Exception, typename... Args>
     Value raise(Args... args) {
@@ -141,7 +189,28 @@ struct TreeEvaluator: public BaseVisitor<TreeEvaluator, false, TreeEvaluatorTrai
 
     Value next(StmtNode* stmt) { return exec(stmt, 0); }
 
+    // Value stack, each call gets a frame starting at `frame` sized by sema
+    // (``FunctionDef::frame_size``) so executing the function does not grow it
     Variables variables;
+    int       frame = 0;
+    int       slots = 0;  // size of the frame laid out by sema, 0 outside of a call
+
+    // Local resolved by sema to a slot of the current frame (``Name::slot``)
+    ValuePair* local(Name_t* name) {
+        if (name != nullptr && name->slot >= 0 && name->slot < slots) {
+            return &variables[frame + name->slot];
+        }
+        return nullptr;
+    }
+
+    Value* store_local(Name_t* name, Value val) {
+        if (ValuePair* var = local(name)) {
+            var->name = name->id;
+            gc_store(nullptr, var->value, val);
+            return &var->value;
+        }
+        return store_variable(name->id, val);
+    }
 
     auto new_scope() {
         return guard([&](std::size_t size) { variables.resize(size); }, variables.size());
@@ -153,20 +222,42 @@ struct TreeEvaluator: public BaseVisitor<TreeEvaluator, false, TreeEvaluatorTrai
 
     Value* fetch_name(Name_t* name, int depth);
 
-    Value& fetch_attribute(Attribute_t* n, int depth);
+    // owner is set to the object holding the attribute, see gc_store
+    Value& fetch_attribute(Attribute_t* n, int depth, void** owner = nullptr);
 
-    Value* fetch_store_target(ExprNode* n, int depth);
+    Value* fetch_store_target(ExprNode* n, int depth, void** owner = nullptr);
 
     Value* add_variable(StringRef name, Value val) {
         kwdebug(treelog, "Adding variable {}", str(name));
         int i = int(variables.size());
-        variables.push_back(ValuePair{str(name), val});
+        variables.push_back(ValuePair{name, val});
+        write_barrier(nullptr, val);
         return &variables[i].value;
     }
 
+    // Assignment, rebinding a name of the current frame overwrites it
+    // instead of pushing a new variable every time the statement runs
+    Value* store_variable(StringRef name, Value val) {
+        for (int i = int(variables.size()) - 1; i >= frame; i--) {
+            if (variables[i].name == name) {
+                gc_store(nullptr, variables[i].value, val);
+                return &variables[i].value;
+            }
+        }
+        return add_variable(name, val);
+    }
+
+    // Make sure the frame of a function fits without reallocating
+    void reserve_frame(int size) {
+        std::size_t needed = variables.size() + std::size_t(size);
+        if (needed > variables.capacity()) {
+            variables.reserve(std::max(needed, variables.capacity() * 2));
+        }
+    }
+
     bool is_concrete(Value val) { return true; }
 
-    void set_value(VariableAddress addr, Value v) { variables[addr.i].value = v; }
+    void set_value(VariableAddress addr, Value v) { gc_store(nullptr, variables[addr.i].value, v); }
 
     Value get_value(VariableAddress addr) { return variables[addr.i].value; }
 
@@ -215,7 +306,8 @@ struct TreeEvaluator: public BaseVisitor<TreeEvaluator, false, TreeEvaluatorTrai
 
     Value call_native(Call_t* call, FunctionDef_t* n, int depth);
     Value call_script(Call_t* call, FunctionDef_t* n, int depth);
-    Value call_constructor(Call_t* call, ClassDef_t* cls, int depth);
+    Value call_constructor(Call_t* call, ClassDef_t* cls, FunctionDef* ctor, int depth);
+    Value dispatch(Call_t* call, Node* callee, CallTarget const& target, int depth);
     Value make_generator(Call_t* call, FunctionDef_t* n, int depth);
 
     // Exception handling that comes after `try`
@@ -236,7 +328,21 @@ struct TreeEvaluator: public BaseVisitor<TreeEvaluator, false, TreeEvaluatorTrai
     Value make(ClassDef* class_t, Array<Value> args, int depth);
     Value resume(Generator* n, int depth);
 
+    // Build a kiwi::ArrayNative<V>, V is int64/float64 for the unboxed lists
+    template <typename V>
+    Value make_list(ListExpr_t* n, int depth);
+
+    // Element of a list, negative indices count from the end
+    template <typename V>
+    Value get_item(kiwi::ArrayNative<V> const& array, Value const& index, int elt_type);
+
+    // `key in container`
+    bool contains_value(Value const& container, Value const& key);
+
     Value exec(StmtNode_t* stmt, int depth) {
+        if (!consume_budget()) {
+            return Value();
+        }
         StackTrace& trace = get_trace();
         trace.stmt        = stmt;
         return Super::exec(stmt, depth);
@@ -244,18 +350,43 @@ struct TreeEvaluator: public BaseVisitor<TreeEvaluator, false, TreeEvaluatorTrai
 
     template <typename T>
     bool is(Value v) {
-        return v.tag == meta::type_id<T>();
+        return v.type_id() == meta::type_id<T>();
     }
 
     Value exec(ExprNode_t* expr, int depth) {
+        if (!consume_budget()) {
+            return Value();
+        }
         StackTrace& trace = get_trace();
         trace.expr        = expr;
         return Super::exec(expr, depth);
     }
 
     StackTrace& get_trace() {
-        kwassert(traces.size() > 0, "Should have at least one call");
-        return traces[traces.size() - 1];
+        kwassert(trace_depth > 0, "Should have at least one call");
+        return traces[trace_depth - 1];
+    }
+
+    // Traces are reused between calls so their blocks keep their memory
+    StackTrace& push_trace() {
+        if (trace_depth == int(traces.size())) {
+            traces.emplace_back();
+        }
+
+        StackTrace& trace = traces[trace_depth];
+        trace_depth += 1;
+
+        trace.stmt = nullptr;
+        trace.expr = nullptr;
+        trace.args.clear();
+        trace.blocks.clear();
+        return trace;
+    }
+
+    void pop_trace() { trace_depth -= 1; }
+
+    Array<StackTrace> active_traces() const {
+        return Array<StackTrace>(traces.begin(), traces.begin() + trace_depth);
     }
 
     Array<ExecBlock>* get_blocks() { return &get_trace().blocks; }
@@ -309,6 +440,9 @@ struct TreeEvaluator: public BaseVisitor<TreeEvaluator, false, TreeEvaluatorTrai
     Expression root;
     Value      return_value;
 
+    // Reference to a native member returned by fetch_attribute
+    Value property;
+
     bool is_partial() const {
         if (partial.empty())
             return false;
@@ -323,7 +457,26 @@ struct TreeEvaluator: public BaseVisitor<TreeEvaluator, false, TreeEvaluatorTrai
         partial[partial.size() - 1] = true;
     }
 
-    bool has_returned() { return return_value.tag != meta::type_id<_Invalid>(); }
+    // Number of nodes the evaluator is still allowed to execute, negative means unlimited
+    // Compile time evaluation sets it so evaluating a non-terminating function gives up
+    int budget = -1;
+
+    bool consume_budget() {
+        if (budget < 0) {
+            return true;
+        }
+        if (budget == 0) {
+            if (!has_exceptions()) {
+                kwdebug(treelog, "Evaluation budget exhausted");
+                raise_exception(Value(), Value());
+            }
+            return false;
+        }
+        budget -= 1;
+        return true;
+    }
+
+    bool has_returned() { return return_value.type_id() != meta::type_id<_Invalid>(); }
 
     void reset() { return_value = Value(); }
 
@@ -345,6 +498,7 @@ struct TreeEvaluator: public BaseVisitor<TreeEvaluator, false, TreeEvaluatorTrai
     Array<Generator*>           gens;
     Array<struct _LyException*> exceptions;
     Array<StackTrace>           traces;
+    int                         trace_depth = 0;
 };
 
 }  // namespace lython
@@ -5,6 +5,15 @@
 #include "utilities/strings.h"
 #include "utilities/helpers.h"
 
+// Threaded dispatch, each instruction jumps directly to the implementation of the next one
+#ifndef KW_VM_COMPUTED_GOTO
+#    if defined(__GNUC__) || defined(__clang__)
+#        define KW_VM_COMPUTED_GOTO 1
+#    else
+#        define KW_VM_COMPUTED_GOTO 0
+#    endif
+#endif
+
 namespace lython {
 
 using StmtRet = VMGen::StmtRet;
@@ -12,1093 +21,1090 @@ using ExprRet = VMGen::ExprRet;
 using ModRet  = VMGen::ModRet;
 using PatRet  = VMGen::PatRet;
 
-
-ExprRet VMGen::namedexpr(NamedExpr_t* n, int depth) { 
-    exec(n->target, depth);
-    exec(n->value, depth);
-    return ExprRet(); 
-}
-ExprRet VMGen::boolop(BoolOp_t* n, int depth) { 
-    for(auto* expr: n->values) {
-        exec(expr, depth);
-    }
-    return ExprRet(); }
-ExprRet VMGen::compare(Compare_t* n, int depth) { 
-    exec(n->left, depth);
-    for(auto* expr: n->comparators) {
-        exec(expr, depth);
+StringRef str(OpCode op) {
+    switch (op) {
+#define OP(name) \
+    case OpCode::name: return StringRef(#name);
+        KW_VM_OPCODES(OP)
+#undef OP
+    default: break;
     }
-    return ExprRet(); 
-}
-ExprRet VMGen::binop(BinOp_t* n, int depth) { 
-    exec(n->left, depth);
-    exec(n->right, depth);
-    return ExprRet(); 
-}
-ExprRet VMGen::unaryop(UnaryOp_t* n, int depth) {
-    exec(n->operand, depth);
-    return ExprRet(); 
-}
-ExprRet VMGen::lambda(Lambda_t* n, int depth) { 
-    exec(n->body, depth);
-    return ExprRet(); 
-}
-ExprRet VMGen::ifexp(IfExp_t* n, int depth) { 
-    exec(n->test, depth);
-    exec(n->body, depth);
-    exec(n->orelse, depth);
-    return ExprRet(); 
+    return StringRef("<invalid>");
 }
-ExprRet VMGen::dictexpr(DictExpr_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::setexpr(SetExpr_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::generateexpr(GeneratorExp_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::listexpr(ListExpr_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::tupleexpr(TupleExpr_t* n, int depth) { return ExprRet(); }
-
-ExprRet VMGen::listcomp(ListComp_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::setcomp(SetComp_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::dictcomp(DictComp_t* n, int depth) { return ExprRet(); }
-
-ExprRet VMGen::await(Await_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::yield(Yield_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::yieldfrom(YieldFrom_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::joinedstr(JoinedStr_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::formattedvalue(FormattedValue_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::constant(Constant_t* n, int depth) { 
-    return ExprRet();
-}
-ExprRet VMGen::attribute(Attribute_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::subscript(Subscript_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::starred(Starred_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::slice(Slice_t* n, int depth) { return ExprRet(); }
-
-ExprRet VMGen::dicttype(DictType_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::arraytype(ArrayType_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::arrow(Arrow_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::builtintype(BuiltinType_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::tupletype(TupleType_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::settype(SetType_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::classtype(ClassType_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::comment(Comment_t* n, int depth) { return ExprRet(); }
-ExprRet VMGen::name(Name_t* n, int depth) { return ExprRet(); }
-
-// JUMP
-ExprRet VMGen::call(Call_t* n, int depth) { 
-    calls_to_be_resolved.push_back({
-        n,
-    });
-    return ExprRet(); 
+
+void Program::dump(std::ostream& out) const {
+    for (int i = 0; i < instructions.size(); i++) {
+        for (Label const& label: labels) {
+            if (label.index == i) {
+                out << fmt::format("{}: (args: {}, registers: {})\n",
+                                   label.name,
+                                   label.argc,
+                                   label.registers);
+            }
+        }
+
+        Instruction const& inst = instructions[i];
+        out << fmt::format("{:4d} | {:<12} {:3d} {:3d} {:3d} {:5d}",
+                           i,
+                           str(str(inst.op)),
+                           inst.a,
+                           inst.b,
+                           inst.c,
+                           inst.d);
+
+        switch (inst.op) {
+        case OpCode::LoadConst: out << "  ; " << constants[inst.d]; break;
+        case OpCode::LoadGlobal:
+        case OpCode::StoreGlobal: out << "  ; " << globals[inst.d]; break;
+        case OpCode::Unary:
+        case OpCode::Binary:
+        case OpCode::CallNative: out << "  ; " << natives[inst.d].name; break;
+        case OpCode::Call: out << "  ; " << labels[inst.d].name; break;
+        default: break;
+        }
+        out << "\n";
+    }
 }
 
-// Leaves
-StmtRet VMGen::invalidstmt(InvalidStatement_t* n, int depth) {
-    kwerror(outlog(), "Invalid statement");
-    return StmtRet();
+//
+// Generate
+// ========
+//
+
+int VMGen::emit(OpCode op, int a, int b, int c, int d) {
+    // alloc reported the overflow, the operands are truncated
+    program.instructions.push_back({op, uint8_t(a), uint8_t(b), uint8_t(c), int32_t(d)});
+    return instruction_counter() - 1;
 }
-StmtRet VMGen::returnstmt(Return_t* n, int depth) {
-    add_instruction(n);
-    if (n->value.has_value()) {
-        exec(n->value.value(), depth);
-    }
-    return StmtRet();
+
+int VMGen::here() {
+    // Instructions before a jump destination cannot be rewritten
+    barrier = instruction_counter();
+    return barrier;
 }
-StmtRet VMGen::deletestmt(Delete_t* n, int depth) {
-    add_instruction(n);
-    for(auto* target : n->targets) {
-        exec(target, depth);
+
+int VMGen::alloc() {
+    if (top == VMMaxRegisters) {
+        kwerror(outlog(),
+                "{} uses more than {} registers",
+                program.labels[current].name,
+                VMMaxRegisters);
+        has_errors = true;
     }
-    return StmtRet();
-}
-StmtRet VMGen::assign(Assign_t* n, int depth) {
-    add_instruction(n);
-    exec(n->value, depth);
-    return StmtRet();
+
+    int reg   = top;
+    top       = top + 1;
+    registers = std::max(registers, top);
+    return reg;
 }
-StmtRet VMGen::augassign(AugAssign_t* n, int depth) {
-    add_instruction(n);
-    exec(n->value, depth);
-    return StmtRet();
+
+int VMGen::constant(Value const& value) {
+    program.constants.push_back(value);
+    return int(program.constants.size()) - 1;
 }
-StmtRet VMGen::annassign(AnnAssign_t* n, int depth) {
-    add_instruction(n);
-    if (n->value.has_value()) {
-        exec(n->value.value(), depth);
+
+int VMGen::native(Function fun, int argc, String const& name, QuickOp op) {
+    for (int i = 0; i < program.natives.size(); i++) {
+        if (program.natives[i].fun == fun) {
+            return i;
+        }
     }
-    return StmtRet();
+    program.natives.push_back({fun, argc, name, op});
+    return int(program.natives.size()) - 1;
 }
-StmtRet VMGen::exprstmt(Expr_t* n, int depth) {
-    if (Comment* cmt = cast<Comment>(n->value)) {
-        return StmtRet();
+
+static QuickOp quick_op(BinaryOperator op) {
+    switch (op) {
+    case BinaryOperator::Add: return QuickOp::Add;
+    case BinaryOperator::Sub: return QuickOp::Sub;
+    case BinaryOperator::Mult: return QuickOp::Mult;
+    case BinaryOperator::Div: return QuickOp::Div;
+    default: return QuickOp::None;
     }
-    add_instruction(n);
-    exec(n->value, depth);
-    return StmtRet();
 }
-StmtRet VMGen::pass(Pass_t* n, int depth) { return StmtRet(); }
-StmtRet VMGen::breakstmt(Break_t* n, int depth) {
-    // jump out
-    Jump* jmp = n->new_object<Jump>();
-    add_instruction(jmp);
-    (*loop_ctx.rbegin()).breakjmp = jmp;
-
-    //
-    // add_instruction(n);
-    return StmtRet();
-}
-StmtRet VMGen::continuestmt(Continue_t* n, int depth) {
-    Jump* jmp = n->new_object<Jump>();
-    add_instruction(jmp);
-    (*loop_ctx.rbegin()).continuejmp = jmp;
 
-    // add_instruction(n);
-    return StmtRet();
+static QuickOp quick_op(CmpOperator op) {
+    switch (op) {
+    case CmpOperator::Eq: return QuickOp::Eq;
+    case CmpOperator::NotEq: return QuickOp::NotEq;
+    case CmpOperator::Lt: return QuickOp::Lt;
+    case CmpOperator::LtE: return QuickOp::LtE;
+    case CmpOperator::Gt: return QuickOp::Gt;
+    case CmpOperator::GtE: return QuickOp::GtE;
+    default: return QuickOp::None;
+    }
 }
-StmtRet VMGen::assertstmt(Assert_t* n, int depth) {
-    CondJump* jmp = n->new_object<CondJump>();
 
-    // TODO: build the exception AssertionError + assert msg
-    Raise* raise = n->new_object<Raise>();
-
-    add_instruction(jmp);
+int VMGen::unsupported(Node* n) {
+    kwerror(outlog(), "VM does not support {}", str(n->kind));
+    has_errors = true;
+    return alloc();
+}
 
-    int raise_idx = instruction_counter();
-    add_instruction(raise);
+void VMGen::move(int dest, int src) {
+    if (dest == src) {
+        return;
+    }
 
-    exec(n->test, depth);
-    jmp->condition = n->test;
-    jmp->then_jmp  = raise_idx + 1;
-    jmp->else_jmp  = raise_idx;
+    // The value was just computed into a temporary, write it to its destination directly
+    if (src >= nlocals && instruction_counter() > barrier) {
+        Instruction& last = program.instructions.back();
+
+        switch (last.op) {
+        case OpCode::LoadConst:
+        case OpCode::Move:
+        case OpCode::LoadGlobal:
+        case OpCode::Unary:
+        case OpCode::Binary:
+        case OpCode::Call:
+        case OpCode::CallNative:
+            if (last.a == src) {
+                last.a = uint8_t(dest);
+                return;
+            }
+        default: break;
+        }
+    }
 
-    return StmtRet();
-}
-StmtRet VMGen::raise(Raise_t* n, int depth) {
-    // this is an implicit jump out to an unknown location
-    //
-    add_instruction(n);
-    return StmtRet();
-}
-StmtRet VMGen::global(Global_t* n, int depth) {
-    add_instruction(n);
-    return StmtRet();
-}
-StmtRet VMGen::nonlocal(Nonlocal_t* n, int depth) {
-    add_instruction(n);
-    return StmtRet();
+    emit(OpCode::Move, dest, src);
 }
 
-// StmtRet VMGen::condjump(CondJump_t* n, int depth) {
-//     return StmtRet();
-// }
+void VMGen::store(ExprNode* target, int reg) {
+    Name* name = cast<Name>(target);
 
-StmtRet VMGen::import(Import_t* n, int depth) { return StmtRet(); }
-StmtRet VMGen::importfrom(ImportFrom_t* n, int depth) { return StmtRet(); }
+    if (name == nullptr) {
+        unsupported(target);
+        return;
+    }
 
-StmtRet VMGen::inlinestmt(Inline_t* n, int depth) {
-    add_body("body", n, n->body, depth);
-    return StmtRet();
-}
-StmtRet VMGen::functiondef(FunctionDef_t* n, int depth) {
-    // we cannot add a call instruction because we ignore expression in this VM
-    if (n->native) {
-        VMNativeFunction* fun = n->new_object<VMNativeFunction>();
-        fun->fun              = n->native;
-        labels.push_back({n, str(n->name), int(program.size()), depth});
-        add_instruction(fun);
-    } else {
-        add_body(str(n->name), n, n->body, depth);
+    if (current == 0) {
+        auto [item, inserted] = globals.insert({name->id, int(program.globals.size())});
+        if (inserted) {
+            program.globals.push_back(str(name->id));
+        }
+        emit(OpCode::StoreGlobal, 0, reg, 0, item->second);
+        return;
+    }
+
+    int local = -1;
+    if (!locals.get(name->id, local)) {
+        unsupported(target);
+        return;
     }
-    return StmtRet();
+    move(local, reg);
 }
-StmtRet VMGen::classdef(ClassDef_t* n, int depth) {
-    // Do we need to insert/generate some more functions ?
-    //
-    //
 
-    // Only functions end up in the final program
-    for (auto* stmt: n->body) {
-        if (FunctionDef* def = cast<FunctionDef>(stmt)) {
-            functiondef(def, depth + 1);
+void VMGen::declare(Array<StmtNode*> const& stmts) {
+    auto local = [&](ExprNode* target) {
+        if (Name* name = cast<Name>(target)) {
+            if (!locals.has_key(name->id)) {
+                locals.insert(name->id, alloc());
+            }
+        }
+    };
+
+    for (StmtNode* stmt: stmts) {
+        switch (stmt->kind) {
+        case NodeKind::Assign: local(cast<Assign>(stmt)->targets[0]); break;
+        case NodeKind::AnnAssign: local(cast<AnnAssign>(stmt)->target); break;
+        case NodeKind::AugAssign: local(cast<AugAssign>(stmt)->target); break;
+        case NodeKind::If: {
+            If* branch = cast<If>(stmt);
+            declare(branch->body);
+            for (Array<StmtNode*> const& alternative: branch->bodies) {
+                declare(alternative);
+            }
+            declare(branch->orelse);
+            break;
+        }
+        case NodeKind::While: {
+            declare(cast<While>(stmt)->body);
+            declare(cast<While>(stmt)->orelse);
+            break;
+        }
+        case NodeKind::Inline: declare(cast<Inline>(stmt)->body); break;
+        default: break;
         }
     }
+}
 
-    return StmtRet();
+void VMGen::body(Array<StmtNode*> const& stmts, int depth) {
+    for (StmtNode* stmt: stmts) {
+        // temporaries do not outlive their statement
+        top = nlocals;
+        Super::exec(stmt, depth);
+    }
+    top = nlocals;
 }
 
-StmtRet VMGen::forstmt(For_t* n, int depth) {
+void VMGen::function(FunctionDef* def, int depth) {
+    int    id    = functions[def->name];
+    Label& label = program.labels[id];
 
-    // Target push some value or values to be modified
-    // n->target
+    if (def->native) {
+        return;
+    }
 
-    // call next on iter and condjump
-    // add_body("test", n, n->iter)
+    locals.clear();
+    current   = id;
+    top       = 0;
+    registers = 0;
 
-    LoopContext& loopctx = loop_ctx.emplace_back();
-    KW_DEFERRED([&]() { loop_ctx.pop_back(); });
+    label.index = here();
 
-    int       start = instruction_counter();
-    CondJump* jmp   = n->new_object<CondJump>();
+    for (Arg& arg: def->args.args) {
+        locals.upsert(arg.arg, alloc());
+    }
+    declare(def->body);
+    nlocals = top;
 
-    // Get next, if stop iteration jump to
-    // we need a break tag and a continue tag
-    exec(n->iter, depth);
+    body(def->body, depth);
 
-    add_instruction(jmp);
+    // implicit return None
+    int none = alloc();
+    emit(OpCode::LoadConst, none, 0, 0, constant(Value(_None())));
+    emit(OpCode::Return, 0, none);
 
-    jmp->then_jmp = instruction_counter();
-    add_body("body", n, n->body, depth);
+    program.labels[id].registers = registers;
+}
 
-    jmp->else_jmp = instruction_counter();
-    add_body("orelse", n, n->orelse, depth);
+ExprRet VMGen::namedexpr(NamedExpr_t* n, int depth) { return unsupported(n); }
 
-    int end = instruction_counter();
+ExprRet VMGen::boolop(BoolOp_t* n, int depth) {
+    // short circuit
+    OpCode     op     = n->op == BoolOperator::And ? OpCode::JumpIfFalse : OpCode::JumpIfTrue;
+    int        result = alloc();
+    Array<int> jumps;
 
-    if (Jump* brk = loopctx.breakjmp) {
-        // Skip orelse
-        brk->destination = end;
-    }
-    if (Jump* cte = loopctx.continuejmp) {
-        // go top of loop
-        cte->destination = start;
+    for (int i = 0; i < n->values.size(); i++) {
+        if (i > 0) {
+            jumps.push_back(emit(op, 0, result));
+        }
+        move(result, exec(n->values[i], depth));
     }
 
-    return StmtRet();
+    int end = here();
+    for (int jump: jumps) {
+        patch(jump, end);
+    }
+    return result;
 }
 
-StmtRet VMGen::whilestmt(While_t* n, int depth) {
-    LoopContext& loopctx = loop_ctx.emplace_back();
-    KW_DEFERRED([&]() { loop_ctx.pop_back(); });
+ExprRet VMGen::compare(Compare_t* n, int depth) {
+    int        result = alloc();
+    int        left   = exec(n->left, depth);
+    Array<int> jumps;
 
-    int       start = instruction_counter();
-    CondJump* jmp   = n->new_object<CondJump>();
-    exec(n->test, depth);
-    jmp->condition  = n->test;
-    add_instruction(jmp);
+    for (int i = 0; i < n->comparators.size(); i++) {
+        Function fun = n->native_operator[i];
+        if (fun == nullptr) {
+            return unsupported(n);
+        }
 
-    jmp->then_jmp = instruction_counter();
-    add_body("body", n, n->body, depth);
+        if (i > 0) {
+            jumps.push_back(emit(OpCode::JumpIfFalse, 0, result));
+        }
 
-    jmp->else_jmp = instruction_counter();
-    add_body("orelse", n, n->orelse, depth);
+        int right = exec(n->comparators[i], depth);
+        int op    = native(fun, 2, str(operator_magic_name(n->ops[i])), quick_op(n->ops[i]));
+        emit(OpCode::Binary, result, left, right, op);
+        left = right;
+    }
 
-    int end = instruction_counter();
-    if (Jump* brk = loopctx.breakjmp) {
-        // Skip orelse
-        brk->destination = end;
+    if (!jumps.empty()) {
+        int end = here();
+        for (int jump: jumps) {
+            patch(jump, end);
+        }
     }
-    if (Jump* cte = loopctx.continuejmp) {
-        // go top of loop
-        cte->destination = start;
+    return result;
+}
+
+ExprRet VMGen::binop(BinOp_t* n, int depth) {
+    if (n->native_operator == nullptr) {
+        return unsupported(n);
     }
 
-    return StmtRet();
+    int left  = exec(n->left, depth);
+    int right = exec(n->right, depth);
+    int op    = native(n->native_operator, 2, str(operator_magic_name(n->op)), quick_op(n->op));
+    int dest  = alloc();
+    emit(OpCode::Binary, dest, left, right, op);
+    return dest;
 }
 
-StmtRet VMGen::ifstmt(If_t* n, int depth) {
-    CondJump* jmp  = n->new_object<CondJump>();
-    jmp->condition = n->test;
-    exec(n->test, depth);
-    add_instruction(jmp);
+ExprRet VMGen::unaryop(UnaryOp_t* n, int depth) {
+    if (n->native_operator == nullptr) {
+        return unsupported(n);
+    }
 
-    jmp->then_jmp = instruction_counter();
-    add_body("body", n, n->body, depth);
+    int operand = exec(n->operand, depth);
+    int op      = native(n->native_operator, 1, str(operator_magic_name(n->op)));
+    int dest    = alloc();
+    emit(OpCode::Unary, dest, operand, 0, op);
+    return dest;
+}
 
-    jmp->else_jmp = instruction_counter();
-    add_body("orelse", n, n->orelse, depth);
+ExprRet VMGen::lambda(Lambda_t* n, int depth) { return unsupported(n); }
 
-    return StmtRet();
-}
+ExprRet VMGen::ifexp(IfExp_t* n, int depth) {
+    int result = alloc();
+    int test   = exec(n->test, depth);
+    int orelse = emit(OpCode::JumpIfFalse, 0, test);
 
-StmtRet VMGen::with(With_t* n, int depth) {
+    move(result, exec(n->body, depth));
+    int end = emit(OpCode::Jump);
 
-    // Add enter instructions
-    for (WithItem& item: n->items) {
-        item.context_expr;
-        item.optional_vars;
-    }
+    patch(orelse, here());
+    move(result, exec(n->orelse, depth));
 
-    // Needs to handle jump to OUTSIDE
+    patch(end, here());
+    return result;
+}
 
-    add_body("body", n, n->body, depth);
+ExprRet VMGen::dictexpr(DictExpr_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::setexpr(SetExpr_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::generateexpr(GeneratorExp_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::listexpr(ListExpr_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::tupleexpr(TupleExpr_t* n, int depth) { return unsupported(n); }
 
-    // jump to here
-    // resume after
+ExprRet VMGen::listcomp(ListComp_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::setcomp(SetComp_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::dictcomp(DictComp_t* n, int depth) { return unsupported(n); }
 
-    // Add exit instructions
-    for (WithItem& item: n->items) {
-        item.context_expr;
-        item.optional_vars;
-    }
+ExprRet VMGen::await(Await_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::yield(Yield_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::yieldfrom(YieldFrom_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::joinedstr(JoinedStr_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::formattedvalue(FormattedValue_t* n, int depth) { return unsupported(n); }
 
-    return StmtRet();
+ExprRet VMGen::constant(Constant_t* n, int depth) {
+    int dest = alloc();
+    emit(OpCode::LoadConst, dest, 0, 0, constant(n->value));
+    return dest;
 }
-StmtRet VMGen::trystmt(Try_t* n, int depth) {
-    // register the exception handler addresses
-    // could `raise Exception` just lookup if "Exception has a registered handler"
 
-    add_body("body", n, n->body, depth);
-    // jump to orelse
+ExprRet VMGen::attribute(Attribute_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::subscript(Subscript_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::starred(Starred_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::slice(Slice_t* n, int depth) { return unsupported(n); }
 
-    // on exception needs to jump to the right address
-    for (auto& handler: n->handlers) {
-        add_body("except_", n, handler.body, depth);
-        // jump to final
-    }
+ExprRet VMGen::dicttype(DictType_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::arraytype(ArrayType_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::arrow(Arrow_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::builtintype(BuiltinType_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::tupletype(TupleType_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::settype(SetType_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::classtype(ClassType_t* n, int depth) { return unsupported(n); }
+ExprRet VMGen::comment(Comment_t* n, int depth) { return alloc(); }
 
-    // regular operation
-    add_body("orelse", n, n->orelse, depth);
+ExprRet VMGen::name(Name_t* n, int depth) {
+    if (current != 0) {
+        int local = -1;
+        if (locals.get(n->id, local)) {
+            return local;
+        }
+    }
 
-    // Needs to handle jump to OUTSIDE
-    add_body("finalbody", n, n->finalbody, depth);
+    auto global = globals.find(n->id);
+    if (global != globals.end()) {
+        int dest = alloc();
+        emit(OpCode::LoadGlobal, dest, 0, 0, global->second);
+        return dest;
+    }
 
-    return StmtRet();
+    return unsupported(n);
 }
 
-StmtRet VMGen::match(Match_t* n, int depth) { return StmtRet(); }
+ExprRet VMGen::call(Call_t* n, int depth) {
+    Name* fun  = cast<Name>(n->func);
+    auto  item = fun != nullptr ? functions.find(fun->id) : functions.end();
 
-PatRet VMGen::matchvalue(MatchValue_t* n, int depth) { return PatRet(); }
-PatRet VMGen::matchsingleton(MatchSingleton_t* n, int depth) { return PatRet(); }
-PatRet VMGen::matchsequence(MatchSequence_t* n, int depth) { return PatRet(); }
-PatRet VMGen::matchmapping(MatchMapping_t* n, int depth) { return PatRet(); }
-PatRet VMGen::matchclass(MatchClass_t* n, int depth) { return PatRet(); }
-PatRet VMGen::matchstar(MatchStar_t* n, int depth) { return PatRet(); }
-PatRet VMGen::matchas(MatchAs_t* n, int depth) { return PatRet(); }
-PatRet VMGen::matchor(MatchOr_t* n, int depth) { return PatRet(); }
+    if (item == functions.end() || !n->keywords.empty()) {
+        return unsupported(n);
+    }
 
-ModRet VMGen::module(Module_t* n, int depth) {
-    Array<StmtNode*> entry_point;
-    Array<StmtNode*> others;
+    Label&       label = program.labels[item->second];
+    FunctionDef* def   = cast<FunctionDef>(label.stmt);
+    int          argc  = int(n->args.size());
 
-    for (auto* stmt: n->body) {
-        if (!in(stmt->kind, NodeKind::FunctionDef, NodeKind::ClassDef)) {
-            entry_point.push_back(stmt);
-        } else {
-            others.push_back(stmt);
-        }
+    if (argc != label.argc) {
+        kwerror(outlog(), "{} expects {} arguments got {}", label.name, label.argc, argc);
+        has_errors = true;
     }
 
-    for (auto* stmt: entry_point) {
-        Super::exec(stmt, depth);
+    // Arguments are moved to consecutive registers, they become the first registers
+    // of the callee frame
+    int base = top;
+    for (int i = 0; i < std::max(argc, 1); i++) {
+        alloc();
     }
-
-    // generate a (return None) as the last instruction of the entry point
-    Return* stop = n->new_object<Return>();
-    add_instruction(stop);
-
-     for (auto* stmt: others) {
-        Super::exec(stmt, depth);
+    for (int i = 0; i < argc; i++) {
+        move(base + i, exec(n->args[i], depth));
     }
 
-    // Resolve Call
-    /*
-    for(LazyCallResolve& pending: calls_to_be_resolved) {
-        ExprNode* fun = pending.call->func;
-        switch (fun->kind) {
-            case NodeKind::Name: {
-                Name* name = cast<Name>(fun);
-                for(auto& label: labels) {
-                    if (str(name->id) == label.name) {
-                        pending.call->jump_id = label.index;
-                    }
-                }
-                continue;
-            }
-            default: {
-                kwerror(outlog(), "unsupported call to {}", str(fun->kind));
-                continue;
-            }
-        }
+    if (def->native) {
+        emit(OpCode::CallNative, base, base, argc, native(def->native, argc, label.name));
+    } else {
+        emit(OpCode::Call, base, base, argc, item->second);
     }
-    */
-    return ModRet();
-};
-ModRet VMGen::interactive(Interactive_t* n, int depth) { return ModRet(); }
-ModRet VMGen::functiontype(FunctionType_t* n, int depth) { return ModRet(); }
-ModRet VMGen::expression(Expression_t* n, int depth) { return ModRet(); }
 
-ModRet VMGen::exported(Exported_t* n, int depth) { return ModRet(); }
-ModRet VMGen::placeholder(Placeholder_t* n, int depth) { return ModRet(); }
+    // the temporaries used to compute the arguments are dead
+    top = base + 1;
+    return base;
+}
 
-//
-// Execute
-// =======
-void exec(int ic, int depth);
-//
+// Leaves
+StmtRet VMGen::invalidstmt(InvalidStatement_t* n, int depth) { return unsupported(n); }
 
-Value VMExec::execute(Program const& prog, int entry) {
-    set_program(&prog);
-    execute(entry);
-    return Value();
+StmtRet VMGen::returnstmt(Return_t* n, int depth) {
+    int value = 0;
+    if (n->value.has_value()) {
+        value = exec(n->value.value(), depth);
+    } else {
+        value = alloc();
+        emit(OpCode::LoadConst, value, 0, 0, constant(Value(_None())));
+    }
+    emit(OpCode::Return, 0, value);
+    return 0;
 }
 
-Value VMExec::execute(int entry) {
-    set_ic(entry);
+StmtRet VMGen::deletestmt(Delete_t* n, int depth) { return unsupported(n); }
 
+StmtRet VMGen::assign(Assign_t* n, int depth) {
+    if (n->targets.size() != 1) {
+        return unsupported(n);
+    }
+    store(n->targets[0], exec(n->value, depth));
+    return 0;
+}
 
-    while (true) {
-        if (ic >= program->instructions.size() || ic < 0) {
-            return getreg(Registers::ReturnValue);
-        }
+StmtRet VMGen::augassign(AugAssign_t* n, int depth) {
+    if (n->native_operator == nullptr || cast<Name>(n->target) == nullptr) {
+        return unsupported(n);
+    }
 
-        Instruction const& inst = program->instructions[ic];
-        Super::exec(inst.stmt, 0);
+    int target = exec(n->target, depth);
+    int value  = exec(n->value, depth);
+    int op     = native(n->native_operator, 2, str(operator_magic_name(n->op)), quick_op(n->op));
 
-        if (ic < 0) {
-            return getreg(Registers::ReturnValue);
-        }
+    emit(OpCode::Binary, target, target, value, op);
 
-        inc_ic();
+    if (current == 0) {
+        store(n->target, target);
     }
+    return 0;
 }
 
-ExprRet VMExec::boolop(BoolOp_t* n, int depth) { 
-    StackTrace& trace = stacktrace.emplace_back();
-    KW_DEFERRED(
-    [&](std::size_t old_size) {
-        stacktrace.pop_back();
-        variables.resize(old_size);
-    },
-    variables.size());
+StmtRet VMGen::annassign(AnnAssign_t* n, int depth) {
+    if (n->value.has_value()) {
+        store(n->target, exec(n->value.value(), depth));
+    }
+    return 0;
+}
 
-    using ExecFun = Value(*)(VMExec*, BoolOp_t*, Value, Value);
+StmtRet VMGen::exprstmt(Expr_t* n, int depth) {
+    exec(n->value, depth);
+    return 0;
+}
 
-    ExecFun exec_native = [](VMExec* self, BoolOp_t* n, Value acc, Value val) -> Value {
-        return n->native_operator(self, self->makeargs(acc, val));
-    };
-    ExecFun exec_script = [](VMExec* self, BoolOp_t* n, Value acc, Value val) -> Value {
-        self->add_value(acc);
-        self->add_value(val);
-        // TODO
-        // jump to the right function
-
-        self->variables.resize(len(self->variables) - 2);
-        return self->getreg(Registers::ReturnValue);
-    };
+StmtRet VMGen::pass(Pass_t* n, int depth) { return 0; }
 
-    ExecFun impl = n->native_operator ? exec_native: exec_script;
-    
-    Value result = Super::exec(n->values[0], depth);
+StmtRet VMGen::breakstmt(Break_t* n, int depth) {
+    if (loop_ctx.empty()) {
+        return unsupported(n);
+    }
+    loop_ctx.back().breaks.push_back(emit(OpCode::Jump));
+    return 0;
+}
 
-    for(int i = 1; i < len(n->values); i++) {
-        // shortcut
-        // if true and OR
-        if (result.as<bool>() && n->op == BoolOperator::Or) {
-            return Value(true);
-        }
-        // if false and AND
-        if (!result.as<bool>() && n->op == BoolOperator::And) {
-            return Value(false);
-        }
+StmtRet VMGen::continuestmt(Continue_t* n, int depth) {
+    if (loop_ctx.empty()) {
+        return unsupported(n);
+    }
+    emit(OpCode::Jump, 0, 0, 0, loop_ctx.back().start);
+    return 0;
+}
 
-        Value val = Super::exec(n->values[i], depth);
+StmtRet VMGen::assertstmt(Assert_t* n, int depth) {
+    int test = exec(n->test, depth);
+    int jump = emit(OpCode::JumpIfTrue, 0, test);
 
-        result = impl(this, n, result, n->values[i]);
+    int message = 0;
+    if (n->msg.has_value()) {
+        message = exec(n->msg.value(), depth);
+    } else {
+        message = alloc();
+        emit(OpCode::LoadConst, message, 0, 0, constant(make_value<String>("AssertionError")));
     }
+    emit(OpCode::Raise, 0, message);
 
-    return Value();
+    patch(jump, here());
+    return 0;
+}
+
+StmtRet VMGen::raise(Raise_t* n, int depth) {
+    int value = 0;
+    if (n->exc.has_value()) {
+        value = exec(n->exc.value(), depth);
+    } else {
+        value = alloc();
+        emit(OpCode::LoadConst, value, 0, 0, constant(Value(_None())));
+    }
+    emit(OpCode::Raise, 0, value);
+    return 0;
 }
-ExprRet VMExec::namedexpr(NamedExpr_t* n, int depth) {
-    Value val = Super::exec(n->value, depth);
-    add_value(val);
-    return val; 
+
+StmtRet VMGen::global(Global_t* n, int depth) { return unsupported(n); }
+StmtRet VMGen::nonlocal(Nonlocal_t* n, int depth) { return unsupported(n); }
+
+StmtRet VMGen::import(Import_t* n, int depth) { return 0; }
+StmtRet VMGen::importfrom(ImportFrom_t* n, int depth) { return 0; }
+
+StmtRet VMGen::inlinestmt(Inline_t* n, int depth) {
+    body(n->body, depth);
+    return 0;
 }
-ExprRet VMExec::compare(Compare_t* n, int depth) {
-    StackTrace& trace = stacktrace.emplace_back();
-    KW_DEFERRED(
-    [&](std::size_t old_size) {
-        stacktrace.pop_back();
-        variables.resize(old_size);
-    },
-    variables.size());
-
-    auto exec_native = [](VMExec* self, Function fun, Value prev, Value next) -> Value {
-        return fun(self, self->makeargs(prev, next));
-    };
 
-    auto exec_script = [](VMExec* self, int jump, Value prev, Value next) -> Value {
-        self->add_value(prev);
-        self->add_value(next);
-        // TODO
-        // jump to the right function
+StmtRet VMGen::functiondef(FunctionDef_t* n, int depth) {
+    // Functions are generated by the module, nested functions are not supported
+    return unsupported(n);
+}
 
-        self->variables.resize(len(self->variables) - 2);
-        return self->getreg(Registers::ReturnValue);
-    };
+StmtRet VMGen::classdef(ClassDef_t* n, int depth) { return unsupported(n); }
 
-    Value prev = Super::exec(n->left, depth);
-    for(int i = 0; i < len(n->comparators); i++) {
-        Value next = Super::exec(n->comparators[i], depth);
+StmtRet VMGen::forstmt(For_t* n, int depth) { return unsupported(n); }
 
-        // TODO
-        // get function implementation index
-        // n->varid
-        Function impl = n->native_operator[i];
+StmtRet VMGen::whilestmt(While_t* n, int depth) {
+    LoopContext& loop = loop_ctx.emplace_back();
+    loop.start        = here();
 
-        Value result = impl ? exec_native(this, impl, prev, next) : exec_script(this, 0, prev, next);
+    int test   = exec(n->test, depth);
+    int orelse = emit(OpCode::JumpIfFalse, 0, test);
 
-        if (!result.as<bool>()){
-            return Value(false);
-        }
-        prev = next;
-    }   
+    body(n->body, depth);
+    emit(OpCode::Jump, 0, 0, 0, loop_ctx.back().start);
+
+    patch(orelse, here());
+    body(n->orelse, depth);
 
-    return Value(true);
+    // break skips orelse
+    int end = here();
+    for (int jump: loop_ctx.back().breaks) {
+        patch(jump, end);
+    }
+    loop_ctx.pop_back();
+    return 0;
 }
-ExprRet VMExec::binop(BinOp_t* n, int depth) 
-{ 
-    StackTrace& trace = stacktrace.emplace_back();
-    KW_DEFERRED(
-    [&](std::size_t old_size) {
-        stacktrace.pop_back();
-        variables.resize(old_size);
-    },
-    variables.size());
-
-    Value left = Super::exec(n->left, depth);
-    Value right = Super::exec(n->right, depth);
-
-    if (n->native_operator) {
-        return n->native_operator(this, makeargs(left, right));
+
+StmtRet VMGen::ifstmt(If_t* n, int depth) {
+    int test   = exec(n->test, depth);
+    int orelse = emit(OpCode::JumpIfFalse, 0, test);
+
+    body(n->body, depth);
+
+    Array<int> ends;
+    for (int i = 0; i < n->tests.size(); i++) {
+        ends.push_back(emit(OpCode::Jump));
+        patch(orelse, here());
+
+        top    = nlocals;
+        test   = exec(n->tests[i], depth);
+        orelse = emit(OpCode::JumpIfFalse, 0, test);
+        body(n->bodies[i], depth);
     }
 
-    add_value(left);
-    add_value(right);
-    
-    // TODO
-    // get function implementation index
-    // n->varid
-    return Value();
-}
-ExprRet VMExec::unaryop(UnaryOp_t* n, int depth) { 
-    
-    StackTrace& trace = stacktrace.emplace_back();
-    KW_DEFERRED(
-    [&](std::size_t old_size) {
-        stacktrace.pop_back();
-        variables.resize(old_size);
-    },
-    variables.size());
-
-    Value operand = Super::exec(n->operand, depth);
-    if (n->native_operator) {
-        return n->native_operator(this, makeargs(operand));
+    if (!n->orelse.empty()) {
+        ends.push_back(emit(OpCode::Jump));
+        patch(orelse, here());
+        body(n->orelse, depth);
+    } else {
+        patch(orelse, here());
     }
 
-    add_value(operand);
-    // TODO
-    // get function implementation index
-    // n->varid
-    return Value();
-}
-ExprRet VMExec::ifexp(IfExp_t* n, int depth) { 
-    Value cond = Super::exec(n->test, depth);
-    if (cond.as<bool>()) {
-        return Super::exec(n->body, depth);
+    int end = here();
+    for (int jump: ends) {
+        patch(jump, end);
     }
-    return Super::exec(n->orelse, depth); 
+    return 0;
 }
 
+StmtRet VMGen::with(With_t* n, int depth) { return unsupported(n); }
+StmtRet VMGen::trystmt(Try_t* n, int depth) { return unsupported(n); }
+StmtRet VMGen::match(Match_t* n, int depth) { return unsupported(n); }
 
-ExprRet VMExec::joinedstr(JoinedStr_t* n, int depth) { return ExprRet(); }
-ExprRet VMExec::formattedvalue(FormattedValue_t* n, int depth) { return ExprRet(); }
-
-ExprRet VMExec::yield(Yield_t* n, int depth) { 
-    // save the current excution state and return to main execution thread
-    return ExprRet(); 
-}
-ExprRet VMExec::yieldfrom(YieldFrom_t* n, int depth) { return ExprRet(); }
+PatRet VMGen::matchvalue(MatchValue_t* n, int depth) { return 0; }
+PatRet VMGen::matchsingleton(MatchSingleton_t* n, int depth) { return 0; }
+PatRet VMGen::matchsequence(MatchSequence_t* n, int depth) { return 0; }
+PatRet VMGen::matchmapping(MatchMapping_t* n, int depth) { return 0; }
+PatRet VMGen::matchclass(MatchClass_t* n, int depth) { return 0; }
+PatRet VMGen::matchstar(MatchStar_t* n, int depth) { return 0; }
+PatRet VMGen::matchas(MatchAs_t* n, int depth) { return 0; }
+PatRet VMGen::matchor(MatchOr_t* n, int depth) { return 0; }
 
+ModRet VMGen::module(Module_t* n, int depth) {
+    // Label 0 is the entry point
+    program.labels.push_back({nullptr, "<module>", 0, depth});
 
-ExprRet VMExec::constant(Constant_t* n, int depth) { 
-    return n->value; 
-}
-ExprRet VMExec::attribute(Attribute_t* n, int depth) { 
-    // get the value or set the value of an attribute
+    // Resolve the functions first so calls can reference functions defined later
+    Array<StmtNode*> entry_point;
+    Array<FunctionDef*> defs;
 
-    return ExprRet(); 
-}
-ExprRet VMExec::subscript(Subscript_t* n, int depth) { 
-    // call native []
-    // or call __getitem__ / __setitem__
-    return ExprRet(); 
-}
+    for (StmtNode* stmt: n->body) {
+        if (FunctionDef* def = cast<FunctionDef>(stmt)) {
+            Label label{def, str(def->name), -1, depth + 1};
+            label.argc = int(def->args.args.size());
 
-ExprRet VMExec::dictexpr(DictExpr_t* n, int depth) { 
-    //
-    // How would the GC interact here
-    //  1. we need the GC to know about the memory allocation
-    //     a. _new_object should call placement new and the memory should be allocated for it by the GC
-    //        or it should take a reference to a `GarbageCollector` that will allocate the memory for it
-    //     b. we could move the tag out of Value and into the GC
-    //        Makes Value cheaper overall, plus once sema is run type safety should be guaranteed
-    //
-    //  2. it needs to know HOW to free it
-    //     a. Here the value is a C++ class, so the constructor can be called
-    //        BUT the value it holds might need to be deleted by a special destructor
-    //     b. If Value is a Script class, its destructor need to be called
-    //        which requires VMExec to be available
-    //     c. ValueDeleter = void(*)(Value&) so the function is not compatible with VMExec
-    //        we could change the signature to be void(*)(GarbageCollector* gc, Value&)
-    //        and VMExec would implement the `GarbageCollector` interface
-    //
-    //  3. So now we have a list of Values allocated
-    //     We can iterate over all the addressable value and mark
-    //     the reachable value
-    //
-    Value val = make_value<Dict<Value, Value>>();
-    
-    Dict<Value, Value>& dict = val.as<Dict<Value, Value>&>();
-    dict.reserve(len(n->keys));
-
-    for(int i = 0; i < len(n->keys); i++) {
-        Value key = Super::exec(n->keys[i], depth);
-        Value value = Super::exec(n->values[i], depth);
-        // dict[key] = val;
-        dict.insert({key, val});
+            functions[def->name] = int(program.labels.size());
+            program.labels.push_back(label);
+            defs.push_back(def);
+        } else {
+            entry_point.push_back(stmt);
+        }
     }
-    return val;
-}
-ExprRet VMExec::setexpr(SetExpr_t* n, int depth) { 
-    Value val = make_value<Array<Value>>();
-    
-    Array<Value>& array = val.as<Array<Value>&>();
-    array.reserve(len(n->elts));
-
-    for(auto* elt: n->elts) {
-        Value element = Super::exec(elt, depth);
-        array.push_back(elt);
+
+    current   = 0;
+    top       = 0;
+    nlocals   = 0;
+    registers = 0;
+    body(entry_point, depth);
+
+    int none = alloc();
+    emit(OpCode::LoadConst, none, 0, 0, constant(Value(_None())));
+    emit(OpCode::Return, 0, none);
+    program.labels[0].registers = registers;
+
+    for (FunctionDef* def: defs) {
+        function(def, depth);
     }
-    return val; 
-}
-ExprRet VMExec::listexpr(ListExpr_t* n, int depth) { 
-    Value val = make_value<Array<Value>>();
-    
-    Array<Value>& array = val.as<Array<Value>&>();
-    array.reserve(len(n->elts));
-
-    for(auto* elt: n->elts) {
-        Value element = Super::exec(elt, depth);
-        array.push_back(elt);
+    return 0;
+};
+
+ModRet VMGen::interactive(Interactive_t* n, int depth) { return 0; }
+ModRet VMGen::functiontype(FunctionType_t* n, int depth) { return 0; }
+ModRet VMGen::expression(Expression_t* n, int depth) { return 0; }
+
+ModRet VMGen::exported(Exported_t* n, int depth) { return 0; }
+ModRet VMGen::placeholder(Placeholder_t* n, int depth) { return 0; }
+
+//
+// Execute
+// =======
+//
+
+inline bool truthy(Value const& value) {
+    if (value.is_type<bool>()) {
+        return value.load<bool>();
     }
-    return val; 
+    return value.as<bool>();
 }
-ExprRet VMExec::tupleexpr(TupleExpr_t* n, int depth) { 
-    Value val = make_value<Array<Value>>();
-    
-    Array<Value>& array = val.as<Array<Value>&>();
-    array.reserve(len(n->elts));
-
-    for(auto* elt: n->elts) {
-        Value element = Super::exec(elt, depth);
-        array.push_back(elt);
-    }
-    return val; 
+
+void VMExec::set_program(Program const* prog) {
+    program = prog;
+    globals.clear();
+    globals.resize(prog->globals.size());
+
+    code = prog->instructions;
+    profile.clear();
+    profile.resize(code.size());
+    pairs.assign(int(OpCode::Size) * int(OpCode::Size), 0);
+
+    budget      = warmup;
+    previous    = OpCode::Nop;
+    quickened   = 0;
+    fused       = 0;
+    deoptimized = 0;
 }
-ExprRet VMExec::slice(Slice_t* n, int depth) { 
-    //
-    // this returns an array view/range/slice
-    Value step;
-    Value upper;
-    Value lower;
-
-    if (n->step.has_value()) {
-        step = Super::exec(n->step.value(), depth);
-    }
-    if (n->lower.has_value()) {
-        lower = Super::exec(n->lower.value(), depth);
-    }
-    if (n->upper.has_value()) {
-        upper = Super::exec(n->upper.value(), depth);
+
+//
+// Quickening
+// ----------
+//
+
+#define KW_VM_QUICK_TYPES(T) \
+    T(I32, int32, i32)       \
+    T(I64, int64, i64)       \
+    T(F64, float64, f64)
+
+#define KW_VM_QUICK_ARITH(OP, ...) \
+    OP(Add, +, __VA_ARGS__)        \
+    OP(Sub, -, __VA_ARGS__)        \
+    OP(Mult, *, __VA_ARGS__)
+
+#define KW_VM_QUICK_CMP(OP, ...) \
+    OP(Eq, ==, __VA_ARGS__)      \
+    OP(NotEq, !=, __VA_ARGS__)   \
+    OP(Lt, <, __VA_ARGS__)       \
+    OP(LtE, <=, __VA_ARGS__)     \
+    OP(Gt, >, __VA_ARGS__)       \
+    OP(GtE, >=, __VA_ARGS__)
+
+// Specialised instruction for an operator applied on two values of type `tag`
+static OpCode quick_opcode(QuickOp op, int tag) {
+#define CASE(name, _, T) \
+    case QuickOp::name: return OpCode::name##T;
+
+#define TYPE(T, type, field)             \
+    if (tag == meta::type_id<type>()) {  \
+        switch (op) {                    \
+            KW_VM_QUICK_ARITH(CASE, T)   \
+            KW_VM_QUICK_CMP(CASE, T)     \
+        default: break;                  \
+        }                                \
     }
 
-    return ExprRet(); 
+    KW_VM_QUICK_TYPES(TYPE)
+
+#undef TYPE
+#undef CASE
+
+    if (tag == meta::type_id<float64>() && op == QuickOp::Div) {
+        return OpCode::DivF64;
+    }
+    return OpCode::Nop;
 }
 
-ExprRet VMExec::name(Name_t* n, int depth) {
-    int idx = (n->load_id - n->store_id);
-    int size = int(variables.size());
+// Comparison fused with the conditional jump that follows it
+static OpCode fused_opcode(OpCode op) {
+    switch (op) {
+#define CASE(name, _, T) \
+    case OpCode::name##T: return OpCode::JumpIfNot##name##T;
+
+#define TYPE(T, type, field) KW_VM_QUICK_CMP(CASE, T)
 
-    Value val = variables[size - idx];
+        KW_VM_QUICK_TYPES(TYPE)
 
-    kwerror(outlog(), "loading {}", str(val));
-    return val;
+#undef TYPE
+#undef CASE
+    default: return OpCode::Nop;
+    }
 }
 
-int VMExec::compute_jump_call_address(Call_t* n, int depth) {
-    //
-    // def oldfun(...)
-    //     pass
-    //
-    // newfun = oldfun
-    //
-    //
-    // or returning of function ?
-    // sema will tell us the expression is callable
-    // constant folding might simplify a lot here
-
-
-    // TODO: this can be pre-computed on VMGen
-    auto find_label = [&](String name) -> int {
-        for(auto& label: program->labels) {
-            if (label.name == name) {
-                return label.index;
-            }
-        }
-        return -1;
-    };
+bool VMExec::record(Instruction const* ip, Value const* R) {
+    int i = int(ip - code.data());
+
+    pairs[int(previous) * int(OpCode::Size) + int(ip->op)] += 1;
+    previous = ip->op;
+
+    InstructionProfile& prof = profile[i];
+    prof.count += 1;
+
+    if (ip->op == OpCode::Binary) {
+        int left  = int(R[ip->b].type_id());
+        int right = int(R[ip->c].type_id());
 
-    switch (n->func->kind) {
-        case NodeKind::Name: {
-            Name* name = cast<Name>(n->func);
-            return find_label(str(name->id));
+        if (prof.count == 1) {
+            prof.left  = left;
+            prof.right = right;
+        } else if (prof.left != left || prof.right != right) {
+            prof.monomorphic = false;
         }
     }
 
-    kwerror(outlog(), "Unsupported expression {}", str(n->func->kind));
-    return -1;
+    budget -= 1;
+    return budget <= 0;
 }
 
-ExprRet VMExec::call(Call_t* n, int depth) {
-    StackTrace& trace = stacktrace.emplace_back();
-
-    // Remove trace when the call finished
-    // Remove arguments from addressable variables
-    KW_DEFERRED(
-        [&](std::size_t old_size) {
-            stacktrace.pop_back();
-            variables.resize(old_size);
-        },
-        variables.size());
-
-    // fetch the label to jump to
-    int fun_idx = compute_jump_call_address(n, depth);
-
-    // is call native instruction
-    Instruction const& inst = program->instructions[fun_idx];
-    if (VMNativeFunction* native = cast<VMNativeFunction>(inst.stmt)) {
-        Array<Value> args;
-        args.reserve(n->args.size());
-        for (auto& arg: n->args) {
-            args.push_back(Super::exec(arg, depth));
-        }
+void VMExec::quicken() {
+    // Type specialisation
+    for (int i = 0; i < code.size(); i++) {
+        Instruction&              inst = code[i];
+        InstructionProfile const& prof = profile[i];
 
-        Function fptr = native->fun;
-        return fptr((void*)(this), args);
-    } else {
-        // check for native call then we can just call it here
-        for (auto& arg: n->args) {
-            Value arg_val = Super::exec(arg, depth);
-            kwdebug(outlog(), "adding value: {}", str(arg_val));
-            add_value(arg_val);
+        if (inst.op != OpCode::Binary || prof.count == 0 || !prof.monomorphic ||
+            prof.left != prof.right) {
+            continue;
         }
 
-        // we could modify ic and return
-        // but then we need to have a return address
-        // here we use an implicit stack which is not good
-        // we should use our current call stack
-        //
-        // BUT in this VM expression are not flatten
-        // so we expect call to return an expression
-        // in a future version we might flatten the tree further to make it SSA
-        // that would simplify execution even further
-        int old = ic;
-        setreg(Registers::ReturnAddress, -1);
-
-        execute(fun_idx);
-
-        set_ic(old);
-        Value v = getreg(Registers::ReturnValue);
-        // std::cout << str(v) << std::endl;
-        return v;
-    }
-    return Value();
-}
-// Leaves
-StmtRet VMExec::invalidstmt(InvalidStatement_t* n, int depth) {
-    kwerror(outlog(), "Invalid statement");
-    return StmtRet();
-}
-StmtRet VMExec::returnstmt(Return_t* n, int depth) {
-    if (n->value.has_value()) {
-        Value ret_val = Super::exec(n->value.value(), depth);
-        setreg(Registers::ReturnValue, ret_val);
-    } else {
-        setreg(Registers::ReturnValue, Value(_None()));
+        OpCode op = quick_opcode(program->natives[inst.d].op, prof.left);
+        if (op != OpCode::Nop) {
+            inst.op = op;
+            quickened += 1;
+        }
     }
 
-    // ic of -1 would stop the program
-    // in the case of a call that is what we want
-    set_ic(getreg(Registers::ReturnAddress).as<int>());
-    return StmtRet();
-}
-StmtRet VMExec::deletestmt(Delete_t* n, int depth) {
-    // delete addressable values
-    // they become inusable, access to them should raise
-    // an exception
-    for (auto* expr: n->targets) {
-        // should probably return an address to a value
-        Value val = Super::exec(expr, depth);
-        int   idx = val.as<int>();
-        //
-        // free_value(variables[idx]);
-        //
-
-        // Make invalid, so use will result in error
-        // this only works if addresse directly
-        // if the value was part of an object the ref might still
-        // think it is valid
-        variables[idx] = Value();
+    // Superinstructions
+    if (pair_count(OpCode::Binary, OpCode::JumpIfFalse) < fuse_threshold) {
+        return;
     }
-    return StmtRet();
-}
-StmtRet VMExec::assign(Assign_t* n, int depth) {
-    Array<ExprNode*>& targets = n->targets;
-    Value             val     = Super::exec(n->value, depth);
 
-    kwassert(targets.size() == 1, "");
+    for (int i = 0; i + 1 < code.size(); i++) {
+        Instruction&       inst = code[i];
+        Instruction const& next = code[i + 1];
+        OpCode             op   = fused_opcode(inst.op);
 
-    switch (targets[0]->kind) {
-    case NodeKind::Name: {
-        add_value(val);
-    }
-    // Unpacking
-    case NodeKind::TupleExpr: {
-        // for ech elem in val
-        //  add_value(val)
-        //
-    }
-    }
+        if (op == OpCode::Nop || next.op != OpCode::JumpIfFalse || next.b != inst.a) {
+            continue;
+        }
 
-    return StmtRet();
+        // the jump target replaces the native index, the deoptimization
+        // restores the original instruction from the program
+        inst.op = op;
+        inst.d  = next.d;
+        fused += 1;
+    }
 }
-StmtRet VMExec::augassign(AugAssign_t* n, int depth) {
-    n->target;
-    Value arg = Super::exec(n->value, depth);
 
-    assert(n->target->kind == NodeKind::Name);
-    if (Name* name = cast<Name>(n->target)) {
-        // lookup
-        int idx = 0;
+Value VMExec::execute(Program const& prog, int entry) {
+    set_program(&prog);
+    return call(entry, {});
+}
 
-        Array<Value> args(2);
-        args[0] = variables[idx];
-        args[1] = arg;
+Value VMExec::call(String const& name, Array<Value> const& arguments) {
+    int function = program->find_label(name);
 
-        variables[idx] = n->native_operator(this, args);
+    if (function < 0) {
+        kwerror(outlog(), "Function {} not found", name);
+        return Value();
     }
-    return StmtRet();
+    return call(function, arguments);
 }
-StmtRet VMExec::annassign(AnnAssign_t* n, int depth) {
-    ExprNode* target = n->target;
-    Value     val;
-    if (n->value.has_value()) {
-        val = Super::exec(n->value.value(), depth);
-    }
 
-    switch (target->kind) {
-    case NodeKind::Name: {
-        add_value(val);
-    }
-    // Unpacking
-    case NodeKind::TupleExpr: {
-        // for ech elem in val
-        //  add_value(val)
-        //
+Value VMExec::call(int function, Array<Value> const& arguments) {
+    Label const& label = program->labels[function];
+
+    if (stack.size() < label.registers) {
+        stack.resize(label.registers);
     }
+    for (int i = 0; i < arguments.size(); i++) {
+        stack[i] = arguments[i];
     }
-    return StmtRet();
-}
-StmtRet VMExec::exprstmt(Expr_t* n, int depth) {
-    // have to be called because of side effects
-    Super::exec(n->value, depth);
-    return StmtRet();
-}
-StmtRet VMExec::pass(Pass_t* n, int depth) {
-    kwassert(false, "should have been ignored");
-    return StmtRet();
-}
-StmtRet VMExec::breakstmt(Break_t* n, int depth) {
-    kwassert(false, "should have been converted to jump");
-    return StmtRet();
-}
-StmtRet VMExec::continuestmt(Continue_t* n, int depth) {
-    // Jump to loop start
-    kwassert(false, "should have been converted to jump");
-    return StmtRet();
-}
-StmtRet VMExec::assertstmt(Assert_t* n, int depth) {
-    kwassert(false, "should have been converted to condjump + raise");
-    return StmtRet();
-}
-StmtRet VMExec::raise(Raise_t* n, int depth) {
-    // this is an implicit jump out to an unknown location
-    //
-    return StmtRet();
-}
 
-//
-// Those two change variable lookup scope
-StmtRet VMExec::global(Global_t* n, int depth) { 
-    //
-    return StmtRet(); }
-StmtRet VMExec::nonlocal(Nonlocal_t* n, int depth) { 
-    //    
-    return StmtRet(); 
+    has_exception = false;
+    return run(function);
 }
 
-StmtRet VMExec::nativefunction(VMNativeFunction_t* n, int depth) {
-    kwassert(false, "should be handled on the call level");
-    return StmtRet();
+Value VMExec::raise(Value value) {
+    has_exception = true;
+    exception     = value;
+    return Value();
 }
 
+Value VMExec::run(int function) {
+    Instruction*       code      = this->code.data();
+    Value const*       constants = program->constants.data();
+    NativeEntry const* natives   = program->natives.data();
+    Label const*       labels    = program->labels.data();
 
-StmtRet VMExec::condjump(CondJump_t* n, int depth) {
-    Value val = Super::exec(n->condition, depth);
-    ic        = n->then_jmp - 1;
-    if (val.as<bool>()) {
-        ic = n->else_jmp - 1;
-    }
-    return StmtRet();
-}
+    std::size_t const  entry = frames.size();
+    Instruction const* ip    = code + labels[function].index;
+    int                base  = 0;
+    Value*             R     = stack.data();
 
-StmtRet VMExec::jump(Jump_t* n, int depth) {
-    ic = n->destination - 1;
-    return StmtRet();
-}
+#if KW_VM_COMPUTED_GOTO
+    static void* dispatch_table[] = {
+#    define OP(name) &&op_##name,
+        KW_VM_OPCODES(OP)
+#    undef OP
+    };
 
-StmtRet VMExec::vmstmt(VMStmt* n, int depth) { return Super::exec(n->stmt, depth); }
+    // During the warm up every instruction goes through the profiler first
+    static void* profile_table[] = {
+#    define OP(name) &&profile,
+        KW_VM_OPCODES(OP)
+#    undef OP
+    };
 
-ExprRet VMExec::starred(Starred_t* n, int depth) { 
-    kwerror(outlog(), "this should probably not exist anymore");
-    return ExprRet(); 
-}
-StmtRet VMExec::import(Import_t* n, int depth) { 
-    kwerror(outlog(), "this should probably not exist anymore");
-    return StmtRet(); }
-StmtRet VMExec::importfrom(ImportFrom_t* n, int depth) { 
-    kwerror(outlog(), "this should probably not exist anymore");
-    return StmtRet(); }
-
-ExprRet VMExec::lambda(Lambda_t* n, int depth) { 
-    kwerror(outlog(), "this should probably not exist anymore");
-    return ExprRet(); 
-}
-ExprRet VMExec::listcomp(ListComp_t* n, int depth) { 
-    kwerror(outlog(), "this should probably not exist anymore");
-    return ExprRet(); }
-ExprRet VMExec::generateexpr(GeneratorExp_t* n, int depth) { 
-    kwerror(outlog(), "this should probably not exist anymore");
-    return ExprRet(); }
-ExprRet VMExec::setcomp(SetComp_t* n, int depth) { 
-    kwerror(outlog(), "this should probably not exist anymore");
-    return ExprRet(); }
-ExprRet VMExec::dictcomp(DictComp_t* n, int depth) { 
-    kwerror(outlog(), "this should probably not exist anymore");
-    return ExprRet(); }
-ExprRet VMExec::await(Await_t* n, int depth) { 
-    kwerror(outlog(), "this should probably not exist anymore");
-    return ExprRet(); }
-
-
-StmtRet VMExec::inlinestmt(Inline_t* n, int depth) {
-    kwassert(false, "should have been converted to instructions");
-    return StmtRet();
-}
-StmtRet VMExec::functiondef(FunctionDef_t* n, int depth) {
-    kwassert(false, "should have been converted to NativeCalls & instructions");
-    return StmtRet();
-}
-StmtRet VMExec::classdef(ClassDef_t* n, int depth) {
-    kwassert(false, "should have been converted to calls");
-    return StmtRet();
-}
+    void* const* table = budget > 0 ? profile_table : dispatch_table;
+
+#    define VM_DISPATCH() goto* table[int(ip->op)];
+#    define VM_CASE(name) op_##name:
+#    define VM_NEXT()     VM_DISPATCH()
+#else
+#    define VM_DISPATCH() switch (ip->op)
+#    define VM_CASE(name) case OpCode::name:
+#    define VM_NEXT()     goto dispatch
+#endif
+
+    // Reads the operands of a quickened instruction, restores the generic instruction
+    // when they do not have the expected type
+#define VM_GUARD(type)                                  \
+    Value const& lhs = R[ip->b];                        \
+    Value const& rhs = R[ip->c];                        \
+    if (!lhs.is_type<type>() || !rhs.is_type<type>()) { \
+        goto deoptimize;                                \
+    }                                                   \
+    auto const l = lhs.load<type>();                    \
+    auto const r = rhs.load<type>();
+
+#if KW_VM_COMPUTED_GOTO
+    VM_DISPATCH();
+
+profile:
+    if (record(ip, R)) {
+        quicken();
+        table = dispatch_table;
+    }
+    goto* dispatch_table[int(ip->op)];
+#else
+dispatch:
+    if (budget > 0 && record(ip, R)) {
+        quicken();
+    }
+#endif
 
-StmtRet VMExec::forstmt(For_t* n, int depth) {
-    kwassert(false, "should have been converted to jump");
-    return StmtRet();
-}
+    VM_DISPATCH() {
+        VM_CASE(Nop) {
+            ip += 1;
+            VM_NEXT();
+        }
+        VM_CASE(LoadConst) {
+            R[ip->a] = constants[ip->d];
+            ip += 1;
+            VM_NEXT();
+        }
+        VM_CASE(Move) {
+            R[ip->a] = R[ip->b];
+            ip += 1;
+            VM_NEXT();
+        }
+        VM_CASE(LoadGlobal) {
+            R[ip->a] = globals[ip->d];
+            ip += 1;
+            VM_NEXT();
+        }
+        VM_CASE(StoreGlobal) {
+            globals[ip->d] = R[ip->b];
+            ip += 1;
+            VM_NEXT();
+        }
+        VM_CASE(Unary) {
+            args.resize(1);
+            args[0]  = R[ip->b];
+            R[ip->a] = natives[ip->d].fun(this, args);
+            ip += 1;
+            VM_NEXT();
+        }
+        VM_CASE(Binary) {
+            args.resize(2);
+            args[0]  = R[ip->b];
+            args[1]  = R[ip->c];
+            R[ip->a] = natives[ip->d].fun(this, args);
+            ip += 1;
+            VM_NEXT();
+        }
+        VM_CASE(Jump) {
+            ip = code + ip->d;
+            VM_NEXT();
+        }
+        VM_CASE(JumpIfFalse) {
+            ip = truthy(R[ip->b]) ? ip + 1 : code + ip->d;
+            VM_NEXT();
+        }
+        VM_CASE(JumpIfTrue) {
+            ip = truthy(R[ip->b]) ? code + ip->d : ip + 1;
+            VM_NEXT();
+        }
+        VM_CASE(Call) {
+            Label const& callee = labels[ip->d];
 
-StmtRet VMExec::whilestmt(While_t* n, int depth) {
-    kwassert(false, "should have been converted to jump");
-    return StmtRet();
-}
+            if (frames.size() - entry >= max_frames) {
+                frames.resize(entry);
+                return raise(make_value<String>("RecursionError"));
+            }
 
-StmtRet VMExec::ifstmt(If_t* n, int depth) {
-    kwassert(false, "should have been converted to jump");
-    return StmtRet();
-}
+            frames.push_back({ip + 1, base, ip->a});
+            base += ip->b;
 
-StmtRet VMExec::with(With_t* n, int depth) {
-    kwassert(false, "should have been converted to calls & jumps");
-    return StmtRet();
-}
-StmtRet VMExec::trystmt(Try_t* n, int depth) {
-    kwassert(false, "should have been converted to jumps");
-    return StmtRet();
-}
+            if (base + callee.registers > stack.size()) {
+                stack.resize(std::max(stack.size() * 2, std::size_t(base + callee.registers)));
+            }
 
-StmtRet VMExec::exported(Exported_t* n, int depth) { return StmtRet(); }
+            R  = stack.data() + base;
+            ip = code + callee.index;
+            VM_NEXT();
+        }
+        VM_CASE(CallNative) {
+            args.resize(ip->c);
+            for (int i = 0; i < ip->c; i++) {
+                args[i] = R[ip->b + i];
+            }
+            R[ip->a] = natives[ip->d].fun(this, args);
+            ip += 1;
+            VM_NEXT();
+        }
+        VM_CASE(Return) {
+            Value result = R[ip->b];
 
-StmtRet VMExec::placeholder(Placeholder_t* n, int depth) { return StmtRet(); }
+            if (frames.size() == entry) {
+                return result;
+            }
 
-StmtRet VMExec::match(Match_t* n, int depth) {
-    kwassert(false, "should have been converted to jumps");
-    return StmtRet();
-}
+            CallFrame frame = frames.back();
+            frames.pop_back();
 
-PatRet VMExec::matchvalue(MatchValue_t* n, int depth) { return PatRet(); }
-PatRet VMExec::matchsingleton(MatchSingleton_t* n, int depth) { return PatRet(); }
-PatRet VMExec::matchsequence(MatchSequence_t* n, int depth) { return PatRet(); }
-PatRet VMExec::matchmapping(MatchMapping_t* n, int depth) { return PatRet(); }
-PatRet VMExec::matchclass(MatchClass_t* n, int depth) { return PatRet(); }
-PatRet VMExec::matchstar(MatchStar_t* n, int depth) { return PatRet(); }
-PatRet VMExec::matchas(MatchAs_t* n, int depth) { return PatRet(); }
-PatRet VMExec::matchor(MatchOr_t* n, int depth) { return PatRet(); }
-
-ModRet VMExec::module(Module_t* n, int depth) {
-    kwerror(outlog(), "No more module");
-    return ModRet();
-};
-ModRet VMExec::interactive(Interactive_t* n, int depth) { return ModRet(); }
-ModRet VMExec::functiontype(FunctionType_t* n, int depth) { return ModRet(); }
-ModRet VMExec::expression(Expression_t* n, int depth) { return ModRet(); }
+            base           = frame.base;
+            R              = stack.data() + base;
+            R[frame.dest]  = result;
+            ip             = frame.ret;
+            VM_NEXT();
+        }
+        VM_CASE(Raise) {
+            frames.resize(entry);
+            return raise(R[ip->b]);
+        }
 
+        // Quickened instructions
+#define ARITH(name, op, T, type, field) \
+    VM_CASE(name##T) {                  \
+        VM_GUARD(type)                  \
+        R[ip->a] = Value(type(l op r)); \
+        ip += 1;                        \
+        VM_NEXT();                      \
+    }
 
+#define CMP(name, op, T, type, field)                  \
+    VM_CASE(name##T) {                                 \
+        VM_GUARD(type)                                 \
+        R[ip->a] = Value(bool(l op r));                \
+        ip += 1;                                       \
+        VM_NEXT();                                     \
+    }                                                  \
+    VM_CASE(JumpIfNot##name##T) {                      \
+        VM_GUARD(type)                                 \
+        bool cond = l op r;                            \
+        R[ip->a]  = Value(cond);                       \
+        ip        = cond ? ip + 2 : code + ip->d;      \
+        VM_NEXT();                                     \
+    }
 
-//
-//
-//
+#define TYPE(T, type, field)                \
+    KW_VM_QUICK_ARITH(ARITH, T, type, field) \
+    KW_VM_QUICK_CMP(CMP, T, type, field)
 
-ExprRet VMExec::dicttype(DictType_t* n, int depth) { 
-    kwerror(outlog(), "No types during runtime");
-    return ExprRet(); 
-}
-ExprRet VMExec::arraytype(ArrayType_t* n, int depth) { 
-    kwerror(outlog(), "No types during runtime");
-    return ExprRet(); 
-}
-ExprRet VMExec::arrow(Arrow_t* n, int depth) { 
-    kwerror(outlog(), "No types during runtime");
-    return ExprRet(); 
+        KW_VM_QUICK_TYPES(TYPE)
+
+#undef TYPE
+#undef CMP
+#undef ARITH
+
+        VM_CASE(DivF64) {
+            VM_GUARD(float64)
+            R[ip->a] = Value(float64(l / r));
+            ip += 1;
+            VM_NEXT();
+        }
+#if !KW_VM_COMPUTED_GOTO
+    default: break;
+#endif
     }
-ExprRet VMExec::builtintype(BuiltinType_t* n, int depth) { 
-    kwerror(outlog(), "No types during runtime");
-    return ExprRet(); 
-}
-ExprRet VMExec::tupletype(TupleType_t* n, int depth) { 
-    kwerror(outlog(), "No types during runtime");
-    return ExprRet(); 
-}
-ExprRet VMExec::settype(SetType_t* n, int depth) { 
-    kwerror(outlog(), "No types during runtime");
-    return ExprRet(); 
-}
-ExprRet VMExec::classtype(ClassType_t* n, int depth) { 
-    kwerror(outlog(), "No types during runtime");
-    return ExprRet(); 
+
+    kwerror(outlog(), "Invalid instruction");
+    return Value();
+
+deoptimize: {
+    // The operands do not have the type the instruction was specialised for,
+    // go back to the generic instruction
+    int i   = int(ip - code);
+    code[i] = program->instructions[i];
+    deoptimized += 1;
+    VM_NEXT();
 }
-ExprRet VMExec::comment(Comment_t* n, int depth) { 
-    kwerror(outlog(), "No comments during runtime");
-    return ExprRet(); 
+
+#undef VM_GUARD
+#undef VM_DISPATCH
+#undef VM_CASE
+#undef VM_NEXT
 }
 
 }  // namespace lython
@@ -14,221 +14,312 @@
 
 namespace lython {
 
+// Register based bytecode
+//
+// Every instruction is 8 bytes wide, operands are registers relative
+// to the frame of the function being executed, or indices into the tables of the program
+// (constants, natives, functions, globals) or jump targets
+//
+//  a: destination register
+//  b: first operand register
+//  c: second operand register (or argument count for calls)
+//  d: constant, native, function, global index or jump target
+//
+#define KW_VM_OPCODES(OP)                                 \
+    OP(Nop)         /*                                 */ \
+    OP(LoadConst)   /* a = constants[d]                */ \
+    OP(Move)        /* a = b                           */ \
+    OP(LoadGlobal)  /* a = globals[d]                  */ \
+    OP(StoreGlobal) /* globals[d] = b                  */ \
+    OP(Unary)       /* a = natives[d](b)               */ \
+    OP(Binary)      /* a = natives[d](b, c)            */ \
+    OP(Jump)        /* ic = d                          */ \
+    OP(JumpIfFalse) /* if not b: ic = d                */ \
+    OP(JumpIfTrue)  /* if b: ic = d                    */ \
+    OP(Call)        /* a = functions[d](b ... b + c)   */ \
+    OP(CallNative)  /* a = natives[d](b ... b + c)     */ \
+    OP(Return)      /* return b                        */ \
+    OP(Raise)       /* raise b                         */ \
+    KW_VM_TYPED_OPCODES(OP, I32)                          \
+    KW_VM_TYPED_OPCODES(OP, I64)                          \
+    KW_VM_TYPED_OPCODES(OP, F64)                          \
+    OP(DivF64)
+
+// Quickened instructions, specialised for operands of a given type.
+// They are only introduced by VMExec once it observed the types of the operands
+// and revert to the generic instruction when their type guard fails
+#define KW_VM_TYPED_OPCODES(OP, T)                                  \
+    OP(Add##T)           /* a = b + c                           */ \
+    OP(Sub##T)           /* a = b - c                           */ \
+    OP(Mult##T)          /* a = b * c                           */ \
+    OP(Eq##T)            /* a = b == c                          */ \
+    OP(NotEq##T)         /* a = b != c                          */ \
+    OP(Lt##T)            /* a = b < c                           */ \
+    OP(LtE##T)           /* a = b <= c                          */ \
+    OP(Gt##T)            /* a = b > c                           */ \
+    OP(GtE##T)           /* a = b >= c                          */ \
+    OP(JumpIfNotEq##T)   /* a = b == c; if not a: ic = d        */ \
+    OP(JumpIfNotNotEq##T)/* else skip the JumpIfFalse that     */ \
+    OP(JumpIfNotLt##T)   /* follows, it is kept so the         */ \
+    OP(JumpIfNotLtE##T)  /* instruction can be deoptimized     */ \
+    OP(JumpIfNotGt##T)   /*                                    */ \
+    OP(JumpIfNotGtE##T)  /*                                    */
+
+enum class OpCode : uint8_t
+{
+#define OP(name) name,
+    KW_VM_OPCODES(OP)
+#undef OP
+    Size
+};
+
+StringRef str(OpCode op);
+
+// Register operands are 8 bits, a frame cannot use more registers than that
+constexpr int VMMaxRegisters = 256;
+
 struct Instruction {
-    // enum OpCode {
-    //     pushscope,
-    //     popscope,
-    //     addvar,
-    //     call,
-    //     setvar,
-    //     loadvar,
-    //     jump,
-    //     condjump
-    // };
-
-    // OpCode op;
-
-    VMNode* stmt = nullptr;
+    OpCode  op = OpCode::Nop;
+    uint8_t a  = 0;
+    uint8_t b  = 0;
+    uint8_t c  = 0;
+    int32_t d  = 0;
 };
 
+static_assert(sizeof(Instruction) == 8, "Instructions are fixed width");
+
 struct VMGenTrait {
-    using StmtRet = Value;
-    using ExprRet = Value;
-    using ModRet  = Value;
-    using PatRet  = Value;
+    using StmtRet = int;
+    using ExprRet = int;  // Register holding the result of the expression
+    using ModRet  = int;
+    using PatRet  = int;
     using Trace   = std::true_type;
 
     enum
     { MaxRecursionDepth = LY_MAX_VISITOR_RECURSION_DEPTH };
 };
 
+// Entry point of a function
 struct Label {
     StmtNode* stmt = nullptr;
     String    name;
     int       index = -1;
     int       depth;
+    int       argc      = 0;  // Arguments are stored in the first registers
+    int       registers = 0;  // Frame size
 };
 
+// Operators with a type specialised instruction
+enum class QuickOp : int8_t
+{
+    None,
+    Add,
+    Sub,
+    Mult,
+    Div,
+    Eq,
+    NotEq,
+    Lt,
+    LtE,
+    Gt,
+    GtE,
+};
+
+// Native function or operator called by the program
+struct NativeEntry {
+    Function fun  = nullptr;
+    int      argc = 0;
+    String   name;
+    QuickOp  op = QuickOp::None;
+};
 
 struct Program {
     Array<Instruction> instructions;
-    Array<Label>       labels;
-
-    int find_label(String const& name) {
-        for(Label& l: labels) {
-            if (l.name == name) {
-                return l.index;
+    Array<Label>       labels;     // Functions, `<module>` is the entry point
+    Array<Value>       constants;  // Constant pool
+    Array<NativeEntry> natives;
+    Array<String>      globals;    // Module level variables
+
+    int find_label(String const& name) const {
+        for (int i = 0; i < labels.size(); i++) {
+            if (labels[i].name == name) {
+                return i;
             }
         }
         return -1;
     }
-};
 
-struct LoopContext {
-    Jump* breakjmp = nullptr;
-    Jump* continuejmp = nullptr;
-};
+    void dump(std::ostream& out) const;
 
+    // Write the program to a bytecode file that can be executed without the front end
+    // fails if the program references natives that cannot be resolved by name
+    bool save(String const& path) const;
 
-struct VariableIndex {
-    int inserted_size;
-    Name* name;
+    // Map a bytecode file written by `save`
+    bool load(String const& path);
 };
 
-struct LazyCallResolve {
-    Call* call = nullptr;
-};
-
-struct YieldedFunction {
-    Array<Value>       variables;   //
-    Array<Value>       registers;   //
-    lython::StackTrace stacktrace;  //
-    int ic = -1;                    // instruction counter to resume from
+struct LoopContext {
+    int        start = 0;
+    Array<int> breaks;  // Jumps to patch once the end of the loop is known
 };
 
 /**
- * The goal of this is to flatten the control flow into simple jumps
- * The code is flatten into a "tape" of instructions.
- * control flow change the instruction pointer
+ * Compile the AST into register based bytecode.
+ *
+ * The control flow is flatten into jumps, expressions are evaluated into registers.
+ * Each function gets a frame of registers, its arguments come first, followed by its local
+ * variables and its temporaries. Module level variables are stored in a separate array
+ * of globals.
+ *
+ * .. code-block:: python
  *
- * This simplify resumption, while keeping the rest as high level as possible
+ *    def add(a: i32, b: i32) -> i32:     # add:
+ *        c = a + b                       #   Binary  r2 = r0 Add r1
+ *        return c                        #   Return  r2
+ *
+ * Only a subset of the language is lowered: functions, module globals, native operators & calls,
+ * if/while/break/continue, raise and assert. ``for``, ``try``, ``with``, class definitions,
+ * container literals, comprehensions, attributes and subscripts are not lowered yet,
+ * they are reported and set ``has_errors``; such modules run on the TreeEvaluator
+ * (see ``run``).
+ *
+ * A raise stops the VM (``VMExec::has_exception``), there are no exception handlers.
  *
- * Technically call is a jump but it is unconditional so the CPU can cache the instruction ahead
- * 
- * Exceptions handling: when a try-catch is found it push exception handling on a global stack (records the handled exception type & the resume jump)
- * when raise is called it does an unconditional jump to an exception handling function that will
- * lookup for the exception specific handler.
- * 
- * cleanup code still needs to be triggered in the right order though
- * 
  */
 struct VMGen: public BaseVisitor<VMGen, false, VMGenTrait> {
     using Super = BaseVisitor<VMGen, false, VMGenTrait>;
 
-    struct GenContext {};
-
-#define FUNCTION_GEN(name, fun) Value fun(name##_t* n, int depth);
+#define FUNCTION_GEN(name, fun) int fun(name##_t* n, int depth);
 
     KW_FOREACH_AST(FUNCTION_GEN)
 
 #undef FUNCTION_GEN
 
-    Array<GenContext>       contexts;
-    Array<Instruction>      program;
-    Array<Label>            labels;
-    Array<LoopContext>      loop_ctx;
-    Array<LazyCallResolve>  calls_to_be_resolved;
+    Program            program;
+    Array<LoopContext> loop_ctx;
+    bool               has_errors = false;
 
-    int instruction_counter() { return int(program.size()); }
+    // Functions of the module, resolved before generating code so calls can be forward
+    Dict<StringRef, int> functions;
+    Dict<StringRef, int> globals;
 
-    void add_instruction(VMNode* stmt) { 
-        kwassert(stmt != nullptr, "Null instruction");
-        program.push_back({stmt}); 
-    }
-    void add_instruction(StmtNode* stmt) {
-        VMStmt* node = stmt->new_object<VMStmt>();
-        node->stmt   = stmt;
-        kwassert(node != nullptr, "Null instruction");
-        program.push_back({node});
-    }
+    // State of the function being generated
+    SmallDict<StringRef, int, 16, StdHash<StringRef>> locals;
+    int                  current   = 0;  // label of the function being generated
+    int                  nlocals   = 0;  // arguments & local variables
+    int                  top       = 0;  // first free register
+    int                  registers = 0;  // max registers used by the frame
+    int                  barrier   = 0;  // last jump destination
 
-    void add_body(String const& name, StmtNode* node, Array<StmtNode*> const& body, int depth) {
-        labels.push_back({node, name, int(program.size()), depth});
-        for (auto* stmt: body) {
-            Super::exec(stmt, depth);
-        }
-    }
-};
+    int instruction_counter() { return int(program.instructions.size()); }
 
-struct VMExec: public BaseVisitor<VMExec, false, VMGenTrait> {
-    using Super = BaseVisitor<VMExec, false, VMGenTrait> ;
-
-    // How to handle nested exception ?
-    //
-    enum class Registers: int {
-        ReturnAddress,
-        ReturnValue,
-        Size,
-    };
-
-    int   ic = 0;
-
-    VMExec():
-        registers(int(Registers::Size))
-    {
-        // addressable variables which is different from reachable
-        // addressable variables are always reachable
-        // but reachable might not be addressable
-        variables.reserve(128);
-        args.reserve(8);
-    }
+    int  emit(OpCode op, int a = 0, int b = 0, int c = 0, int d = 0);
+    int  here();
+    void patch(int jump, int destination) { program.instructions[jump].d = destination; }
 
-    void set_program(Program const* prog) {
-        program = prog;
-    }
+    int alloc();
+    int constant(Value const& value);
+    int native(Function fun, int argc, String const& name, QuickOp op = QuickOp::None);
 
-    Value execute(int entry);
-    Value execute(Program const& program, int entry);
-    void exec(int ic, int depth);
+    // store the value of a register to a variable
+    void store(ExprNode* target, int reg);
+    void move(int dest, int src);
 
-    template<typename... Args>
-    Array<Value>& makeargs(Args... newargs) {
-        args = {newargs...};
-        return args;
-    }
+    int  unsupported(Node* n);
+    void declare(Array<StmtNode*> const& stmts);
+    void body(Array<StmtNode*> const& stmts, int depth);
+    void function(FunctionDef* def, int depth);
+};
 
-    Array<Value> args;
-    Program const* program = nullptr;
+struct CallFrame {
+    Instruction const* ret  = nullptr;  // instruction to resume from
+    int                base = 0;        // first register of the caller
+    int                dest = 0;        // register of the caller receiving the result
+};
 
-    Value getreg(Registers register_) {
-        return registers[int(register_)];
-    }
-    void setreg(Registers register_, Value val) {
-        registers[int(register_)] = val;
-    }
+// Runtime information gathered on an instruction during the warm up
+struct InstructionProfile {
+    uint32 count = 0;
+    int    left  = -1;  // type of the operands
+    int    right = -1;
+    bool   monomorphic = true;
+};
 
-    int add_value(Value val) {
-        int idx = len(variables);
-        variables.push_back(val);
-        return idx;
+/**
+ * Interpret the bytecode produced by VMGen.
+ *
+ * Registers of all the frames live in a single value stack, a call moves the base of the
+ * frame to the arguments of the call so they become the first registers of the callee
+ *
+ * Dispatch uses computed goto when supported by the compiler
+ *
+ * The first `warmup` instructions are executed in profiling mode which records the types
+ * of the operands and the opcode pairs. The instructions are then quickened:
+ *
+ * * generic operators whose operands always had the same type are replaced by
+ *   type specialised instructions (``Binary(Add-i32-i32)`` => ``AddI32``)
+ * * a comparison followed by a conditional jump is fused into a single instruction
+ *   (``LtI32`` + ``JumpIfFalse`` => ``JumpIfNotLtI32``)
+ *
+ * Quickened instructions guard the type of their operands, when the guard fails the
+ * original instruction is restored.
+ */
+struct VMExec {
+    Array<Value>     stack;
+    Array<Value>     globals;
+    Array<CallFrame> frames;
+    Array<Value>     args;  // Argument buffer of native calls
+
+    Program const*     program = nullptr;
+    Array<Instruction> code;  // Instructions being executed, rewritten by the quickening
+
+    int   max_frames = 1024;
+    bool  has_exception = false;
+    Value exception;
+
+    // Quickening
+    int                       warmup = 1024;  // number of instructions to profile, 0 disables it
+    Array<InstructionProfile> profile;
+    Array<uint32>             pairs;  // [previous opcode][opcode]
+    int                       fuse_threshold = 16;
+
+    // Statistics
+    int quickened   = 0;
+    int fused       = 0;
+    int deoptimized = 0;
+
+    VMExec() {
+        stack.resize(4096);
+        frames.reserve(64);
+        args.reserve(8);
     }
 
-    int compute_jump_call_address(Call_t* n, int depth); 
+    void set_program(Program const* prog);
 
-    void set_ic(int entry) {
-        ic = entry;
-        kwdebug(outlog(), "IC: {}", ic);
-    }
-    void inc_ic() {
-        ic += 1;
-        kwdebug(outlog(), "IC: {}", ic);
-    }
+    // Execute the module entry point
+    Value execute(Program const& program, int entry);
 
-    Array<Value>              variables;
-    Array<Value>              registers;
-    Array<lython::StackTrace> stacktrace;
+    // Call a function of the program
+    Value call(String const& name, Array<Value> const& arguments);
+    Value call(int function, Array<Value> const& arguments);
 
-#define FUNCTION_GEN(name, fun) Value fun(name##_t* n, int depth);
+    uint32 pair_count(OpCode prev, OpCode next) const {
+        return pairs[int(prev) * int(OpCode::Size) + int(next)];
+    }
 
-#define X(name, _)
-#define SSECTION(name)
-#define MOD(name, fun)   FUNCTION_GEN(name, fun)
-#define EXPR(name, fun)  FUNCTION_GEN(name, fun)
-#define STMT(name, fun)  FUNCTION_GEN(name, fun)
-#define MATCH(name, fun) FUNCTION_GEN(name, fun)
-#define VM(name, fun)    FUNCTION_GEN(name, fun)
+    // Rewrite the instructions using the profile
+    void quicken();
 
-    NODEKIND_ENUM(X, SSECTION, EXPR, STMT, MOD, MATCH, VM)
+    private:
+    Value run(int function);
+    Value raise(Value value);
 
-#undef X
-#undef SSECTION
-#undef EXPR
-#undef STMT
-#undef MOD
-#undef MATCH
-#undef VM
+    // Record the execution of an instruction, returns true when the warm up is over
+    bool record(Instruction const* ip, Value const* R);
 
-#undef FUNCTION_GEN
+    int    budget = 0;  // instructions left to profile
+    OpCode previous = OpCode::Nop;
 };
 
 // Assemble programs together ?
@@ -240,10 +331,13 @@ struct VMExec: public BaseVisitor<VMExec, false, VMGenTrait> {
 // and make space in the main program to accomodate them
 // we could probably put them at the end so we do not have to move too many addresses
 
-inline Program compile(Module* mod) {
+// Returns false if the module uses constructs VMGen does not support,
+// the program must not be executed then
+inline bool compile(Module* mod, Program& program) {
     VMGen compiler;
     compiler.exec(mod, 0);
-    return Program{compiler.program, compiler.labels};
+    program = compiler.program;
+    return !compiler.has_errors;
 }
 
 inline Value eval(Program const& program) {
@@ -251,6 +345,39 @@ inline Value eval(Program const& program) {
     return eval.execute(program, 0);
 }
 
+enum class Engine
+{
+    Register,
+    Tree,
+};
+
+// Runs a module VMGen cannot lower, returns true if it raised
+inline bool run_tree(Module* mod) {
+    TreeEvaluator eval;
+    eval.use_garbage_collector();
+    eval.module(mod, 0);
+    return eval.has_exceptions();
+}
+
+// Runs the module on the register VM, or on the TreeEvaluator when it cannot be compiled.
+// Returns true if the execution raised
+inline bool run(Module* mod, Engine* engine = nullptr) {
+    Program program;
+    bool    compiled = compile(mod, program);
+
+    if (engine != nullptr) {
+        *engine = compiled ? Engine::Register : Engine::Tree;
+    }
+
+    if (!compiled) {
+        return run_tree(mod);
+    }
+
+    VMExec vm;
+    vm.execute(program, 0);
+    return vm.has_exception;
+}
+
 }  // namespace lython
 
 #endif
\ No newline at end of file
@@ -6,6 +6,8 @@
 #define WITH_LOG 1
 #include "stdlib/garbage.h"
 #include <algorithm>
+#include <future>
+#include <thread>
 
 
 
@@ -639,6 +641,20 @@ TEST_CASE("BoehmGarbageCollector_Collect_Garbage") {
     REQUIRE(gc.allocations(GCGen::Temporary).size() == 2);
 }
 
+// Same as Collect_Garbage without scanning the stack, the list is the only root
+TEST_CASE("BoehmGarbageCollector_Collect_Garbage_Rooted") {
+    BoehmGarbageCollector gc;
+
+    auto l = test_only_two(gc);
+    REQUIRE(gc.allocations(GCGen::Temporary).size() == 5);
+
+    gc.mark_obj(l);
+    gc.sweep(GCGen::Temporary);
+    print(l);
+
+    REQUIRE(gc.allocations(GCGen::Temporary).size() == 2);
+}
+
 
 TEST_CASE("BoehmGarbageCollector_Relocate") {
     BoehmGarbageCollector gc;
@@ -655,6 +671,18 @@ TEST_CASE("BoehmGarbageCollector_Relocate") {
     REQUIRE(gc.allocations(GCGen::Temporary).size() == 2);
 }
 
+TEST_CASE("BoehmGarbageCollector_Relocate_Rooted") {
+    BoehmGarbageCollector gc;
+
+    ListBool* l = test_relocated(gc);
+
+    gc.mark_obj(l);
+    gc.sweep(GCGen::Temporary);
+    print(l);
+
+    REQUIRE(gc.allocations(GCGen::Temporary).size() == 2);
+}
+
 
 TEST_CASE("BoehmGarbageCollector_Marks recursively find pointers") {
     BoehmGarbageCollector gc;
@@ -687,4 +715,263 @@ TEST_CASE("BoehmGarbageCollector_Globals") {
 
     REQUIRE(gc.allocations(GCGen::Temporary).size() == 1);
 
-}
\ No newline at end of file
+}
+
+// Keeps its members on the std heap, the collector finds them through its tracer
+struct Children {
+    Array<ListBool*> items;
+};
+
+void trace_children(void* obj, GCVisitor& visitor) {
+    for (ListBool* item: static_cast<Children*>(obj)->items) {
+        visitor.visit(item);
+    }
+}
+
+KIWI_NOINLINE Children* make_children(BoehmGarbageCollector& gc, Children& root) {
+    void*     memory = gc.malloc(sizeof(Children), Finalizer<Children>::finalize, trace_children);
+    Children* parent = new (memory) Children();
+
+    parent->items.push_back(make_list(gc, 1, nullptr));
+    root.items.push_back(make_list(gc, 2, nullptr));
+    make_list(gc, 3, nullptr);
+    return parent;
+}
+
+TEST_CASE("BoehmGarbageCollector_Roots_Tracers") {
+    BoehmGarbageCollector gc;
+    gc.auto_collect = false;
+
+    // values held outside of the GC objects
+    Children root;
+    gc.add_root(&root, trace_children);
+
+    Children* parent = make_children(gc, root);
+    REQUIRE(gc.allocations(GCGen::Temporary).size() == 4);
+
+    gc.mark_added_roots(GCGen::Temporary);
+    gc.mark_obj(parent);
+    gc.sweep(GCGen::Temporary);
+
+    REQUIRE(gc.allocations(GCGen::Temporary).size() == 3);
+    REQUIRE(gc.is_pointer(GCGen::Temporary, parent->items[0]));
+    REQUIRE(gc.is_pointer(GCGen::Temporary, root.items[0]));
+
+    gc.remove_root(&root);
+    REQUIRE(gc.roots.empty());
+}
+
+KIWI_NOINLINE void make_garbage(BoehmGarbageCollector& gc, int n) {
+    for (int i = 0; i < n; i++) {
+        make_list(gc, i, nullptr);
+    }
+}
+
+TEST_CASE("BoehmGarbageCollector_Generations") {
+    BoehmGarbageCollector gc;
+    gc.auto_collect = false;
+    gc.promote_age  = 1;
+
+    ListBool* old = gc.named(make_list(gc, 1, nullptr), "old");
+
+    // survivors move to the next generation
+    gc.collect();
+    REQUIRE(gc.allocations(GCGen::Temporary).size() == 0);
+    REQUIRE(gc.allocations(GCGen::Medium).size() == 1);
+    REQUIRE(gc.stats.minor == 1);
+
+    // old to young pointers are remembered
+    ListBool* young = gc.named(make_list(gc, 2, nullptr), "young");
+    gc.store(old, old->next, young);
+    young = nullptr;
+    REQUIRE(gc.remembered.size() == 1);
+
+    reset_frame();
+    gc.collect();
+    print(old);
+    REQUIRE(old->next != nullptr);
+    REQUIRE(gc.allocations(GCGen::Medium).size() == 2);
+
+    // both live in the same generation now
+    REQUIRE(gc.remembered.size() == 0);
+}
+
+TEST_CASE("BoehmGarbageCollector_Allocation_Budget") {
+    BoehmGarbageCollector gc;
+    gc.auto_collect = true;
+    gc.minor_budget = sizeof(ListBool) * 16;
+
+    make_garbage(gc, 64);
+
+    REQUIRE(gc.stats.minor > 0);
+    REQUIRE(gc.stats.freed > 0);
+    REQUIRE(gc.allocations(GCGen::Temporary).size() < 64);
+}
+
+TEST_CASE("BoehmGarbageCollector_Pages") {
+    BoehmGarbageCollector gc;
+    gc.auto_collect         = false;
+    gc.thread_local_buffers = false;
+
+    ListBool* a = make_list(gc, 1, nullptr);
+    ListBool* b = make_list(gc, 2, nullptr);
+    REQUIRE(gc.pages.size() == 1);
+
+    // only the start of live objects are pointers
+    REQUIRE(gc.is_pointer(GCGen::Temporary, a));
+    REQUIRE(!gc.is_pointer(GCGen::Temporary, &a->next));
+    REQUIRE(!gc.is_pointer(GCGen::Temporary, &gc));
+
+    // freed blocks get reused
+    gc.free(a);
+    REQUIRE(!gc.is_pointer(GCGen::Temporary, a));
+    ListBool* c = make_list(gc, 3, nullptr);
+    REQUIRE(c == a);
+
+    // large objects get their own page
+    void* large = gc.malloc(GCPage::size * 2);
+    REQUIRE(gc.pages.size() == 2);
+    REQUIRE(gc.is_pointer(GCGen::Temporary, large));
+    REQUIRE(gc.page(large)->bytes == GCPage::size * 3);
+
+    gc.free(large);
+    REQUIRE(!gc.is_pointer(GCGen::Temporary, large));
+    REQUIRE(gc.allocations(GCGen::Temporary).size() == 2);
+}
+
+TEST_CASE("BoehmGarbageCollector_Incremental") {
+    BoehmGarbageCollector gc;
+    gc.auto_collect = false;
+    gc.slice_budget = 1;
+
+    ListBool* head  = test_all_there(gc);
+    ListBool* other = make_list(gc, 6, nullptr);
+
+    gc.start_marking(GCGen::Temporary);
+    REQUIRE(gc.marking);
+
+    // allocated black
+    ListBool* owner = make_list(gc, 7, nullptr);
+    REQUIRE(gc.is_marked(owner));
+
+    // stores shade the stored object
+    gc.store(owner, owner->next, other);
+    REQUIRE(gc.is_marked(other));
+
+    while (gc.marking) {
+        gc.mark_slice();
+    }
+    print(head);
+    print(owner);
+
+    REQUIRE(gc.stats.slices > 1);
+    REQUIRE(gc.stats.minor == 1);
+    REQUIRE(gc.allocations(GCGen::Temporary).size() == 7);
+    REQUIRE(!gc.is_marked(owner));
+
+    std::size_t pauses = 0;
+    for (std::size_t n: gc.stats.pauses) {
+        pauses += n;
+    }
+    REQUIRE(pauses == gc.stats.slices + 2);
+    gc.stats.show(std::cout);
+}
+
+TEST_CASE("BoehmGarbageCollector_Pause_Histogram") {
+    GCStats stats;
+    stats.record_pause(5);
+    stats.record_pause(700);
+    stats.record_pause(1e6);
+
+    REQUIRE(stats.pauses[0] == 1);
+    REQUIRE(stats.pauses[5] == 1);
+    REQUIRE(stats.pauses[GCStats::bucket_count - 1] == 1);
+    REQUIRE(stats.max_pause == 1e6);
+}
+
+TEST_CASE("BoehmGarbageCollector_Thread_Local_Buffers") {
+    BoehmGarbageCollector gc;
+    gc.auto_collect = false;
+
+    ListBool*   a          = make_list(gc, 1, nullptr);
+    ListBool*   b          = make_list(gc, 2, nullptr);
+    std::size_t block_size = gc.page(a)->block_size;
+
+    // bump allocated next to each other
+    REQUIRE((char*)(b) - (char*)(a) == block_size);
+    REQUIRE(gc.page(a)->owned);
+
+    // the blocks reserved by the buffer are not objects yet
+    REQUIRE(gc.is_pointer(GCGen::Temporary, b));
+    REQUIRE(!gc.is_pointer(GCGen::Temporary, (char*)(b) + block_size));
+
+    // other threads get their own buffer, given back when the thread exits
+    ListBool* c       = nullptr;
+    GCPage*   c_page  = nullptr;
+    bool      c_owned = false;
+    std::thread([&]() {
+        c       = make_list(gc, 3, nullptr);
+        c_page  = gc.page(c);
+        c_owned = c_page->owned;
+    }).join();
+    REQUIRE(c_page != gc.page(a));
+    REQUIRE(c_owned);
+    REQUIRE(!gc.page(c)->owned);
+    REQUIRE(gc.allocations(GCGen::Temporary).size() == 3);
+
+    // the collecting thread gives its buffers back, the empty pages are released
+    gc.free(a);
+    gc.free(b);
+    gc.free(c);
+    gc.collect();
+    REQUIRE(gc.pages.size() == 1);
+    REQUIRE(!gc.pages[0]->owned);
+
+    ListBool* d = make_list(gc, 4, nullptr);
+    REQUIRE(gc.page(d) == gc.pages[0]);
+    REQUIRE(gc.pages[0]->used == 1);
+
+    // allocating from another collector gives the buffers back
+    {
+        BoehmGarbageCollector other;
+        other.auto_collect = false;
+        make_list(other, 5, nullptr);
+    }
+    REQUIRE(!gc.page(d)->owned);
+    REQUIRE(gc.page(make_list(gc, 6, nullptr))->owned);
+}
+
+TEST_CASE("BoehmGarbageCollector_Thread_Local_Buffers_Sweep") {
+    BoehmGarbageCollector gc;
+    gc.auto_collect = false;
+
+    // an object only referenced by a thread that is still allocating,
+    // the address is hidden so the stack of the collecting thread does not keep it alive
+    uintptr_t const    mask = uintptr_t(-1);
+    std::promise<void> allocated;
+    std::promise<void> collected;
+    uintptr_t          hidden = 0;
+
+    std::thread thread([&]() {
+        hidden = uintptr_t(make_list(gc, 1, nullptr)) ^ mask;
+        allocated.set_value();
+        collected.get_future().wait();
+    });
+
+    allocated.get_future().wait();
+    gc.collect();
+
+    // the stack of the other thread is not scanned, the collection waits for it
+    REQUIRE(gc.stats.deferred == 1);
+    REQUIRE(gc.stats.minor == 0);
+    REQUIRE(gc.page((void*)(hidden ^ mask))->owned);
+    REQUIRE(gc.is_pointer(GCGen::Temporary, (void*)(hidden ^ mask)));
+
+    collected.set_value();
+    thread.join();
+    REQUIRE(!gc.page((void*)(hidden ^ mask))->owned);
+
+    gc.collect();
+    REQUIRE(gc.stats.deferred == 1);
+    REQUIRE(gc.stats.minor == 1);
+}
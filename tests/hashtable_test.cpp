@@ -7,10 +7,12 @@
 
 #include <chrono>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <random>
 #include <unordered_map>
 
+#include "linear_hashtable.h"
 #include "stdlib/hashtable.h"
 #include "stdlib/smalldict.h"
 
@@ -234,6 +236,186 @@ TEST(hastable, collision_deletion) {
     EXPECT_LT(v.load_factor(), 1.f);
 }
 
+TEST(hastable, tombstones) {
+    HashTable<std::string, int, BadHash> v(16);
+
+    // fill more than a group so the first group has no empty slot left
+    for (int i = 0; i < 14; i++) {
+        EXPECT_TRUE(v.insert(std::to_string(i), i));
+    }
+
+    // deleted keys leave tombstones that must not hide the keys after them
+    for (int i = 0; i < 14; i += 2) {
+        EXPECT_TRUE(v.remove(std::to_string(i)));
+    }
+
+    for (int i = 0; i < 14; i++) {
+        int value = -1;
+        EXPECT_EQ(v.get(std::to_string(i), value), (i % 2 == 1));
+    }
+
+    // churn, tombstones are reused or rehashed away instead of growing the table
+    for (int round = 0; round < 100; round++) {
+        std::string key = "k" + std::to_string(round);
+        EXPECT_TRUE(v.insert(key, round));
+        EXPECT_TRUE(v.remove(key));
+    }
+
+    EXPECT_EQ(v.size(), 7);
+    EXPECT_EQ(v.load_factor(), 7.f / 16.f);
+
+    for (int i = 1; i < 14; i += 2) {
+        int value = -1;
+        EXPECT_TRUE(v.get(std::to_string(i), value));
+        EXPECT_EQ(value, i);
+    }
+}
+
+TEST(hastable, grow) {
+    HashTable<int, int, WyHash<int>> v(16);
+
+    for (int i = 0; i < 10000; i++) {
+        EXPECT_TRUE(v.insert(i, i * 2));
+    }
+
+    EXPECT_EQ(v.size(), 10000);
+    EXPECT_LT(v.load_factor(), 0.875f);
+
+    for (int i = 0; i < 10000; i++) {
+        int value = 0;
+        EXPECT_TRUE(v.get(i, value));
+        EXPECT_EQ(value, i * 2);
+    }
+
+    int value = 0;
+    EXPECT_FALSE(v.get(10000, value));
+}
+
+TEMPLATE_TEST_CASE("hastable-hashers",
+                   "",
+                   Hash<std::string>,
+                   SipHash<std::string>,
+                   XXHash<std::string>,
+                   WyHash<std::string>) {
+    HashTable<std::string, int, TestType> v;
+
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_TRUE(v.insert(std::string(i % 64, 'x') + std::to_string(i), i));
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        int value = 0;
+        EXPECT_TRUE(v.get(std::string(i % 64, 'x') + std::to_string(i), value));
+        EXPECT_EQ(value, i);
+    }
+
+    EXPECT_EQ(v.size(), 1000);
+    EXPECT_TRUE(v.remove(std::string(0, 'x') + std::to_string(0)));
+    EXPECT_EQ(v.size(), 999);
+}
+
+TEST(hashtable, hash_policy) {
+    std::string text = "hash_policy";
+
+    // integers are mixed, not hashed by identity
+    EXPECT_TRUE(Hash<int>::hash(1) != 1);
+    EXPECT_TRUE(Hash<int>::hash(1) != Hash<int>::hash(2));
+    EXPECT_EQ(Hash<int64_t>::hash(42), WyHash<int64_t>::hash(42));
+
+    // every byte string hashes on its content
+    EXPECT_EQ(Hash<std::string>::hash(text), uint64_t(xx_hash_3(text.data(), text.size())));
+    EXPECT_EQ(Hash<std::string>::hash(text), Hash<std::string_view>::hash(text.c_str()));
+    EXPECT_EQ(Hash<std::string>::hash(text),
+              Hash<std::vector<char>>::hash(std::vector<char>(text.begin(), text.end())));
+
+    // the fast hashers read the characters of every byte string, not the string object
+    EXPECT_EQ(XXHash<std::string>::hash(text), XXHash<std::string_view>::hash(text.c_str()));
+    EXPECT_EQ(WyHash<std::string>::hash(text), WyHash<std::string_view>::hash(text.c_str()));
+    EXPECT_EQ(WyHash<std::string>::hash(text),
+              WyHash<std::vector<char>>::hash(std::vector<char>(text.begin(), text.end())));
+
+    // SipHash is keyed, it does not match the unkeyed hashes
+    EXPECT_TRUE(SipHash<std::string>::hash(text) != Hash<std::string>::hash(text));
+
+    // nor the hash with the public key it used to have
+    uint64_t public_key = 0;
+    siphash(text.data(), text.size(), "dW8(2!?GTfDFJ@Le", (uint8_t*)&public_key, sizeof(uint64_t));
+    EXPECT_TRUE(SipHash<std::string>::hash(text) != public_key);
+    EXPECT_EQ(SipHash<std::string>::hash(text), SipHash<std::string>::hash(text));
+
+    // keys that compare equal hash equal
+    EXPECT_EQ(Hash<double>::hash(-0.0), Hash<double>::hash(0.0));
+    EXPECT_EQ(Hash<float>::hash(-0.0f), Hash<float>::hash(0.0f));
+    EXPECT_TRUE(Hash<double>::hash(1.0) != Hash<double>::hash(-1.0));
+}
+
+TEST(smalldict, inline) {
+    SmallDict<std::string, int> v;
+    int                         value = 0;
+
+    EXPECT_TRUE(v.insert("a", 1));
+    EXPECT_FALSE(v.insert("a", 2));
+    EXPECT_TRUE(v.upsert("b", 2));
+    EXPECT_TRUE(v.upsert("a", 3));
+
+    EXPECT_EQ(v.size(), 2);
+    EXPECT_FALSE(v.promoted());
+    EXPECT_TRUE(v.get("a", value));
+    EXPECT_EQ(value, 3);
+    EXPECT_TRUE(v.has_key("b"));
+    EXPECT_FALSE(v.has_key("c"));
+
+    EXPECT_TRUE(v.remove("a"));
+    EXPECT_FALSE(v.remove("a"));
+    EXPECT_EQ(v.size(), 1);
+    EXPECT_TRUE(v.get("b", value));
+    EXPECT_EQ(value, 2);
+}
+
+TEST(smalldict, promotion) {
+    SmallDict<std::string, int, 4> v;
+
+    for (int i = 0; i < 4; i++) {
+        EXPECT_TRUE(v.insert(std::to_string(i), i));
+    }
+    EXPECT_FALSE(v.promoted());
+
+    EXPECT_TRUE(v.insert("4", 4));
+    EXPECT_TRUE(v.promoted());
+    EXPECT_EQ(v.size(), 5);
+
+    SmallDict<std::string, int, 4> copy = v;
+    for (int i = 0; i < 5; i++) {
+        int value = -1;
+        EXPECT_TRUE(copy.get(std::to_string(i), value));
+        EXPECT_EQ(value, i);
+    }
+
+    v.clear();
+    EXPECT_EQ(v.size(), 0);
+    EXPECT_EQ(copy.size(), 5);
+}
+
+TEST(smalldict, collision) {
+    // every key has the same tag, the keys decide
+    SmallDict<std::string, int, 8, BadHash> v;
+
+    for (int i = 0; i < 8; i++) {
+        EXPECT_TRUE(v.insert(std::to_string(i), i));
+    }
+
+    for (int i = 0; i < 8; i++) {
+        int value = -1;
+        EXPECT_TRUE(v.get(std::to_string(i), value));
+        EXPECT_EQ(value, i);
+    }
+
+    EXPECT_TRUE(v.remove("3"));
+    EXPECT_FALSE(v.has_key("3"));
+    EXPECT_TRUE(v.has_key("7"));
+    EXPECT_EQ(v.size(), 7);
+}
+
 template <std::size_t SIZE>
 inline std::vector<std::tuple<std::string, int>> const& pairs() {
     static std::vector<std::tuple<std::string, int>> data;
@@ -260,14 +442,6 @@ inline std::vector<std::tuple<std::string, int>> const& pairs() {
     return data;
 }
 
-template <typename T>
-struct StdHash {
-    static uint64_t hash(T const& v) noexcept {
-        std::hash<T> h;
-        return h(v);
-    }
-};
-
 #define SIZE 100000000
 
 TEST(benchmark, init) { pairs<SIZE>(); }
@@ -441,7 +615,7 @@ TEST(benchmark_lookup_int, hashtable_stdhash) {
 
 template <typename T>
 struct Siphash {
-    std::size_t operator()(const T& k) const { return Hash<T>::hash(k); }
+    std::size_t operator()(const T& k) const { return SipHash<T>::hash(k); }
 };
 
 TEST(benchmark_lookup_str, unordered_map_siphash) {
@@ -526,7 +700,27 @@ TEST(benchmark_lookup_int, unordered_map_stdhash) {
     }
 }
 
-class UnorderedAdapter {};
+template <typename Key, typename Value, typename Hasher>
+struct UnorderedAdapter {
+    UnorderedAdapter(int buckets): map(buckets) {}
+
+    bool insert(Key const& k, Value const& v) { return map.emplace(k, v).second; }
+
+    bool get(Key const& k, Value& v) const {
+        auto it = map.find(k);
+        if (it == map.end()) {
+            return false;
+        }
+        v = it->second;
+        return true;
+    }
+
+    bool remove(Key const& k) { return map.erase(k) > 0; }
+
+    void clear() { map.clear(); }
+
+    std::unordered_map<Key, Value, Hasher> map;
+};
 
 TEST(benchmark_lookup_int, unordered_map_siphash) {
     std::unordered_map<int, std::string, Siphash<int>> v(INIT);
@@ -556,4 +750,169 @@ TEST(benchmark_lookup_int, unordered_map_siphash) {
     }
 }
 
+// Throughput of the group probed table against the previous linear probing table
+// and std::unordered_map, in nanoseconds per operation
+template <typename Key>
+struct ThroughputData {
+    std::vector<Key> keys;
+    std::vector<Key> missing;
+};
+
+template <typename Key>
+Key make_key(std::default_random_engine& rng, int i);
+
+template <>
+int make_key<int>(std::default_random_engine& rng, int) {
+    return std::uniform_int_distribution<int>()(rng);
+}
+
+template <>
+std::string make_key<std::string>(std::default_random_engine& rng, int i) {
+    std::uniform_int_distribution<int> size(4, 24);
+    std::uniform_int_distribution<int> letter('a', 'z');
+
+    std::string key(size(rng), ' ');
+    for (auto& c: key) {
+        c = char(letter(rng));
+    }
+    // keeps keys unique
+    return key + std::to_string(i);
+}
+
+template <typename Key>
+ThroughputData<Key> const& throughput_data(int n) {
+    static ThroughputData<Key> data;
+
+    if (data.keys.size() == std::size_t(n)) {
+        return data;
+    }
+
+    std::default_random_engine rng(0);
+    data.keys.clear();
+    data.missing.clear();
+    for (int i = 0; i < n; i++) {
+        data.keys.push_back(make_key<Key>(rng, i));
+        data.missing.push_back(make_key<Key>(rng, n + i));
+    }
+    return data;
+}
+
+template <typename Table, typename Key>
+void throughput(const char* name, const char* tag, int n) {
+    auto const& data = throughput_data<Key>(n);
+    int         found = 0;
+    int         value = 0;
+
+    auto ns_per_op = [n](auto start, auto end) {
+        return std::chrono::duration<double, std::nano>(end - start).count() / n;
+    };
+
+    Table v(16);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        v.insert(data.keys[i], i);
+    }
+    auto   end    = std::chrono::steady_clock::now();
+    double insert = ns_per_op(start, end);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        found += v.get(data.keys[i], value);
+    }
+    end        = std::chrono::steady_clock::now();
+    double hit = ns_per_op(start, end);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        found += v.get(data.missing[i], value);
+    }
+    end         = std::chrono::steady_clock::now();
+    double miss = ns_per_op(start, end);
+
+    // remove and reinsert, exercises tombstones
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        v.remove(data.keys[i]);
+        v.insert(data.missing[i], i);
+    }
+    end          = std::chrono::steady_clock::now();
+    double churn = ns_per_op(start, end);
+
+    EXPECT_EQ(found, n);
+
+    std::cout << std::setw(30) << name << " | " << std::setw(4) << tag << " | " << std::setw(8)
+              << std::fixed << std::setprecision(1) << insert << " | " << std::setw(8) << hit
+              << " | " << std::setw(8) << miss << " | " << std::setw(8) << churn << "\n";
+
+    perffile() << name << "," << tag << "," << n << ",insert," << insert << "\n";
+    perffile() << name << "," << tag << "," << n << ",hit," << hit << "\n";
+    perffile() << name << "," << tag << "," << n << ",miss," << miss << "\n";
+    perffile() << name << "," << tag << "," << n << ",churn," << churn << "\n";
+}
+
+// Maps the size of a keyword argument list, built and queried once
+template <typename Table>
+void small_maps(const char* name, std::vector<std::string> const& keys) {
+    int repeat = 100000;
+    int value  = 0;
+    int found  = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) {
+        Table v(4);
+        for (int i = 0; i < int(keys.size()); i++) {
+            v.insert(keys[i], i);
+        }
+        for (auto const& key: keys) {
+            found += v.get(key, value);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    EXPECT_EQ(found, repeat * int(keys.size()));
+    std::cout << std::setw(30) << name << " | " << std::setw(8) << std::fixed
+              << std::setprecision(1)
+              << std::chrono::duration<double, std::nano>(end - start).count() / repeat
+              << " ns/map\n";
+}
+
+TEST(benchmark_throughput, small_maps) {
+    std::vector<std::string> keys = {"sep", "end", "file", "flush", "key", "reverse"};
+
+    using Str = std::string;
+    small_maps<SmallDict<Str, int, 8, WyHash<Str>>>("smalldict wyhash", keys);
+    small_maps<HashTable<Str, int, WyHash<Str>>>("swiss wyhash", keys);
+    small_maps<UnorderedAdapter<Str, int, std::hash<Str>>>("unordered_map std", keys);
+}
+
+TEST(benchmark_throughput, tables) {
+    int n = 1 << 18;
+
+    std::cout << std::setw(30) << "table"
+              << " | " << std::setw(4) << "key"
+              << " | " << std::setw(8) << "insert"
+              << " | " << std::setw(8) << "hit"
+              << " | " << std::setw(8) << "miss"
+              << " | " << std::setw(8) << "churn"
+              << " (ns/op)\n";
+
+    using Str = std::string;
+    throughput<LinearHashTable<Str, int>, Str>("linear siphash", "str", n);
+    throughput<UnorderedAdapter<Str, int, Siphash<Str>>, Str>("unordered_map siphash", "str", n);
+    throughput<HashTable<Str, int, SipHash<Str>>, Str>("swiss siphash", "str", n);
+    throughput<HashTable<Str, int>, Str>("swiss default", "str", n);
+    throughput<UnorderedAdapter<Str, int, std::hash<Str>>, Str>("unordered_map std", "str", n);
+    throughput<HashTable<Str, int, XXHash<Str>>, Str>("swiss xxh3", "str", n);
+    throughput<HashTable<Str, int, WyHash<Str>>, Str>("swiss wyhash", "str", n);
+
+    throughput<LinearHashTable<int, int>, int>("linear siphash", "int", n);
+    throughput<UnorderedAdapter<int, int, Siphash<int>>, int>("unordered_map siphash", "int", n);
+    throughput<HashTable<int, int, SipHash<int>>, int>("swiss siphash", "int", n);
+    throughput<HashTable<int, int>, int>("swiss default", "int", n);
+    throughput<UnorderedAdapter<int, int, std::hash<int>>, int>("unordered_map std", "int", n);
+    throughput<HashTable<int, int, XXHash<int>>, int>("swiss xxh3", "int", n);
+    throughput<HashTable<int, int, WyHash<int>>, int>("swiss wyhash", "int", n);
+}
+
 #endif
@@ -1,5 +1,7 @@
 // 
 #include <catch2/catch_all.hpp>
+#include <filesystem>
+#include <fstream>
 #include <sstream>
 
 // Kiwi
@@ -7,7 +9,9 @@
 #include "lexer/buffer.h"
 #include "parser/parser.h"
 #include "revision_data.h"
+#include "sema/importlib.h"
 #include "sema/sema.h"
+#include "sema/sema_cache.h"
 #include "utilities/strings.h"
 #include "logging/logging.h"
 #include "lowering/SSA.h"
@@ -149,6 +153,261 @@ void run_testcase(String const& folder, String const& name, Array<TestCase> case
     }
 }
 
+TEST_CASE("SEMA_Cache_Roundtrip") {
+    String code = "class Point:\n"
+                  "    def __init__(self, x: i32):\n"
+                  "        self.x = x\n"
+                  "\n"
+                  "    def __add__(self, other: Point) -> Point:\n"
+                  "        return self\n"
+                  "\n"
+                  "def add(a: i32, b: i32) -> i32:\n"
+                  "    return a + b\n";
+
+    auto parse = [&]() -> Module* {
+        StringBuffer reader(code);
+        Lexer        lex(reader);
+        Parser       parser(lex);
+        return parser.parse_module();
+    };
+
+    Module*          mod = parse();
+    SemanticAnalyser sema;
+    sema.exec(mod, 0);
+
+    SemaCacheEntry entry;
+    REQUIRE(SemaCache::extract(mod, sema.bindings, entry));
+    REQUIRE(entry.bindings.size() > 0);
+    REQUIRE(entry.attributes.size() > 0);
+
+    // Restore the exported state on a module that did not go through sema
+    Module*  restored = parse();
+    Bindings bindings;
+    REQUIRE(SemaCache::restore(restored, entry, bindings));
+
+    SemaCacheEntry again;
+    REQUIRE(SemaCache::extract(restored, bindings, again));
+
+    REQUIRE(entry.bindings.size() == again.bindings.size());
+    for (int i = 0; i < entry.bindings.size(); i++) {
+        REQUIRE(entry.bindings[i].name == again.bindings[i].name);
+        REQUIRE(entry.bindings[i].type == again.bindings[i].type);
+    }
+
+    REQUIRE(entry.attributes.size() == again.attributes.size());
+    for (int i = 0; i < entry.attributes.size(); i++) {
+        REQUIRE(entry.attributes[i].name == again.attributes[i].name);
+        REQUIRE(entry.attributes[i].type == again.attributes[i].type);
+    }
+
+    delete mod;
+    delete restored;
+}
+
+TEST_CASE("SEMA_Cache_SaveLoad") {
+    namespace fs = std::filesystem;
+
+    SemaCacheEntry entry;
+    entry.key         = 0x1234;
+    entry.source_hash = 0xabcd;
+    entry.imports.push_back({"other", 0x42});
+    entry.bindings.push_back({"add", "A 2 B i32 B i32 B i32"});
+    entry.attributes.push_back({"Point", "x", "B i32"});
+
+    fs::path  dir      = fs::temp_directory_path() / "lysema_saveload";
+    String    filepath = String((dir / "mod.py").string().c_str());
+    SemaCache cache;
+
+    REQUIRE(cache.save(filepath, entry));
+
+    SemaCacheEntry loaded;
+    REQUIRE(cache.load(filepath, loaded));
+
+    REQUIRE(loaded.key == entry.key);
+    REQUIRE(loaded.source_hash == entry.source_hash);
+    REQUIRE(loaded.imports.size() == 1);
+    REQUIRE(loaded.imports[0].module == "other");
+    REQUIRE(loaded.imports[0].key == 0x42);
+    REQUIRE(loaded.bindings.size() == 1);
+    REQUIRE(loaded.bindings[0].name == "add");
+    REQUIRE(loaded.bindings[0].type == entry.bindings[0].type);
+    REQUIRE(loaded.attributes.size() == 1);
+    REQUIRE(loaded.attributes[0].cls == "Point");
+    REQUIRE(loaded.attributes[0].type == "B i32");
+
+    // the entry is written to a temporary file renamed over the cache
+    int files = 0;
+    for (auto const& item: fs::directory_iterator(dir / "__lycache__")) {
+        files += item.path().extension() == ".lysema";
+        REQUIRE(item.path().extension() != ".tmp");
+    }
+    REQUIRE(files == 1);
+
+    // a truncated entry is rejected
+    String      cachefile = SemaCache::cache_path(filepath);
+    std::string content;
+    {
+        std::ifstream in(cachefile.c_str());
+        content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    auto truncated = [&](std::size_t size) {
+        {
+            std::ofstream out(cachefile.c_str(), std::ios::trunc);
+            out << content.substr(0, size);
+        }
+        SemaCacheEntry partial;
+        return !cache.load(filepath, partial);
+    };
+
+    REQUIRE(truncated(content.rfind("attr")));
+    REQUIRE(truncated(content.rfind("end")));
+    REQUIRE(truncated(content.size() - 3));
+    REQUIRE(!truncated(content.size()));
+
+    fs::remove_all(dir);
+}
+
+TEST_CASE("SEMA_Cache_Restore_Failure") {
+    String code = "class Point:\n"
+                  "    def __init__(self, x: i32):\n"
+                  "        self.x = x\n"
+                  "\n"
+                  "def add(a: i32, b: i32) -> i32:\n"
+                  "    return a + b\n";
+
+    StringBuffer reader(code);
+    Lexer        lex(reader);
+    Parser       parser(lex);
+    Module*      mod = parser.parse_module();
+
+    // The binding is valid but the attribute belongs to a class the module does not define
+    SemaCacheEntry entry;
+    entry.bindings.push_back({"add", "A 2 B i32 B i32 B i32"});
+    entry.attributes.push_back({"Vector", "x", "B i32"});
+
+    Bindings bindings;
+    int      size = int(bindings.bindings.size());
+    REQUIRE(SemaCache::restore(mod, entry, bindings) == false);
+
+    // Nothing was applied
+    FunctionDef* add = cast<FunctionDef>(mod->body[1]);
+    ClassDef*    cls = cast<ClassDef>(mod->body[0]);
+    REQUIRE(add->type == nullptr);
+    REQUIRE(cls->attributes.size() == 0);
+    REQUIRE(bindings.bindings.size() == size);
+
+    // Class types only resolve to the classes of the module
+    entry.attributes.clear();
+    entry.bindings[0].type = "A 2 B i32 B i32 C Vector";
+    REQUIRE(SemaCache::restore(mod, entry, bindings) == false);
+    REQUIRE(add->type == nullptr);
+
+    delete mod;
+}
+
+TEST_CASE("SEMA_Cache_Invalidation") {
+    namespace fs = std::filesystem;
+
+    fs::path dir = fs::temp_directory_path() / "lysema_invalidation";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    auto write = [&](const char* name, const char* source) {
+        std::ofstream file(dir / name);
+        file << source;
+    };
+
+    auto cache_exists = [&](const char* name) {
+        return fs::exists(dir / "__lycache__" / name);
+    };
+
+    write("cachemod.py",
+          "class Point:\n"
+          "    def __init__(self, x: i32):\n"
+          "        self.x = x\n"
+          "\n"
+          "def add(a: i32, b: i32) -> i32:\n"
+          "    return a + b\n");
+
+    write("cacheuser.py",
+          "from cachemod import Point\n"
+          "\n"
+          "def make(x: i32) -> Point:\n"
+          "    return Point(x)\n");
+
+    {
+        ImportLib importlib;
+        importlib.add_to_path(String(dir.string().c_str()));
+
+        ImportLib::ImportedLib* lib = importlib.importfile(StringRef("cachemod"));
+        REQUIRE(lib != nullptr);
+        REQUIRE(lib->cached == false);
+        REQUIRE(cache_exists("cachemod.lysema"));
+
+        // Point is defined by another module, restoring cacheuser could not resolve it
+        REQUIRE(importlib.importfile(StringRef("cacheuser")) != nullptr);
+        REQUIRE(cache_exists("cacheuser.lysema") == false);
+    }
+
+    // Same source, the analysis is restored
+    {
+        ImportLib importlib;
+        importlib.add_to_path(String(dir.string().c_str()));
+
+        ImportLib::ImportedLib* lib = importlib.importfile(StringRef("cachemod"));
+        REQUIRE(lib->cached == true);
+        REQUIRE(lib->sema == nullptr);
+    }
+
+    // The content hash changed, the entry is stale
+    write("cachemod.py",
+          "def add(a: i32, b: i32) -> i32:\n"
+          "    return a - b\n");
+    {
+        ImportLib importlib;
+        importlib.add_to_path(String(dir.string().c_str()));
+
+        ImportLib::ImportedLib* lib = importlib.importfile(StringRef("cachemod"));
+        REQUIRE(lib->cached == false);
+        REQUIRE(lib->sema != nullptr);
+        REQUIRE(lib->sema->has_errors() == false);
+    }
+
+    fs::remove_all(dir);
+}
+
+TEST_CASE("SEMA_Diagnostics_Deferred") {
+    int          count = 200;
+    StringStream code;
+    for (int i = 0; i < count; i++) {
+        code << "v" << i << " = undefined_" << i << "\n";
+    }
+
+    StringBuffer reader(code.str());
+    Lexer        lex(reader);
+    Parser       parser(lex);
+    Module*      mod = parser.parse_module();
+
+    // nobody is listening, no message should be generated
+    outlog().disable(LogLevel::Error);
+    SemanticAnalyser sema;
+    sema.exec(mod, 0);
+    outlog().enable(LogLevel::Error);
+
+    REQUIRE(sema.errors.size() == count);
+    for (SemaException* err: sema.errors) {
+        REQUIRE(err->cached_message.empty());
+    }
+
+    REQUIRE(std::string(sema.errors[0]->what()) == "NameError: name 'undefined_0' is not defined");
+
+    sema.errors.clear();
+    REQUIRE(sema.errors.empty());
+
+    delete mod;
+}
+
 /*
 TEST_CASE("Class_Attribute_Lookup") {
     // Futures tests cases
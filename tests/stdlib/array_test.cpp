@@ -2,10 +2,439 @@
 
 #include "dtypes.h"
 #include "stdlib/array.h"
+#include "stdlib/tuple.h"
+#include "utilities/names.h"
 
+#include <cmath>
+#include <random>
+#include <stdexcept>
 
 using namespace kiwi;
 
 TEST_CASE("Array") {
     // TEST_LEXING([](){ return "1.0"; })
 }
+
+template <typename V>
+ArrayNative<V> random_array(int n, int range) {
+    std::mt19937                       gen(n);
+    std::uniform_int_distribution<int> dist(-range, range);
+
+    ArrayNative<V> array;
+    for (int i = 0; i < n; i++) {
+        array.append(V(dist(gen)));
+    }
+    return array;
+}
+
+TEMPLATE_TEST_CASE("Array_unboxed_search", "", int64_t, double) {
+    auto isa = GENERATE(kernels::Isa::Portable, kernels::Isa::SSE2, kernels::Isa::AVX2);
+    if (!kernels::force_isa(isa)) {
+        // the CPU does not support it
+        return;
+    }
+
+    // sizes around the unrolled block sizes
+    for (int n: {0, 1, 7, 8, 9, 15, 16, 17, 31, 100}) {
+        ArrayNative<TestType> array = random_array<TestType>(n, 10);
+
+        for (int k = -11; k <= 11; k++) {
+            TestType key = TestType(k);
+
+            int expected_count = 0;
+            int expected_index = -1;
+            for (int i = 0; i < n; i++) {
+                if (array.values[i] == key) {
+                    expected_count += 1;
+                    expected_index = expected_index < 0 ? i : expected_index;
+                }
+            }
+
+            REQUIRE(array.count(key) == expected_count);
+            REQUIRE(array.__contains__(key) == (expected_index >= 0));
+
+            auto index = array.index(key);
+            if (expected_index >= 0) {
+                REQUIRE(std::get<int>(index) == expected_index);
+            } else {
+                REQUIRE(index.index() == 1);
+            }
+        }
+    }
+}
+
+TEMPLATE_TEST_CASE("Array_unboxed_index_range", "", int64_t, double) {
+    ArrayNative<TestType> array;
+    for (int i = 0; i < 20; i++) {
+        array.append(TestType(i % 10));
+    }
+
+    REQUIRE(std::get<int>(array.index(TestType(3))) == 3);
+    REQUIRE(std::get<int>(array.index(TestType(3), 4)) == 13);
+    REQUIRE(std::get<int>(array.index(TestType(9), -1)) == 19);
+    REQUIRE(array.index(TestType(3), 4, 13).index() == 1);
+    REQUIRE(array.index(TestType(3), 14).index() == 1);
+
+    REQUIRE(!array.remove(TestType(3)).has_value());
+    REQUIRE(array.__len__() == 19);
+    REQUIRE(array.count(TestType(3)) == 1);
+    REQUIRE(array.remove(TestType(42)).has_value());
+}
+
+TEMPLATE_TEST_CASE("Array_unboxed_sum", "", int64_t, double) {
+    for (int n: {0, 1, 3, 4, 5, 1000}) {
+        ArrayNative<TestType> array = random_array<TestType>(n, 1000);
+
+        TestType expected = 0;
+        for (auto v: array.values) {
+            expected += v;
+        }
+        // the values are integers, the float sum is exact
+        REQUIRE(array.sum() == expected);
+    }
+}
+
+TEMPLATE_TEST_CASE("Array_unboxed_sort", "", int64_t, double) {
+    // below and above the radix sort threshold
+    for (int n: {0, 1, 10, 511, 512, 5000}) {
+        for (int range: {3, 1000, 1 << 30}) {
+            ArrayNative<TestType> array    = random_array<TestType>(n, range);
+            lython::Array<TestType> expected = array.values;
+
+            std::sort(expected.begin(), expected.end());
+            array.sort();
+
+            REQUIRE(array.values == expected);
+        }
+    }
+}
+
+TEST_CASE("Array_unboxed_sort_float") {
+    ArrayNative<double> array;
+    for (int i = 0; i < 1000; i++) {
+        array.append((i % 2 ? -1.0 : 1.0) * i / 7.0);
+    }
+    array.append(std::numeric_limits<double>::infinity());
+    array.append(-std::numeric_limits<double>::infinity());
+    array.append(std::numeric_limits<double>::lowest());
+    array.append(std::numeric_limits<double>::denorm_min());
+
+    lython::Array<double> expected = array.values;
+    std::sort(expected.begin(), expected.end());
+    array.sort();
+
+    REQUIRE(array.values == expected);
+}
+
+TEST_CASE("Array_interned_search") {
+    auto isa = GENERATE(kernels::Isa::Portable, kernels::Isa::SSE2, kernels::Isa::AVX2);
+    if (!kernels::force_isa(isa)) {
+        // the CPU does not support it
+        return;
+    }
+
+    static_assert(kernels::has_interned_id<lython::StringRef>::value);
+
+    lython::Array<lython::StringRef> names;
+    for (int i = 0; i < 10; i++) {
+        names.emplace_back(lython::String(1, char('a' + i)));
+    }
+
+    ArrayNative<lython::StringRef> array;
+    for (int i = 0; i < 37; i++) {
+        array.append(names[(i * 7) % 10]);
+    }
+
+    lython::StringRef missing("missing");
+    REQUIRE(!array.__contains__(missing));
+    REQUIRE(array.count(missing) == 0);
+
+    for (auto const& name: names) {
+        int expected_count = 0;
+        int expected_index = -1;
+        for (int i = 0; i < array.__len__(); i++) {
+            if (array.values[i] == name) {
+                expected_count += 1;
+                expected_index = expected_index < 0 ? i : expected_index;
+            }
+        }
+
+        REQUIRE(array.__contains__(name));
+        REQUIRE(array.count(name) == expected_count);
+        REQUIRE(std::get<int>(array.index(name)) == expected_index);
+    }
+
+    REQUIRE(!array.remove(names[0]).has_value());
+    REQUIRE(array.count(names[0]) == 3);
+}
+
+TEST_CASE("Tuple_unboxed_contains") {
+    TupleNative<int64_t> tuple;
+    for (int i = 0; i < 20; i++) {
+        tuple.values.push_back(i * 3);
+    }
+
+    REQUIRE(tuple.__contains__(57));
+    REQUIRE(tuple.__contains__(0));
+    REQUIRE(!tuple.__contains__(58));
+    REQUIRE(!tuple.__contains__(-3));
+}
+
+struct Item {
+    int key;
+    int id;
+
+    bool operator<(Item const& other) const { return key < other.key; }
+};
+
+// inputs TimSort is adaptive to
+std::vector<Item> sort_input(int n, int pattern) {
+    std::mt19937 gen(n + pattern);
+    std::vector<Item> items;
+
+    for (int i = 0; i < n; i++) {
+        int key = 0;
+        switch (pattern) {
+        case 0: key = int(gen() % 10); break;                  // many duplicates
+        case 1: key = i; break;                                // sorted
+        case 2: key = n - i; break;                            // reversed
+        case 3: key = (i % 100 < 90) ? i : int(gen() % n); break;  // mostly sorted
+        case 4: key = (i / 50) % 2 ? i : -i; break;            // alternating runs
+        default: key = int(gen()); break;
+        }
+        items.push_back(Item{key, i});
+    }
+    return items;
+}
+
+bool same_order(std::vector<Item> const& a, lython::Array<Item> const& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); i++) {
+        if (a[i].key != b[i].key || a[i].id != b[i].id) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("Array_sort_stable") {
+    for (int n: {0, 1, 31, 32, 33, 100, 1000, 10000}) {
+        for (int pattern = 0; pattern < 6; pattern++) {
+            std::vector<Item> expected = sort_input(n, pattern);
+            std::stable_sort(expected.begin(), expected.end());
+
+            ArrayNative<Item> array;
+            for (Item const& item: sort_input(n, pattern)) {
+                array.append(item);
+            }
+            array.sort();
+
+            REQUIRE(same_order(expected, array.values));
+        }
+    }
+}
+
+TEST_CASE("Array_sort_key") {
+    ArrayNative<Item> array;
+    for (Item const& item: sort_input(1000, 0)) {
+        array.append(item);
+    }
+
+    int calls = 0;
+    array.sort([&calls](Item const& item) {
+        calls += 1;
+        return -item.key;
+    });
+    REQUIRE(calls == 1000);
+
+    // reverse keeps the equal elements in their original order
+    std::vector<Item> expected = sort_input(1000, 0);
+    std::stable_sort(expected.begin(), expected.end(), [](Item const& a, Item const& b) {
+        return b.key < a.key;
+    });
+    REQUIRE(same_order(expected, array.values));
+
+    array.sort([](Item const& item) { return item.id; }, true);
+    REQUIRE(array.values.front().id == 999);
+    REQUIRE(array.values.back().id == 0);
+}
+
+TEST_CASE("Array_sort_parallel") {
+    lython::ThreadPool pool(4);
+
+    for (int pattern = 0; pattern < 6; pattern++) {
+        std::vector<Item> items    = sort_input(int(sorting::parallel_threshold) * 3 + 17, pattern);
+        std::vector<Item> expected = items;
+
+        std::stable_sort(expected.begin(), expected.end());
+        sorting::parallel_sort(items.data(), items.size(), std::less<Item>(), pool);
+
+        REQUIRE(same_order(expected, lython::Array<Item>(items.begin(), items.end())));
+    }
+}
+
+TEST_CASE("Array_sort_parallel_exception") {
+    lython::ThreadPool pool(4);
+    std::vector<Item>  items = sort_input(int(sorting::parallel_threshold) * 3 + 17, 5);
+
+    // the exception reaches the caller instead of terminating the worker
+    auto failing = [](Item const& a, Item const& b) {
+        if (a.id == 7 || b.id == 7) {
+            throw std::runtime_error("comparison failed");
+        }
+        return a < b;
+    };
+    REQUIRE_THROWS_AS(sorting::parallel_sort(items.data(), items.size(), failing, pool),
+                      std::runtime_error);
+
+    // the pool is still usable
+    std::vector<Item> expected = items;
+    std::stable_sort(expected.begin(), expected.end());
+    sorting::parallel_sort(items.data(), items.size(), std::less<Item>(), pool);
+    REQUIRE(same_order(expected, lython::Array<Item>(items.begin(), items.end())));
+}
+
+TEST_CASE("Array_sort_unboxed_stable") {
+    for (int n: {10, 1000}) {
+        // -0.0 == 0.0, the zeros keep their order in both directions
+        ArrayNative<double> array;
+        for (int i = 0; i < n; i++) {
+            array.append(i % 2 ? -0.0 : 0.0);
+        }
+        array.append(1.0);
+        array.append(-1.0);
+
+        array.sort();
+        REQUIRE(array.values[0] == -1.0);
+        REQUIRE(array.values[n + 1] == 1.0);
+        for (int i = 0; i < n; i++) {
+            REQUIRE(std::signbit(array.values[i + 1]) == (i % 2 == 1));
+        }
+
+        array.sort(true);
+        REQUIRE(array.values[0] == 1.0);
+        REQUIRE(array.values[n + 1] == -1.0);
+        for (int i = 0; i < n; i++) {
+            REQUIRE(std::signbit(array.values[i + 1]) == (i % 2 == 1));
+        }
+    }
+
+    ArrayNative<int64_t> ints;
+    for (int i = 0; i < 1000; i++) {
+        ints.append(i % 10 - 5);
+    }
+    ints.sort(true);
+    REQUIRE(ints.values[0] == 4);
+    REQUIRE(ints.values[999] == -5);
+    REQUIRE(std::is_sorted(ints.values.begin(), ints.values.end(), std::greater<int64_t>()));
+}
+
+TEST_CASE("Array_copy_on_write") {
+    ArrayNative<int64_t> a;
+    for (int i = 0; i < 100; i++) {
+        a.append(99 - i);
+    }
+
+    // the copy shares the values until one of them is modified
+    ArrayNative<int64_t> b = a.copy();
+    REQUIRE(b.values.shares(a.values));
+    REQUIRE(b.count(5) == 1);
+    REQUIRE(b.values.shares(a.values));
+
+    b.append(1000);
+    REQUIRE(!b.values.shares(a.values));
+    REQUIRE(a.__len__() == 100);
+    REQUIRE(b.__len__() == 101);
+
+    // in place algorithms detach too
+    ArrayNative<int64_t> c = a.copy();
+    c.sort();
+    REQUIRE(c.values[0] == 0);
+    REQUIRE(a.values[0] == 99);
+
+    // clearing a shared list only drops its reference
+    ArrayNative<int64_t> d = a.copy();
+    REQUIRE(a.values.use_count() == 2);
+    d.clear();
+    REQUIRE(d.__len__() == 0);
+    REQUIRE(a.__len__() == 100);
+    REQUIRE(a.values.use_count() == 1);
+
+    // iterating only reads, the values stay shared
+    ArrayNative<int64_t> e     = a.copy();
+    int64_t              total = 0;
+    for (auto it = e.begin(); it != e.end(); ++it) {
+        total += *it;
+    }
+    for (auto it = e.rbegin(); it != e.rend(); ++it) {
+        total -= *it;
+    }
+    auto iter = e.__iter__();
+    while (!std::holds_alternative<StopIteration>(iter.__next__())) {
+    }
+    REQUIRE(total == 0);
+    REQUIRE(e.values.shares(a.values));
+
+    // insert and erase detach, the position can come from the shared storage
+    ArrayNative<int64_t> f = a.copy();
+    f.values.insert(std::as_const(f.values).begin() + 1, 1000);
+    REQUIRE(!f.values.shares(a.values));
+    REQUIRE(f.values[1] == 1000);
+    REQUIRE(a.values[1] == 98);
+
+    ArrayNative<int64_t> g = a.copy();
+    g.values.erase(std::as_const(g.values).begin());
+    REQUIRE(g.__len__() == 99);
+    REQUIRE(g.values[0] == 98);
+    REQUIRE(a.__len__() == 100);
+
+    // nothing allocated yet
+    ArrayNative<int64_t> h;
+    h.values.insert(std::as_const(h.values).begin(), 7);
+    REQUIRE(h.__len__() == 1);
+    REQUIRE(h.values[0] == 7);
+}
+
+TEST_CASE("Array_value_aliasing") {
+    using lython::Value;
+    lython::register_value<ArrayNative<Value>>();
+
+    Value list = lython::make_value<ArrayNative<Value>>();
+    list.ref<ArrayNative<Value>>().append(Value(lython::int64(1)));
+
+    // `b = a` aliases, the mutations are visible through both names
+    Value alias = list;
+    alias.ref<ArrayNative<Value>>().append(Value(lython::int64(2)));
+    REQUIRE(list.ref<ArrayNative<Value>>().__len__() == 2);
+
+    // `b = a.copy()` is O(1) but independent
+    Value copy = list.copy();
+    auto& original = list.ref<ArrayNative<Value>>();
+    auto& copied   = copy.ref<ArrayNative<Value>>();
+    REQUIRE(copied.values.shares(original.values));
+
+    copied.append(Value(lython::int64(3)));
+    REQUIRE(original.__len__() == 2);
+    REQUIRE(copied.__len__() == 3);
+
+    original.values[0] = Value(lython::int64(10));
+    REQUIRE(copied.values[0].as<lython::int64>() == 1);
+    REQUIRE(alias.ref<ArrayNative<Value>>().values[0].as<lython::int64>() == 10);
+}
+
+TEST_CASE("Tuple_copy_on_write") {
+    TupleNative<int64_t> tuple;
+    for (int i = 0; i < 20; i++) {
+        tuple.values.push_back(i);
+    }
+
+    TupleNative<int64_t> copy = tuple.copy();
+    REQUIRE(copy.values.shares(tuple.values));
+    REQUIRE(copy.__contains__(19));
+
+    TupleNative<int64_t> sum = tuple.__add__(copy);
+    REQUIRE(sum.__len__() == 40);
+    REQUIRE(copy.values.shares(tuple.values));
+}
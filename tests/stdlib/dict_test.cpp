@@ -0,0 +1,265 @@
+#include <catch2/catch_all.hpp>
+
+#include "dtypes.h"
+#include "stdlib/dict.h"
+#include "stdlib/hashtable.h"
+#include "stdlib/set.h"
+#include "utilities/names.h"
+
+using namespace kiwi;
+
+using IntDict = DictNative<int, int>;
+
+TEST_CASE("Dict_Insertion_Order") {
+    IntDict dict;
+    dict.__setitem__(3, 30);
+    dict.__setitem__(1, 10);
+    dict.__setitem__(2, 20);
+    dict.__setitem__(1, 11);
+
+    REQUIRE(dict.__len__() == 3);
+    REQUIRE(dict.keys() == lython::Array<int>{3, 1, 2});
+    REQUIRE(dict.values() == lython::Array<int>{30, 11, 20});
+
+    // deleted keys keep the order of the others
+    REQUIRE(!dict.__delitem__(1).has_value());
+    REQUIRE(dict.__delitem__(1).has_value());
+    dict.__setitem__(1, 12);
+    REQUIRE(dict.keys() == lython::Array<int>{3, 2, 1});
+
+    auto iter = dict.__iter__();
+    REQUIRE(std::get<0>(iter.__next__()) == 3);
+    REQUIRE(std::get<0>(iter.__next__()) == 2);
+    REQUIRE(std::get<0>(iter.__next__()) == 1);
+    REQUIRE(iter.__next__().index() == 1);
+
+    auto rev = dict.__reversed__();
+    REQUIRE(std::get<0>(rev.__next__()) == 1);
+}
+
+TEST_CASE("Dict_Methods") {
+    IntDict dict = {{1, 10}, {2, 20}};
+
+    REQUIRE(dict.__contains__(1));
+    REQUIRE(!dict.__contains__(3));
+    REQUIRE(std::get<0>(dict.__getitem__(2)) == 20);
+    REQUIRE(dict.__getitem__(3).index() == 1);
+    REQUIRE(dict.get(3, -1) == -1);
+
+    REQUIRE(dict.setdefault(3, 30) == 30);
+    REQUIRE(dict.setdefault(3, 31) == 30);
+
+    REQUIRE(dict.pop(1, -1) == 10);
+    REQUIRE(dict.pop(1, -1) == -1);
+    REQUIRE(dict.pop(1).index() == 1);
+
+    auto last = dict.popitem();
+    REQUIRE(std::get<0>(last).key == 3);
+    REQUIRE(dict.__len__() == 1);
+
+    IntDict other = dict.copy();
+    REQUIRE(other.__eq__(dict));
+    other.update(IntDict{{5, 50}});
+    REQUIRE(other.__ne__(dict));
+
+    IntDict keys = IntDict::fromkeys(lython::Array<int>{1, 2, 3}, 0);
+    REQUIRE(keys.__len__() == 3);
+
+    keys.clear();
+    REQUIRE(keys.__len__() == 0);
+    REQUIRE(keys.popitem().index() == 1);
+}
+
+TEST_CASE("Dict_Popitem") {
+    IntDict dict;
+    for (int i = 0; i < 100; i++) {
+        dict.__setitem__(i, i);
+    }
+
+    // the deleted tail is dropped, popitem does not rescan it
+    for (int i = 99; i >= 50; i--) {
+        REQUIRE(std::get<0>(dict.popitem()).key == i);
+        REQUIRE(dict.entries.size() == std::size_t(i));
+    }
+
+    // the index slots left behind still count, the index gets rebuilt
+    for (int i = 0; i < 10000; i++) {
+        dict.__setitem__(1000 + i, i);
+        REQUIRE(std::get<0>(dict.popitem()).key == 1000 + i);
+    }
+    REQUIRE(dict.__len__() == 50);
+
+    // deleted entries are compacted away when the index is rebuilt, in order
+    for (int i = 0; i < 50; i += 2) {
+        dict.__delitem__(i);
+    }
+    for (int i = 100; i < 200; i++) {
+        dict.__setitem__(i, i);
+    }
+    REQUIRE(dict.__len__() == 125);
+
+    int previous = -1;
+    for (auto const& item: dict) {
+        REQUIRE(item.key > previous);
+        REQUIRE(item.key == item.value);
+        previous = item.key;
+    }
+}
+
+TEST_CASE("Dict_Many_Keys") {
+    DictNative<std::string, int> dict;
+    int                          n = 100000;
+
+    for (int i = 0; i < n; i++) {
+        dict.__setitem__(std::to_string(i), i);
+    }
+    for (int i = 0; i < n; i += 2) {
+        dict.__delitem__(std::to_string(i));
+    }
+    REQUIRE(dict.__len__() == n / 2);
+
+    for (int i = 0; i < n; i++) {
+        REQUIRE(dict.__contains__(std::to_string(i)) == (i % 2 == 1));
+    }
+
+    // reinserting after deletes compacts the entries
+    for (int i = 0; i < n; i += 2) {
+        dict.__setitem__(std::to_string(i), i);
+    }
+    REQUIRE(dict.entries.size() < std::size_t(n) * 2);
+
+    int i = 0;
+    for (auto const& pair: dict) {
+        REQUIRE(std::get<0>(dict.__getitem__(pair.key)) == pair.value);
+        i += 1;
+    }
+    REQUIRE(i == n);
+}
+
+TEST_CASE("Set_Operations") {
+    using IntSet = SetNative<int>;
+
+    IntSet a = {1, 2, 3};
+    IntSet b = {3, 4};
+
+    REQUIRE(a.__contains__(2));
+    REQUIRE(a.__len__() == 3);
+
+    REQUIRE(a.intersection(b).__eq__(IntSet{3}));
+    REQUIRE(a.union_(b).__eq__(IntSet{1, 2, 3, 4}));
+    REQUIRE(a.difference(b).__eq__(IntSet{1, 2}));
+    REQUIRE(a.symmetric_difference(b).__eq__(IntSet{1, 2, 4}));
+
+    REQUIRE(IntSet{1, 2}.issubset(a));
+    REQUIRE(IntSet{1, 2}.__lt__(a));
+    REQUIRE(!a.__lt__(a));
+    REQUIRE(a.issuperset(IntSet{3}));
+    REQUIRE(a.isdisjoint(IntSet{5, 6}));
+    REQUIRE(!a.isdisjoint(b));
+
+    a.add(3);
+    REQUIRE(a.__len__() == 3);
+    REQUIRE(!a.remove(1).has_value());
+    REQUIRE(a.remove(1).has_value());
+    REQUIRE(std::get<0>(a.pop()) == 3);
+
+    lython::Array<int> values;
+    for (int v: IntSet{5, 1, 3}) {
+        values.push_back(v);
+    }
+    REQUIRE(values == lython::Array<int>{5, 1, 3});
+}
+
+TEST_CASE("Dict_Value") {
+    using lython::Value;
+
+    Dict dict;
+    dict.__setitem__(Value(1), Value(10));
+    dict.__setitem__(Value(2), Value(20));
+
+    REQUIRE(dict.__contains__(Value(1)));
+    REQUIRE(std::get<0>(dict.__getitem__(Value(2))) == Value(20));
+    REQUIRE(!dict.__contains__(Value(3)));
+
+    Set set = {Value(1), Value(1), Value(2)};
+    REQUIRE(set.__len__() == 2);
+}
+
+TEST_CASE("Dict_String_Keys_SipHash") {
+    // string keys can come from the script input, they are hashed with the keyed SipHash
+    std::string key = "untrusted";
+    REQUIRE(DictNative<std::string, int>::_hash(key) == lython::SipHash<std::string>::hash(key));
+    REQUIRE(DictNative<int, int>::_hash(7) == std::hash<int>()(7));
+}
+
+TEST_CASE("Hash_Interned_Strings") {
+    using lython::Hash;
+    using lython::StringRef;
+
+    std::string text = "hash_interned";
+    StringRef   ref(text.c_str());
+    StringRef   same(text.c_str());
+
+    // the id is hashed, the same string gets the same id
+    REQUIRE(Hash<StringRef>::hash(ref) == Hash<StringRef>::hash(same));
+    REQUIRE(Hash<StringRef>::hash(ref) != Hash<StringRef>::hash(StringRef("hash_interned2")));
+    REQUIRE(Hash<StringRef>::hash(ref) != ref.__id__());
+
+    lython::HashTable<StringRef, int> table;
+    for (int i = 0; i < 100; i++) {
+        REQUIRE(table.insert(StringRef(("key_" + std::to_string(i)).c_str()), i));
+    }
+    for (int i = 0; i < 100; i++) {
+        int value = 0;
+        REQUIRE(table.get(StringRef(("key_" + std::to_string(i)).c_str()), value));
+        REQUIRE(value == i);
+    }
+}
+
+TEST_CASE("Dict_copy_on_write") {
+    IntDict dict;
+    for (int i = 0; i < 100; i++) {
+        dict.__setitem__(i, i * 10);
+    }
+
+    // the copy shares the entries and the index until one of them is modified
+    IntDict copy = dict.copy();
+    REQUIRE(copy.entries.shares(dict.entries));
+    REQUIRE(copy.indices.shares(dict.indices));
+    REQUIRE(copy.__contains__(50));
+    REQUIRE(std::get<int>(copy.__getitem__(50)) == 500);
+    REQUIRE(copy.entries.shares(dict.entries));
+
+    copy.__setitem__(50, -1);
+    REQUIRE(!copy.entries.shares(dict.entries));
+    REQUIRE(std::get<int>(dict.__getitem__(50)) == 500);
+    REQUIRE(std::get<int>(copy.__getitem__(50)) == -1);
+
+    // a removal on the copy is not visible in the original
+    IntDict other = dict.copy();
+    other.__delitem__(10);
+    other.__setitem__(1000, 1);
+    REQUIRE(dict.__contains__(10));
+    REQUIRE(!dict.__contains__(1000));
+    REQUIRE(other.__len__() == 100);
+
+    other.clear();
+    REQUIRE(dict.__len__() == 100);
+    REQUIRE(!dict.__eq__(copy));
+
+    // iterating only reads, the entries stay shared
+    IntDict view  = dict.copy();
+    int     total = 0;
+    for (auto it = view.begin(); it != view.end(); ++it) {
+        total += it->value;
+    }
+    auto keys = view.__iter__();
+    while (!std::holds_alternative<StopIteration>(keys.__next__())) {
+    }
+    REQUIRE(total == 49500);
+    REQUIRE(view.entries.shares(dict.entries));
+
+    // setdefault on an existing key only reads
+    REQUIRE(view.setdefault(20, -1) == 200);
+    REQUIRE(view.entries.shares(dict.entries));
+}
@@ -0,0 +1,91 @@
+#include <catch2/catch_all.hpp>
+
+#include "builtin/operators.h"
+#include "dtypes.h"
+#include "stdlib/str.h"
+#include "utilities/names.h"
+
+using namespace kiwi;
+using lython::Array;
+using lython::make_value;
+using lython::String;
+using lython::StringView;
+using lython::Value;
+
+TEST_CASE("Str_builder_value_semantic") {
+    StringBuilder a("ab");
+    StringBuilder b = a.concat("c");
+
+    // b ends the buffer, appending to it is done in place
+    StringBuilder c = b.concat("d");
+    REQUIRE(c.buffer == a.buffer);
+
+    // a does not end the buffer anymore, it gets its own copy
+    StringBuilder d = a.concat("x");
+    REQUIRE(d.buffer != a.buffer);
+
+    REQUIRE(a.view() == "ab");
+    REQUIRE(b.view() == "abc");
+    REQUIRE(c.view() == "abcd");
+    REQUIRE(d.view() == "abx");
+
+    // the appended string lives in the buffer itself
+    StringBuilder e = c.concat(c.view());
+    REQUIRE(e.view() == "abcdabcd");
+    REQUIRE(c.view() == "abcd");
+
+    REQUIRE(StringBuilder().view() == "");
+    REQUIRE(StringBuilder().concat("a").view() == "a");
+    REQUIRE(std::hash<StringBuilder>()(e) == std::hash<String>()(String("abcdabcd")));
+}
+
+TEST_CASE("Str_add_operator") {
+    lython::Function add = lython::get_native_binary_operation(lython::StringRef("Add-str-str"));
+    REQUIRE(add != nullptr);
+
+    // s = s + part
+    int   n     = 100000;
+    Value acc   = make_value<String>("");
+    Value part  = make_value<String>("ab");
+    Value first = Value();
+
+    for (int i = 0; i < n; i++) {
+        Array<Value> args = {acc, part};
+        acc               = add(nullptr, args);
+
+        if (i == 0) {
+            first = acc;
+        }
+    }
+
+    REQUIRE(string_view(acc).size() == std::size_t(n) * 2);
+    REQUIRE(string_view(acc).substr(0, 6) == "ababab");
+
+    // every iteration appended to the same buffer, the earlier values are unchanged
+    REQUIRE(acc.as<StringBuilder const&>().buffer == first.as<StringBuilder const&>().buffer);
+    REQUIRE(string_view(first) == "ab");
+
+    // builders mix with plain strings on both sides
+    Array<Value> args = {part, first};
+    REQUIRE(string_view(add(nullptr, args)) == "abab");
+}
+
+TEST_CASE("Str_join") {
+    Value sep = make_value<String>(", ");
+
+    ArrayNative<Value> strs;
+    REQUIRE(join(", ", strs) == "");
+
+    strs.append(make_value<String>("a"));
+    REQUIRE(join(", ", strs) == "a");
+
+    strs.append(make_value<StringBuilder>(StringBuilder("b").concat("c")));
+    strs.append(make_value<String>(""));
+    strs.append(make_value<String>("d"));
+    REQUIRE(join(", ", strs) == "a, bc, , d");
+    REQUIRE(join("", strs) == "abcd");
+
+    Value        list = make_value<ArrayNative<Value>>(strs);
+    Array<Value> args = {sep, list};
+    REQUIRE(string_view(str_join(nullptr, args)) == "a, bc, , d");
+}
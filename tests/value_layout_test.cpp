@@ -0,0 +1,90 @@
+#include "ast/values/value.h"
+#include "utilities/printing.h"
+
+#include <limits>
+
+#include <catch2/catch_all.hpp>
+
+using namespace lython;
+
+TEST_CASE("Value_Layout") {
+#if WITH_VALUE_NANBOX
+    REQUIRE(sizeof(Value) == 8);
+#else
+    REQUIRE(sizeof(Value) == 16);
+#endif
+
+    int   x = 0;
+    float y = 0;
+
+    // Every layout should give back what was stored
+    REQUIRE(Value(true).as<bool>() == true);
+    REQUIRE(Value(int32(-7)).as<int32>() == -7);
+    REQUIRE(Value(uint8(200)).as<uint8>() == 200);
+    REQUIRE(Value(float32(1.5f)).as<float32>() == 1.5f);
+    REQUIRE(Value(float64(-2.25)).as<float64>() == -2.25);
+    REQUIRE(Value(int64(-1) << 40).as<int64>() == (int64(-1) << 40));
+    REQUIRE(Value(int64(1) << 62).as<int64>() == (int64(1) << 62));
+    REQUIRE(Value(uint64(-1)).as<uint64>() == uint64(-1));
+    REQUIRE(Value(Pointi{1, -2}).as<Pointi>() == Pointi{1, -2});
+    REQUIRE(Value(Pointf{0.5f, 2}).as<Pointf>() == Pointf{0.5f, 2});
+    REQUIRE(Value(Color{1, 2, 3, 4}).as<Color>() == Color{1, 2, 3, 4});
+    REQUIRE(make_value<int*>(&x).as<int*>() == &x);
+    REQUIRE(make_value<float*>(&y).as<float*>() == &y);
+
+    // NaN does not get mistaken for a boxed value
+    Value nan(std::numeric_limits<float64>::quiet_NaN());
+    REQUIRE(nan.is_type<float64>());
+    REQUIRE(nan.as<float64>() != nan.as<float64>());
+    REQUIRE(Value(-std::numeric_limits<float64>::quiet_NaN()).is_type<float64>());
+
+    REQUIRE(Value(int32(1)).is_type<int32>());
+    REQUIRE(!Value(int32(1)).is_type<float64>());
+    REQUIRE(Value().is_type<_Invalid>());
+    REQUIRE(Value(_None()).is_type<_None>());
+
+    // References stay valid when modified in place
+    Value  big(int64(1) << 50);
+    int64* ref = big.as<int64*>();
+    *ref += 1;
+    REQUIRE(big.as<int64>() == (int64(1) << 50) + 1);
+}
+
+TEST_CASE("Value_Copy_Ownership") {
+    // Copies do not alias, writing in place only modifies the value written to
+    Value a(Pointi{1, 2});
+    Value b = a;
+    a.as<Pointi*>()->x = 10;
+    REQUIRE(a.as<Pointi>().x == 10);
+    REQUIRE(b.as<Pointi>().x == 1);
+
+    Value c;
+    c = b;
+    c.as<Pointi*>()->y = 20;
+    REQUIRE(b.as<Pointi>().y == 2);
+    REQUIRE(c.as<Pointi>().y == 20);
+
+    Value big(int64(1) << 40);
+    Value copy = big;
+    *big.as<int64*>() += 1;
+    REQUIRE(big.as<int64>() == (int64(1) << 40) + 1);
+    REQUIRE(copy.as<int64>() == (int64(1) << 40));
+
+    // Reading through a const value does not modify it
+    Value const fixed(int64(1) << 40);
+    REQUIRE(fixed.as<int64>() == (int64(1) << 40));
+    REQUIRE(fixed.load<int64>() == (int64(1) << 40));
+#if WITH_VALUE_NANBOX
+    REQUIRE(fixed.kind() == Value::IntKind);
+    REQUIRE(!Value::has_const_storage<int64>());
+    REQUIRE(!Value::has_const_storage<int*>());
+#endif
+
+    // Boxed values keep their storage, const references are stable
+    Value const   point(Pointi{1, 2});
+    Pointi const& p     = point.as<Pointi const&>();
+    Value const   other = Value(Pointi{3, 4});
+    REQUIRE(other.as<Pointi const&>().x == 3);
+    REQUIRE(p.x == 1);
+    REQUIRE(&p == point.pointer<Pointi>());
+}
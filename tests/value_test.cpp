@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <limits>
 #include <numeric>
 
 #include <catch2/catch_all.hpp>
@@ -788,14 +789,14 @@ Value owned_from_pointer(T* raw) {
         return;
     };
 
-    meta::ClassMetadata& metadata = meta::classmeta(val.tag);
+    meta::ClassMetadata& metadata = meta::classmeta(val.type_id());
     metadata.deleter              = deleter;
     metadata.ref                  = refmaker;
     return val;
 }
 
 Value weakref(Value& val) {
-    meta::ClassMetadata& metadata = meta::classmeta(val.tag);
+    meta::ClassMetadata& metadata = meta::classmeta(val.type_id());
 
     if (metadata.ref) {
         return metadata.ref(val);
@@ -918,22 +919,22 @@ TEST_CASE("Value_Point_attribute") {
     {
         auto value = make_value<Point2D>(3.0f, 4.0f);
 
-        meta::ClassMetadata const& meta = meta::classmeta(value.tag);
+        meta::ClassMetadata const& meta = meta::classmeta(value.type_id());
         REQUIRE(meta.members.size() == 2);
 
         Value x = getattr(value, "x");
-        REQUIRE(x.tag == meta::type_id<float>());
+        REQUIRE(x.type_id() == meta::type_id<float>());
         REQUIRE(x.as<float>() == 3.f);
 
         Value y = getattr(value, "y");
-        REQUIRE(y.tag == meta::type_id<float>());
+        REQUIRE(y.type_id() == meta::type_id<float>());
         REQUIRE(y.as<float>() == 4.f);
 
         setattr(value, "y", make_value<float>(5.0f));
 
         // Point2D instance was changed
         y = getattr(value, "y");
-        REQUIRE(y.tag == meta::type_id<float>());
+        REQUIRE(y.type_id() == meta::type_id<float>());
         REQUIRE(y.as<float>() == 5.f);
 
         // Point2D instance was changed
@@ -944,14 +945,14 @@ TEST_CASE("Value_Point_attribute") {
         auto value = make_value<Point2D>(3.0f, 4.0f);
 
         Value y = getattrref(value, "y");
-        REQUIRE(y.tag == meta::type_id<float*>());
+        REQUIRE(y.type_id() == meta::type_id<float*>());
         REQUIRE(y.as<float>() == 4.f);
 
         y.ref<float>() = 5.0f;
 
         // Point2D instance was changed
         y = getattr(value, "y");
-        REQUIRE(y.tag == meta::type_id<float>());
+        REQUIRE(y.type_id() == meta::type_id<float>());
         REQUIRE(y.as<float>() == 5.f);
 
         // Point2D instance was changed
@@ -964,21 +965,21 @@ TEST_CASE("Value attribute") {
 
     auto value = make_value<Rectangle>(Point2D(3.0f, 4.0f), Point2D(3.0f, 4.0f));
  
-     meta::ClassMetadata const& meta = meta::classmeta(value.tag);
+     meta::ClassMetadata const& meta = meta::classmeta(value.type_id());
 
     REQUIRE(meta.members.size() == 2);
 
     Value p = getattr(value, "p");
-    REQUIRE(p.tag == meta::type_id<Point2D>());
+    REQUIRE(p.type_id() == meta::type_id<Point2D>());
     REQUIRE(p.as<Point2D>() == Point2D(3.0f, 4.0f));
 
     Value s = getattr(value, "s");
-    REQUIRE(s.tag == meta::type_id<Point2D>());
+    REQUIRE(s.type_id() == meta::type_id<Point2D>());
     REQUIRE(s.as<Point2D>() == Point2D(3.0f, 4.0f));
 
     setattr(value, "s", make_value<Point2D>(1.0f, 2.0f));
     s = getattr(value, "s");
-    REQUIRE(s.tag == meta::type_id<Point2D>());
+    REQUIRE(s.type_id() == meta::type_id<Point2D>());
     REQUIRE(s.as<Point2D>() == Point2D(1.0f, 2.0f));
 
 }
@@ -1015,22 +1016,22 @@ TEST_CASE("Value Rect2 attribute") {
 
     auto value = make_value<Rect2>(rect1, rect2);
  
-    meta::ClassMetadata const& meta = meta::classmeta(value.tag);
+    meta::ClassMetadata const& meta = meta::classmeta(value.type_id());
 
     REQUIRE(meta.members.size() == 2);
 
     Value p = getattr(value, "a");
-    REQUIRE(p.tag == meta::type_id<Rectangle>());
+    REQUIRE(p.type_id() == meta::type_id<Rectangle>());
     REQUIRE(p.as<Rectangle>() == rect1);
 
     Value s = getattr(value, "b");
-    REQUIRE(s.tag == meta::type_id<Rectangle>());
+    REQUIRE(s.type_id() == meta::type_id<Rectangle>());
     REQUIRE(s.as<Rectangle>() == rect2);
 
     auto rect3 = Rectangle(Point2D(9.0f, 10.0f), Point2D(11.0f, 12.0f));
     setattr(value, "b", make_value<Rectangle>(rect3));
     s = getattr(value, "b");
-    REQUIRE(s.tag == meta::type_id<Rectangle>());
+    REQUIRE(s.type_id() == meta::type_id<Rectangle>());
     REQUIRE(s.as<Rectangle>() == rect3);
 }
 
@@ -1059,7 +1060,7 @@ TEST_CASE("Value Non trivial attribute") {
     Array<float> data = {1.f, 2.f};
     auto value = make_value<NewVec>(data);
  
-    meta::ClassMetadata& meta = meta::classmeta(value.tag);
+    meta::ClassMetadata& meta = meta::classmeta(value.type_id());
 
     {
         meta::ClassMetadata& meta_v = meta::classmeta(meta::type_id<Array<float>>());
@@ -1071,13 +1072,13 @@ TEST_CASE("Value Non trivial attribute") {
     REQUIRE(meta.members.size() == 1);
 
     Value p = getattr(value, "data");
-    REQUIRE(p.tag == meta::type_id<Array<float>>());
+    REQUIRE(p.type_id() == meta::type_id<Array<float>>());
     REQUIRE(p.as<Array<float>>() == data);
 
     Array<float> data2 = {3.f, 4.f};
     setattr(value, "data", make_value<Array<float>>(data2));
     Value s = getattr(value, "data");
-    REQUIRE(s.tag == meta::type_id<Array<float>>());
+    REQUIRE(s.type_id() == meta::type_id<Array<float>>());
     REQUIRE(s.as<Array<float>>() == data2);
 }
 
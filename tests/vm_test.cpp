@@ -3,12 +3,16 @@
 #include "revision_data.h"
 #include "sema/native_module.h"
 #include "sema/sema.h"
+#include "stdlib/array.h"
 #include "utilities/printing.h"
 #include "utilities/strings.h"
 #include "vm/tree.h"
+#include "vm/vm.h"
+#include "lowering/constant_folding.h"
 
 #include <catch2/catch_all.hpp>
 #include <sstream>
+#include <fstream>
 
 #include "logging/logging.h"
 
@@ -255,6 +259,666 @@ TEST_CASE("VM_Generator") {
     run_vm_testcases("VM_Generator", get_test_cases("vm", "VM_Generator"));
 }
 
+TEST_CASE("VM_ConstantFolding") {
+    String code = "def square(x: i32) -> i32:\n"
+                  "    return x * x\n"
+                  "\n"
+                  "def forever(x: i32) -> i32:\n"
+                  "    while True:\n"
+                  "        x += 1\n"
+                  "    return x\n"
+                  "\n"
+                  "a = 1 + 2 * 3\n"
+                  "b = square(3) + 1\n"
+                  "c = forever(1)\n";
+
+    StringBuffer reader(code);
+    Lexer        lex(reader);
+    Parser       parser(lex);
+    Module*      mod = parser.parse_module();
+    REQUIRE(parser.has_errors() == false);
+
+    SemanticAnalyser sema;
+    sema.exec(mod, 0);
+    REQUIRE(sema.has_errors() == false);
+
+    ConstantFolding folding;
+    folding.budget = 1024;
+    folding.module(mod);
+
+    auto value = [&](int i) { return str(cast<Assign>(mod->body[i])->value); };
+
+    REQUIRE(value(2) == "7");
+    REQUIRE(value(3) == "10");
+
+    // Never terminates, the evaluation runs out of budget
+    REQUIRE(value(4) == "forever(1)");
+    REQUIRE(folding.folded == 4);
+    REQUIRE(folding.abandoned == 1);
+
+    delete mod;
+}
+
+TEST_CASE("VM_ConstantFolding_DivisionByZero") {
+    String code = "def inverse(x: i32) -> i32:\n"
+                  "    return 1 / x\n"
+                  "\n"
+                  "def half(x: i32) -> i32:\n"
+                  "    return x / 2\n"
+                  "\n"
+                  "a = 1 / 0\n"
+                  "b = 1 % 0\n"
+                  "c = inverse(0)\n"
+                  "d = half(8)\n"
+                  "e = 7 % 2\n";
+
+    StringBuffer reader(code);
+    Lexer        lex(reader);
+    Parser       parser(lex);
+    Module*      mod = parser.parse_module();
+    REQUIRE(parser.has_errors() == false);
+
+    SemanticAnalyser sema;
+    sema.exec(mod, 0);
+    REQUIRE(sema.has_errors() == false);
+
+    // Evaluating an integer division by zero would crash the compiler
+    ConstantFolding folding;
+    folding.module(mod);
+
+    auto value = [&](int i) { return str(cast<Assign>(mod->body[i])->value); };
+
+    REQUIRE(value(2) == "1 / 0");
+    REQUIRE(value(3) == "1 % 0");
+    REQUIRE(value(4) == "inverse(0)");
+    REQUIRE(value(5) == "4");
+    REQUIRE(value(6) == "1");
+    REQUIRE(folding.abandoned == 0);
+
+    delete mod;
+}
+
+TEST_CASE("VM_InlineCache") {
+    String code = "class Point:\n"
+                  "    def __init__(self, x: i32):\n"
+                  "        self.x = x\n"
+                  "\n"
+                  "def getx(p: Point) -> i32:\n"
+                  "    return p.x\n"
+                  "\n"
+                  "def run(n: i32) -> i32:\n"
+                  "    s = 0\n"
+                  "    i = 0\n"
+                  "    while i < n:\n"
+                  "        p = Point(i)\n"
+                  "        s += getx(p)\n"
+                  "        i += 1\n"
+                  "    return s\n";
+
+    Module* mod    = nullptr;
+    String  result = eval_it(code, "run(4)", mod);
+    REQUIRE(result == "6");
+
+    // Every iteration after the first one hits the cache
+    While* loop = cast<While>(cast<FunctionDef>(mod->body[2])->body[2]);
+    Call*  ctor = cast<Call>(cast<Assign>(loop->body[0])->value);
+    REQUIRE(ctor->cache.is_monomorphic());
+    REQUIRE(ctor->cache.hits == 3);
+
+    // The callee is resolved by sema, the name is not loaded on every call
+    REQUIRE(ctor->callee == mod->body[0]);
+
+    // Point instances are copied from the class template object
+    ClassDef* point = cast<ClassDef>(mod->body[0]);
+    REQUIRE(point->instance.is_type<ScriptObject>());
+
+    FunctionDef* getx = cast<FunctionDef>(mod->body[1]);
+    Attribute*   attr = cast<Attribute>(cast<Return>(getx->body[0])->value.value());
+    REQUIRE(attr->cache.is_monomorphic());
+    REQUIRE(attr->cache.hits == 3);
+
+    delete mod;
+}
+
+TEST_CASE("VM_InlineCache_Rebound") {
+    String code = "def value() -> i32:\n"
+                  "    return 1\n"
+                  "\n"
+                  "def get() -> i32:\n"
+                  "    return value()\n"
+                  "\n"
+                  "def value() -> i32:\n"
+                  "    return 2\n";
+
+    // value is bound twice, the call loads the name to find the function
+    Module* mod = nullptr;
+    REQUIRE(eval_it(code, "get()", mod) == "2");
+
+    Call* call = cast<Call>(cast<Return>(cast<FunctionDef>(mod->body[1])->body[0])->value.value());
+    REQUIRE(call->callee == nullptr);
+
+    delete mod;
+}
+
+TEST_CASE("VM_ScriptObjectSlots") {
+    String code = "class Point:\n"
+                  "    def __init__(self, x: i32, y: i32):\n"
+                  "        self.x = x\n"
+                  "        self.y = y\n"
+                  "\n"
+                  "    def sum(self) -> i32:\n"
+                  "        return self.x + self.y\n"
+                  "\n"
+                  "def make() -> Point:\n"
+                  "    return Point(1, 2)\n";
+
+    Module* mod    = nullptr;
+    String  result = eval_it(code, "make()", mod);
+    REQUIRE(result == "(x=1, y=2)");
+
+    // The layout is computed by sema, attributes resolve to a slot
+    ClassDef* point = cast<ClassDef>(mod->body[0]);
+    REQUIRE(point->attributes.size() == 4);
+
+    FunctionDef* sum = cast<FunctionDef>(point->body[1]);
+    BinOp*       add = cast<BinOp>(cast<Return>(sum->body[0])->value.value());
+    REQUIRE(cast<Attribute>(add->left)->attrid == point->get_attribute(StringRef("x")));
+    REQUIRE(cast<Attribute>(add->right)->attrid == point->get_attribute(StringRef("y")));
+
+    ScriptObject const& obj = point->instance.as<ScriptObject const&>();
+    REQUIRE(obj.class_t == point);
+    REQUIRE(obj.slots.size() == point->attributes.size());
+
+    delete mod;
+}
+
+TEST_CASE("VM_TreeFrames") {
+    String code = "def count(n: i32) -> i32:\n"
+                  "    s = 0\n"
+                  "    i = 0\n"
+                  "    while i < n:\n"
+                  "        if (i % 2) == 0:\n"
+                  "            s = s + i\n"
+                  "        i = i + 1\n"
+                  "    return s\n"
+                  "\n"
+                  "def twice(n: i32) -> i32:\n"
+                  "    a = count(n)\n"
+                  "    b = count(n)\n"
+                  "    return a + b\n";
+
+    Module* mod = nullptr;
+    REQUIRE(eval_it(code, "count(10)", mod) == "20");
+    delete mod;
+
+    REQUIRE(eval_it(code, "twice(10)", mod) == "40");
+
+    // Frames are sized by sema: arguments and distinct locals
+    REQUIRE(cast<FunctionDef>(mod->body[0])->frame_size == 3);
+    REQUIRE(cast<FunctionDef>(mod->body[1])->frame_size == 3);
+
+    // Locals are resolved to their slot in the frame: n, s, i
+    FunctionDef* count = cast<FunctionDef>(mod->body[0]);
+    REQUIRE(cast<Name>(cast<Assign>(count->body[0])->targets[0])->slot == 1);
+    REQUIRE(cast<Name>(cast<Assign>(count->body[1])->targets[0])->slot == 2);
+
+    Compare* test = cast<Compare>(cast<While>(count->body[2])->test);
+    REQUIRE(cast<Name>(test->left)->slot == 2);
+    REQUIRE(cast<Name>(test->comparators[0])->slot == 0);
+    delete mod;
+}
+
+Module* vm_compile(String const& code, Program& program) {
+    StringBuffer reader(code);
+    Lexer        lex(reader);
+    Parser       parser(lex);
+    Module*      mod = parser.parse_module();
+    REQUIRE(parser.has_errors() == false);
+
+    SemanticAnalyser sema;
+    sema.exec(mod, 0);
+    sema.show_diagnostic(std::cout);
+    REQUIRE(sema.has_errors() == false);
+
+    VMGen compiler;
+    compiler.exec(mod, 0);
+    REQUIRE(compiler.has_errors == false);
+
+    program = compiler.program;
+    return mod;
+}
+
+TEST_CASE("VM_Bytecode") {
+    String code = "def fib(n: i32) -> i32:\n"
+                  "    if n < 2:\n"
+                  "        return n\n"
+                  "    return fib(n - 1) + fib(n - 2)\n"
+                  "\n"
+                  "def loop(n: i32) -> i32:\n"
+                  "    s = 0\n"
+                  "    i = 0\n"
+                  "    while i < n:\n"
+                  "        if ((i % 2) == 0) and (i > 2):\n"
+                  "            s += i\n"
+                  "        elif i == 1:\n"
+                  "            s = s + 100\n"
+                  "        else:\n"
+                  "            s -= 1\n"
+                  "        i += 1\n"
+                  "    return s\n"
+                  "\n"
+                  "def pick(a: i32, b: i32) -> i32:\n"
+                  "    return a if a > b else b\n"
+                  "\n"
+                  "def check(n: i32) -> i32:\n"
+                  "    assert n > 0, \"negative\"\n"
+                  "    return n\n"
+                  "\n"
+                  "g = fib(10)\n";
+
+    Program program;
+    Module* mod = vm_compile(code, program);
+    program.dump(std::cout);
+
+    VMExec vm;
+    vm.execute(program, 0);
+    REQUIRE(vm.has_exception == false);
+    REQUIRE(str(vm.globals[0]) == "55");
+
+    // Same results as the tree evaluator
+    Module* tree = nullptr;
+    REQUIRE(str(vm.call("fib", {Value(15)})) == eval_it(code, "fib(15)", tree));
+    delete tree;
+
+    REQUIRE(str(vm.call("loop", {Value(10)})) == eval_it(code, "loop(10)", tree));
+    delete tree;
+
+    REQUIRE(str(vm.call("pick", {Value(3), Value(7)})) == "7");
+    REQUIRE(str(vm.call("pick", {Value(8), Value(7)})) == "8");
+
+    REQUIRE(str(vm.call("check", {Value(2)})) == "2");
+    REQUIRE(vm.has_exception == false);
+
+    vm.call("check", {Value(-1)});
+    REQUIRE(vm.has_exception == true);
+    REQUIRE(vm.exception.as<String>() == "negative");
+    REQUIRE(vm.frames.empty());
+
+    // Operands are read from the frame registers directly
+    Label const&       pick = program.labels[program.find_label("pick")];
+    Instruction const& gt   = program.instructions[pick.index];
+    REQUIRE(pick.argc == 2);
+    REQUIRE(gt.op == OpCode::Binary);
+    REQUIRE(gt.b == 0);
+    REQUIRE(gt.c == 1);
+
+    delete mod;
+}
+
+TEST_CASE("VM_Compile_Errors") {
+    auto compile_code = [](String const& code) {
+        StringBuffer reader(code);
+        Lexer        lex(reader);
+        Parser       parser(lex);
+        Module*      mod = parser.parse_module();
+        REQUIRE(parser.has_errors() == false);
+
+        SemanticAnalyser sema;
+        sema.exec(mod, 0);
+        REQUIRE(sema.has_errors() == false);
+
+        Program program;
+        bool    compiled = compile(mod, program);
+        delete mod;
+        return compiled;
+    };
+
+    REQUIRE(compile_code("def first(a: i32) -> i32:\n"
+                         "    return a\n"));
+
+    // Classes are not lowered, the module cannot run on the VM
+    REQUIRE(compile_code("class Point:\n"
+                         "    def __init__(self, x: i32):\n"
+                         "        self.x = x\n") == false);
+
+    // Register operands are 8 bits
+    StringStream code;
+    code << "def big(a: i32) -> i32:\n";
+    for (int i = 0; i < VMMaxRegisters; i++) {
+        code << "    v" << i << " = a\n";
+    }
+    code << "    return a\n";
+    REQUIRE(compile_code(code.str()) == false);
+}
+
+TEST_CASE("VM_Run_Fallback") {
+    auto run_code = [](String const& code, Engine& engine) {
+        StringBuffer reader(code);
+        Lexer        lex(reader);
+        Parser       parser(lex);
+        Module*      mod = parser.parse_module();
+        REQUIRE(parser.has_errors() == false);
+
+        SemanticAnalyser sema;
+        sema.exec(mod, 0);
+        REQUIRE(sema.has_errors() == false);
+
+        bool raised = run(mod, &engine);
+        delete mod;
+        return raised;
+    };
+
+    Engine engine = Engine::Tree;
+    REQUIRE(run_code("def first(a: i32) -> i32:\n"
+                     "    return a\n"
+                     "\n"
+                     "assert first(2) == 2\n",
+                     engine) == false);
+    REQUIRE(engine == Engine::Register);
+
+    // Classes and attributes are not lowered, the module runs on the tree evaluator
+    String point = "class Point:\n"
+                   "    def __init__(self, x: i32):\n"
+                   "        self.x = x\n"
+                   "\n"
+                   "def check(n: i32) -> bool:\n"
+                   "    return Point(n).x == n\n"
+                   "\n";
+
+    REQUIRE(run_code(point + "assert check(3)\n", engine) == false);
+    REQUIRE(engine == Engine::Tree);
+
+    REQUIRE(run_code(point + "assert Point(2).x == 3\n", engine) == true);
+    REQUIRE(engine == Engine::Tree);
+}
+
+TEST_CASE("VM_Tree_Collection") {
+    String code = "class Point:\n"
+                  "    def __init__(self, x: i32, y: i32):\n"
+                  "        self.x = x\n"
+                  "        self.y = y\n"
+                  "\n"
+                  "class Holder:\n"
+                  "    def __init__(self, p: Point):\n"
+                  "        self.p = p\n"
+                  "\n"
+                  "def churn(n: i32) -> i32:\n"
+                  "    keep = Holder(Point(0, 0))\n"
+                  "    i = 1\n"
+                  "    while i < n:\n"
+                  "        keep.p = Point(i, keep.p.x)\n"
+                  "        i += 1\n"
+                  "    return keep.p.x + keep.p.y\n"
+                  "\n"
+                  "assert churn(4000) == 7997\n";
+
+    StringBuffer reader(code);
+    Lexer        lex(reader);
+    Parser       parser(lex);
+    Module*      mod = parser.parse_module();
+    REQUIRE(parser.has_errors() == false);
+
+    SemanticAnalyser sema;
+    sema.exec(mod, 0);
+    REQUIRE(sema.has_errors() == false);
+
+    // the points are allocated by the collector, a small budget collects during the loop
+    BoehmGarbageCollector& gc     = garbage_collector();
+    std::size_t            budget = gc.minor_budget;
+    GCStats                before = gc.stats;
+    gc.minor_budget               = 4096;
+
+    Engine engine = Engine::Tree;
+    bool   raised = run(mod, &engine);
+    gc.minor_budget = budget;
+    delete mod;
+
+    REQUIRE(engine == Engine::Tree);
+    REQUIRE(raised == false);
+    REQUIRE(gc.stats.minor > before.minor);
+    REQUIRE(gc.stats.freed > before.freed);
+
+    // `keep` survives and gets promoted, the points stored inside it after that
+    // are only reachable through the write barrier
+    REQUIRE(gc.stats.promoted > before.promoted);
+}
+
+TEST_CASE("VM_Quickening") {
+    String code = "def loop(n: i32) -> i32:\n"
+                  "    s = 0\n"
+                  "    i = 0\n"
+                  "    while i < n:\n"
+                  "        s += i * 2\n"
+                  "        i += 1\n"
+                  "    return s\n"
+                  "\n"
+                  "def pick(a: i32, b: i32) -> i32:\n"
+                  "    return a if a > b else b\n";
+
+    Program program;
+    Module* mod = vm_compile(code, program);
+
+    VMExec generic;
+    generic.warmup = 0;
+    generic.execute(program, 0);
+
+    VMExec vm;
+    vm.warmup = 256;
+    vm.execute(program, 0);
+
+    // Profile pick and loop with i32 operands
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(str(vm.call("pick", {Value(i), Value(2)})) ==
+                str(generic.call("pick", {Value(i), Value(2)})));
+    }
+    REQUIRE(str(vm.call("loop", {Value(100)})) == str(generic.call("loop", {Value(100)})));
+    REQUIRE(str(vm.call("loop", {Value(1000)})) == str(generic.call("loop", {Value(1000)})));
+
+    REQUIRE(generic.quickened == 0);
+    REQUIRE(vm.quickened > 0);
+    REQUIRE(vm.fused > 0);
+    REQUIRE(vm.deoptimized == 0);
+
+    // `a > b` followed by the conditional jump became a single instruction
+    Label const& pick = program.labels[program.find_label("pick")];
+    REQUIRE(program.instructions[pick.index].op == OpCode::Binary);
+    REQUIRE(vm.code[pick.index].op == OpCode::JumpIfNotGtI32);
+
+    // `while i < n` as well
+    Label const& loop  = program.labels[program.find_label("loop")];
+    bool         fused = false;
+    for (int i = loop.index; i < pick.index; i++) {
+        fused = fused || vm.code[i].op == OpCode::JumpIfNotLtI32;
+    }
+    REQUIRE(fused);
+
+    // The type guard fails, the generic instruction is restored
+    REQUIRE(str(vm.call("pick", {Value(int64(3)), Value(int64(7))})) == "7");
+    REQUIRE(vm.deoptimized == 1);
+    REQUIRE(vm.code[pick.index].op == OpCode::Binary);
+    REQUIRE(str(vm.call("pick", {Value(5), Value(2)})) == "5");
+
+    delete mod;
+}
+
+// Evaluates the list literal assigned by the last statement, the sema errors are ignored
+static Value eval_list(String const& code, ArrayStorage& storage) {
+    StringBuffer reader(code);
+    Lexer        lex(reader);
+    Parser       parser(lex);
+    Module*      mod = parser.parse_module();
+
+    SemanticAnalyser sema;
+    sema.exec(mod, 0);
+
+    ListExpr* list = cast<ListExpr>(cast<Assign>(mod->body[mod->body.size() - 1])->value);
+    storage        = list->storage;
+
+    TreeEvaluator eval;
+    eval.module(mod, 0);
+    Value result = eval.exec(list, 0);
+
+    delete mod;
+    return result;
+}
+
+TEST_CASE("VM_ListExpr_Storage") {
+    ArrayStorage storage = ArrayStorage::Boxed;
+
+    Value ints = eval_list("x = [1, 2, 3]\n", storage);
+    REQUIRE(storage == ArrayStorage::Int64);
+    REQUIRE(ints.as<kiwi::ArrayNative<int64> const&>().values[2] == 3);
+
+    Value floats = eval_list("x = [1.5, 2.5]\n", storage);
+    REQUIRE(storage == ArrayStorage::Float64);
+    REQUIRE(floats.as<kiwi::ArrayNative<float64> const&>().values[1] == 2.5);
+
+    // mixed families are not converted to the type of the first element
+    Value mixed = eval_list("x = [1, 2.5]\n", storage);
+    REQUIRE(storage == ArrayStorage::Boxed);
+    REQUIRE(mixed.as<kiwi::ArrayNative<Value> const&>().values[1].as<float64>() == 2.5);
+
+    // elements without a type are boxed
+    Value unknown = eval_list("def f(a):\n    return a\n\nx = [1, f(2.5)]\n", storage);
+    REQUIRE(storage == ArrayStorage::Boxed);
+    REQUIRE(unknown.as<kiwi::ArrayNative<Value> const&>().values[1].as<float64>() == 2.5);
+}
+
+TEST_CASE("VM_List_Subscript") {
+    String code = "def total(n: i32) -> i32:\n"
+                  "    s = 0\n"
+                  "    i = 0\n"
+                  "    xs = [1, 2, 3, 4, 5]\n"
+                  "    while i < n:\n"
+                  "        s = s + xs[i]\n"
+                  "        i += 1\n"
+                  "    return s\n"
+                  "\n"
+                  "def last() -> f64:\n"
+                  "    s = 0.0\n"
+                  "    ys = [0.5, 1.5, 4.5]\n"
+                  "    return s + ys[0] + ys[1] + ys[-1]\n"
+                  "\n"
+                  "def has(x: i32) -> bool:\n"
+                  "    return x in [2, 4, 8]\n"
+                  "\n"
+                  "def missing(x: f64) -> bool:\n"
+                  "    return x not in [0.5, 1.5]\n";
+
+    auto run = [&](String const& call) {
+        Module* mod    = nullptr;
+        String  result = eval_it(code, call, mod);
+        delete mod;
+        return result;
+    };
+
+    // unboxed int64 elements are read back as i32
+    REQUIRE(run("total(5)") == "15");
+    REQUIRE(run("total(2)") == "3");
+    REQUIRE(run("last()") == "6.5");
+    REQUIRE(run("has(4)") == "True");
+    REQUIRE(run("has(5)") == "False");
+    REQUIRE(run("missing(0.5)") == "False");
+    REQUIRE(run("missing(2.5)") == "True");
+}
+
+TEST_CASE("VM_BytecodeFile") {
+    String code = "def loop(n: i32) -> f64:\n"
+                  "    s = 0.5\n"
+                  "    i = 0\n"
+                  "    while i < n:\n"
+                  "        s = s + 1.0\n"
+                  "        i += 1\n"
+                  "    return s\n"
+                  "\n"
+                  "def check(n: i32) -> i32:\n"
+                  "    assert n > 0, \"negative\"\n"
+                  "    return n\n"
+                  "\n"
+                  "g = check(3)\n";
+
+    Program program;
+    Module* mod = vm_compile(code, program);
+
+    String path = "vm_bytecode_test.lybc";
+    REQUIRE(program.save(path));
+
+    Program loaded;
+    REQUIRE(loaded.load(path));
+    std::remove(path.c_str());
+
+    REQUIRE(loaded.instructions.size() == program.instructions.size());
+    REQUIRE(loaded.labels.size() == program.labels.size());
+    REQUIRE(loaded.constants.size() == program.constants.size());
+    REQUIRE(loaded.natives.size() == program.natives.size());
+    REQUIRE(loaded.globals == program.globals);
+
+    for (int i = 0; i < program.natives.size(); i++) {
+        REQUIRE(loaded.natives[i].fun == program.natives[i].fun);
+    }
+
+    // The loaded program runs without the front end
+    VMExec vm;
+    vm.execute(loaded, 0);
+    REQUIRE(str(vm.globals[0]) == "3");
+    REQUIRE(str(vm.call("loop", {Value(10)})) == "10.5");
+
+    vm.call("check", {Value(-1)});
+    REQUIRE(vm.has_exception == true);
+    REQUIRE(vm.exception.as<String>() == "negative");
+
+    // Not a bytecode file
+    {
+        std::ofstream out(path.c_str(), std::ios::binary);
+        out << "def loop(n: i32) -> i32:\n    return n\n";
+    }
+    Program invalid;
+    REQUIRE(invalid.load(path) == false);
+    std::remove(path.c_str());
+
+    // Well formed file with a malformed program
+    auto malformed = [&](auto corrupt) {
+        Program bad = program;
+        corrupt(bad);
+        REQUIRE(bad.save(path));
+
+        Program rejected;
+        bool    loaded = rejected.load(path);
+        std::remove(path.c_str());
+        return !loaded;
+    };
+
+    auto find = [](Program& prog, OpCode op) -> Instruction& {
+        for (Instruction& inst: prog.instructions) {
+            if (inst.op == op) {
+                return inst;
+            }
+        }
+        FAIL("opcode not found");
+        return prog.instructions[0];
+    };
+
+    // register outside of the frame
+    REQUIRE(malformed([&](Program& bad) { find(bad, OpCode::Return).b = uint8_t(255); }));
+    // call arguments overflowing the frame
+    REQUIRE(malformed([&](Program& bad) { find(bad, OpCode::Call).b = uint8_t(255); }));
+    // call with the wrong number of arguments
+    REQUIRE(malformed([&](Program& bad) { find(bad, OpCode::Call).c += 1; }));
+    // frame larger than the VM supports
+    REQUIRE(malformed([&](Program& bad) { bad.labels[1].registers = VMMaxRegisters + 1; }));
+    // function running off its end into the next one
+    REQUIRE(malformed([&](Program& bad) {
+        bad.instructions[bad.labels[2].index - 1].op = OpCode::Nop;
+    }));
+    // jump into another function
+    REQUIRE(malformed([&](Program& bad) { find(bad, OpCode::JumpIfFalse).d = bad.labels[2].index; }));
+    REQUIRE(malformed([&](Program& bad) { find(bad, OpCode::Jump).d = 0; }));
+    // two functions starting at the same instruction
+    REQUIRE(malformed([&](Program& bad) { bad.labels[2].index = bad.labels[1].index; }));
+
+    delete mod;
+}
+
 #endif
 
 #if EXPERIMENTAL_TESTS